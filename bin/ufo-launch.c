@@ -394,6 +394,53 @@ read_params (Environment *env)
     return result;
 }
 
+static guint
+try_consume_depth (Environment *env)
+{
+    /*
+     * "depth=N" right after the exclamation mark, i.e. "! depth=4 task", is
+     * the depth. A plain number would need quoting because "!4" triggers the
+     * history expansion of interactive shells.
+     */
+    Token *t;
+    GList *tmp;
+    gchar *end;
+    guint64 depth;
+
+    consume_spaces (env);
+    tmp = env->current;
+    t = peek (env);
+
+    if (t == NULL || t->type != STRING || g_strcmp0 (t->str->str, "depth"))
+        return 0;
+
+    skip (env);
+
+    if (peek (env)->type != ASSIGNMENT) {
+        env->current = tmp;
+        return 0;
+    }
+
+    skip (env);
+    t = consume (env);
+    depth = 0;
+
+    if (t->type == STRING) {
+        depth = g_ascii_strtoull (t->str->str, &end, 10);
+
+        if (end == t->str->str || *end != '\0')
+            depth = 0;
+    }
+
+    if (depth < 1 || depth > G_MAXUINT) {
+        g_set_error (env->error, UFO_TASK_ERROR, UFO_TASK_ERROR_SETUP,
+                     "Expected a positive number after `depth=' at position %u", t->pos);
+        return 0;
+    }
+
+    return (guint) depth;
+}
+
 static UfoTaskNode *
 read_connection (Environment *env, UfoTaskNode *previous)
 {
@@ -416,6 +463,13 @@ read_connection (Environment *env, UfoTaskNode *previous)
 
     do {
         if (consume_maybe (env, EXCLAMATION)) {
+            guint depth;
+
+            depth = try_consume_depth (env);
+
+            if (*(env->error) != NULL)
+                return NULL;
+
             consume_spaces (env);
             next = try_consume_task (env);
 
@@ -424,6 +478,7 @@ read_connection (Environment *env, UfoTaskNode *previous)
 
             if (params == NULL) {
                 ufo_task_graph_connect_nodes (env->graph, previous, next);
+                ufo_task_graph_set_edge_queue_depth (env->graph, previous, next, depth);
             }
             else {
                 GList *it;
@@ -433,6 +488,7 @@ read_connection (Environment *env, UfoTaskNode *previous)
 
                     from = UFO_TASK_NODE (it->data);
                     ufo_task_graph_connect_nodes_full (env->graph, from, next, i++);
+                    ufo_task_graph_set_edge_queue_depth (env->graph, from, next, depth);
                 }
 
                 g_list_free (params);
@@ -528,6 +584,11 @@ main(int argc, char* argv[])
     static gboolean trace = FALSE;
     static gboolean version = FALSE;
     static gboolean timestamps = FALSE;
+    static gboolean fuse = FALSE;
+    static gboolean tune = FALSE;
+    static gint queue_depth = 0;
+    static gint reorder_window = 0;
+    static gint workers = -1;
     static gchar **addresses = NULL;
     static gchar *dump = NULL;
 
@@ -536,6 +597,11 @@ main(int argc, char* argv[])
         { "address", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &addresses, "Address of remote server running `ufod'", NULL },
         { "dump",    'd', 0, G_OPTION_ARG_STRING, &dump, "Dump to JSON file", NULL },
         { "timestamps",0, 0, G_OPTION_ARG_NONE, &timestamps, "generate timestamps", NULL },
+        { "queue-depth", 0, 0, G_OPTION_ARG_INT, &queue_depth, "Buffers in flight per connection", "N" },
+        { "reorder-window", 0, 0, G_OPTION_ARG_INT, &reorder_window, "Restore item order where branches merge", "N" },
+        { "workers", 0, 0, G_OPTION_ARG_INT, &workers, "Run tasks on N worker threads, 0 for one per processor", "N" },
+        { "fuse",      0, 0, G_OPTION_ARG_NONE, &fuse, "Run chains of tasks on the same device in one thread", NULL },
+        { "tune",      0, 0, G_OPTION_ARG_NONE, &tune, "Tune expansion and queue depths from previous runs", NULL },
         { "quiet",   'q', 0, G_OPTION_ARG_NONE, &quiet, "be quiet", NULL },
         { "quieter",   0, 0, G_OPTION_ARG_NONE, &quieter, "be quieter", NULL },
         { "version",   0, 0, G_OPTION_ARG_NONE, &version, "Show version information", NULL },
@@ -546,7 +612,7 @@ main(int argc, char* argv[])
     g_type_init ();
 #endif
 
-    context = g_option_context_new ("TASK [PROP=VAR [PROP=VAR ...]] ! [TASK ...]");
+    context = g_option_context_new ("TASK [PROP=VAR [PROP=VAR ...]] ! [depth=N] [TASK ...]");
     g_option_context_add_main_entries (context, entries, NULL);
 
     if (!g_option_context_parse (context, &argc, &argv, &error)) {
@@ -575,6 +641,17 @@ main(int argc, char* argv[])
         return 1;
     }
 
+    if (queue_depth < 0) {
+        g_printerr ("Error: queue depth must not be negative\n");
+        return 1;
+    }
+
+    if (reorder_window < 0) {
+        g_printerr ("Error: reorder window must not be negative\n");
+        return 1;
+    }
+
+    ufo_task_graph_set_queue_depth (graph, (guint) queue_depth);
     leaves = ufo_graph_get_leaves (UFO_GRAPH (graph));
 
     if (leaves == NULL) {
@@ -597,8 +674,16 @@ main(int argc, char* argv[])
     g_object_set (sched,
                   "enable-tracing", trace,
                   "timestamps", timestamps,
+                  "reorder-window", (guint) reorder_window,
+                  "fuse", fuse,
+                  "tune", tune,
                   NULL);
 
+    if (workers == 0)
+        g_object_set (sched, "workers", UFO_BASE_SCHEDULER_AUTO_WORKERS, NULL);
+    else if (workers > 0)
+        g_object_set (sched, "workers", (guint) workers, NULL);
+
     address_list = string_array_to_value_array (addresses);
 
     if (address_list) {
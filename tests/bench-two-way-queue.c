@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark comparing the GAsyncQueue and the lock-free ring backends of
+ * UfoTwoWayQueue. Items circulate between one producer and a number of
+ * consumers the same way buffers circulate between two connected tasks.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <ufo/ufo.h>
+
+static gint n_items = 1000000;
+static gint capacity = 2;
+static gint n_consumers = 1;
+static gint poison_pill;
+
+static GOptionEntry entries[] = {
+    { "items", 'n', 0, G_OPTION_ARG_INT, &n_items, "Number of items to pass", "N" },
+    { "capacity", 'c', 0, G_OPTION_ARG_INT, &capacity, "Number of items in the queue", "N" },
+    { "consumers", 'j', 0, G_OPTION_ARG_INT, &n_consumers, "Number of consumer threads", "N" },
+    { NULL }
+};
+
+static gpointer
+produce (UfoTwoWayQueue *queue)
+{
+    for (gint i = 0; i < n_items; i++)
+        ufo_two_way_queue_producer_push (queue, ufo_two_way_queue_producer_pop (queue));
+
+    /* One poison pill per consumer */
+    for (gint i = 0; i < n_consumers; i++) {
+        ufo_two_way_queue_producer_pop (queue);
+        ufo_two_way_queue_producer_push (queue, &poison_pill);
+    }
+
+    return NULL;
+}
+
+static gpointer
+consume (UfoTwoWayQueue *queue)
+{
+    for (;;) {
+        gpointer item;
+
+        item = ufo_two_way_queue_consumer_pop (queue);
+
+        if (item == &poison_pill)
+            break;
+
+        ufo_two_way_queue_consumer_push (queue, item);
+    }
+
+    /* Give back a slot for the next poison pill */
+    ufo_two_way_queue_consumer_push (queue, GINT_TO_POINTER (1));
+    return NULL;
+}
+
+static void
+run (const gchar *backend)
+{
+    UfoTwoWayQueue *queue;
+    GThread *producer;
+    GThread **consumers;
+    GTimer *timer;
+    gdouble elapsed;
+
+    g_setenv ("UFO_TWO_WAY_QUEUE", backend, TRUE);
+    queue = ufo_two_way_queue_new (NULL);
+
+    for (gint i = 0; i < capacity; i++)
+        ufo_two_way_queue_insert (queue, GINT_TO_POINTER (i + 1));
+
+    consumers = g_new0 (GThread *, n_consumers);
+    timer = g_timer_new ();
+
+    producer = g_thread_create ((GThreadFunc) produce, queue, TRUE, NULL);
+
+    for (gint i = 0; i < n_consumers; i++)
+        consumers[i] = g_thread_create ((GThreadFunc) consume, queue, TRUE, NULL);
+
+    g_thread_join (producer);
+
+    for (gint i = 0; i < n_consumers; i++)
+        g_thread_join (consumers[i]);
+
+    elapsed = g_timer_elapsed (timer, NULL);
+
+    g_print ("%-6s %10i items  %8.3f s  %8.2f Mitems/s  %8.1f ns/item\n",
+             backend, n_items, elapsed, n_items / elapsed / 1e6, elapsed / n_items * 1e9);
+
+    g_timer_destroy (timer);
+    g_free (consumers);
+    ufo_two_way_queue_free (queue);
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GError *error = NULL;
+
+#if !(GLIB_CHECK_VERSION (2, 36, 0))
+    g_type_init ();
+#endif
+
+    context = g_option_context_new ("- benchmark two-way queue backends");
+    g_option_context_add_main_entries (context, entries, NULL);
+
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("Error parsing options: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (n_items < 1 || capacity < 1 || n_consumers < 1) {
+        g_printerr ("Items, capacity and consumers must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    g_print ("capacity=%i consumers=%i\n", capacity, n_consumers);
+    run ("async");
+    run ("ring");
+
+    g_option_context_free (context);
+    return EXIT_SUCCESS;
+}
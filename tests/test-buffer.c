@@ -19,7 +19,11 @@
 
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
 #include <ufo/ufo.h>
+#include "ufo/ufo-memory.h"
+#include "ufo/ufo-priv.h"
 #include "test-suite.h"
 
 typedef struct {
@@ -110,6 +114,263 @@ test_convert_16_from_data (Fixture *fixture,
         g_assert (host_data[i] == ((gfloat) fixture->data16[i]));
 }
 
+static void
+test_convert_16_large (Fixture *fixture,
+                       gconstpointer unused)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 1031,
+        .dims[1] = 17,
+    };
+    UfoBuffer *buffer;
+    guint16 *data;
+    gfloat *host_data;
+    guint n_data;
+
+    /* Odd size to exercise both the vectorized and the scalar tail path */
+    n_data = requisition.dims[0] * requisition.dims[1];
+    buffer = ufo_buffer_new (&requisition, NULL);
+    data = g_new0 (guint16, n_data);
+
+    for (guint i = 0; i < n_data; i++)
+        data[i] = (guint16) (i * 37);
+
+    host_data = ufo_buffer_get_host_array (buffer, NULL);
+    g_memmove (host_data, data, n_data * sizeof (guint16));
+
+    ufo_buffer_convert (buffer, UFO_BUFFER_DEPTH_16U);
+    host_data = ufo_buffer_get_host_array (buffer, NULL);
+
+    for (guint i = 0; i < n_data; i++)
+        g_assert (host_data[i] == ((gfloat) data[i]));
+
+    g_free (data);
+    g_object_unref (buffer);
+}
+
+static void
+test_native_depth (Fixture *fixture,
+                   gconstpointer unused)
+{
+    UfoBuffer *copy;
+    gfloat *host_data;
+
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    g_memmove (host_data, fixture->data16, fixture->n_data * sizeof (guint16));
+    ufo_buffer_set_depth (fixture->buffer, UFO_BUFFER_DEPTH_16U);
+    g_assert (ufo_buffer_get_depth (fixture->buffer) == UFO_BUFFER_DEPTH_16U);
+
+    /* Host copies keep the native depth */
+    copy = ufo_buffer_dup (fixture->buffer);
+    ufo_buffer_copy (fixture->buffer, copy);
+    g_assert (ufo_buffer_get_depth (copy) == UFO_BUFFER_DEPTH_16U);
+
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    g_assert (ufo_buffer_get_depth (fixture->buffer) == UFO_BUFFER_DEPTH_32F);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (host_data[i] == ((gfloat) fixture->data16[i]));
+
+    host_data = ufo_buffer_get_host_array (copy, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (host_data[i] == ((gfloat) fixture->data16[i]));
+
+    g_object_unref (copy);
+}
+
+static void
+test_file_mapping (Fixture *fixture,
+                   gconstpointer unused)
+{
+    UfoBuffer *buffer;
+    GError *error = NULL;
+    gchar *filename;
+    gchar *contents;
+    gsize length;
+    gfloat *host_data;
+    gint fd;
+
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = 8,
+    };
+
+    /* 16 bytes of header followed by native 16-bit data */
+    fd = g_file_open_tmp ("ufo-test-XXXXXX", &filename, &error);
+    g_assert_no_error (error);
+    close (fd);
+
+    contents = g_malloc0 (16 + fixture->n_data * sizeof (guint16));
+    memcpy (contents + 16, fixture->data16, fixture->n_data * sizeof (guint16));
+    g_file_set_contents (filename, contents, 16 + fixture->n_data * sizeof (guint16), &error);
+    g_assert_no_error (error);
+    g_free (contents);
+
+    buffer = ufo_buffer_new_from_file_mapping (filename, 16, &requisition, UFO_BUFFER_DEPTH_16U,
+                                               UFO_BUFFER_MAPPING_READ_ONLY, NULL, &error);
+    g_assert_no_error (error);
+    g_assert (ufo_buffer_get_depth (buffer) == UFO_BUFFER_DEPTH_16U);
+
+    host_data = ufo_buffer_get_host_array (buffer, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (host_data[i] == ((gfloat) fixture->data16[i]));
+
+    /* Widened data is private and can be modified */
+    host_data[0] = 42.0f;
+    g_object_unref (buffer);
+
+    /* Requesting more data than the file holds must fail */
+    requisition.dims[0] = 16;
+    buffer = ufo_buffer_new_from_file_mapping (filename, 16, &requisition, UFO_BUFFER_DEPTH_16U,
+                                               UFO_BUFFER_MAPPING_READ_ONLY, NULL, &error);
+    g_assert (buffer == NULL);
+    g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+    g_clear_error (&error);
+
+    /* Copy-on-write mappings must never change the file */
+    requisition.dims[0] = 4;
+    buffer = ufo_buffer_new_from_file_mapping (filename, 16, &requisition, UFO_BUFFER_DEPTH_32F,
+                                               UFO_BUFFER_MAPPING_COPY_ON_WRITE, NULL, &error);
+    g_assert_no_error (error);
+    host_data = ufo_buffer_get_host_array (buffer, NULL);
+    memset (host_data, 0, 4 * sizeof (gfloat));
+    g_object_unref (buffer);
+
+    g_file_get_contents (filename, &contents, &length, &error);
+    g_assert_no_error (error);
+    g_assert (memcmp (contents + 16, fixture->data16, fixture->n_data * sizeof (guint16)) == 0);
+    g_free (contents);
+
+    g_unlink (filename);
+    g_free (filename);
+}
+
+static void
+test_file_mapping_copy_on_write (Fixture *fixture,
+                                 gconstpointer unused)
+{
+    UfoBuffer *buffer;
+    UfoBuffer *source;
+    GError *error = NULL;
+    gchar *filename;
+    gchar *contents;
+    gsize length;
+    gfloat *host_data;
+    gint fd;
+
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = 8,
+    };
+
+    fd = g_file_open_tmp ("ufo-test-XXXXXX", &filename, &error);
+    g_assert_no_error (error);
+    close (fd);
+
+    g_file_set_contents (filename, (const gchar *) fixture->data8, fixture->n_data, &error);
+    g_assert_no_error (error);
+
+    /* The mapping only holds a quarter of the widened data */
+    buffer = ufo_buffer_new_from_file_mapping (filename, 0, &requisition, UFO_BUFFER_DEPTH_8U,
+                                               UFO_BUFFER_MAPPING_COPY_ON_WRITE, NULL, &error);
+    g_assert_no_error (error);
+
+    host_data = ufo_buffer_get_host_array (buffer, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (host_data[i] == ((gfloat) fixture->data8[i]));
+
+    g_object_unref (buffer);
+
+    /* Copying full-size data into it must not write into the mapping */
+    buffer = ufo_buffer_new_from_file_mapping (filename, 0, &requisition, UFO_BUFFER_DEPTH_8U,
+                                               UFO_BUFFER_MAPPING_COPY_ON_WRITE, NULL, &error);
+    g_assert_no_error (error);
+
+    source = ufo_buffer_new (&requisition, NULL);
+    host_data = ufo_buffer_get_host_array (source, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        host_data[i] = -1.0f * i;
+
+    ufo_buffer_copy (source, buffer);
+    host_data = ufo_buffer_get_host_array (buffer, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (host_data[i] == -1.0f * i);
+
+    g_object_unref (source);
+    g_object_unref (buffer);
+
+    g_file_get_contents (filename, &contents, &length, &error);
+    g_assert_no_error (error);
+    g_assert (memcmp (contents, fixture->data8, fixture->n_data) == 0);
+    g_free (contents);
+
+    g_unlink (filename);
+    g_free (filename);
+}
+
+static void
+test_convert_to (Fixture *fixture,
+                 gconstpointer unused)
+{
+    static const gfloat input[8] = { -1.0f, 0.4f, 0.6f, 127.0f, 254.5f, 300.0f, 128.0f, 0.0f };
+    static const guint8 clamped[8] = { 0, 0, 1, 127, 255, 255, 128, 0 };
+    static const guint16 scaled[8] = { 0, 26214, 39321, 65535, 65535, 65535, 65535, 0 };
+    gfloat *host_data;
+    guint8 data8[8];
+    guint16 data16[8];
+
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    g_memmove (host_data, input, sizeof (input));
+
+    ufo_buffer_convert_to (fixture->buffer, data8, UFO_BUFFER_DEPTH_8U, 0.0f, 0.0f);
+    ufo_buffer_convert_to (fixture->buffer, data16, UFO_BUFFER_DEPTH_16U, 0.0f, 1.0f);
+
+    for (guint i = 0; i < fixture->n_data; i++) {
+        g_assert_cmpuint (data8[i], ==, clamped[i]);
+        g_assert_cmpuint (data16[i], ==, scaled[i]);
+    }
+}
+
+static void
+test_stats (Fixture *fixture,
+            gconstpointer unused)
+{
+    UfoBufferStats stats;
+    guint histogram[4];
+    gfloat *host_data;
+
+    ufo_buffer_convert_from_data (fixture->buffer, fixture->data8, UFO_BUFFER_DEPTH_8U);
+    ufo_buffer_get_stats (fixture->buffer, &stats, histogram, 4, NULL);
+
+    g_assert (stats.min == 1.0f);
+    g_assert (stats.max == 255.0f);
+    g_assert_cmpfloat (fabs (stats.sum - 518.0), <, 1e-6);
+    g_assert_cmpfloat (fabs (stats.mean - 64.75), <, 1e-6);
+    g_assert_cmpfloat (fabs (stats.variance - 12002.1875), <, 1e-6);
+    g_assert_cmpuint (histogram[0], ==, 6);
+    g_assert_cmpuint (histogram[1], ==, 0);
+    g_assert_cmpuint (histogram[2], ==, 0);
+    g_assert_cmpuint (histogram[3], ==, 2);
+
+    g_assert (ufo_buffer_min (fixture->buffer, NULL) == stats.min);
+    g_assert (ufo_buffer_max (fixture->buffer, NULL) == stats.max);
+
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        host_data[i] = 3.0f;
+
+    ufo_buffer_get_stats (fixture->buffer, &stats, histogram, 4, NULL);
+    g_assert (stats.variance == 0.0);
+    g_assert_cmpuint (histogram[0], ==, fixture->n_data);
+}
+
 static void
 test_insert_metadata (Fixture *fixture,
                       gconstpointer unused)
@@ -167,6 +428,245 @@ test_copy_metadata (Fixture *fixture,
     g_object_unref (copy);
 }
 
+static void
+test_copy_metadata_on_write (Fixture *fixture,
+                             gconstpointer unused)
+{
+    GValue value = {0};
+    GList *keys;
+    UfoBuffer *copy;
+
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = 8,
+    };
+
+    copy = ufo_buffer_new (&requisition, NULL);
+    g_value_init (&value, G_TYPE_INT);
+
+    /* More entries than fit into the initial store */
+    for (gint i = 0; i < 6; i++) {
+        gchar *name = g_strdup_printf ("key-%i", i);
+
+        g_value_set_int (&value, i);
+        ufo_buffer_set_metadata (fixture->buffer, name, &value);
+        g_free (name);
+    }
+
+    ufo_buffer_copy_metadata (fixture->buffer, copy);
+
+    /* Writing to the copy must not change the source and vice versa */
+    g_value_set_int (&value, 100);
+    ufo_buffer_set_metadata (copy, "key-0", &value);
+    ufo_buffer_set_metadata (fixture->buffer, "key-1", &value);
+
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (fixture->buffer, "key-0")), ==, 0);
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (copy, "key-0")), ==, 100);
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (copy, "key-1")), ==, 1);
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (copy, "key-5")), ==, 5);
+
+    /* Entries only present in the destination are kept */
+    ufo_buffer_set_metadata (copy, "extra", &value);
+    ufo_buffer_copy_metadata (fixture->buffer, copy);
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (copy, "key-0")), ==, 0);
+    g_assert (ufo_buffer_get_metadata (copy, "extra") != NULL);
+
+    keys = ufo_buffer_get_metadata_keys (copy);
+    g_assert_cmpuint (g_list_length (keys), ==, 7);
+    g_list_free (keys);
+
+    /* Setting a value from the buffer's own store must be safe */
+    ufo_buffer_set_metadata (copy, "key-2", ufo_buffer_get_metadata (copy, "key-2"));
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (copy, "key-2")), ==, 2);
+
+    g_value_unset (&value);
+    g_object_unref (copy);
+}
+
+static void
+test_batch_frames (Fixture *fixture,
+                   gconstpointer unused)
+{
+    UfoBuffer *batch;
+    UfoBuffer *frame;
+    GValue value = {0};
+    gfloat *host_data;
+
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = 8,
+    };
+
+    batch = ufo_buffer_new (&requisition, NULL);
+    ufo_buffer_set_n_frames (batch, 3);
+    g_assert_cmpuint (ufo_buffer_get_n_frames (batch), ==, 3);
+    g_assert_cmpuint (ufo_buffer_get_size (batch), ==, 3 * 8 * sizeof (gfloat));
+
+    g_value_init (&value, G_TYPE_INT);
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+
+    for (guint i = 0; i < 3; i++) {
+        for (guint j = 0; j < fixture->n_data; j++)
+            host_data[j] = (gfloat) (i * 10 + j);
+
+        g_value_set_int (&value, (gint) i);
+        ufo_buffer_set_metadata (fixture->buffer, "index", &value);
+        ufo_buffer_set_frame (batch, i, fixture->buffer);
+    }
+
+    host_data = ufo_buffer_get_host_array (batch, NULL);
+    g_assert (host_data[8] == 10.0f);
+    g_assert (host_data[23] == 27.0f);
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_frame_metadata (batch, 1, "index")), ==, 1);
+
+    /* Frames come out with their own metadata */
+    frame = ufo_buffer_new (&requisition, NULL);
+    ufo_buffer_get_frame (batch, 2, frame);
+    host_data = ufo_buffer_get_host_array (frame, NULL);
+    g_assert (host_data[0] == 20.0f);
+    g_assert_cmpint (g_value_get_int (ufo_buffer_get_metadata (frame, "index")), ==, 2);
+
+    /* Shrinking keeps the leading frames */
+    ufo_buffer_set_n_frames (batch, 2);
+    g_assert_cmpuint (ufo_buffer_get_size (batch), ==, 2 * 8 * sizeof (gfloat));
+    ufo_buffer_get_frame (batch, 1, frame);
+    g_assert (ufo_buffer_get_host_array (frame, NULL)[7] == 17.0f);
+
+    g_value_unset (&value);
+    g_object_unref (frame);
+    g_object_unref (batch);
+}
+
+static void
+test_view (Fixture *fixture,
+           gconstpointer unused)
+{
+    UfoBuffer *image;
+    UfoBuffer *view;
+    gfloat *image_data;
+    gfloat *view_data;
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 4,
+        .dims[1] = 4,
+    };
+
+    UfoRegion rows = {
+        .origin = { 0, 1, 0 },
+        .size = { 4, 2, 1 },
+    };
+
+    image = ufo_buffer_new (&requisition, NULL);
+    image_data = ufo_buffer_get_host_array (image, NULL);
+
+    for (guint i = 0; i < 16; i++)
+        image_data[i] = (gfloat) i;
+
+    view = ufo_buffer_new_view (image, &rows);
+    g_assert (view != NULL);
+    g_assert_cmpuint (ufo_buffer_get_size (view), ==, 8 * sizeof (gfloat));
+
+    /* Views share storage with their parent */
+    view_data = ufo_buffer_get_host_array (view, NULL);
+    g_assert (view_data[0] == 4.0f);
+    view_data[7] = -1.0f;
+    g_assert (image_data[11] == -1.0f);
+
+    g_object_unref (view);
+    g_object_unref (image);
+}
+
+static void
+test_resize_capacity (Fixture *fixture,
+                      gconstpointer unused)
+{
+    gfloat *data;
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 4,
+        .dims[1] = 2,
+    };
+
+    /* Shrinking keeps the storage */
+    data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    ufo_buffer_resize (fixture->buffer, &requisition);
+    g_assert_cmpuint (ufo_buffer_get_size (fixture->buffer), ==, 8 * sizeof (gfloat));
+    requisition.dims[1] = 1;
+    ufo_buffer_resize (fixture->buffer, &requisition);
+    g_assert_cmpuint (ufo_buffer_get_size (fixture->buffer), ==, 4 * sizeof (gfloat));
+    g_assert (ufo_buffer_get_host_array (fixture->buffer, NULL) == data);
+
+    /* Growing beyond the capacity reallocates with room to spare ... */
+    requisition.dims[1] = 64;
+    ufo_buffer_resize (fixture->buffer, &requisition);
+    data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    data[255] = 1.0f;
+
+    /* ... so that growing a little further does not */
+    requisition.dims[1] = 96;
+    ufo_buffer_resize (fixture->buffer, &requisition);
+    g_assert (ufo_buffer_get_host_array (fixture->buffer, NULL) == data);
+    data[383] = 1.0f;
+}
+
+static void
+test_copy_region (Fixture *fixture,
+                  gconstpointer unused)
+{
+    UfoBuffer *image;
+    UfoBuffer *tile;
+    gfloat *image_data;
+    gfloat *tile_data;
+    const gsize tile_origin[] = { 0, 0, 0 };
+    const gsize image_origin[] = { 2, 2, 0 };
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 4,
+        .dims[1] = 4,
+    };
+
+    UfoRegion center = {
+        .origin = { 1, 1, 0 },
+        .size = { 2, 2, 1 },
+    };
+
+    UfoRegion whole_tile = {
+        .origin = { 0, 0, 0 },
+        .size = { 2, 2, 1 },
+    };
+
+    image = ufo_buffer_new (&requisition, NULL);
+    image_data = ufo_buffer_get_host_array (image, NULL);
+
+    for (guint i = 0; i < 16; i++)
+        image_data[i] = (gfloat) i;
+
+    requisition.dims[0] = 2;
+    requisition.dims[1] = 2;
+    tile = ufo_buffer_new (&requisition, NULL);
+
+    /* Crop the center ... */
+    ufo_buffer_copy_region (image, &center, tile, tile_origin);
+    tile_data = ufo_buffer_get_host_array (tile, NULL);
+    g_assert (tile_data[0] == 5.0f);
+    g_assert (tile_data[1] == 6.0f);
+    g_assert (tile_data[2] == 9.0f);
+    g_assert (tile_data[3] == 10.0f);
+
+    /* ... and stitch it into the lower right corner */
+    ufo_buffer_copy_region (tile, &whole_tile, image, image_origin);
+    image_data = ufo_buffer_get_host_array (image, NULL);
+    g_assert (image_data[10] == 5.0f);
+    g_assert (image_data[15] == 10.0f);
+    g_assert (image_data[9] == 9.0f);
+
+    g_object_unref (tile);
+    g_object_unref (image);
+}
+
 static void
 test_location (Fixture *fixture,
                gconstpointer unused)
@@ -176,6 +676,256 @@ test_location (Fixture *fixture,
     g_assert (ufo_buffer_get_location (fixture->buffer) == UFO_BUFFER_LOCATION_HOST);
 }
 
+static void
+test_host_memory_fallback (Fixture *fixture,
+                           gconstpointer unused)
+{
+    g_assert (ufo_buffer_get_host_memory (fixture->buffer) == UFO_BUFFER_HOST_MEMORY_DEFAULT);
+    ufo_buffer_set_host_memory (fixture->buffer, UFO_BUFFER_HOST_MEMORY_PINNED);
+    g_assert (ufo_buffer_get_host_memory (fixture->buffer) == UFO_BUFFER_HOST_MEMORY_PINNED);
+
+    /* Without a context we must get regular, zeroed memory */
+    g_assert (ufo_buffer_get_host_array (fixture->buffer, NULL)[0] == 0.0f);
+    g_assert (!ufo_buffer_is_pinned (fixture->buffer));
+}
+
+static void
+test_pool_reuse (Fixture *fixture,
+                 gconstpointer unused)
+{
+    UfoBufferPool *pool;
+    UfoBufferPoolStats stats;
+    UfoBuffer *first;
+    UfoBuffer *second;
+    GValue value = {0};
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 16,
+        .dims[1] = 8,
+    };
+
+    pool = ufo_buffer_pool_new (0);
+    first = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+
+    g_value_init (&value, G_TYPE_INT);
+    g_value_set_int (&value, 1);
+    ufo_buffer_set_metadata (first, "foo", &value);
+
+    ufo_buffer_pool_release (pool, first);
+    ufo_buffer_pool_get_stats (pool, &stats);
+    g_assert (stats.misses == 1);
+    g_assert (stats.n_held == 1);
+    g_assert (stats.bytes_held == 16 * 8 * sizeof (gfloat));
+
+    /* Same number of bytes but different shape must be served from the pool */
+    requisition.dims[0] = 8;
+    requisition.dims[1] = 16;
+    second = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+    g_assert (second == first);
+    g_assert (ufo_buffer_cmp_dimensions (second, &requisition) == 0);
+    g_assert (ufo_buffer_get_metadata (second, "foo") == NULL);
+
+    ufo_buffer_pool_get_stats (pool, &stats);
+    g_assert (stats.hits == 1);
+    g_assert (stats.n_held == 0);
+    g_assert (stats.bytes_held == 0);
+
+    ufo_buffer_pool_release (pool, second);
+    ufo_buffer_pool_free (pool);
+}
+
+static void
+test_pool_size_class (Fixture *fixture,
+                      gconstpointer unused)
+{
+    UfoBufferPool *pool;
+    UfoBufferPoolStats stats;
+    UfoBuffer *first;
+    UfoBuffer *second;
+    UfoBuffer *third;
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 16,
+        .dims[1] = 8,
+    };
+
+    pool = ufo_buffer_pool_new (0);
+    first = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+    ufo_buffer_get_host_array (first, NULL)[0] = 1.0f;
+    ufo_buffer_pool_release (pool, first);
+
+    /* A smaller request of the same class is served and starts out empty */
+    requisition.n_dims = 1;
+    requisition.dims[0] = 10;
+    second = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+    g_assert (second == first);
+    g_assert_cmpuint (ufo_buffer_get_size (second), ==, 10 * sizeof (gfloat));
+    g_assert (ufo_buffer_get_location (second) == UFO_BUFFER_LOCATION_INVALID);
+    ufo_buffer_pool_release (pool, second);
+
+    /* A request of a larger class is not */
+    requisition.dims[0] = 2000;
+    third = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+    g_assert (third != first);
+
+    ufo_buffer_pool_get_stats (pool, &stats);
+    g_assert (stats.hits == 1);
+    g_assert (stats.misses == 2);
+    g_assert (stats.n_held == 1);
+
+    g_object_unref (third);
+    ufo_buffer_pool_free (pool);
+}
+
+static void
+test_memory_accounting (Fixture *fixture,
+                        gconstpointer unused)
+{
+    UfoBuffer *buffer;
+    guint64 before;
+    guint64 used;
+    guint64 peak;
+
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = 1024,
+    };
+
+    /* Other tests may hold host memory, so only look at the difference */
+    ufo_memory_get_usage (NULL, &before, NULL);
+
+    buffer = ufo_buffer_new (&requisition, NULL);
+    ufo_memory_get_usage (NULL, &used, NULL);
+    g_assert_cmpuint (used, ==, before);
+
+    ufo_buffer_get_host_array (buffer, NULL);
+    ufo_memory_get_usage (NULL, &used, &peak);
+    g_assert_cmpuint (used, ==, before + 1024 * sizeof (gfloat));
+    g_assert_cmpuint (peak, >=, used);
+
+    g_object_unref (buffer);
+    ufo_memory_get_usage (NULL, &used, NULL);
+    g_assert_cmpuint (used, ==, before);
+}
+
+static void
+test_memory_budget (Fixture *fixture,
+                    gconstpointer unused)
+{
+    gpointer context = GINT_TO_POINTER (0xcafe);
+    guint64 used;
+    guint64 peak;
+
+    g_assert_cmpuint (ufo_memory_get_budget (context), ==, 0);
+    g_assert (!ufo_memory_exceeds_budget (context, G_MAXSIZE));
+
+    ufo_memory_set_budget (context, 1024);
+    ufo_memory_alloc (context, 1000);
+    g_assert (!ufo_memory_exceeds_budget (context, 24));
+    g_assert (ufo_memory_exceeds_budget (context, 25));
+
+    /* Exceeding the budget is reported only once per setting */
+    g_assert (ufo_memory_warn_once (context));
+    g_assert (!ufo_memory_warn_once (context));
+
+    ufo_memory_free (context, 600);
+    ufo_memory_get_usage (context, &used, &peak);
+    g_assert_cmpuint (used, ==, 400);
+    g_assert_cmpuint (peak, ==, 1000);
+
+    /* Freeing more than was accounted does not wrap around */
+    ufo_memory_free (context, 1000);
+    ufo_memory_get_usage (context, &used, NULL);
+    g_assert_cmpuint (used, ==, 0);
+
+    ufo_memory_set_budget (context, 2048);
+    g_assert (ufo_memory_warn_once (context));
+
+    ufo_memory_forget (context);
+    g_assert_cmpuint (ufo_memory_get_budget (context), ==, 0);
+}
+
+static void
+test_memory_discard (Fixture *fixture,
+                     gconstpointer unused)
+{
+    UfoBufferPool *pool;
+    UfoBuffer *pooled;
+    guint64 before;
+    guint64 used;
+    gfloat *data;
+
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = 1024,
+    };
+
+    pool = ufo_buffer_pool_new (0);
+    pooled = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+    data = ufo_buffer_get_host_array (pooled, NULL);
+    data[0] = 1.0f;
+    ufo_buffer_pool_release (pool, pooled);
+
+    /* Hit the limit with everything that is allocated right now */
+    ufo_memory_get_usage (NULL, &before, NULL);
+    ufo_memory_set_budget (NULL, before);
+    g_assert (ufo_memory_exceeds_budget (NULL, 1));
+
+    /* Host data is the only copy, discarding must keep it */
+    ufo_buffer_pool_discard_host_arrays (pool, 1);
+    ufo_memory_get_usage (NULL, &used, NULL);
+    g_assert_cmpuint (used, ==, before);
+    g_assert_cmpuint (ufo_buffer_discard_host_array (pooled), ==, 0);
+
+    ufo_memory_set_budget (NULL, 0);
+    g_assert (!ufo_memory_exceeds_budget (NULL, 1));
+
+    pooled = ufo_buffer_pool_acquire (pool, &requisition, NULL);
+    g_assert (ufo_buffer_get_host_array (pooled, NULL) == data);
+    g_object_unref (pooled);
+    ufo_buffer_pool_free (pool);
+
+    ufo_memory_get_usage (NULL, &used, NULL);
+    g_assert_cmpuint (used, ==, before - 1024 * sizeof (gfloat));
+}
+
+static void
+test_begin_read (Fixture *fixture,
+                 gconstpointer unused)
+{
+    gfloat *host_data;
+    gfloat *read_data;
+    guint8 data8[8];
+
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    g_memmove (host_data, fixture->data8, fixture->n_data);
+    ufo_buffer_set_depth (fixture->buffer, UFO_BUFFER_DEPTH_8U);
+
+    /* Narrow host data is widened for readers as well */
+    read_data = ufo_buffer_begin_read (fixture->buffer, UFO_BUFFER_LOCATION_HOST, NULL);
+    g_assert (read_data == host_data);
+    g_assert (ufo_buffer_get_location (fixture->buffer) == UFO_BUFFER_LOCATION_HOST);
+    g_assert (ufo_buffer_get_depth (fixture->buffer) == UFO_BUFFER_DEPTH_32F);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert (read_data[i] == ((gfloat) fixture->data8[i]));
+
+    /* Nested reads see the same data */
+    g_assert (ufo_buffer_begin_read (fixture->buffer, UFO_BUFFER_LOCATION_HOST, NULL) == read_data);
+    ufo_buffer_convert_to (fixture->buffer, data8, UFO_BUFFER_DEPTH_8U, 0.0f, 0.0f);
+    ufo_buffer_end_read (fixture->buffer);
+    ufo_buffer_end_read (fixture->buffer);
+
+    for (guint i = 0; i < fixture->n_data; i++)
+        g_assert_cmpuint (data8[i], ==, fixture->data8[i]);
+
+    host_data = ufo_buffer_get_host_array (fixture->buffer, NULL);
+    g_assert (host_data == read_data);
+    g_assert (ufo_buffer_get_location (fixture->buffer) == UFO_BUFFER_LOCATION_HOST);
+}
+
 void
 test_add_buffer (void)
 {
@@ -195,6 +945,38 @@ test_add_buffer (void)
                 Fixture, NULL,
                 setup, test_convert_16_from_data, teardown);
 
+    g_test_add ("/no-opencl/buffer/convert/16/large",
+                Fixture, NULL,
+                setup, test_convert_16_large, teardown);
+
+    g_test_add ("/no-opencl/buffer/convert/native",
+                Fixture, NULL,
+                setup, test_native_depth, teardown);
+
+    g_test_add ("/no-opencl/buffer/resize/capacity",
+                Fixture, NULL,
+                setup, test_resize_capacity, teardown);
+
+    g_test_add ("/no-opencl/buffer/file-mapping",
+                Fixture, NULL,
+                setup, test_file_mapping, teardown);
+
+    g_test_add ("/no-opencl/buffer/file-mapping/copy-on-write",
+                Fixture, NULL,
+                setup, test_file_mapping_copy_on_write, teardown);
+
+    g_test_add ("/no-opencl/buffer/convert/to",
+                Fixture, NULL,
+                setup, test_convert_to, teardown);
+
+    g_test_add ("/no-opencl/buffer/begin-read/host",
+                Fixture, NULL,
+                setup, test_begin_read, teardown);
+
+    g_test_add ("/no-opencl/buffer/stats",
+                Fixture, NULL,
+                setup, test_stats, teardown);
+
     g_test_add ("/no-opencl/buffer/metadata/insert",
                 Fixture, NULL,
                 setup, test_insert_metadata, teardown);
@@ -202,8 +984,47 @@ test_add_buffer (void)
     g_test_add ("/no-opencl/buffer/metadata/copy",
                 Fixture, NULL,
                 setup, test_copy_metadata, teardown);
+    g_test_add ("/no-opencl/buffer/metadata/copy-on-write",
+                Fixture, NULL,
+                setup, test_copy_metadata_on_write, teardown);
+
+    g_test_add ("/no-opencl/buffer/batch",
+                Fixture, NULL,
+                setup, test_batch_frames, teardown);
+
+    g_test_add ("/no-opencl/buffer/view",
+                Fixture, NULL,
+                setup, test_view, teardown);
+
+    g_test_add ("/no-opencl/buffer/copy-region",
+                Fixture, NULL,
+                setup, test_copy_region, teardown);
 
     g_test_add ("/no-opencl/buffer/location",
                 Fixture, NULL,
                 setup, test_location, teardown);
+
+    g_test_add ("/no-opencl/buffer/host-memory/fallback",
+                Fixture, NULL,
+                setup, test_host_memory_fallback, teardown);
+
+    g_test_add ("/no-opencl/buffer/pool/reuse",
+                Fixture, NULL,
+                setup, test_pool_reuse, teardown);
+
+    g_test_add ("/no-opencl/buffer/pool/size-class",
+                Fixture, NULL,
+                setup, test_pool_size_class, teardown);
+
+    g_test_add ("/no-opencl/buffer/memory/accounting",
+                Fixture, NULL,
+                setup, test_memory_accounting, teardown);
+
+    g_test_add ("/no-opencl/buffer/memory/budget",
+                Fixture, NULL,
+                setup, test_memory_budget, teardown);
+
+    g_test_add ("/no-opencl/buffer/memory/discard",
+                Fixture, NULL,
+                setup, test_memory_discard, teardown);
 }
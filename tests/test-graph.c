@@ -227,6 +227,21 @@ test_remove_edge (Fixture *fixture, gconstpointer data)
     g_assert (ufo_graph_get_num_edges (fixture->sequence) == 1);
 }
 
+static void
+test_remove_node (Fixture *fixture, gconstpointer data)
+{
+    GList *predecessors;
+
+    ufo_graph_remove_node (fixture->diamond, fixture->target1);
+    g_assert (ufo_graph_get_num_nodes (fixture->diamond) == 3);
+    g_assert (ufo_graph_get_num_edges (fixture->diamond) == 2);
+
+    predecessors = ufo_graph_get_predecessors (fixture->diamond, fixture->target3);
+    g_assert (g_list_length (predecessors) == 1);
+    g_assert (predecessors->data == fixture->target2);
+    g_list_free (predecessors);
+}
+
 static void
 test_get_labels (Fixture *fixture, gconstpointer data)
 {
@@ -408,6 +423,238 @@ test_flatten (Fixture *fixture, gconstpointer data)
     g_list_free (levels);
 }
 
+static void
+test_queue_depth (Fixture *fixture, gconstpointer data)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *target;
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (ufo_dummy_task_new ());
+    target = UFO_TASK_NODE (ufo_dummy_task_new ());
+    ufo_task_graph_connect_nodes_full (graph, source, target, 1);
+
+    /* Without any setting the scheduler decides */
+    g_assert_cmpuint (ufo_task_graph_get_edge_queue_depth (graph, source, target), ==, 0);
+
+    ufo_task_graph_set_queue_depth (graph, 4);
+    g_assert_cmpuint (ufo_task_graph_get_edge_queue_depth (graph, source, target), ==, 4);
+
+    ufo_task_graph_set_edge_queue_depth (graph, source, target, 8);
+    g_assert_cmpuint (ufo_task_graph_get_edge_queue_depth (graph, source, target), ==, 8);
+    g_assert_cmpuint (ufo_task_node_get_queue_depth (target, 1), ==, 8);
+    g_assert_cmpuint (ufo_task_node_get_queue_depth (target, 0), ==, 0);
+
+    g_object_unref (source);
+    g_object_unref (target);
+    g_object_unref (graph);
+}
+
+static void
+test_queue_depth_json (Fixture *fixture, gconstpointer data)
+{
+    UfoPluginManager *manager;
+    UfoTaskGraph *graph;
+    UfoTaskGraph *loaded;
+    UfoTaskNode *source;
+    UfoTaskNode *target;
+    GList *roots;
+    GList *successors;
+    GError *error = NULL;
+    gchar *json;
+
+    static const gchar *invalid[] = {
+        "{\"queue-depth\": 0, \"nodes\": []}",
+        "{\"nodes\": [{\"plugin\": \"[dummy]\", \"name\": \"a\"}, {\"plugin\": \"[dummy]\", \"name\": \"b\"}],"
+        " \"edges\": [{\"from\": {\"name\": \"a\"}, \"to\": {\"name\": \"b\"}, \"depth\": -1}]}",
+        "{\"queue-depth\": 4294967296, \"nodes\": []}",
+        NULL
+    };
+
+    manager = ufo_plugin_manager_new ();
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (ufo_dummy_task_new ());
+    target = UFO_TASK_NODE (ufo_dummy_task_new ());
+    ufo_task_node_set_identifier (source, "source");
+    ufo_task_node_set_identifier (target, "target");
+    ufo_task_graph_connect_nodes (graph, source, target);
+
+    /* The smallest and the largest depth survive a round trip */
+    ufo_task_graph_set_queue_depth (graph, 1);
+    ufo_task_graph_set_edge_queue_depth (graph, source, target, G_MAXUINT);
+    json = ufo_task_graph_get_json_data (graph, &error);
+    g_assert_no_error (error);
+
+    loaded = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    ufo_task_graph_read_from_data (loaded, manager, json, &error);
+    g_assert_no_error (error);
+    g_assert_cmpuint (ufo_task_graph_get_queue_depth (loaded), ==, 1);
+
+    roots = ufo_graph_get_roots (UFO_GRAPH (loaded));
+    g_assert_cmpuint (g_list_length (roots), ==, 1);
+    successors = ufo_graph_get_successors (UFO_GRAPH (loaded), UFO_NODE (roots->data));
+    g_assert_cmpuint (g_list_length (successors), ==, 1);
+    g_assert_cmpuint (ufo_task_node_get_queue_depth (UFO_TASK_NODE (successors->data), 0), ==, G_MAXUINT);
+
+    g_list_free (successors);
+    g_list_free (roots);
+    g_object_unref (loaded);
+    g_free (json);
+
+    /* Depths that are not positive or too large are rejected */
+    for (guint i = 0; invalid[i] != NULL; i++) {
+        loaded = UFO_TASK_GRAPH (ufo_task_graph_new ());
+        ufo_task_graph_read_from_data (loaded, manager, invalid[i], &error);
+        g_assert_error (error, UFO_TASK_GRAPH_ERROR, UFO_TASK_GRAPH_ERROR_JSON_KEY);
+        g_assert_cmpuint (ufo_graph_get_num_edges (UFO_GRAPH (loaded)), ==, 0);
+        g_clear_error (&error);
+        g_object_unref (loaded);
+    }
+
+    g_object_unref (source);
+    g_object_unref (target);
+    g_object_unref (graph);
+    g_object_unref (manager);
+}
+
+static void
+test_numa_node (Fixture *fixture, gconstpointer data)
+{
+    UfoPluginManager *manager;
+    UfoTaskGraph *graph;
+    UfoTaskGraph *loaded;
+    UfoTaskNode *source;
+    UfoTaskNode *target;
+    GList *nodes;
+    GList *it;
+    GError *error = NULL;
+    gchar *json;
+
+    manager = ufo_plugin_manager_new ();
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (ufo_dummy_task_new ());
+    target = UFO_TASK_NODE (ufo_dummy_task_new ());
+    ufo_task_node_set_identifier (source, "source");
+    ufo_task_node_set_identifier (target, "target");
+    ufo_task_graph_connect_nodes (graph, source, target);
+
+    g_assert_cmpint (ufo_task_node_get_numa_node (source), ==, -1);
+    ufo_task_node_set_numa_node (source, 1);
+    g_assert_cmpint (ufo_task_node_get_numa_node (source), ==, 1);
+
+    /* Only the pinned task carries the key */
+    json = ufo_task_graph_get_json_data (graph, &error);
+    g_assert_no_error (error);
+
+    loaded = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    ufo_task_graph_read_from_data (loaded, manager, json, &error);
+    g_assert_no_error (error);
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (loaded));
+    g_assert_cmpuint (g_list_length (nodes), ==, 2);
+
+    for (it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        UfoTaskNode *node = UFO_TASK_NODE (it->data);
+
+        if (!g_strcmp0 (ufo_task_node_get_identifier (node), "source"))
+            g_assert_cmpint (ufo_task_node_get_numa_node (node), ==, 1);
+        else
+            g_assert_cmpint (ufo_task_node_get_numa_node (node), ==, -1);
+    }
+
+    g_list_free (nodes);
+    g_object_unref (loaded);
+    g_free (json);
+    g_object_unref (source);
+    g_object_unref (target);
+    g_object_unref (graph);
+    g_object_unref (manager);
+}
+
+static void
+test_fuse (Fixture *fixture, gconstpointer data)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *sink;
+    UfoTaskNode *copies[3];
+    UfoNode *fused;
+    GList *successors;
+    GList *tasks;
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (ufo_dummy_task_new ());
+    sink = UFO_TASK_NODE (ufo_dummy_task_new ());
+
+    for (guint i = 0; i < 3; i++)
+        copies[i] = UFO_TASK_NODE (ufo_copy_task_new ());
+
+    ufo_task_graph_connect_nodes (graph, source, copies[0]);
+    ufo_task_graph_connect_nodes (graph, copies[0], copies[1]);
+    ufo_task_graph_connect_nodes (graph, copies[1], copies[2]);
+    ufo_task_graph_connect_nodes_full (graph, copies[2], sink, 1);
+    ufo_task_graph_set_edge_queue_depth (graph, source, copies[0], 4);
+
+    ufo_task_graph_fuse (graph);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 3);
+    g_assert_cmpuint (ufo_graph_get_num_edges (UFO_GRAPH (graph)), ==, 2);
+
+    successors = ufo_graph_get_successors (UFO_GRAPH (graph), UFO_NODE (source));
+    g_assert (g_list_length (successors) == 1);
+    fused = UFO_NODE (successors->data);
+    g_list_free (successors);
+
+    g_assert (UFO_IS_FUSED_TASK (fused));
+    g_assert (ufo_graph_get_edge_label (UFO_GRAPH (graph), fused, UFO_NODE (sink)) == GINT_TO_POINTER (1));
+    g_assert_cmpuint (ufo_task_graph_get_edge_queue_depth (graph, source, UFO_TASK_NODE (fused)), ==, 4);
+
+    tasks = ufo_fused_task_get_tasks (UFO_FUSED_TASK (fused));
+    g_assert (g_list_length (tasks) == 3);
+    g_assert (g_list_nth_data (tasks, 0) == copies[0]);
+    g_assert (g_list_nth_data (tasks, 2) == copies[2]);
+
+    /* Fused tasks are not fused again */
+    ufo_task_graph_fuse (graph);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 3);
+
+    for (guint i = 0; i < 3; i++)
+        g_object_unref (copies[i]);
+
+    g_object_unref (source);
+    g_object_unref (sink);
+    g_object_unref (graph);
+}
+
+static void
+test_fuse_branches (Fixture *fixture, gconstpointer data)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *copies[3];
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    source = UFO_TASK_NODE (ufo_dummy_task_new ());
+
+    for (guint i = 0; i < 3; i++)
+        copies[i] = UFO_TASK_NODE (ufo_copy_task_new ());
+
+    /* copies[0] branches out, so none of the chains is longer than one */
+    ufo_task_graph_connect_nodes (graph, source, copies[0]);
+    ufo_task_graph_connect_nodes (graph, copies[0], copies[1]);
+    ufo_task_graph_connect_nodes (graph, copies[0], copies[2]);
+
+    ufo_task_graph_fuse (graph);
+    g_assert_cmpuint (ufo_graph_get_num_nodes (UFO_GRAPH (graph)), ==, 4);
+    g_assert_cmpuint (ufo_graph_get_num_edges (UFO_GRAPH (graph)), ==, 3);
+
+    for (guint i = 0; i < 3; i++)
+        g_object_unref (copies[i]);
+
+    g_object_unref (source);
+    g_object_unref (graph);
+}
+
 void
 test_add_graph (void)
 {
@@ -423,11 +670,17 @@ test_add_graph (void)
         { "/no-opencl/graph/edges/number",            test_get_num_edges },
         { "/no-opencl/graph/edges/all",               test_get_edges },
         { "/no-opencl/graph/edges/remove",            test_remove_edge },
+        { "/no-opencl/graph/nodes/remove",            test_remove_node },
         { "/no-opencl/graph/labels",                  test_get_labels },
         { "/no-opencl/graph/expansion",               test_expansion },
         { "/no-opencl/graph/copy",                    test_copy },
         { "/no-opencl/graph/copy/shallow",            test_shallow_copy },
         { "/no-opencl/graph/flatten",                 test_flatten },
+        { "/no-opencl/graph/queue-depth",             test_queue_depth },
+        { "/no-opencl/graph/queue-depth/json",        test_queue_depth_json },
+        { "/no-opencl/graph/numa-node",               test_numa_node },
+        { "/no-opencl/graph/fuse",                    test_fuse },
+        { "/no-opencl/graph/fuse/branches",           test_fuse_branches },
         { NULL, NULL }
     };
 
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+/* A dummy task that declares to only read its input */
+typedef UfoDummyTask TestReader;
+typedef UfoDummyTaskClass TestReaderClass;
+
+static void test_reader_task_init (UfoTaskIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (TestReader, test_reader, UFO_TYPE_DUMMY_TASK,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK, test_reader_task_init))
+
+static UfoTaskMode
+test_reader_get_mode (UfoTask *task)
+{
+    return UFO_TASK_MODE_PROCESSOR | UFO_TASK_MODE_CPU | UFO_TASK_MODE_READ_ONLY_INPUT;
+}
+
+static void
+test_reader_task_init (UfoTaskIface *iface)
+{
+    UfoTaskIface *parent;
+
+    parent = g_type_interface_peek_parent (iface);
+    *iface = *parent;
+    iface->get_mode = test_reader_get_mode;
+}
+
+static void
+test_reader_class_init (TestReaderClass *klass)
+{
+}
+
+static void
+test_reader_init (TestReader *self)
+{
+}
+
+typedef struct {
+    UfoGroup *group;
+    UfoTask *fast;
+    UfoTask *slow;
+    UfoRequisition requisition;
+} Fixture;
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    GList *targets = NULL;
+
+    fixture->fast = UFO_TASK (ufo_dummy_task_new ());
+    fixture->slow = UFO_TASK (ufo_dummy_task_new ());
+    targets = g_list_append (targets, fixture->fast);
+    targets = g_list_append (targets, fixture->slow);
+
+    fixture->group = ufo_group_new (targets, NULL, UFO_SEND_DYNAMIC);
+    fixture->requisition.n_dims = 1;
+    fixture->requisition.dims[0] = 8;
+
+    g_list_free (targets);
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    g_object_unref (fixture->group);
+    g_object_unref (fixture->fast);
+    g_object_unref (fixture->slow);
+}
+
+static void
+send (Fixture *fixture)
+{
+    UfoBuffer *buffer;
+
+    buffer = ufo_group_pop_output_buffer (fixture->group, &fixture->requisition);
+    ufo_group_push_output_buffer (fixture->group, buffer);
+}
+
+static void
+test_dynamic (Fixture *fixture, gconstpointer data)
+{
+    UfoBuffer *fast_input;
+    UfoBuffer *slow_input;
+
+    /* With nothing in flight, targets are served in turn */
+    send (fixture);
+    send (fixture);
+
+    fast_input = ufo_group_pop_input_buffer (fixture->group, fixture->fast);
+    slow_input = ufo_group_pop_input_buffer (fixture->group, fixture->slow);
+    g_assert (UFO_IS_BUFFER (fast_input));
+    g_assert (UFO_IS_BUFFER (slow_input));
+
+    /* The fast target finishes first and must receive the next two items */
+    ufo_group_push_input_buffer (fixture->group, fixture->fast, fast_input);
+    send (fixture);
+
+    fast_input = ufo_group_pop_input_buffer (fixture->group, fixture->fast);
+    ufo_group_push_input_buffer (fixture->group, fixture->fast, fast_input);
+    send (fixture);
+
+    fast_input = ufo_group_pop_input_buffer (fixture->group, fixture->fast);
+    ufo_group_push_input_buffer (fixture->group, fixture->fast, fast_input);
+    ufo_group_push_input_buffer (fixture->group, fixture->slow, slow_input);
+}
+
+static void
+test_batched (Fixture *fixture, gconstpointer data)
+{
+    UfoBuffer *fast_inputs[8];
+    UfoBuffer *slow_inputs[8];
+
+    for (guint i = 0; i < 4; i++)
+        send (fixture);
+
+    ufo_group_finish (fixture->group);
+
+    /* Everything that is ready is fetched at once, up to the end of stream */
+    g_assert_cmpuint (ufo_group_pop_input_buffers (fixture->group, fixture->fast, fast_inputs, 8), ==, 3);
+    g_assert_cmpuint (ufo_group_pop_input_buffers (fixture->group, fixture->slow, slow_inputs, 1), ==, 1);
+    g_assert_cmpuint (ufo_group_pop_input_buffers (fixture->group, fixture->slow, slow_inputs + 1, 7), ==, 2);
+
+    g_assert (UFO_IS_BUFFER (fast_inputs[0]));
+    g_assert (UFO_IS_BUFFER (fast_inputs[1]));
+    g_assert (fast_inputs[2] == UFO_END_OF_STREAM);
+    g_assert (slow_inputs[2] == UFO_END_OF_STREAM);
+
+    ufo_group_push_input_buffers (fixture->group, fixture->fast, fast_inputs, 2);
+    ufo_group_push_input_buffers (fixture->group, fixture->slow, slow_inputs, 2);
+}
+
+static void
+test_slots (Fixture *fixture, gconstpointer data)
+{
+    UfoTask *stranger;
+    UfoBuffer *input;
+    gint slot;
+
+    stranger = UFO_TASK (ufo_dummy_task_new ());
+    g_assert_cmpint (ufo_group_get_slot (fixture->group, fixture->fast), ==, 0);
+    g_assert_cmpint (ufo_group_get_slot (fixture->group, fixture->slow), ==, 1);
+    g_assert_cmpint (ufo_group_get_slot (fixture->group, stranger), ==, -1);
+    g_object_unref (stranger);
+
+    /* Ties are broken starting after the first target, so this goes to the slow one */
+    send (fixture);
+    slot = ufo_group_get_slot (fixture->group, fixture->slow);
+    g_assert_cmpuint (ufo_group_pop_input_buffers_at (fixture->group, slot, &input, 1), ==, 1);
+    g_assert (UFO_IS_BUFFER (input));
+    ufo_group_push_input_buffers_at (fixture->group, slot, &input, 1);
+}
+
+static void
+test_readiness (Fixture *fixture, gconstpointer data)
+{
+    UfoBuffer *input;
+    guint fast;
+    guint slow;
+
+    fast = ufo_group_get_slot (fixture->group, fixture->fast);
+    slow = ufo_group_get_slot (fixture->group, fixture->slow);
+
+    g_assert (ufo_group_can_pop_output (fixture->group));
+    g_assert (!ufo_group_can_pop_input_at (fixture->group, fast));
+    g_assert (!ufo_group_can_pop_input_at (fixture->group, slow));
+
+    /* By default each target can have one more buffer than there are targets */
+    for (guint i = 0; i < 6; i++)
+        send (fixture);
+
+    g_assert (ufo_group_can_pop_input_at (fixture->group, fast));
+    g_assert (ufo_group_can_pop_input_at (fixture->group, slow));
+    g_assert (!ufo_group_can_pop_output (fixture->group));
+
+    ufo_group_pop_input_buffers_at (fixture->group, fast, &input, 1);
+    ufo_group_push_input_buffers_at (fixture->group, fast, &input, 1);
+    g_assert (ufo_group_can_pop_output (fixture->group));
+}
+
+static void
+test_end_of_stream (Fixture *fixture, gconstpointer data)
+{
+    UfoGroup *group;
+    GList *targets;
+    UfoBuffer *inputs[8];
+    UfoBuffer *buffer;
+
+    targets = g_list_append (NULL, fixture->fast);
+    group = ufo_group_new (targets, NULL, UFO_SEND_SEQUENTIAL);
+    ufo_group_set_num_expected (group, fixture->fast, 1);
+    ufo_group_set_queue_depth (group, fixture->fast, 2);
+    g_list_free (targets);
+
+    /* Each buffer ends the stream, the second one comes after the first end */
+    for (guint i = 0; i < 2; i++) {
+        buffer = ufo_group_pop_output_buffer (group, &fixture->requisition);
+        ufo_group_push_output_buffer (group, buffer);
+    }
+
+    g_assert (!ufo_group_can_pop_output (group));
+    g_assert_cmpuint (ufo_group_pop_input_buffers_at (group, 0, inputs, 8), ==, 2);
+    g_assert (UFO_IS_BUFFER (inputs[0]));
+    g_assert (inputs[1] == UFO_END_OF_STREAM);
+
+    /* The buffer behind the end went back to the producer */
+    g_assert (ufo_group_can_pop_output (group));
+    g_assert (ufo_group_pop_output_buffer (group, &fixture->requisition) != inputs[0]);
+
+    ufo_group_push_input_buffers_at (group, 0, inputs, 1);
+    g_object_unref (group);
+}
+
+static void
+test_shared_broadcast (Fixture *fixture, gconstpointer data)
+{
+    UfoGroup *group;
+    UfoTask *tasks[3];
+    GList *targets = NULL;
+    UfoBuffer *original;
+    UfoBuffer *inputs[3];
+
+    /* The writing target comes first and may only hold a single buffer */
+    tasks[0] = fixture->fast;
+    tasks[1] = UFO_TASK (g_object_new (test_reader_get_type (), NULL));
+    tasks[2] = UFO_TASK (g_object_new (test_reader_get_type (), NULL));
+
+    for (guint i = 0; i < 3; i++)
+        targets = g_list_append (targets, tasks[i]);
+
+    group = ufo_group_new (targets, NULL, UFO_SEND_BROADCAST);
+    g_list_free (targets);
+
+    for (guint i = 0; i < 3; i++)
+        ufo_group_set_queue_depth (group, tasks[i], 1);
+
+    for (guint round = 0; round < 3; round++) {
+        g_assert (ufo_group_can_pop_output (group));
+        original = ufo_group_pop_output_buffer (group, &fixture->requisition);
+        ufo_group_push_output_buffer (group, original);
+        g_assert (!ufo_group_can_pop_output (group));
+
+        for (guint i = 0; i < 3; i++)
+            g_assert_cmpuint (ufo_group_pop_input_buffers_at (group, i, &inputs[i], 1), ==, 1);
+
+        /* Readers share the original, the writer has a copy */
+        g_assert (inputs[1] == original);
+        g_assert (inputs[2] == original);
+        g_assert (inputs[0] != original);
+
+        for (guint i = 0; i < 3; i++)
+            ufo_group_push_input_buffers_at (group, i, &inputs[i], 1);
+    }
+
+    g_object_unref (group);
+    g_object_unref (tasks[1]);
+    g_object_unref (tasks[2]);
+}
+
+void
+test_add_group (void)
+{
+    g_test_add ("/no-opencl/group/dynamic",
+                Fixture, NULL,
+                setup, test_dynamic, teardown);
+
+    g_test_add ("/no-opencl/group/batched",
+                Fixture, NULL,
+                setup, test_batched, teardown);
+
+    g_test_add ("/no-opencl/group/slots",
+                Fixture, NULL,
+                setup, test_slots, teardown);
+
+    g_test_add ("/no-opencl/group/readiness",
+                Fixture, NULL,
+                setup, test_readiness, teardown);
+
+    g_test_add ("/no-opencl/group/end-of-stream",
+                Fixture, NULL,
+                setup, test_end_of_stream, teardown);
+
+    g_test_add ("/no-opencl/group/broadcast/shared",
+                Fixture, NULL,
+                setup, test_shared_broadcast, teardown);
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ufo/ufo.h>
+#include "ufo/ufo-merge.h"
+#include "ufo/ufo-priv.h"
+#include "test-suite.h"
+
+#define NO_SEQUENCE     G_MAXUINT64
+
+typedef struct {
+    UfoTask *target;
+    UfoGroup *groups[2];
+    UfoMerge *merge;
+    UfoRequisition requisition;
+} Fixture;
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    GList *targets;
+    UfoLink links[2];
+
+    fixture->target = UFO_TASK (ufo_dummy_task_new ());
+    targets = g_list_append (NULL, fixture->target);
+
+    /* Two expanded branches joining again at the same input */
+    for (guint i = 0; i < 2; i++) {
+        fixture->groups[i] = ufo_group_new (targets, NULL, UFO_SEND_SCATTER);
+        ufo_group_set_queue_depth (fixture->groups[i], fixture->target, 8);
+        links[i].group = fixture->groups[i];
+        links[i].slot = (guint) ufo_group_get_slot (fixture->groups[i], fixture->target);
+    }
+
+    fixture->merge = ufo_merge_new (links, 2);
+    fixture->requisition.n_dims = 1;
+    fixture->requisition.dims[0] = 8;
+
+    g_list_free (targets);
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    ufo_merge_free (fixture->merge);
+    g_object_unref (fixture->groups[0]);
+    g_object_unref (fixture->groups[1]);
+    g_object_unref (fixture->target);
+}
+
+static void
+send (Fixture *fixture,
+      guint branch,
+      guint64 sequence)
+{
+    UfoBuffer *buffer;
+
+    buffer = ufo_group_pop_output_buffer (fixture->groups[branch], &fixture->requisition);
+    ufo_buffer_clear_metadata (buffer);
+
+    if (sequence != NO_SEQUENCE) {
+        GValue value = {0};
+
+        g_value_init (&value, G_TYPE_UINT64);
+        g_value_set_uint64 (&value, sequence);
+        ufo_buffer_set_metadata (buffer, "sequence", &value);
+        g_value_unset (&value);
+    }
+
+    ufo_group_push_output_buffer (fixture->groups[branch], buffer);
+}
+
+static void
+finish (Fixture *fixture)
+{
+    ufo_group_finish (fixture->groups[0]);
+    ufo_group_finish (fixture->groups[1]);
+}
+
+/*
+ * Pop everything from the merge and check that the items arrive with
+ * @expected sequence numbers and then the end of stream.
+ */
+static void
+check_order (Fixture *fixture,
+             guint window,
+             const guint64 *expected,
+             guint n_expected)
+{
+    UfoLink *source;
+
+    for (guint i = 0; i < n_expected; i++) {
+        UfoBuffer *buffer;
+        GValue *value;
+
+        source = NULL;
+
+        buffer = ufo_merge_pop (fixture->merge, window, &source);
+        g_assert (UFO_IS_BUFFER (buffer));
+        g_assert (source != NULL);
+
+        value = ufo_buffer_get_metadata (buffer, "sequence");
+
+        if (expected[i] == NO_SEQUENCE)
+            g_assert (value == NULL);
+        else
+            g_assert_cmpuint (g_value_get_uint64 (value), ==, expected[i]);
+
+        ufo_group_push_input_buffers_at (source->group, source->slot, &buffer, 1);
+    }
+
+    g_assert (ufo_merge_poll (fixture->merge, window));
+    g_assert (ufo_merge_pop (fixture->merge, window, &source) == UFO_END_OF_STREAM);
+}
+
+static void
+test_unordered (Fixture *fixture, gconstpointer data)
+{
+    static const guint64 expected[] = { 0, 2, 1 };
+
+    send (fixture, 0, 0);
+    send (fixture, 0, 1);
+    send (fixture, 1, 2);
+    finish (fixture);
+
+    /* Without a window the branches are served in turn */
+    check_order (fixture, 0, expected, G_N_ELEMENTS (expected));
+}
+
+static void
+test_out_of_order (Fixture *fixture, gconstpointer data)
+{
+    static const guint64 expected[] = { 0, 1, 2, 3, 4 };
+
+    g_assert (!ufo_merge_poll (fixture->merge, 4));
+
+    send (fixture, 0, 1);
+    send (fixture, 0, 3);
+    send (fixture, 0, 4);
+
+    /* The first branch is ahead, so nothing can be emitted yet */
+    g_assert (!ufo_merge_poll (fixture->merge, 4));
+
+    send (fixture, 1, 0);
+    send (fixture, 1, 2);
+    g_assert (ufo_merge_poll (fixture->merge, 4));
+
+    finish (fixture);
+    check_order (fixture, 4, expected, G_N_ELEMENTS (expected));
+}
+
+static void
+test_window_overflow (Fixture *fixture, gconstpointer data)
+{
+    static const guint64 expected[] = { 1, 0, 2 };
+
+    send (fixture, 0, 1);
+    send (fixture, 1, 0);
+    send (fixture, 1, 2);
+    finish (fixture);
+
+    /* A window smaller than the number of branches cannot restore the order
+     * but must not lose anything */
+    check_order (fixture, 1, expected, G_N_ELEMENTS (expected));
+}
+
+static void
+test_missing_sequence (Fixture *fixture, gconstpointer data)
+{
+    static const guint64 expected[] = { NO_SEQUENCE, 0, 1 };
+
+    send (fixture, 0, NO_SEQUENCE);
+    send (fixture, 0, 1);
+    send (fixture, 1, 0);
+    finish (fixture);
+
+    /* Items that cannot be ordered are passed on right away */
+    check_order (fixture, 4, expected, G_N_ELEMENTS (expected));
+}
+
+static void
+test_end_while_held (Fixture *fixture, gconstpointer data)
+{
+    static const guint64 expected[] = { 2, 5, 6 };
+
+    send (fixture, 0, 2);
+    send (fixture, 1, 5);
+    send (fixture, 1, 6);
+    finish (fixture);
+
+    /* Numbers 0, 1, 3 and 4 never arrive, the held items still go out */
+    check_order (fixture, 4, expected, G_N_ELEMENTS (expected));
+}
+
+void
+test_add_merge (void)
+{
+    g_test_add ("/no-opencl/merge/unordered",
+                Fixture, NULL,
+                setup, test_unordered, teardown);
+
+    g_test_add ("/no-opencl/merge/ordered/out-of-order",
+                Fixture, NULL,
+                setup, test_out_of_order, teardown);
+
+    g_test_add ("/no-opencl/merge/ordered/window-overflow",
+                Fixture, NULL,
+                setup, test_window_overflow, teardown);
+
+    g_test_add ("/no-opencl/merge/ordered/missing-sequence",
+                Fixture, NULL,
+                setup, test_missing_sequence, teardown);
+
+    g_test_add ("/no-opencl/merge/ordered/end-while-held",
+                Fixture, NULL,
+                setup, test_end_while_held, teardown);
+}
@@ -17,7 +17,10 @@
  * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+#include <sched.h>
 #include <ufo/ufo.h>
+#include "ufo/ufo-priv.h"
 #include "test-suite.h"
 
 static void
@@ -55,6 +58,47 @@ test_copy (void)
     g_object_unref (copy);
 }
 
+#ifndef __APPLE__
+static void
+test_cpu_list (void)
+{
+    cpu_set_t mask;
+
+    ufo_parse_cpu_list ("0-3,8,10-11", &mask);
+    g_assert_cmpint (CPU_COUNT (&mask), ==, 7);
+
+    for (guint cpu = 0; cpu < 16; cpu++) {
+        gboolean expected = cpu <= 3 || cpu == 8 || cpu == 10 || cpu == 11;
+        g_assert_cmpint (CPU_ISSET (cpu, &mask) ? 1 : 0, ==, expected ? 1 : 0);
+    }
+
+    /* Memory-only nodes have an empty list */
+    ufo_parse_cpu_list ("", &mask);
+    g_assert_cmpint (CPU_COUNT (&mask), ==, 0);
+}
+#endif
+
+static void
+test_closest_numa_node (void)
+{
+    /* Two sockets with two nodes each, node 0 has no usable CPUs */
+    const guint distances[] = {
+        10, 12, 20, 20,
+        12, 10, 20, 20,
+        20, 20, 10, 12,
+        20, 20, 12, 10,
+    };
+    const guint candidates[] = { 1, 2, 3 };
+
+    g_assert_cmpint (ufo_find_closest_numa_index (distances, 4, 0, candidates, 3), ==, 0);
+    g_assert_cmpint (ufo_find_closest_numa_index (distances, 4, 1, candidates, 3), ==, 0);
+    g_assert_cmpint (ufo_find_closest_numa_index (distances, 4, 3, candidates, 3), ==, 2);
+
+    /* Equally far nodes resolve to the first candidate */
+    g_assert_cmpint (ufo_find_closest_numa_index (distances, 4, 0, &candidates[1], 2), ==, 0);
+    g_assert_cmpint (ufo_find_closest_numa_index (distances, 4, 0, candidates, 0), ==, -1);
+}
+
 void
 test_add_node (void)
 {
@@ -63,4 +107,12 @@ test_add_node (void)
 
     g_test_add_func ("/no-opencl/node/copy",
                      test_copy);
+
+#ifndef __APPLE__
+    g_test_add_func ("/no-opencl/node/cpu/cpu-list",
+                     test_cpu_list);
+#endif
+
+    g_test_add_func ("/no-opencl/node/cpu/closest-numa-node",
+                     test_closest_numa_node);
 }
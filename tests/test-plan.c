@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib/gstdio.h>
+#include <ufo/ufo.h>
+#include "ufo/ufo-plan.h"
+#include "test-suite.h"
+
+typedef struct {
+    UfoPluginManager *manager;
+    UfoTaskGraph *graph;
+    UfoTaskNode *source;
+    UfoTaskNode *target;
+    gchar *dir;
+    gchar *filename;
+    gchar *plan_filename;
+} Fixture;
+
+static const gchar *graph_json =
+    "{\"nodes\": [{\"plugin\": \"[dummy]\", \"name\": \"source\"},"
+    "             {\"plugin\": \"[dummy]\", \"name\": \"target\"}],"
+    " \"edges\": [{\"from\": {\"name\": \"source\"}, \"to\": {\"name\": \"target\"}}]}";
+
+static UfoTaskNode *
+get_node (UfoTaskGraph *graph,
+          const gchar *name)
+{
+    UfoTaskNode *result = NULL;
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    for (it = g_list_first (nodes); it != NULL; it = g_list_next (it)) {
+        if (!g_strcmp0 (ufo_task_node_get_identifier (UFO_TASK_NODE (it->data)), name))
+            result = UFO_TASK_NODE (it->data);
+    }
+
+    g_list_free (nodes);
+    g_assert (result != NULL);
+    return result;
+}
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    GError *error = NULL;
+
+    fixture->dir = g_dir_make_tmp ("ufo-plan-XXXXXX", &error);
+    g_assert_no_error (error);
+
+    fixture->filename = g_build_filename (fixture->dir, "graph.json", NULL);
+    fixture->plan_filename = g_strdup_printf ("%s.plan", fixture->filename);
+    g_file_set_contents (fixture->filename, graph_json, -1, &error);
+    g_assert_no_error (error);
+
+    fixture->manager = ufo_plugin_manager_new ();
+    fixture->graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    ufo_task_graph_read_from_file (fixture->graph, fixture->manager, fixture->filename, &error);
+    g_assert_no_error (error);
+
+    fixture->source = get_node (fixture->graph, "source");
+    fixture->target = get_node (fixture->graph, "target");
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    g_object_unref (fixture->graph);
+    g_object_unref (fixture->manager);
+
+    g_unlink (fixture->plan_filename);
+    g_unlink (fixture->filename);
+    g_rmdir (fixture->dir);
+
+    g_free (fixture->plan_filename);
+    g_free (fixture->filename);
+    g_free (fixture->dir);
+}
+
+static void
+test_save_load (Fixture *fixture, gconstpointer data)
+{
+    UfoPlan *plan;
+    GError *error = NULL;
+
+    ufo_task_node_set_queue_depth (fixture->target, 0, 4);
+
+    plan = ufo_plan_new (fixture->graph);
+    g_assert (!ufo_plan_load (plan));
+    ufo_plan_save (plan, &error);
+    g_assert_no_error (error);
+    ufo_plan_free (plan);
+
+    /* The plan is kept next to the graph */
+    g_assert (g_file_test (fixture->plan_filename, G_FILE_TEST_EXISTS));
+
+    ufo_task_node_set_queue_depth (fixture->target, 0, 2);
+
+    plan = ufo_plan_new (fixture->graph);
+    g_assert (ufo_plan_load (plan));
+    ufo_plan_apply (plan);
+    g_assert_cmpuint (ufo_task_node_get_queue_depth (fixture->target, 0), ==, 4);
+
+    /* Without a refined run, all GPUs are used */
+    g_assert_cmpuint (ufo_plan_get_copies (plan, 3), ==, 3);
+    ufo_plan_free (plan);
+}
+
+static void
+test_changed_graph (Fixture *fixture, gconstpointer data)
+{
+    UfoTaskNode *sink;
+    UfoPlan *plan;
+    GError *error = NULL;
+
+    plan = ufo_plan_new (fixture->graph);
+    ufo_plan_save (plan, &error);
+    g_assert_no_error (error);
+    ufo_plan_free (plan);
+
+    sink = UFO_TASK_NODE (ufo_dummy_task_new ());
+    ufo_task_graph_connect_nodes (fixture->graph, fixture->target, sink);
+
+    /* The sidecar of the old graph does not fit anymore */
+    plan = ufo_plan_new (fixture->graph);
+    g_assert (!ufo_plan_load (plan));
+    ufo_plan_free (plan);
+
+    g_object_unref (sink);
+}
+
+static void
+test_refine (Fixture *fixture, gconstpointer data)
+{
+    UfoProfiler *producer;
+    UfoProfiler *consumer;
+    UfoPlan *plan;
+    GError *error = NULL;
+    gdouble time;
+
+    producer = ufo_task_node_get_profiler (fixture->source);
+    consumer = ufo_task_node_get_profiler (fixture->target);
+
+    /* Source waits for room while target waits for data */
+    ufo_profiler_start (producer, UFO_PROFILER_TIMER_BLOCKED);
+    ufo_profiler_start (consumer, UFO_PROFILER_TIMER_FETCH);
+    g_usleep (G_USEC_PER_SEC / 100);
+    ufo_profiler_stop (producer, UFO_PROFILER_TIMER_BLOCKED);
+    ufo_profiler_stop (consumer, UFO_PROFILER_TIMER_FETCH);
+
+    time = 2 * ufo_profiler_elapsed (producer, UFO_PROFILER_TIMER_BLOCKED);
+
+    plan = ufo_plan_new (fixture->graph);
+    ufo_plan_refine (plan, fixture->graph, 0, 1, time);
+    ufo_plan_save (plan, &error);
+    g_assert_no_error (error);
+    ufo_plan_free (plan);
+
+    /* The edge had the default depth of two, so it doubles to four */
+    plan = ufo_plan_new (fixture->graph);
+    g_assert (ufo_plan_load (plan));
+    ufo_plan_apply (plan);
+    g_assert_cmpuint (ufo_task_node_get_queue_depth (fixture->target, 0), ==, 4);
+    ufo_plan_free (plan);
+}
+
+void
+test_add_plan (void)
+{
+    g_test_add ("/no-opencl/plan/save-load",
+                Fixture, NULL,
+                setup, test_save_load, teardown);
+
+    g_test_add ("/no-opencl/plan/changed-graph",
+                Fixture, NULL,
+                setup, test_changed_graph, teardown);
+
+    g_test_add ("/no-opencl/plan/refine",
+                Fixture, NULL,
+                setup, test_refine, teardown);
+}
@@ -47,8 +47,12 @@ int main(int argc, char *argv[])
 
     test_add_buffer ();
     test_add_graph ();
+    test_add_group ();
+    test_add_merge ();
+    test_add_plan ();
     test_add_profiler ();
     test_add_node ();
+    test_add_two_way_queue ();
 
 #ifdef WITH_MPI
     int provided;
@@ -22,8 +22,12 @@
 
 void test_add_buffer (void);
 void test_add_graph (void);
+void test_add_group (void);
+void test_add_merge (void);
 void test_add_node (void);
+void test_add_plan (void);
 void test_add_profiler (void);
+void test_add_two_way_queue (void);
 void test_add_mpi_remote_node (void);
 void test_add_zmq_messenger (void);
 
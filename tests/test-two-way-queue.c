@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <glib.h>
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+#define N_ITEMS     100000
+#define CAPACITY    4
+
+typedef struct {
+    UfoTwoWayQueue *queue;
+} Fixture;
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    GList *init = NULL;
+
+    g_setenv ("UFO_TWO_WAY_QUEUE", (const gchar *) data, TRUE);
+
+    for (guint i = 0; i < CAPACITY; i++)
+        init = g_list_append (init, GUINT_TO_POINTER (i + 1));
+
+    fixture->queue = ufo_two_way_queue_new (init);
+    g_list_free (init);
+    g_unsetenv ("UFO_TWO_WAY_QUEUE");
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    ufo_two_way_queue_free (fixture->queue);
+}
+
+static gpointer
+produce (UfoTwoWayQueue *queue)
+{
+    for (guint i = 0; i < N_ITEMS; i++)
+        ufo_two_way_queue_producer_push (queue, ufo_two_way_queue_producer_pop (queue));
+
+    return NULL;
+}
+
+static void
+test_pass_items (Fixture *fixture, gconstpointer data)
+{
+    GThread *thread;
+    guint next = 1;
+
+    thread = g_thread_create ((GThreadFunc) produce, fixture->queue, TRUE, NULL);
+    g_assert (thread != NULL);
+
+    /* A single producer and consumer keep the items in insertion order */
+    for (guint i = 0; i < N_ITEMS; i++) {
+        gpointer item;
+
+        item = ufo_two_way_queue_consumer_pop (fixture->queue);
+        g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, next);
+        next = next == CAPACITY ? 1 : next + 1;
+        ufo_two_way_queue_consumer_push (fixture->queue, item);
+    }
+
+    g_thread_join (thread);
+    g_assert_cmpuint (ufo_two_way_queue_get_capacity (fixture->queue), ==, CAPACITY);
+}
+
+static gpointer
+produce_many (UfoTwoWayQueue *queue)
+{
+    gpointer items[CAPACITY];
+    guint n_items = 0;
+
+    while (n_items < N_ITEMS) {
+        guint n;
+
+        n = ufo_two_way_queue_producer_pop_many (queue, items, MIN (CAPACITY, N_ITEMS - n_items));
+        ufo_two_way_queue_producer_push_many (queue, items, n);
+        n_items += n;
+    }
+
+    return NULL;
+}
+
+static void
+test_pass_many (Fixture *fixture, gconstpointer data)
+{
+    GThread *thread;
+    gpointer items[CAPACITY];
+    guint n_items = 0;
+    guint next = 1;
+
+    thread = g_thread_create ((GThreadFunc) produce_many, fixture->queue, TRUE, NULL);
+    g_assert (thread != NULL);
+
+    while (n_items < N_ITEMS) {
+        guint n;
+
+        n = ufo_two_way_queue_consumer_pop_many (fixture->queue, items, CAPACITY);
+        g_assert_cmpuint (n, >=, 1);
+        g_assert_cmpuint (n, <=, CAPACITY);
+
+        for (guint i = 0; i < n; i++) {
+            g_assert_cmpuint (GPOINTER_TO_UINT (items[i]), ==, next);
+            next = next == CAPACITY ? 1 : next + 1;
+        }
+
+        ufo_two_way_queue_consumer_push_many (fixture->queue, items, n);
+        n_items += n;
+    }
+
+    g_thread_join (thread);
+
+    /* Nothing is in flight anymore, so all items are available at once */
+    g_assert_cmpuint (ufo_two_way_queue_producer_pop_many (fixture->queue, items, CAPACITY), ==, CAPACITY);
+}
+
+static void
+test_insert (Fixture *fixture, gconstpointer data)
+{
+    ufo_two_way_queue_insert (fixture->queue, GUINT_TO_POINTER (CAPACITY + 1));
+    g_assert_cmpuint (ufo_two_way_queue_get_capacity (fixture->queue), ==, CAPACITY + 1);
+    g_assert_cmpuint (g_list_length (ufo_two_way_queue_get_inserted (fixture->queue)), ==, CAPACITY + 1);
+
+    for (guint i = 0; i < CAPACITY + 1; i++) {
+        gpointer item;
+
+        item = ufo_two_way_queue_producer_pop (fixture->queue);
+        g_assert_cmpuint (GPOINTER_TO_UINT (item), ==, i + 1);
+        ufo_two_way_queue_producer_push (fixture->queue, item);
+    }
+
+    for (guint i = 0; i < CAPACITY + 1; i++)
+        g_assert_cmpuint (GPOINTER_TO_UINT (ufo_two_way_queue_consumer_pop (fixture->queue)), ==, i + 1);
+}
+
+static void
+test_grow (Fixture *fixture, gconstpointer data)
+{
+    UfoTwoWayQueue *queue;
+    GList *init = NULL;
+
+    g_setenv ("UFO_TWO_WAY_QUEUE", "ring", TRUE);
+    g_setenv ("UFO_TWO_WAY_QUEUE_SIZE", "2", TRUE);
+
+    for (guint i = 0; i < CAPACITY; i++)
+        init = g_list_append (init, GUINT_TO_POINTER (i + 1));
+
+    /* More items than ring slots grow the rings */
+    queue = ufo_two_way_queue_new (init);
+    g_list_free (init);
+    g_unsetenv ("UFO_TWO_WAY_QUEUE");
+    g_unsetenv ("UFO_TWO_WAY_QUEUE_SIZE");
+
+    g_assert_cmpuint (ufo_two_way_queue_get_capacity (queue), ==, CAPACITY);
+
+    for (guint i = 0; i < CAPACITY; i++)
+        ufo_two_way_queue_producer_push (queue, ufo_two_way_queue_producer_pop (queue));
+
+    for (guint i = 0; i < CAPACITY; i++)
+        g_assert_cmpuint (GPOINTER_TO_UINT (ufo_two_way_queue_consumer_pop (queue)), ==, i + 1);
+
+    ufo_two_way_queue_free (queue);
+}
+
+static void
+test_reserve (Fixture *fixture, gconstpointer data)
+{
+    /* Too large for rings, items must survive switching to GAsyncQueue */
+    ufo_two_way_queue_reserve (fixture->queue, 1 << 20);
+
+    for (guint i = 0; i < CAPACITY; i++)
+        ufo_two_way_queue_producer_push (fixture->queue, ufo_two_way_queue_producer_pop (fixture->queue));
+
+    for (guint i = 0; i < CAPACITY; i++)
+        g_assert_cmpuint (GPOINTER_TO_UINT (ufo_two_way_queue_consumer_pop (fixture->queue)), ==, i + 1);
+
+    g_assert (!ufo_two_way_queue_consumer_can_pop (fixture->queue));
+}
+
+void
+test_add_two_way_queue (void)
+{
+    g_test_add ("/no-opencl/two-way-queue/async/pass-items",
+                Fixture, "async",
+                setup, test_pass_items, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/async/pass-many",
+                Fixture, "async",
+                setup, test_pass_many, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/async/insert",
+                Fixture, "async",
+                setup, test_insert, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/ring/pass-items",
+                Fixture, "ring",
+                setup, test_pass_items, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/ring/pass-many",
+                Fixture, "ring",
+                setup, test_pass_many, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/ring/insert",
+                Fixture, "ring",
+                setup, test_insert, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/ring/grow",
+                Fixture, "ring",
+                setup, test_grow, teardown);
+
+    g_test_add ("/no-opencl/two-way-queue/ring/reserve",
+                Fixture, "ring",
+                setup, test_reserve, teardown);
+}
@@ -60,17 +60,27 @@ struct _UfoBaseSchedulerPrivate {
     UfoResources    *resources;
     GList           *gpu_nodes;
     gboolean         expand;
+    gboolean         fuse;
+    gboolean         tune;
     gboolean         trace;
     gboolean         ran;
     gboolean         timestamps;
+    guint            batch_size;
+    guint            reorder_window;
+    guint            n_workers;
     gdouble          time;
 };
 
 enum {
     PROP_0,
     PROP_EXPAND,
+    PROP_FUSE,
+    PROP_TUNE,
     PROP_ENABLE_TRACING,
     PROP_TIMESTAMPS,
+    PROP_BATCH_SIZE,
+    PROP_REORDER_WINDOW,
+    PROP_WORKERS,
     PROP_TIME,
     N_PROPERTIES,
 };
@@ -236,6 +246,14 @@ ufo_base_scheduler_set_property (GObject *object,
             priv->expand = g_value_get_boolean (value);
             break;
 
+        case PROP_FUSE:
+            priv->fuse = g_value_get_boolean (value);
+            break;
+
+        case PROP_TUNE:
+            priv->tune = g_value_get_boolean (value);
+            break;
+
         case PROP_ENABLE_TRACING:
             priv->trace = g_value_get_boolean (value);
             break;
@@ -244,6 +262,18 @@ ufo_base_scheduler_set_property (GObject *object,
             priv->timestamps = g_value_get_boolean (value);
             break;
 
+        case PROP_BATCH_SIZE:
+            priv->batch_size = g_value_get_uint (value);
+            break;
+
+        case PROP_REORDER_WINDOW:
+            priv->reorder_window = g_value_get_uint (value);
+            break;
+
+        case PROP_WORKERS:
+            priv->n_workers = g_value_get_uint (value);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
             break;
@@ -263,6 +293,14 @@ ufo_base_scheduler_get_property (GObject *object,
             g_value_set_boolean (value, priv->expand);
             break;
 
+        case PROP_FUSE:
+            g_value_set_boolean (value, priv->fuse);
+            break;
+
+        case PROP_TUNE:
+            g_value_set_boolean (value, priv->tune);
+            break;
+
         case PROP_ENABLE_TRACING:
             g_value_set_boolean (value, priv->trace);
             break;
@@ -271,6 +309,18 @@ ufo_base_scheduler_get_property (GObject *object,
             g_value_set_boolean (value, priv->timestamps);
             break;
 
+        case PROP_BATCH_SIZE:
+            g_value_set_uint (value, priv->batch_size);
+            break;
+
+        case PROP_REORDER_WINDOW:
+            g_value_set_uint (value, priv->reorder_window);
+            break;
+
+        case PROP_WORKERS:
+            g_value_set_uint (value, priv->n_workers);
+            break;
+
         case PROP_TIME:
             g_value_set_double (value, priv->time);
             break;
@@ -361,6 +411,20 @@ ufo_base_scheduler_class_init (UfoBaseSchedulerClass *klass)
                               TRUE,
                               G_PARAM_READWRITE);
 
+    properties[PROP_FUSE] =
+        g_param_spec_boolean ("fuse",
+                              "Fuse chains of tasks on the same device to run in one thread",
+                              "Fuse chains of tasks on the same device to run in one thread",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
+    properties[PROP_TUNE] =
+        g_param_spec_boolean ("tune",
+                              "Tune expansion and queue depths from profiles of previous runs",
+                              "Tune expansion and queue depths from profiles of previous runs of the same graph",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
     properties[PROP_ENABLE_TRACING] =
         g_param_spec_boolean ("enable-tracing",
                               "Enable and write profile traces",
@@ -375,6 +439,27 @@ ufo_base_scheduler_class_init (UfoBaseSchedulerClass *klass)
                               FALSE,
                               G_PARAM_READWRITE);
 
+    properties[PROP_BATCH_SIZE] =
+        g_param_spec_uint ("batch-size",
+                           "Number of frames combined for batch-capable tasks",
+                           "Number of frames combined for batch-capable tasks",
+                           1, G_MAXUINT, 1,
+                           G_PARAM_READWRITE);
+
+    properties[PROP_REORDER_WINDOW] =
+        g_param_spec_uint ("reorder-window",
+                           "Number of items held back to restore the order of merged branches",
+                           "Number of items held back to restore the order of merged branches, 0 disables reordering",
+                           0, G_MAXUINT, 0,
+                           G_PARAM_READWRITE);
+
+    properties[PROP_WORKERS] =
+        g_param_spec_uint ("workers",
+                           "Number of worker threads that run the tasks",
+                           "Number of worker threads that run the tasks, 0 runs each task in its own thread and UFO_BASE_SCHEDULER_AUTO_WORKERS starts one per processor",
+                           0, G_MAXUINT, 0,
+                           G_PARAM_READWRITE);
+
     properties[PROP_TIME] =
         g_param_spec_double ("time",
                              "Finished execution time",
@@ -395,8 +480,13 @@ ufo_base_scheduler_init (UfoBaseScheduler *scheduler)
 
     scheduler->priv = priv = UFO_BASE_SCHEDULER_GET_PRIVATE (scheduler);
     priv->expand = TRUE;
+    priv->fuse = FALSE;
+    priv->tune = FALSE;
     priv->trace = FALSE;
     priv->timestamps = FALSE;
+    priv->batch_size = 1;
+    priv->reorder_window = 0;
+    priv->n_workers = 0;
     priv->ran = FALSE;
     priv->time = 0.0;
     priv->gpu_nodes = NULL;
@@ -37,6 +37,14 @@ G_BEGIN_DECLS
 
 #define UFO_BASE_SCHEDULER_ERROR            ufo_base_scheduler_error_quark()
 
+/**
+ * UFO_BASE_SCHEDULER_AUTO_WORKERS:
+ *
+ * Value of the #UfoBaseScheduler:workers property that starts one worker per
+ * processor.
+ */
+#define UFO_BASE_SCHEDULER_AUTO_WORKERS     G_MAXUINT
+
 typedef struct _UfoBaseScheduler           UfoBaseScheduler;
 typedef struct _UfoBaseSchedulerClass      UfoBaseSchedulerClass;
 typedef struct _UfoBaseSchedulerPrivate    UfoBaseSchedulerPrivate;
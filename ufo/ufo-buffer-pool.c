@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ufo/ufo-buffer-pool.h>
+#include "ufo-memory.h"
+#include "ufo-priv.h"
+
+/**
+ * SECTION:ufo-buffer-pool
+ * @Short_description: Re-use buffers across groups and scheduler runs
+ * @Title: UfoBufferPool
+ *
+ * A #UfoBufferPool keeps released #UfoBuffer objects around so that subsequent
+ * requests for buffers of a similar size and OpenCL context can be served
+ * without allocating host and device memory again. Buffers are grouped in
+ * power-of-two size classes of their capacity per cl_context, and a request is
+ * served by any buffer of its class that is large enough to hold it.
+ *
+ * The process-wide pool returned by ufo_buffer_pool_get_default() is used by
+ * #UfoGroup, #UfoOutputTask and ufo_buffer_dup(). Its size can be limited with
+ * the <envar>UFO_BUFFER_POOL_MAX_BYTES</envar> environment variable.
+ */
+
+#define MIN_SIZE_CLASS  4096
+
+typedef struct {
+    gpointer context;
+    gsize size_class;
+} PoolKey;
+
+struct _UfoBufferPool {
+    GMutex *lock;
+    GHashTable *buckets;
+    gsize max_bytes;
+    UfoBufferPoolStats stats;
+};
+
+static guint
+pool_key_hash (const PoolKey *key)
+{
+    return g_direct_hash (key->context) ^ ((guint) key->size_class);
+}
+
+static gboolean
+pool_key_equal (const PoolKey *a,
+                const PoolKey *b)
+{
+    return a->context == b->context && a->size_class == b->size_class;
+}
+
+static void
+free_bucket (GQueue *bucket)
+{
+    g_queue_foreach (bucket, (GFunc) g_object_unref, NULL);
+    g_queue_free (bucket);
+}
+
+static gsize
+get_size_class (gsize size)
+{
+    gsize size_class = MIN_SIZE_CLASS;
+
+    while (size_class < size)
+        size_class <<= 1;
+
+    return size_class;
+}
+
+static gsize
+compute_required_size (UfoRequisition *requisition)
+{
+    gsize size = sizeof (gfloat);
+
+    for (guint i = 0; i < requisition->n_dims; i++)
+        size *= requisition->dims[i];
+
+    return size;
+}
+
+static gboolean
+requisition_equal (UfoBuffer *buffer,
+                   UfoRequisition *requisition)
+{
+    UfoRequisition other;
+
+    ufo_buffer_get_requisition (buffer, &other);
+
+    if (other.n_dims != requisition->n_dims)
+        return FALSE;
+
+    for (guint i = 0; i < other.n_dims; i++) {
+        if (other.dims[i] != requisition->dims[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * ufo_buffer_pool_get_default: (skip)
+ *
+ * Get the process-wide buffer pool.
+ *
+ * Returns: The default #UfoBufferPool. It must not be freed.
+ */
+UfoBufferPool *
+ufo_buffer_pool_get_default (void)
+{
+    static gsize initialized = 0;
+    static UfoBufferPool *pool = NULL;
+
+    if (g_once_init_enter (&initialized)) {
+        const gchar *var;
+        gsize max_bytes = 0;
+
+        var = g_getenv ("UFO_BUFFER_POOL_MAX_BYTES");
+
+        if (var != NULL)
+            max_bytes = (gsize) g_ascii_strtoull (var, NULL, 10);
+
+        pool = ufo_buffer_pool_new (max_bytes);
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return pool;
+}
+
+/**
+ * ufo_buffer_pool_new: (skip)
+ * @max_bytes: Maximum number of bytes held by the pool or 0 for no limit
+ *
+ * Create a new buffer pool.
+ *
+ * Returns: A new #UfoBufferPool.
+ */
+UfoBufferPool *
+ufo_buffer_pool_new (gsize max_bytes)
+{
+    UfoBufferPool *pool = g_new0 (UfoBufferPool, 1);
+
+    pool->lock = g_mutex_new ();
+    pool->buckets = g_hash_table_new_full ((GHashFunc) pool_key_hash,
+                                           (GEqualFunc) pool_key_equal,
+                                           g_free, (GDestroyNotify) free_bucket);
+    pool->max_bytes = max_bytes;
+
+    return pool;
+}
+
+void
+ufo_buffer_pool_free (UfoBufferPool *pool)
+{
+    g_return_if_fail (pool != NULL && pool != ufo_buffer_pool_get_default ());
+
+    g_hash_table_destroy (pool->buckets);
+    g_mutex_free (pool->lock);
+    g_free (pool);
+}
+
+/**
+ * ufo_buffer_pool_acquire: (skip)
+ * @pool: A #UfoBufferPool
+ * @requisition: Size of the requested buffer
+ * @context: (allow-none): cl_context of the requested buffer
+ *
+ * Take a buffer out of @pool that is large enough to hold @requisition and
+ * belongs to @context. If no such buffer is available, a new one is created.
+ * The returned buffer has @requisition as its size and a single frame. Its
+ * contents are undefined and its location is %UFO_BUFFER_LOCATION_INVALID.
+ *
+ * Returns: (transfer full): A #UfoBuffer that should be given back with
+ * ufo_buffer_pool_release().
+ */
+UfoBuffer *
+ufo_buffer_pool_acquire (UfoBufferPool *pool,
+                         UfoRequisition *requisition,
+                         gpointer context)
+{
+    UfoBuffer *buffer = NULL;
+    GQueue *bucket;
+    PoolKey key;
+    gsize size;
+
+    g_return_val_if_fail (pool != NULL && requisition != NULL, NULL);
+
+    size = compute_required_size (requisition);
+    key.context = context;
+    key.size_class = get_size_class (size);
+
+    g_mutex_lock (pool->lock);
+
+    bucket = g_hash_table_lookup (pool->buckets, &key);
+
+    if (bucket != NULL) {
+        GList *it;
+        GList *candidate = NULL;
+        gsize best = G_MAXSIZE;
+
+        /* Prefer a buffer with exactly the same shape so we do not even have
+         * to touch it, otherwise take the smallest one that is large enough. */
+        for (it = bucket->head; it != NULL; it = g_list_next (it)) {
+            UfoBuffer *pooled = UFO_BUFFER (it->data);
+            gsize capacity = ufo_buffer_get_capacity (pooled);
+
+            if (capacity < size)
+                continue;
+
+            if (requisition_equal (pooled, requisition)) {
+                candidate = it;
+                break;
+            }
+
+            if (capacity < best) {
+                best = capacity;
+                candidate = it;
+            }
+        }
+
+        if (candidate != NULL) {
+            buffer = UFO_BUFFER (candidate->data);
+            g_queue_delete_link (bucket, candidate);
+            pool->stats.n_held--;
+            pool->stats.bytes_held -= ufo_buffer_get_capacity (buffer);
+        }
+    }
+
+    if (buffer != NULL)
+        pool->stats.hits++;
+    else
+        pool->stats.misses++;
+
+    g_mutex_unlock (pool->lock);
+
+    if (buffer == NULL)
+        return ufo_buffer_new (requisition, context);
+
+    /* The capacity suffices, so resizing keeps the storage */
+    ufo_buffer_set_n_frames (buffer, 1);
+
+    if (!requisition_equal (buffer, requisition))
+        ufo_buffer_resize (buffer, requisition);
+
+    ufo_buffer_reset_location (buffer);
+
+    return buffer;
+}
+
+/**
+ * ufo_buffer_pool_release: (skip)
+ * @pool: A #UfoBufferPool
+ * @buffer: (transfer full): A #UfoBuffer
+ *
+ * Give @buffer back to @pool. The reference of the caller is transferred to the
+ * pool. If somebody else still holds a reference to @buffer or the pool is
+ * full, @buffer is unreferenced instead. Metadata of @buffer is removed.
+ */
+void
+ufo_buffer_pool_release (UfoBufferPool *pool,
+                         UfoBuffer *buffer)
+{
+    GQueue *bucket;
+    PoolKey key;
+    gsize size;
+
+    g_return_if_fail (pool != NULL && UFO_IS_BUFFER (buffer));
+
+    /* Other threads may drop their references concurrently */
+    if (g_atomic_int_get (&G_OBJECT (buffer)->ref_count) > 1) {
+        g_object_unref (buffer);
+        return;
+    }
+
+    size = ufo_buffer_get_capacity (buffer);
+    ufo_buffer_clear_metadata (buffer);
+
+    g_mutex_lock (pool->lock);
+
+    if (pool->max_bytes > 0 && pool->stats.bytes_held + size > pool->max_bytes) {
+        g_mutex_unlock (pool->lock);
+        g_object_unref (buffer);
+        return;
+    }
+
+    key.context = ufo_buffer_get_context (buffer);
+    key.size_class = get_size_class (size);
+    bucket = g_hash_table_lookup (pool->buckets, &key);
+
+    if (bucket == NULL) {
+        PoolKey *new_key = g_new0 (PoolKey, 1);
+
+        *new_key = key;
+        bucket = g_queue_new ();
+        g_hash_table_insert (pool->buckets, new_key, bucket);
+    }
+
+    g_queue_push_head (bucket, buffer);
+    pool->stats.n_held++;
+    pool->stats.bytes_held += size;
+
+    g_mutex_unlock (pool->lock);
+}
+
+typedef struct {
+    UfoBufferPool *pool;
+    gpointer context;
+} DrainData;
+
+static gboolean
+remove_context (PoolKey *key,
+                GQueue *bucket,
+                DrainData *data)
+{
+    GList *it;
+
+    if (key->context != data->context)
+        return FALSE;
+
+    for (it = bucket->head; it != NULL; it = g_list_next (it)) {
+        data->pool->stats.n_held--;
+        data->pool->stats.bytes_held -= ufo_buffer_get_capacity (UFO_BUFFER (it->data));
+    }
+
+    return TRUE;
+}
+
+/**
+ * ufo_buffer_pool_drain: (skip)
+ * @pool: A #UfoBufferPool
+ * @context: (allow-none): A cl_context
+ *
+ * Release all buffers held by @pool that belong to @context. This must be
+ * called before @context is released.
+ */
+void
+ufo_buffer_pool_drain (UfoBufferPool *pool,
+                       gpointer context)
+{
+    DrainData data;
+
+    g_return_if_fail (pool != NULL);
+
+    data.pool = pool;
+    data.context = context;
+
+    g_mutex_lock (pool->lock);
+    g_hash_table_foreach_remove (pool->buckets, (GHRFunc) remove_context, &data);
+    g_mutex_unlock (pool->lock);
+}
+
+/*
+ * Drop stale host copies of device-resident buffers held by @pool until
+ * another @n_bytes fit into the host memory budget. Pooled buffers are not
+ * used by anyone else, so their host arrays can be released safely.
+ */
+void
+ufo_buffer_pool_discard_host_arrays (UfoBufferPool *pool,
+                                     gsize n_bytes)
+{
+    GHashTableIter iter;
+    GQueue *bucket;
+    gsize discarded = 0;
+
+    g_return_if_fail (pool != NULL);
+
+    g_mutex_lock (pool->lock);
+    g_hash_table_iter_init (&iter, pool->buckets);
+
+    while (ufo_memory_exceeds_budget (NULL, n_bytes) &&
+           g_hash_table_iter_next (&iter, NULL, (gpointer *) &bucket)) {
+        GList *it;
+
+        /* Start with the least recently released buffers */
+        for (it = bucket->tail; it != NULL; it = g_list_previous (it)) {
+            discarded += ufo_buffer_discard_host_array (UFO_BUFFER (it->data));
+
+            if (!ufo_memory_exceeds_budget (NULL, n_bytes))
+                break;
+        }
+    }
+
+    g_mutex_unlock (pool->lock);
+
+    if (discarded > 0)
+        g_debug ("Discarded %3.2f MB of stale host memory", discarded / 1024. / 1024.);
+}
+
+/**
+ * ufo_buffer_pool_clear: (skip)
+ * @pool: A #UfoBufferPool
+ *
+ * Release all buffers held by @pool.
+ */
+void
+ufo_buffer_pool_clear (UfoBufferPool *pool)
+{
+    g_return_if_fail (pool != NULL);
+
+    g_mutex_lock (pool->lock);
+    g_hash_table_remove_all (pool->buckets);
+    pool->stats.n_held = 0;
+    pool->stats.bytes_held = 0;
+    g_mutex_unlock (pool->lock);
+}
+
+/**
+ * ufo_buffer_pool_set_max_bytes: (skip)
+ * @pool: A #UfoBufferPool
+ * @max_bytes: Maximum number of bytes held by the pool or 0 for no limit
+ *
+ * Limit the amount of memory that @pool keeps around. Already pooled buffers
+ * are not released if they exceed the new limit.
+ */
+void
+ufo_buffer_pool_set_max_bytes (UfoBufferPool *pool,
+                               gsize max_bytes)
+{
+    g_return_if_fail (pool != NULL);
+
+    g_mutex_lock (pool->lock);
+    pool->max_bytes = max_bytes;
+    g_mutex_unlock (pool->lock);
+}
+
+/**
+ * ufo_buffer_pool_get_stats: (skip)
+ * @pool: A #UfoBufferPool
+ * @stats: (out): Location to store the current counters
+ *
+ * Get a snapshot of the hit, miss and occupancy counters of @pool.
+ */
+void
+ufo_buffer_pool_get_stats (UfoBufferPool *pool,
+                           UfoBufferPoolStats *stats)
+{
+    g_return_if_fail (pool != NULL && stats != NULL);
+
+    g_mutex_lock (pool->lock);
+    *stats = pool->stats;
+    g_mutex_unlock (pool->lock);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UFO_BUFFER_POOL_H
+#define __UFO_BUFFER_POOL_H
+
+#if !defined (__UFO_H_INSIDE__) && !defined (UFO_COMPILATION)
+#error "Only <ufo/ufo.h> can be included directly."
+#endif
+
+#include <ufo/ufo-buffer.h>
+
+G_BEGIN_DECLS
+
+typedef struct _UfoBufferPool       UfoBufferPool;
+typedef struct _UfoBufferPoolStats  UfoBufferPoolStats;
+
+/**
+ * UfoBufferPoolStats:
+ * @hits: Number of requests served from pooled buffers
+ * @misses: Number of requests that required a new buffer
+ * @n_held: Number of buffers currently held by the pool
+ * @bytes_held: Number of bytes currently held by the pool
+ *
+ * Counters of a #UfoBufferPool as returned by ufo_buffer_pool_get_stats().
+ */
+struct _UfoBufferPoolStats {
+    guint64 hits;
+    guint64 misses;
+    guint   n_held;
+    gsize   bytes_held;
+};
+
+UfoBufferPool * ufo_buffer_pool_get_default     (void);
+UfoBufferPool * ufo_buffer_pool_new             (gsize               max_bytes);
+void            ufo_buffer_pool_free            (UfoBufferPool      *pool);
+UfoBuffer     * ufo_buffer_pool_acquire         (UfoBufferPool      *pool,
+                                                 UfoRequisition     *requisition,
+                                                 gpointer            context);
+void            ufo_buffer_pool_release         (UfoBufferPool      *pool,
+                                                 UfoBuffer          *buffer);
+void            ufo_buffer_pool_drain           (UfoBufferPool      *pool,
+                                                 gpointer            context);
+void            ufo_buffer_pool_clear           (UfoBufferPool      *pool);
+void            ufo_buffer_pool_set_max_bytes   (UfoBufferPool      *pool,
+                                                 gsize               max_bytes);
+void            ufo_buffer_pool_get_stats       (UfoBufferPool      *pool,
+                                                 UfoBufferPoolStats *stats);
+
+G_END_DECLS
+
+#endif
@@ -18,6 +18,11 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
 #else
@@ -25,7 +30,12 @@
 #endif
 
 #include <ufo/ufo-buffer.h>
+#include <ufo/ufo-buffer-pool.h>
 #include <ufo/ufo-resources.h>
+#include "ufo-priv.h"
+#include "ufo-convert.h"
+#include "ufo-memory.h"
+#include "ufo-stats.h"
 #include "compat.h"
 
 /**
@@ -56,7 +66,8 @@
  * @size: n-dimensional size of the region
  *
  * Defines a region with at most #UFO_BUFFER_MAX_NDIMS dimensions for use with
- * ufo_buffer_get_device_array_view().
+ * ufo_buffer_get_device_array_view(), ufo_buffer_new_view() and
+ * ufo_buffer_copy_region().
  */
 
 /**
@@ -69,7 +80,8 @@
  * @UFO_BUFFER_DEPTH_32U: 32 bit unsigned
  * @UFO_BUFFER_DEPTH_32F: 32 bit float
  *
- * Source depth of data as used in ufo_buffer_convert().
+ * Source depth of data as used in ufo_buffer_convert() and
+ * ufo_buffer_set_depth().
  */
 
 /**
@@ -83,10 +95,50 @@
  * Location of the backed data memory.
  */
 
+/**
+ * UfoBufferHostMemory:
+ * @UFO_BUFFER_HOST_MEMORY_DEFAULT: Use the mode configured for the buffer's
+ *  context, i.e. UfoResources:pinned-host-memory, or regular pageable memory
+ * @UFO_BUFFER_HOST_MEMORY_PAGEABLE: Allocate host arrays with g_malloc()
+ * @UFO_BUFFER_HOST_MEMORY_PINNED: Back host arrays with a mapped
+ *  %CL_MEM_ALLOC_HOST_PTR buffer so that the driver can use DMA transfers
+ *
+ * Allocation mode of the host array as set with ufo_buffer_set_host_memory().
+ */
+
+/**
+ * UfoBufferMapping:
+ * @UFO_BUFFER_MAPPING_READ_ONLY: Mapped data must not be modified
+ * @UFO_BUFFER_MAPPING_COPY_ON_WRITE: Modified pages are copied and private to
+ *  the buffer
+ *
+ * Access mode of buffers created with ufo_buffer_new_from_file_mapping().
+ */
+
 G_DEFINE_TYPE(UfoBuffer, ufo_buffer, G_TYPE_OBJECT)
 
 #define UFO_BUFFER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_BUFFER, UfoBufferPrivate))
 
+/* Metadata is kept in a small array of interned key/value pairs. Stores are
+ * shared between buffers by ufo_buffer_copy_metadata() and copied on the first
+ * write, so propagating metadata along a pipeline does not allocate. */
+#define METADATA_MIN_ENTRIES    4
+
+/* Growing buffers round their capacity up to this many bytes */
+#define CAPACITY_GRANULARITY    (64 * 1024)
+
+typedef struct {
+    GQuark  key;
+    GValue  value;
+} MetadataEntry;
+
+typedef struct {
+    gint            ref_count;
+    guint           n_entries;
+    guint           n_allocated;
+    MetadataEntry   entries[];
+} Metadata;
+
 enum {
     PROP_0,
     PROP_ID,
@@ -98,21 +150,115 @@ struct _UfoBufferPrivate {
     UfoRequisition      requisition;
     gfloat             *host_array;
     gboolean            free;
+    gsize               host_size;      /* accounted bytes of host_array */
     cl_mem              device_array;
     cl_mem              device_image;
     cl_context          context;
     cl_command_queue    last_queue;
     gsize               size;           /* size of buffer in bytes */
+    gsize               capacity;       /* bytes that host and device arrays hold */
     UfoBufferLocation      location;
     UfoBufferLocation      last_location;
-    GHashTable         *metadata;
+    guint               mirrors;        /* other locations holding the same data */
+    gint                n_readers;      /* pending ufo_buffer_begin_read() calls */
+    volatile gint       read_lock;      /* bit 0 serializes transfers of readers */
+    Metadata           *metadata;       /* NULL if there is no metadata */
     GList              *sub_device_arrays;
+    UfoBufferHostMemory host_memory;
+    cl_mem              pinned_array;   /* backs host_array if pinned */
+    cl_command_queue    pinned_queue;   /* queue used to map pinned_array */
+    cl_event            pending_event;  /* last asynchronous transfer */
+    UfoBufferDepth      depth;          /* depth of the data in host_array */
+    cl_mem              raw_array;      /* native-depth staging for uploads */
+    gpointer            mapping;        /* file mapping that backs host_array */
+    gsize               mapping_size;
+    gboolean            mapping_writable;
+    guint               n_frames;       /* frames of requisition in a batch */
+    Metadata          **frame_metadata; /* per-frame stores or NULL */
+    UfoBuffer          *parent;         /* owner of host_array of a view */
 };
 
+/* Host memory mode and a queue to map pinned memory with per context */
+typedef struct {
+    UfoBufferHostMemory mode;
+    cl_command_queue    queue;
+} ContextHostMemory;
+
+/* cl_context -> ContextHostMemory, set through UfoResources */
+static GHashTable *context_host_memory = NULL;
+G_LOCK_DEFINE_STATIC (context_host_memory);
+
+#define LOCATION_BIT(location)  (1 << (location))
+
+/*
+ * Returns TRUE if @location holds the current data, either because it is the
+ * current location or because it was mirrored there by a read-only access.
+ */
+static gboolean
+has_copy (UfoBufferPrivate *priv,
+          UfoBufferLocation location)
+{
+    if (priv->location != location && !(priv->mirrors & LOCATION_BIT (location)))
+        return FALSE;
+
+    switch (location) {
+        case UFO_BUFFER_LOCATION_HOST:
+            return priv->host_array != NULL;
+        case UFO_BUFFER_LOCATION_DEVICE:
+            return priv->device_array != NULL;
+        case UFO_BUFFER_LOCATION_DEVICE_IMAGE:
+            return priv->device_image != NULL;
+        default:
+            return FALSE;
+    }
+}
+
+/*
+ * Forget that @location holds valid data because its storage goes away. If it
+ * was the current location, a mirror takes over if there is one.
+ */
+static void
+drop_copy (UfoBufferPrivate *priv,
+           UfoBufferLocation location)
+{
+    priv->mirrors &= ~LOCATION_BIT (location);
+
+    if (priv->location != location)
+        return;
+
+    if (priv->mirrors & LOCATION_BIT (UFO_BUFFER_LOCATION_DEVICE))
+        priv->location = UFO_BUFFER_LOCATION_DEVICE;
+    else if (priv->mirrors & LOCATION_BIT (UFO_BUFFER_LOCATION_HOST))
+        priv->location = UFO_BUFFER_LOCATION_HOST;
+    else
+        priv->location = UFO_BUFFER_LOCATION_INVALID;
+
+    priv->mirrors &= ~LOCATION_BIT (priv->location);
+}
+
+/*
+ * Make @new_location the current location. Unless the data is only read, the
+ * caller may write to it and all other copies become stale.
+ */
 static void
 update_location (UfoBufferPrivate *priv,
-                 UfoBufferLocation new_location)
+                 UfoBufferLocation new_location,
+                 gboolean read_only)
 {
+    if (read_only) {
+        /* Narrow host data stays valid, it is widened whenever it is read */
+        if (priv->location != UFO_BUFFER_LOCATION_INVALID)
+            priv->mirrors |= LOCATION_BIT (priv->location);
+
+        priv->mirrors &= ~LOCATION_BIT (new_location);
+    }
+    else {
+        /* The caller may write, all other copies become stale */
+        priv->mirrors = 0;
+    }
+
+    /* The host array keeps its depth even if it is not current, so that
+     * ufo_buffer_discard_location() can go back to it */
     priv->last_location = priv->location;
     priv->location = new_location;
 }
@@ -129,6 +275,21 @@ copy_requisition (UfoRequisition *src,
         dst->dims[i] = src->dims[i];
 }
 
+static gboolean
+requisition_equal (UfoRequisition *a,
+                   UfoRequisition *b)
+{
+    if (a->n_dims != b->n_dims)
+        return FALSE;
+
+    for (guint i = 0; i < a->n_dims; i++) {
+        if (a->dims[i] != b->dims[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 static gsize
 compute_required_size (UfoRequisition *requisition)
 {
@@ -141,12 +302,271 @@ compute_required_size (UfoRequisition *requisition)
 }
 
 static void
-alloc_host_mem (UfoBufferPrivate *priv)
+set_pending_event (UfoBufferPrivate *priv,
+                   cl_event event)
+{
+    /* The new event was enqueued after the old one, waiting for it suffices */
+    if (priv->pending_event != NULL)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (priv->pending_event));
+
+    priv->pending_event = event;
+}
+
+static void
+wait_pending_event (UfoBufferPrivate *priv)
+{
+    if (priv->pending_event == NULL)
+        return;
+
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &priv->pending_event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (priv->pending_event));
+    priv->pending_event = NULL;
+}
+
+static void
+sync_pending_event (UfoBufferPrivate *priv,
+                    cl_command_queue queue)
+{
+    cl_command_queue event_queue;
+
+    if (priv->pending_event == NULL)
+        return;
+
+    /* Commands on the same in-order queue are serialized anyway */
+    UFO_RESOURCES_CHECK_CLERR (clGetEventInfo (priv->pending_event, CL_EVENT_COMMAND_QUEUE,
+                                               sizeof (cl_command_queue), &event_queue, NULL));
+
+    if (event_queue != queue)
+        wait_pending_event (priv);
+}
+
+static void
+free_host_mem (UfoBufferPrivate *priv)
 {
-    if (priv->host_array != NULL && priv->free)
+    wait_pending_event (priv);
+
+    if (priv->pinned_array != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueUnmapMemObject (priv->pinned_queue,
+                                                            priv->pinned_array,
+                                                            priv->host_array,
+                                                            0, NULL, NULL));
+        UFO_RESOURCES_CHECK_CLERR (clFinish (priv->pinned_queue));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->pinned_array));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (priv->pinned_queue));
+        priv->pinned_array = NULL;
+        priv->pinned_queue = NULL;
+    }
+    else if (priv->mapping != NULL) {
+        munmap (priv->mapping, priv->mapping_size);
+        priv->mapping = NULL;
+        priv->mapping_size = 0;
+    }
+    else if (priv->host_array != NULL && priv->free) {
         g_free (priv->host_array);
+    }
+
+    if (priv->host_size > 0) {
+        ufo_memory_free (NULL, priv->host_size);
+        priv->host_size = 0;
+    }
+
+    priv->host_array = NULL;
+    priv->mirrors &= ~LOCATION_BIT (UFO_BUFFER_LOCATION_HOST);
+
+    /* New host arrays hold floats until told otherwise */
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+}
+
+/*
+ * Make room for @size bytes of host memory. If that exceeds the host budget,
+ * stale host copies of pooled device-resident buffers are dropped first.
+ */
+static void
+reserve_host_mem (gsize size)
+{
+    if (!ufo_memory_exceeds_budget (NULL, size))
+        return;
+
+    ufo_buffer_pool_discard_host_arrays (ufo_buffer_pool_get_default (), size);
+
+    if (ufo_memory_exceeds_budget (NULL, size) && ufo_memory_warn_once (NULL))
+        g_warning ("Host memory budget of %" G_GUINT64_FORMAT " bytes exceeded",
+                   ufo_memory_get_budget (NULL));
+}
+
+/*
+ * Make room for @size bytes of device memory in the context of @priv by
+ * releasing pooled buffers of that context if the budget would be exceeded.
+ */
+static void
+reserve_device_mem (UfoBufferPrivate *priv,
+                    gsize size)
+{
+    if (!ufo_memory_exceeds_budget (priv->context, size))
+        return;
+
+    ufo_buffer_pool_drain (ufo_buffer_pool_get_default (), priv->context);
+
+    if (ufo_memory_exceeds_budget (priv->context, size) && ufo_memory_warn_once (priv->context))
+        g_warning ("Device memory budget of %" G_GUINT64_FORMAT " bytes exceeded",
+                   ufo_memory_get_budget (priv->context));
+}
+
+static gboolean
+is_allocation_failure (cl_int err)
+{
+    return err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES;
+}
+
+/*
+ * Set @array, allocated with g_malloc() after reserve_host_mem(), as the host
+ * array of @priv.
+ */
+static void
+set_accounted_host_array (UfoBufferPrivate *priv,
+                          gpointer array)
+{
+    priv->host_array = array;
+    priv->free = TRUE;
+    priv->host_size = priv->capacity;
+    ufo_memory_alloc (NULL, priv->host_size);
+}
+
+static gboolean
+use_pinned_host_mem (UfoBufferPrivate *priv)
+{
+    UfoBufferHostMemory mode = priv->host_memory;
+
+    if (priv->context == NULL)
+        return FALSE;
+
+    if (mode == UFO_BUFFER_HOST_MEMORY_DEFAULT) {
+        ContextHostMemory *entry = NULL;
+
+        G_LOCK (context_host_memory);
+
+        if (context_host_memory != NULL)
+            entry = g_hash_table_lookup (context_host_memory, priv->context);
+
+        if (entry != NULL)
+            mode = entry->mode;
+
+        G_UNLOCK (context_host_memory);
+    }
+
+    return mode == UFO_BUFFER_HOST_MEMORY_PINNED;
+}
+
+/*
+ * Return a retained queue to map pinned memory with. Host arrays are often
+ * allocated before the buffer saw any queue, e.g. when a reader fills it, so
+ * use the queue registered for the context or create one on its first device.
+ */
+static cl_command_queue
+get_mapping_queue (UfoBufferPrivate *priv)
+{
+    cl_command_queue queue = priv->last_queue;
+    cl_device_id *devices;
+    size_t size;
+    cl_int err;
+
+    if (queue == NULL) {
+        G_LOCK (context_host_memory);
+
+        if (context_host_memory != NULL) {
+            ContextHostMemory *entry;
+
+            entry = g_hash_table_lookup (context_host_memory, priv->context);
+
+            if (entry != NULL)
+                queue = entry->queue;
+        }
+
+        /* Retain while locked, the entry may be replaced at any time */
+        if (queue != NULL)
+            UFO_RESOURCES_CHECK_CLERR (clRetainCommandQueue (queue));
+
+        G_UNLOCK (context_host_memory);
+
+        if (queue != NULL)
+            return queue;
+    }
+    else {
+        UFO_RESOURCES_CHECK_CLERR (clRetainCommandQueue (queue));
+        return queue;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clGetContextInfo (priv->context, CL_CONTEXT_DEVICES, 0, NULL, &size));
+
+    if (size < sizeof (cl_device_id))
+        return NULL;
+
+    devices = g_malloc (size);
+    UFO_RESOURCES_CHECK_CLERR (clGetContextInfo (priv->context, CL_CONTEXT_DEVICES, size, devices, NULL));
+    queue = clCreateCommandQueue (priv->context, devices[0], 0, &err);
+    g_free (devices);
+
+    if (err != CL_SUCCESS) {
+        g_warning ("Could not create queue to map pinned memory: %s", ufo_resources_clerr (err));
+        return NULL;
+    }
+
+    return queue;
+}
+
+static gboolean
+alloc_pinned_host_mem (UfoBufferPrivate *priv)
+{
+    cl_command_queue queue;
+    cl_mem mem;
+    gpointer array;
+    cl_int err;
+
+    queue = get_mapping_queue (priv);
+
+    if (queue == NULL)
+        return FALSE;
+
+    mem = clCreateBuffer (priv->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, priv->capacity, NULL, &err);
+
+    if (err != CL_SUCCESS) {
+        g_warning ("Could not allocate %zu bytes of pinned memory: %s", priv->capacity, ufo_resources_clerr (err));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (queue));
+        return FALSE;
+    }
+
+    array = clEnqueueMapBuffer (queue, mem, CL_TRUE,
+                                CL_MAP_READ | CL_MAP_WRITE,
+                                0, priv->capacity, 0, NULL, NULL, &err);
+
+    if (err != CL_SUCCESS) {
+        g_warning ("Could not map pinned memory: %s", ufo_resources_clerr (err));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (mem));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (queue));
+        return FALSE;
+    }
+
+    g_debug ("ALOC %p [size=%3.2f MB, type=pinned]", (gpointer) mem, priv->capacity / 1024. / 1024.);
+    ufo_memory_track_mem (NULL, mem);
+
+    memset (array, 0, priv->capacity);
+    priv->pinned_array = mem;
+    priv->pinned_queue = queue;
+    priv->host_array = array;
+    return TRUE;
+}
+
+static void
+alloc_host_mem (UfoBufferPrivate *priv)
+{
+    free_host_mem (priv);
+    priv->free = TRUE;
+    reserve_host_mem (priv->capacity);
+
+    if (use_pinned_host_mem (priv) && alloc_pinned_host_mem (priv))
+        return;
 
-    priv->host_array = g_malloc0 (priv->size);
+    set_accounted_host_array (priv, g_malloc0 (priv->capacity));
 }
 
 static void
@@ -155,13 +575,27 @@ alloc_device_array (UfoBufferPrivate *priv)
     cl_int err;
     cl_mem mem;
 
-    if (priv->device_array != NULL)
+    if (priv->device_array != NULL) {
         UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_array));
+        priv->mirrors &= ~LOCATION_BIT (UFO_BUFFER_LOCATION_DEVICE);
+    }
+
+    reserve_device_mem (priv, priv->capacity);
+    mem = clCreateBuffer (priv->context, CL_MEM_READ_WRITE, priv->capacity, NULL, &err);
+
+    if (is_allocation_failure (err)) {
+        /* Idle buffers may hold the memory we need */
+        ufo_buffer_pool_drain (ufo_buffer_pool_get_default (), priv->context);
+        mem = clCreateBuffer (priv->context, CL_MEM_READ_WRITE, priv->capacity, NULL, &err);
+    }
 
-    mem = clCreateBuffer (priv->context, CL_MEM_READ_WRITE, priv->size, NULL, &err);
-    g_debug ("ALOC %p [size=%3.2f MB, type=buffer]", (gpointer) mem, priv->size / 1024. / 1024.);
+    g_debug ("ALOC %p [size=%3.2f MB, type=buffer]", (gpointer) mem, priv->capacity / 1024. / 1024.);
 
     UFO_RESOURCES_CHECK_CLERR (err);
+
+    if (err == CL_SUCCESS)
+        ufo_memory_track_mem (priv->context, mem);
+
     priv->device_array = mem;
 }
 
@@ -210,20 +644,14 @@ alloc_device_image (UfoBufferPrivate *priv)
     priv->device_image = mem;
 }
 #else
-static void
-alloc_device_image (UfoBufferPrivate *priv)
+static cl_mem
+create_device_image (UfoBufferPrivate *priv,
+                     cl_int *err)
 {
     cl_image_format format;
     cl_mem_flags flags;
     gsize width, height, depth;
     cl_mem mem = NULL;
-    cl_int err = CL_SUCCESS;
-
-    g_assert ((priv->requisition.n_dims == 2) ||
-              (priv->requisition.n_dims == 3));
-
-    if (priv->device_image != NULL)
-        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_image));
 
     format.image_channel_order = CL_INTENSITY;
     format.image_channel_data_type = CL_FLOAT;
@@ -234,16 +662,42 @@ alloc_device_image (UfoBufferPrivate *priv)
     depth = priv->requisition.dims[2];
 
     if (priv->requisition.n_dims == 2) {
-        mem = clCreateImage2D (priv->context, flags, &format, width, height, 0, NULL, &err);
+        mem = clCreateImage2D (priv->context, flags, &format, width, height, 0, NULL, err);
         g_debug ("ALOC %p [size=%3.2f MB, type=2D image]", (gpointer) mem, width * height * 4 / 1024. / 1024.);
     }
     else if (priv->requisition.n_dims == 3) {
-        mem = clCreateImage3D (priv->context, flags, &format, width, height, depth, 0, 0, NULL, &err);
+        mem = clCreateImage3D (priv->context, flags, &format, width, height, depth, 0, 0, NULL, err);
         g_debug ("ALOC %p [size=%3.2f MB, type=3D image]", (gpointer) mem, width * height * depth * 4 / 1024. / 1024.);
     }
 
+    return mem;
+}
+
+static void
+alloc_device_image (UfoBufferPrivate *priv)
+{
+    cl_mem mem;
+    cl_int err = CL_SUCCESS;
+
+    g_assert ((priv->requisition.n_dims == 2) ||
+              (priv->requisition.n_dims == 3));
+
+    if (priv->device_image != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_image));
+        priv->mirrors &= ~LOCATION_BIT (UFO_BUFFER_LOCATION_DEVICE_IMAGE);
+    }
+
+    reserve_device_mem (priv, priv->size);
+    mem = create_device_image (priv, &err);
+
+    if (is_allocation_failure (err)) {
+        ufo_buffer_pool_drain (ufo_buffer_pool_get_default (), priv->context);
+        mem = create_device_image (priv, &err);
+    }
+
     UFO_RESOURCES_CHECK_CLERR (err);
     g_assert (mem != NULL);
+    ufo_memory_track_mem (priv->context, mem);
     priv->device_image = mem;
 }
 #endif
@@ -271,6 +725,7 @@ ufo_buffer_new (UfoRequisition *requisition,
     priv->context = context;
 
     priv->size = compute_required_size (requisition);
+    priv->capacity = priv->size;
     copy_requisition (requisition, &priv->requisition);
 
     return buffer;
@@ -324,7 +779,114 @@ ufo_buffer_new_with_data (UfoRequisition *requisition,
 
     priv->free = FALSE;
     priv->host_array = data;
-    update_location (priv, UFO_BUFFER_LOCATION_HOST);
+    update_location (priv, UFO_BUFFER_LOCATION_HOST, FALSE);
+
+    return buffer;
+}
+
+/**
+ * ufo_buffer_new_from_file_mapping:
+ * @filename: Path of a file containing raw data
+ * @offset: Byte offset of the data in @filename
+ * @requisition: size requisition
+ * @depth: Bit depth of the data in @filename
+ * @mode: Whether the mapped data may be modified
+ * @context: (allow-none): cl_context to use for creating the device array
+ * @error: Location for a #GError or %NULL
+ *
+ * Create a new buffer whose host array is a memory mapping of tightly packed
+ * data of @depth, starting at @offset in @filename. No data is read until it
+ * is accessed, and as with ufo_buffer_set_depth(), only the native bytes are
+ * transferred when the buffer is requested on the device. Changes are never
+ * written back to @filename.
+ *
+ * With %UFO_BUFFER_MAPPING_READ_ONLY, the array returned by
+ * ufo_buffer_get_host_array() must not be written to as long as the data is
+ * still mapped, i.e. unless it had to be widened on the host or was copied back
+ * from the device. With %UFO_BUFFER_MAPPING_COPY_ON_WRITE, modified pages are
+ * private to the buffer.
+ *
+ * Returns: (transfer full): A new #UfoBuffer or %NULL on error.
+ */
+UfoBuffer *
+ufo_buffer_new_from_file_mapping (const gchar *filename,
+                                  gsize offset,
+                                  UfoRequisition *requisition,
+                                  UfoBufferDepth depth,
+                                  UfoBufferMapping mode,
+                                  gpointer context,
+                                  GError **error)
+{
+    UfoBuffer *buffer;
+    UfoBufferPrivate *priv;
+    struct stat st;
+    gpointer mapping;
+    gsize page_offset;
+    gsize raw_size;
+    gint prot;
+    gint fd;
+
+    g_return_val_if_fail (filename != NULL && requisition != NULL, NULL);
+    g_return_val_if_fail ((requisition->n_dims <= UFO_BUFFER_MAX_NDIMS) &&
+                          (requisition->n_dims > 0), NULL);
+    g_return_val_if_fail (ufo_convert_get_depth_size (depth) > 0, NULL);
+
+    raw_size = compute_required_size (requisition) / sizeof (gfloat) * ufo_convert_get_depth_size (depth);
+    page_offset = offset % (gsize) sysconf (_SC_PAGESIZE);
+
+    fd = open (filename, O_RDONLY);
+
+    if (fd < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not open `%s': %s", filename, g_strerror (errno));
+        return NULL;
+    }
+
+    if (fstat (fd, &st) < 0) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not stat `%s': %s", filename, g_strerror (errno));
+        close (fd);
+        return NULL;
+    }
+
+    if ((gsize) st.st_size < offset + raw_size) {
+        g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                     "`%s' is too small to hold %zu bytes at offset %zu",
+                     filename, raw_size, offset);
+        close (fd);
+        return NULL;
+    }
+
+    /* Private mappings are never written back, PROT_WRITE only makes them
+     * copy-on-write */
+    prot = PROT_READ;
+
+    if (mode == UFO_BUFFER_MAPPING_COPY_ON_WRITE)
+        prot |= PROT_WRITE;
+
+    mapping = mmap (NULL, page_offset + raw_size, prot, MAP_PRIVATE, fd, (off_t) (offset - page_offset));
+    close (fd);
+
+    if (mapping == MAP_FAILED) {
+        g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+                     "Could not map `%s': %s", filename, g_strerror (errno));
+        return NULL;
+    }
+
+    /* Frames are usually read front to back and exactly once per run */
+    madvise (mapping, page_offset + raw_size, MADV_SEQUENTIAL);
+    madvise (mapping, page_offset + raw_size, MADV_WILLNEED);
+
+    buffer = ufo_buffer_new (requisition, context);
+    priv = buffer->priv;
+
+    priv->mapping = mapping;
+    priv->mapping_size = page_offset + raw_size;
+    priv->mapping_writable = mode == UFO_BUFFER_MAPPING_COPY_ON_WRITE;
+    priv->host_array = (gfloat *) (((gchar *) mapping) + page_offset);
+    priv->free = FALSE;
+    update_location (priv, UFO_BUFFER_LOCATION_HOST, FALSE);
+    priv->depth = depth;
 
     return buffer;
 }
@@ -352,7 +914,7 @@ get_num_elements (UfoBufferPrivate *priv)
     for (guint i = 0; i < priv->requisition.n_dims; i++)
         n *= priv->requisition.dims[i];
 
-    return n;
+    return n * priv->n_frames;
 }
 
 static void
@@ -368,25 +930,168 @@ set_region_from_requisition (size_t region[3],
         region[2] = 1;
 }
 
+/*
+ * Replace a file mapping with regular host memory before the host array is
+ * written to. Copy-on-write mappings are kept if they can hold the whole
+ * capacity, which is not the case for narrower data.
+ */
 static void
-transfer_host_to_host (UfoBufferPrivate *src_priv,
-                       UfoBufferPrivate *dst_priv,
-                       cl_command_queue queue)
+make_host_writable (UfoBufferPrivate *priv)
 {
-    g_memmove (dst_priv->host_array,
-               src_priv->host_array,
-               src_priv->size);
-}
+    gpointer array;
+    gsize page_offset;
+    gboolean valid;
+    UfoBufferDepth depth;
 
-static void
-transfer_host_to_device (UfoBufferPrivate *src_priv,
-                         UfoBufferPrivate *dst_priv,
-                         cl_command_queue queue)
-{
-    cl_int errcode;
+    if (priv->mapping == NULL)
+        return;
 
-    errcode = clEnqueueWriteBuffer (queue,
-                                    dst_priv->device_array,
+    page_offset = (gsize) ((gchar *) priv->host_array - (gchar *) priv->mapping);
+
+    if (priv->mapping_writable && priv->mapping_size - page_offset >= priv->capacity)
+        return;
+
+    reserve_host_mem (priv->capacity);
+    array = g_malloc (priv->capacity);
+    valid = has_copy (priv, UFO_BUFFER_LOCATION_HOST);
+
+    depth = priv->depth;
+
+    if (valid)
+        memcpy (array, priv->host_array, get_num_elements (priv) * ufo_convert_get_depth_size (depth));
+
+    free_host_mem (priv);
+    set_accounted_host_array (priv, array);
+    priv->depth = depth;
+
+    if (valid && priv->location != UFO_BUFFER_LOCATION_HOST)
+        priv->mirrors |= LOCATION_BIT (UFO_BUFFER_LOCATION_HOST);
+}
+
+/*
+ * Convert mapped data of @depth into regular host memory. The mapping only
+ * covers the native data and cannot be widened in place.
+ */
+static void
+convert_mapping (UfoBufferPrivate *priv,
+                 UfoBufferDepth depth)
+{
+    gfloat *array;
+
+    reserve_host_mem (priv->capacity);
+    array = g_malloc (priv->capacity);
+    ufo_convert_to_float (array, priv->host_array, depth, get_num_elements (priv));
+    free_host_mem (priv);
+    set_accounted_host_array (priv, array);
+}
+
+static void
+widen_on_host (UfoBufferPrivate *priv)
+{
+    if (priv->depth == UFO_BUFFER_DEPTH_32F)
+        return;
+
+    if (priv->mapping != NULL) {
+        convert_mapping (priv, priv->depth);
+    }
+    else if (priv->host_array != NULL) {
+        ufo_convert_to_float (priv->host_array, priv->host_array, priv->depth, get_num_elements (priv));
+    }
+
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+}
+
+/*
+ * Upload the native-depth host data of @src_priv and widen it into the device
+ * array of @dst_priv with an OpenCL kernel. Returns the event of the conversion
+ * or %NULL if no kernel is available, in which case the data has been widened
+ * on the host and must be uploaded as usual.
+ */
+static cl_event
+enqueue_native_upload (UfoBufferPrivate *src_priv,
+                       UfoBufferPrivate *dst_priv,
+                       cl_command_queue queue,
+                       cl_uint n_wait,
+                       const cl_event *wait_list)
+{
+    gpointer kernel;
+    cl_mem target;
+    cl_event upload;
+    cl_event conversion;
+    gsize n_elements;
+    gsize raw_size;
+    cl_int errcode;
+
+    kernel = ufo_convert_create_device_kernel (dst_priv->context, src_priv->depth);
+
+    if (kernel == NULL) {
+        widen_on_host (src_priv);
+        return NULL;
+    }
+
+    n_elements = get_num_elements (src_priv);
+    raw_size = n_elements * ufo_convert_get_depth_size (src_priv->depth);
+    target = dst_priv->device_array;
+
+    if (raw_size < src_priv->size) {
+        /* Narrower data cannot be widened in-place by parallel work items */
+        if (dst_priv->raw_array == NULL) {
+            reserve_device_mem (dst_priv, dst_priv->capacity / 2);
+            dst_priv->raw_array = clCreateBuffer (dst_priv->context, CL_MEM_READ_ONLY,
+                                                  dst_priv->capacity / 2, NULL, &errcode);
+            UFO_RESOURCES_CHECK_CLERR (errcode);
+            ufo_memory_track_mem (dst_priv->context, dst_priv->raw_array);
+        }
+
+        target = dst_priv->raw_array;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueWriteBuffer (queue, target, CL_FALSE,
+                                                     0, raw_size, src_priv->host_array,
+                                                     n_wait, wait_list, &upload));
+
+    conversion = ufo_convert_enqueue_to_float (kernel, queue, dst_priv->device_array, target,
+                                               n_elements, upload);
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (upload));
+
+    return conversion;
+}
+
+static void
+transfer_host_to_host (UfoBufferPrivate *src_priv,
+                       UfoBufferPrivate *dst_priv,
+                       cl_command_queue queue)
+{
+    /* Native-depth data, possibly mapped, is not necessarily as large as the
+     * host array */
+    g_memmove (dst_priv->host_array,
+               src_priv->host_array,
+               get_num_elements (src_priv) * ufo_convert_get_depth_size (src_priv->depth));
+
+    dst_priv->depth = src_priv->depth;
+}
+
+static void
+transfer_host_to_device (UfoBufferPrivate *src_priv,
+                         UfoBufferPrivate *dst_priv,
+                         cl_command_queue queue)
+{
+    cl_int errcode;
+
+    if (src_priv->depth != UFO_BUFFER_DEPTH_32F) {
+        cl_event event;
+
+        event = enqueue_native_upload (src_priv, dst_priv, queue, 0, NULL);
+
+        if (event != NULL) {
+            UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+            UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+            return;
+        }
+    }
+
+    errcode = clEnqueueWriteBuffer (queue,
+                                    dst_priv->device_array,
                                     CL_TRUE,
                                     0, src_priv->size,
                                     src_priv->host_array,
@@ -405,6 +1110,7 @@ transfer_host_to_image (UfoBufferPrivate *src_priv,
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
 
+    widen_on_host (src_priv);
     set_region_from_requisition (region, &src_priv->requisition);
 
     errcode = clEnqueueWriteImage (queue,
@@ -455,6 +1161,7 @@ transfer_device_to_host (UfoBufferPrivate *src_priv,
                                    0, NULL, NULL);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    dst_priv->depth = UFO_BUFFER_DEPTH_32F;
 }
 
 static void
@@ -523,6 +1230,7 @@ transfer_image_to_host (UfoBufferPrivate *src_priv,
                                   0, NULL, NULL);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    dst_priv->depth = UFO_BUFFER_DEPTH_32F;
 }
 
 static void
@@ -548,7 +1256,6 @@ transfer_image_to_device (UfoBufferPrivate *src_priv,
     UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
 }
 
-
 /**
  * ufo_buffer_copy:
  * @src: Source #UfoBuffer
@@ -565,6 +1272,7 @@ ufo_buffer_copy (UfoBuffer *src, UfoBuffer *dst)
 
     UfoBufferPrivate *spriv;
     UfoBufferPrivate *dpriv;
+    UfoBufferLocation src_location;
     cl_command_queue queue;
 
     TransferFunc transfer[3][3] = {
@@ -577,6 +1285,8 @@ ufo_buffer_copy (UfoBuffer *src, UfoBuffer *dst)
 
     g_return_if_fail (UFO_IS_BUFFER (src) && UFO_IS_BUFFER (dst));
 
+    ufo_buffer_set_n_frames (dst, src->priv->n_frames);
+
     if (ufo_buffer_cmp_dimensions (dst, &src->priv->requisition) != 0)
         ufo_buffer_resize (dst, &src->priv->requisition);
 
@@ -584,19 +1294,29 @@ ufo_buffer_copy (UfoBuffer *src, UfoBuffer *dst)
     dpriv = dst->priv;
     queue = spriv->last_queue != NULL ? spriv->last_queue : dpriv->last_queue;
 
+    wait_pending_event (spriv);
+    wait_pending_event (dpriv);
+
     if (spriv->location == UFO_BUFFER_LOCATION_INVALID) {
         alloc_host_mem (spriv);
         spriv->location = UFO_BUFFER_LOCATION_HOST;
     }
 
+    dpriv->last_queue = queue;
+
     if (dpriv->location == UFO_BUFFER_LOCATION_INVALID ||
         (!dpriv->host_array && !dpriv->device_array && !dpriv->device_image)) {
         alloc[spriv->location](dpriv);
         dpriv->location = spriv->location;
     }
 
-    transfer[spriv->location][dpriv->location](spriv, dpriv, queue);
-    dpriv->last_queue = queue;
+    if (dpriv->location == UFO_BUFFER_LOCATION_HOST)
+        make_host_writable (dpriv);
+
+    /* Prefer a source copy in the same kind of memory as the destination */
+    src_location = has_copy (spriv, dpriv->location) ? dpriv->location : spriv->location;
+    transfer[src_location][dpriv->location](spriv, dpriv, queue);
+    dpriv->mirrors = 0;
 }
 
 /**
@@ -604,7 +1324,8 @@ ufo_buffer_copy (UfoBuffer *src, UfoBuffer *dst)
  * @buffer: A #UfoBuffer
  *
  * Create a new buffer with the same requisition as @buffer. Note, that this is
- * not a copy of @buffer!
+ * not a copy of @buffer! The buffer is taken from the default #UfoBufferPool
+ * and can be given back with ufo_buffer_pool_release().
  *
  * Returns: (transfer full): A #UfoBuffer with the same size as @buffer.
  */
@@ -615,17 +1336,74 @@ ufo_buffer_dup (UfoBuffer *buffer)
     UfoRequisition requisition;
 
     ufo_buffer_get_requisition (buffer, &requisition);
-    copy = ufo_buffer_new (&requisition, buffer->priv->context);
+    copy = ufo_buffer_pool_acquire (ufo_buffer_pool_get_default (),
+                                    &requisition, buffer->priv->context);
+    ufo_buffer_set_n_frames (copy, buffer->priv->n_frames);
     return copy;
 }
 
+static void
+release_storage (UfoBufferPrivate *priv)
+{
+    free_host_mem (priv);
+
+    if (priv->device_array != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_array));
+        priv->device_array = NULL;
+    }
+
+    if (priv->device_image != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_image));
+        priv->device_image = NULL;
+    }
+
+    if (priv->raw_array != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->raw_array));
+        priv->raw_array = NULL;
+    }
+
+    priv->mirrors = 0;
+}
+
+static void
+release_device_image (UfoBufferPrivate *priv)
+{
+    if (priv->device_image == NULL)
+        return;
+
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_image));
+    priv->device_image = NULL;
+    drop_copy (priv, UFO_BUFFER_LOCATION_DEVICE_IMAGE);
+}
+
+/*
+ * Use @size bytes of the storage of @priv. Host and device arrays are kept if
+ * they are large enough, otherwise they are released and the capacity grows to
+ * the next multiple of the granularity, so that requisitions which vary by a
+ * few rows do not reallocate every time.
+ */
+static void
+set_size (UfoBufferPrivate *priv,
+          gsize size)
+{
+    if (size > priv->capacity) {
+        release_storage (priv);
+        priv->capacity = (size + CAPACITY_GRANULARITY - 1) / CAPACITY_GRANULARITY * CAPACITY_GRANULARITY;
+    }
+
+    priv->size = size;
+}
 /**
  * ufo_buffer_resize:
  * @buffer: A #UfoBuffer
  * @requisition: A #UfoRequisition structure
  *
  * Resize an existing buffer. If the new requisition has the same size as
- * before, resizing is a no-op.
+ * before, resizing is a no-op. Host and device arrays are only reallocated if
+ * they are too small for the new requisition, otherwise they are kept and
+ * re-interpreted. Growing arrays are rounded up to leave room for slightly
+ * larger requisitions later on. Images are released whenever the shape
+ * changes. The number of frames of a batch is not changed.
  *
  * Since: 0.2
  */
@@ -637,27 +1415,17 @@ ufo_buffer_resize (UfoBuffer *buffer,
 
     g_return_if_fail (UFO_IS_BUFFER (buffer));
 
-    if (ufo_buffer_cmp_dimensions (buffer, requisition) == 0)
-        return;
-
     priv = UFO_BUFFER_GET_PRIVATE (buffer);
 
-    if (priv->host_array != NULL && priv->free) {
-        g_free (priv->host_array);
-        priv->host_array = NULL;
-    }
-
-    if (priv->device_array != NULL) {
-        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_array));
-        priv->device_array = NULL;
-    }
+    if (requisition_equal (&priv->requisition, requisition))
+        return;
 
-    if (priv->device_image != NULL) {
-        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_image));
-        priv->device_image = NULL;
-    }
+    wait_pending_event (priv);
+    priv->depth = UFO_BUFFER_DEPTH_32F;
 
-    priv->size = compute_required_size (requisition);
+    /* Images carry their shape, so those have to go anyway */
+    release_device_image (priv);
+    set_size (priv, compute_required_size (requisition) * priv->n_frames);
     copy_requisition (requisition, &priv->requisition);
 }
 
@@ -756,13 +1524,46 @@ ufo_buffer_set_host_array (UfoBuffer *buffer, gpointer array, gboolean free_data
 
     priv = buffer->priv;
 
-    if (priv->free)
-        g_free (priv->host_array);
+    free_host_mem (priv);
 
     priv->free = free_data;
     priv->host_array = array;
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+
+    /* Arrays provided by the caller hold exactly the current size */
+    priv->capacity = priv->size;
+
+    update_location (priv, UFO_BUFFER_LOCATION_HOST, FALSE);
+    priv->mirrors = 0;
+}
+
+static gfloat *
+get_host_array (UfoBufferPrivate *priv,
+                cl_command_queue cmd_queue,
+                gboolean read_only)
+{
+    update_last_queue (priv, cmd_queue);
+    sync_pending_event (priv, priv->last_queue);
+
+    if (priv->host_array == NULL)
+        alloc_host_mem (priv);
+
+    if (!has_copy (priv, UFO_BUFFER_LOCATION_HOST)) {
+        make_host_writable (priv);
+
+        if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
+            transfer_device_to_host (priv, priv, priv->last_queue);
+
+        if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_image)
+            transfer_image_to_host (priv, priv, priv->last_queue);
+    }
 
-    update_location (priv, UFO_BUFFER_LOCATION_HOST);
+    /* A pending upload may still read from the host array */
+    wait_pending_event (priv);
+    widen_on_host (priv);
+    update_location (priv, UFO_BUFFER_LOCATION_HOST, read_only);
+
+    return priv->host_array;
 }
 
 /**
@@ -776,28 +1577,236 @@ ufo_buffer_set_host_array (UfoBuffer *buffer, gpointer array, gboolean free_data
  */
 gfloat *
 ufo_buffer_get_host_array (UfoBuffer *buffer, gpointer cmd_queue)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    return get_host_array (buffer->priv, cmd_queue, FALSE);
+}
+
+/**
+ * ufo_buffer_get_host_array_async:
+ * @buffer: A #UfoBuffer.
+ * @cmd_queue: (allow-none): A cl_command_queue object or %NULL.
+ * @event: (out) (allow-none) (transfer none): Location for the cl_event of the
+ *  transfer or %NULL.
+ *
+ * Like ufo_buffer_get_host_array() but does not wait for the transfer from
+ * device memory to finish. The returned array must not be accessed before
+ * @event completed or ufo_buffer_wait() returned. All other accessors of
+ * @buffer wait for the transfer if necessary. @event is owned by @buffer and
+ * %NULL if no transfer was necessary.
+ *
+ * Returns: Float array.
+ */
+gfloat *
+ufo_buffer_get_host_array_async (UfoBuffer *buffer,
+                                 gpointer cmd_queue,
+                                 gpointer *event)
 {
     UfoBufferPrivate *priv;
+    cl_event transfer;
+    cl_uint n_wait;
+    gboolean stale;
 
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
     priv = buffer->priv;
 
     update_last_queue (priv, cmd_queue);
+    sync_pending_event (priv, priv->last_queue);
+    n_wait = priv->pending_event != NULL ? 1 : 0;
 
     if (priv->host_array == NULL)
         alloc_host_mem (priv);
 
-    if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
-        transfer_device_to_host (priv, priv, priv->last_queue);
+    stale = !has_copy (priv, UFO_BUFFER_LOCATION_HOST);
+
+    if (stale)
+        make_host_writable (priv);
+
+    if (stale && priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array) {
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (priv->last_queue, priv->device_array, CL_FALSE,
+                                                        0, priv->size, priv->host_array,
+                                                        n_wait, n_wait ? &priv->pending_event : NULL,
+                                                        &transfer));
+        set_pending_event (priv, transfer);
+        priv->depth = UFO_BUFFER_DEPTH_32F;
+    }
+    else if (stale && priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_image) {
+        size_t region[3];
+        size_t origin[] = { 0, 0, 0 };
+
+        set_region_from_requisition (region, &priv->requisition);
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueReadImage (priv->last_queue, priv->device_image, CL_FALSE,
+                                                       origin, region, 0, 0, priv->host_array,
+                                                       n_wait, n_wait ? &priv->pending_event : NULL,
+                                                       &transfer));
+        set_pending_event (priv, transfer);
+        priv->depth = UFO_BUFFER_DEPTH_32F;
+    }
+    else if (priv->depth != UFO_BUFFER_DEPTH_32F) {
+        /* An upload may still read the narrow data */
+        wait_pending_event (priv);
+        widen_on_host (priv);
+    }
 
-    if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_image)
-        transfer_image_to_host (priv, priv, priv->last_queue);
+    update_location (priv, UFO_BUFFER_LOCATION_HOST, FALSE);
 
-    update_location (priv, UFO_BUFFER_LOCATION_HOST);
+    if (event != NULL)
+        *event = priv->pending_event;
 
     return priv->host_array;
 }
 
+/**
+ * ufo_buffer_set_host_memory:
+ * @buffer: A #UfoBuffer
+ * @mode: Allocation mode for the host array
+ *
+ * Choose how the host array of @buffer is allocated. With
+ * %UFO_BUFFER_HOST_MEMORY_PINNED the host array is backed by page-locked
+ * memory that is mapped once, so that transfers between host and device do not
+ * go through an additional staging copy. The mode takes effect with the next
+ * allocation of the host array, which may happen before @buffer was used
+ * with any command queue. If pinned memory cannot be allocated, a warning is
+ * emitted and regular memory is used instead.
+ */
+void
+ufo_buffer_set_host_memory (UfoBuffer *buffer,
+                            UfoBufferHostMemory mode)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    buffer->priv->host_memory = mode;
+}
+
+/**
+ * ufo_buffer_get_host_memory:
+ * @buffer: A #UfoBuffer
+ *
+ * Get the allocation mode of the host array of @buffer.
+ *
+ * Returns: The #UfoBufferHostMemory mode set with ufo_buffer_set_host_memory().
+ */
+UfoBufferHostMemory
+ufo_buffer_get_host_memory (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), UFO_BUFFER_HOST_MEMORY_DEFAULT);
+    return buffer->priv->host_memory;
+}
+
+/**
+ * ufo_buffer_is_pinned:
+ * @buffer: A #UfoBuffer
+ *
+ * Check if the current host array of @buffer is backed by pinned memory.
+ *
+ * Returns: %TRUE if the host array is pinned.
+ */
+gboolean
+ufo_buffer_is_pinned (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), FALSE);
+    return buffer->priv->pinned_array != NULL;
+}
+
+static void
+free_context_host_memory (ContextHostMemory *entry)
+{
+    if (entry->queue != NULL)
+        UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (entry->queue));
+
+    g_free (entry);
+}
+
+/*
+ * Set the host memory mode for buffers of @context that use
+ * %UFO_BUFFER_HOST_MEMORY_DEFAULT. Pinned host arrays of buffers that have not
+ * been used with a queue yet are mapped with @cmd_queue.
+ */
+void
+ufo_buffer_set_context_host_memory (gpointer context,
+                                    UfoBufferHostMemory mode,
+                                    gpointer cmd_queue)
+{
+    G_LOCK (context_host_memory);
+
+    if (context_host_memory == NULL)
+        context_host_memory = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                     NULL, (GDestroyNotify) free_context_host_memory);
+
+    if (mode == UFO_BUFFER_HOST_MEMORY_DEFAULT) {
+        g_hash_table_remove (context_host_memory, context);
+    }
+    else {
+        ContextHostMemory *entry;
+
+        entry = g_new0 (ContextHostMemory, 1);
+        entry->mode = mode;
+        entry->queue = cmd_queue;
+
+        if (cmd_queue != NULL)
+            UFO_RESOURCES_CHECK_CLERR (clRetainCommandQueue (cmd_queue));
+
+        g_hash_table_insert (context_host_memory, context, entry);
+    }
+
+    G_UNLOCK (context_host_memory);
+}
+
+/*
+ * Release the host array of @buffer if it is merely a stale copy of data that
+ * resides on a device. Memory that is pinned, mapped or not owned by @buffer is
+ * kept. Returns the number of bytes that were released.
+ */
+gsize
+ufo_buffer_discard_host_array (UfoBuffer *buffer)
+{
+    UfoBufferPrivate *priv;
+    gsize size = 0;
+
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0);
+    priv = buffer->priv;
+
+    /* Readers from ufo_buffer_begin_read() may still hold the host array */
+    if (priv->host_size > 0 && g_atomic_int_get (&priv->n_readers) == 0 &&
+        (priv->location == UFO_BUFFER_LOCATION_DEVICE ||
+         priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE)) {
+        size = priv->host_size;
+        free_host_mem (priv);
+        priv->last_location = priv->location;
+    }
+
+    return size;
+}
+
+/*
+ * Forget where the data of @buffer lived, so that its storage is reused as if
+ * it was freshly allocated. Used by #UfoBufferPool before handing a buffer out
+ * again.
+ */
+void
+ufo_buffer_reset_location (UfoBuffer *buffer)
+{
+    UfoBufferPrivate *priv;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    priv = buffer->priv;
+
+    wait_pending_event (priv);
+    priv->location = UFO_BUFFER_LOCATION_INVALID;
+    priv->last_location = UFO_BUFFER_LOCATION_INVALID;
+    priv->mirrors = 0;
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+}
+
+/*
+ * Number of bytes @buffer can hold without reallocating its storage.
+ */
+gsize
+ufo_buffer_get_capacity (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0);
+    return buffer->priv->capacity;
+}
+
 /**
  * ufo_buffer_set_device_array:
  * @buffer: A #UfoBuffer.
@@ -829,11 +1838,38 @@ void ufo_buffer_set_device_array (UfoBuffer *buffer, gpointer array, gboolean fr
                    size, priv->size);
     }
 
+    wait_pending_event (priv);
+
     if (priv->free && priv->device_array)
          UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_array));
 
     priv->device_array = array;
-    update_location (priv, UFO_BUFFER_LOCATION_DEVICE);
+    priv->capacity = priv->size;
+    update_location (priv, UFO_BUFFER_LOCATION_DEVICE, FALSE);
+    priv->mirrors = 0;
+}
+
+static cl_mem
+get_device_array (UfoBufferPrivate *priv,
+                  cl_command_queue cmd_queue,
+                  gboolean read_only)
+{
+    update_last_queue (priv, cmd_queue);
+    sync_pending_event (priv, priv->last_queue);
+
+    if (priv->device_array == NULL)
+        alloc_device_array (priv);
+
+    if (!has_copy (priv, UFO_BUFFER_LOCATION_DEVICE)) {
+        if (has_copy (priv, UFO_BUFFER_LOCATION_DEVICE_IMAGE))
+            transfer_image_to_device (priv, priv, priv->last_queue);
+        else if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
+            transfer_host_to_device (priv, priv, priv->last_queue);
+    }
+
+    update_location (priv, UFO_BUFFER_LOCATION_DEVICE, read_only);
+
+    return priv->device_array;
 }
 
 /**
@@ -844,33 +1880,120 @@ void ufo_buffer_set_device_array (UfoBuffer *buffer, gpointer array, gboolean fr
  * Return the current cl_mem object of @buffer. If the data is not yet in device
  * memory, it is transfered via @cmd_queue to the object. If @cmd_queue is %NULL
  * @cmd_queue, the last used command queue is used.
+ * Host data with a native depth set by ufo_buffer_set_depth() is transferred as
+ * is and converted on the device.
  *
  * Returns: (transfer none): A cl_mem object associated with @buffer.
  */
 gpointer
 ufo_buffer_get_device_array (UfoBuffer *buffer, gpointer cmd_queue)
 {
-    UfoBufferPrivate *priv;
-
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
-    priv = buffer->priv;
-
-    update_last_queue (priv, cmd_queue);
-
-    if (priv->device_array == NULL)
-        alloc_device_array (priv);
+    return get_device_array (buffer->priv, cmd_queue, FALSE);
+}
 
-    if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
-        transfer_host_to_device (priv, priv, priv->last_queue);
+/**
+ * ufo_buffer_get_device_array_async:
+ * @buffer: A #UfoBuffer.
+ * @cmd_queue: (allow-none): A cl_command_queue object or %NULL.
+ * @event: (out) (allow-none) (transfer none): Location for the cl_event of the
+ *  transfer or %NULL.
+ *
+ * Like ufo_buffer_get_device_array() but does not wait for the transfer to
+ * device memory to finish. Commands enqueued afterwards on the same in-order
+ * @cmd_queue are ordered after the transfer, other queues have to wait for
+ * @event. The event is owned by @buffer and %NULL if no transfer was
+ * necessary. Accessing the buffer with ufo_buffer_get_host_array() or from a
+ * different queue waits for the transfer to finish.
+ *
+ * Returns: (transfer none): A cl_mem object associated with @buffer.
+ */
+gpointer
+ufo_buffer_get_device_array_async (UfoBuffer *buffer,
+                                   gpointer cmd_queue,
+                                   gpointer *event)
+{
+    UfoBufferPrivate *priv;
+    cl_event transfer;
+    cl_uint n_wait;
+    gboolean stale;
+
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    priv = buffer->priv;
+
+    update_last_queue (priv, cmd_queue);
+    sync_pending_event (priv, priv->last_queue);
+    n_wait = priv->pending_event != NULL ? 1 : 0;
+
+    if (priv->device_array == NULL)
+        alloc_device_array (priv);
+
+    stale = !has_copy (priv, UFO_BUFFER_LOCATION_DEVICE);
+
+    if (stale && priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array) {
+        transfer = NULL;
+
+        if (priv->depth != UFO_BUFFER_DEPTH_32F)
+            transfer = enqueue_native_upload (priv, priv, priv->last_queue,
+                                              n_wait, n_wait ? &priv->pending_event : NULL);
+
+        if (transfer == NULL)
+            UFO_RESOURCES_CHECK_CLERR (clEnqueueWriteBuffer (priv->last_queue, priv->device_array, CL_FALSE,
+                                                             0, priv->size, priv->host_array,
+                                                             n_wait, n_wait ? &priv->pending_event : NULL,
+                                                             &transfer));
+
+        set_pending_event (priv, transfer);
+    }
+    else if (stale && priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_image) {
+        size_t region[3];
+        size_t origin[] = { 0, 0, 0 };
+
+        set_region_from_requisition (region, &priv->requisition);
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueCopyImageToBuffer (priv->last_queue, priv->device_image,
+                                                               priv->device_array, origin, region, 0,
+                                                               n_wait, n_wait ? &priv->pending_event : NULL,
+                                                               &transfer));
+        set_pending_event (priv, transfer);
+    }
 
-    if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_array)
-        transfer_image_to_device (priv, priv, priv->last_queue);
+    update_location (priv, UFO_BUFFER_LOCATION_DEVICE, FALSE);
 
-    update_location (priv, UFO_BUFFER_LOCATION_DEVICE);
+    if (event != NULL)
+        *event = priv->pending_event;
 
     return priv->device_array;
 }
 
+/**
+ * ufo_buffer_get_pending_event:
+ * @buffer: A #UfoBuffer.
+ *
+ * Get the event of the last asynchronous transfer that has not been waited
+ * for yet.
+ *
+ * Returns: (transfer none): A cl_event owned by @buffer or %NULL.
+ */
+gpointer
+ufo_buffer_get_pending_event (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    return buffer->priv->pending_event;
+}
+
+/**
+ * ufo_buffer_wait:
+ * @buffer: A #UfoBuffer.
+ *
+ * Block until all asynchronous transfers of @buffer have finished.
+ */
+void
+ufo_buffer_wait (UfoBuffer *buffer)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    wait_pending_event (buffer->priv);
+}
+
 /**
  * ufo_buffer_get_device_array_with_offset:
  * @buffer: A #UfoBuffer
@@ -957,6 +2080,7 @@ ufo_buffer_get_device_array_view (UfoBuffer *buffer,
     }
 
     update_last_queue (priv, cmd_queue);
+    wait_pending_event (priv);
 
     size = region->size[0] * region->size[1] * region->size[2] * sizeof(float);
     src_row_pitch = sizeof(float) * priv->requisition.dims[0];
@@ -969,6 +2093,8 @@ ufo_buffer_get_device_array_view (UfoBuffer *buffer,
     UFO_RESOURCES_CHECK_CLERR (errcode);
 
     if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array) {
+        widen_on_host (priv);
+
         if (priv->requisition.n_dims == 1) {
             UFO_RESOURCES_CHECK_CLERR (clEnqueueWriteBuffer (cmd_queue, mem, CL_TRUE,
                                                              region->origin[0] * sizeof (float), size,
@@ -1031,6 +2157,276 @@ ufo_buffer_get_device_array_view (UfoBuffer *buffer,
     return mem;
 }
 
+/*
+ * Extend @region to three dimensions of @priv. Returns %FALSE if it does not
+ * fit.
+ */
+static gboolean
+normalize_region (UfoBufferPrivate *priv,
+                  UfoRegion *region,
+                  gsize origin[3],
+                  gsize size[3],
+                  gsize dims[3])
+{
+    for (guint i = 0; i < 3; i++) {
+        if (i < priv->requisition.n_dims) {
+            origin[i] = region->origin[i];
+            size[i] = region->size[i];
+            dims[i] = priv->requisition.dims[i];
+        }
+        else {
+            origin[i] = 0;
+            size[i] = 1;
+            dims[i] = 1;
+        }
+
+        if (origin[i] + size[i] > dims[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * ufo_buffer_new_view:
+ * @parent: A #UfoBuffer
+ * @region: Region of @parent
+ *
+ * Create a buffer whose host array is the @region of the host array of
+ * @parent, without copying any data. Because host arrays are dense, @region
+ * must be contiguous, i.e. it may only be smaller than @parent in its
+ * outermost partial dimension, like a range of complete rows of an image.
+ *
+ * The data of @parent is brought to the host. Writes to the host array of the
+ * view are visible in @parent and vice versa, as long as neither of them is
+ * resized. The view keeps a reference on @parent.
+ *
+ * Returns: (transfer full): A new #UfoBuffer or %NULL if @region is not
+ * contiguous or exceeds @parent.
+ */
+UfoBuffer *
+ufo_buffer_new_view (UfoBuffer *parent,
+                     UfoRegion *region)
+{
+    UfoBufferPrivate *ppriv;
+    UfoBufferPrivate *priv;
+    UfoBuffer *view;
+    UfoRequisition requisition;
+    gsize origin[3];
+    gsize size[3];
+    gsize dims[3];
+    gsize offset;
+    gfloat *host_array;
+
+    g_return_val_if_fail (UFO_IS_BUFFER (parent) && region != NULL, NULL);
+    ppriv = parent->priv;
+    g_return_val_if_fail (ppriv->n_frames == 1, NULL);
+
+    if (!normalize_region (ppriv, region, origin, size, dims)) {
+        g_warning ("Requested view exceeds buffer size");
+        return NULL;
+    }
+
+    /* Only the outermost partial dimension may be smaller than the parent */
+    for (guint i = 0; i < 3; i++) {
+        if (size[i] == dims[i])
+            continue;
+
+        for (guint j = i + 1; j < 3; j++) {
+            if (size[j] != 1) {
+                g_warning ("Requested view is not contiguous");
+                return NULL;
+            }
+        }
+
+        break;
+    }
+
+    ufo_buffer_get_host_array (parent, NULL);
+
+    /* Views must not be written into a read-only mapping */
+    make_host_writable (ppriv);
+    host_array = ppriv->host_array;
+
+    requisition.n_dims = ppriv->requisition.n_dims;
+
+    for (guint i = 0; i < requisition.n_dims; i++)
+        requisition.dims[i] = size[i];
+
+    offset = origin[0] + dims[0] * (origin[1] + dims[1] * origin[2]);
+
+    view = ufo_buffer_new (&requisition, ppriv->context);
+    priv = view->priv;
+    priv->host_array = host_array + offset;
+    priv->free = FALSE;
+    priv->parent = g_object_ref (parent);
+    update_location (priv, UFO_BUFFER_LOCATION_HOST, FALSE);
+
+    return view;
+}
+
+/**
+ * ufo_buffer_copy_region:
+ * @src: Source #UfoBuffer
+ * @region: Region of @src to copy
+ * @dst: Destination #UfoBuffer
+ * @dst_origin: (array fixed-size=3): Origin of the copied region in @dst
+ *
+ * Copy a rectangular @region of @src to @dst at @dst_origin, without touching
+ * the rest of @dst. If the data of @src or @dst is in device memory, the copy
+ * is done with rectangular OpenCL transfers and no full frame is moved between
+ * host and device. Images are accessed through their device arrays, so a
+ * destination image is in device array memory afterwards.
+ */
+void
+ufo_buffer_copy_region (UfoBuffer *src,
+                        UfoRegion *region,
+                        UfoBuffer *dst,
+                        const gsize *dst_origin)
+{
+    UfoBufferPrivate *spriv;
+    UfoBufferPrivate *dpriv;
+    UfoRegion dst_region;
+    cl_command_queue queue;
+    gsize src_origin[3], src_dims[3];
+    gsize dst_offset[3], dst_dims[3];
+    gsize size[3], dst_size[3];
+    gsize src_pitch[2];
+    gsize dst_pitch[2];
+    gboolean src_on_device;
+    gboolean dst_on_device;
+    gchar *src_host = NULL;
+    gchar *dst_host = NULL;
+    cl_mem src_mem = NULL;
+    cl_mem dst_mem = NULL;
+
+    g_return_if_fail (UFO_IS_BUFFER (src) && UFO_IS_BUFFER (dst));
+    g_return_if_fail (region != NULL && dst_origin != NULL);
+
+    spriv = src->priv;
+    dpriv = dst->priv;
+    g_return_if_fail (spriv->n_frames == 1 && dpriv->n_frames == 1);
+
+    for (guint i = 0; i < UFO_BUFFER_MAX_NDIMS; i++) {
+        dst_region.origin[i] = dst_origin[i];
+        dst_region.size[i] = region->size[i];
+    }
+
+    if (!normalize_region (spriv, region, src_origin, size, src_dims) ||
+        !normalize_region (dpriv, &dst_region, dst_offset, dst_size, dst_dims) ||
+        memcmp (size, dst_size, sizeof (size)) != 0) {
+        g_warning ("Requested region exceeds buffer size");
+        return;
+    }
+
+    /* Row and slice pitch in bytes, the first dimension is in bytes too */
+    src_pitch[0] = src_dims[0] * sizeof (gfloat);
+    src_pitch[1] = src_pitch[0] * src_dims[1];
+    dst_pitch[0] = dst_dims[0] * sizeof (gfloat);
+    dst_pitch[1] = dst_pitch[0] * dst_dims[1];
+    src_origin[0] *= sizeof (gfloat);
+    dst_offset[0] *= sizeof (gfloat);
+    size[0] *= sizeof (gfloat);
+
+    queue = spriv->last_queue != NULL ? spriv->last_queue : dpriv->last_queue;
+    src_on_device = queue != NULL &&
+                    (spriv->location == UFO_BUFFER_LOCATION_DEVICE ||
+                     spriv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE);
+    dst_on_device = queue != NULL && dpriv->context != NULL &&
+                    (dpriv->location == UFO_BUFFER_LOCATION_DEVICE ||
+                     dpriv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE);
+
+    if (src_on_device)
+        src_mem = ufo_buffer_begin_read (src, UFO_BUFFER_LOCATION_DEVICE, queue);
+    else
+        src_host = (gchar *) ufo_buffer_begin_read (src, UFO_BUFFER_LOCATION_HOST, NULL);
+
+    if (dst_on_device) {
+        dst_mem = ufo_buffer_get_device_array (dst, queue);
+    }
+    else {
+        ufo_buffer_get_host_array (dst, NULL);
+        make_host_writable (dpriv);
+        dst_host = (gchar *) dpriv->host_array;
+    }
+
+    if (src_on_device && dst_on_device) {
+        cl_event event;
+
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueCopyBufferRect (queue, src_mem, dst_mem,
+                                                            src_origin, dst_offset, size,
+                                                            src_pitch[0], src_pitch[1],
+                                                            dst_pitch[0], dst_pitch[1],
+                                                            0, NULL, &event));
+        UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    }
+    else if (src_on_device) {
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBufferRect (queue, src_mem, CL_TRUE,
+                                                            src_origin, dst_offset, size,
+                                                            src_pitch[0], src_pitch[1],
+                                                            dst_pitch[0], dst_pitch[1],
+                                                            dst_host, 0, NULL, NULL));
+    }
+    else if (dst_on_device) {
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueWriteBufferRect (queue, dst_mem, CL_TRUE,
+                                                             dst_offset, src_origin, size,
+                                                             dst_pitch[0], dst_pitch[1],
+                                                             src_pitch[0], src_pitch[1],
+                                                             src_host, 0, NULL, NULL));
+    }
+    else {
+        for (gsize z = 0; z < size[2]; z++) {
+            for (gsize y = 0; y < size[1]; y++) {
+                memmove (dst_host + (dst_offset[2] + z) * dst_pitch[1] + (dst_offset[1] + y) * dst_pitch[0] + dst_offset[0],
+                         src_host + (src_origin[2] + z) * src_pitch[1] + (src_origin[1] + y) * src_pitch[0] + src_origin[0],
+                         size[0]);
+            }
+        }
+    }
+
+    /* All copies above have completed */
+    ufo_buffer_end_read (src);
+}
+
+static cl_mem
+get_device_image (UfoBufferPrivate *priv,
+                  cl_command_queue cmd_queue,
+                  gboolean read_only)
+{
+    update_last_queue (priv, cmd_queue);
+    sync_pending_event (priv, priv->last_queue);
+
+    if (priv->device_image == NULL)
+        alloc_device_image (priv);
+
+    if (!has_copy (priv, UFO_BUFFER_LOCATION_DEVICE_IMAGE)) {
+        /* Copying on the device is cheaper than going through the host */
+        if (has_copy (priv, UFO_BUFFER_LOCATION_DEVICE)) {
+            transfer_device_to_image (priv, priv, priv->last_queue);
+        }
+        else if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array) {
+            if (priv->depth != UFO_BUFFER_DEPTH_32F) {
+                /* Widen on the device and go through the regular array */
+                if (priv->device_array == NULL)
+                    alloc_device_array (priv);
+
+                transfer_host_to_device (priv, priv, priv->last_queue);
+                transfer_device_to_image (priv, priv, priv->last_queue);
+
+                if (read_only)
+                    priv->mirrors |= LOCATION_BIT (UFO_BUFFER_LOCATION_DEVICE);
+            }
+            else
+                transfer_host_to_image (priv, priv, priv->last_queue);
+        }
+    }
+
+    update_location (priv, UFO_BUFFER_LOCATION_DEVICE_IMAGE, read_only);
+
+    return priv->device_image;
+}
+
 /**
  * ufo_buffer_get_device_image:
  * @buffer: A #UfoBuffer.
@@ -1046,25 +2442,12 @@ gpointer
 ufo_buffer_get_device_image (UfoBuffer *buffer,
                              gpointer cmd_queue)
 {
-    UfoBufferPrivate *priv;
-
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
-    priv = buffer->priv;
-
-    update_last_queue (priv, cmd_queue);
-
-    if (priv->device_image == NULL)
-        alloc_device_image (priv);
-
-    if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
-        transfer_host_to_image (priv, priv, priv->last_queue);
 
-    if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
-        transfer_device_to_image (priv, priv, priv->last_queue);
+    /* Images describe a single frame */
+    g_return_val_if_fail (buffer->priv->n_frames == 1, NULL);
 
-    update_location (priv, UFO_BUFFER_LOCATION_DEVICE_IMAGE);
-
-    return priv->device_image;
+    return get_device_image (buffer->priv, cmd_queue, FALSE);
 }
 
 /**
@@ -1085,59 +2468,107 @@ ufo_buffer_get_location (UfoBuffer *buffer)
  * @buffer: A #UfoBuffer
  *
  * Discard the current and use the last location without copying to it first.
+ * If that is the host array, its data keeps the depth it was left with.
  */
 void
 ufo_buffer_discard_location (UfoBuffer *buffer)
 {
+    UfoBufferPrivate *priv;
+
     g_return_if_fail (UFO_IS_BUFFER (buffer));
-    buffer->priv->location = buffer->priv->last_location;
+    priv = buffer->priv;
+    priv->location = priv->last_location;
+    priv->mirrors = 0;
+
+    /* Whoever writes the buffer next expects regular memory */
+    if (priv->mapping != NULL)
+        free_host_mem (priv);
 }
 
-static void
-convert_data (UfoBufferPrivate *priv,
-              gconstpointer data,
-              UfoBufferDepth depth)
+/**
+ * ufo_buffer_begin_read:
+ * @buffer: A #UfoBuffer
+ * @location: Location in which the data is needed
+ * @cmd_queue: (allow-none): A cl_command_queue object or %NULL
+ *
+ * Get the data of @buffer in @location for reading only, i.e. the host array,
+ * the device array or the device image. Unlike ufo_buffer_get_host_array(),
+ * ufo_buffer_get_device_array() and ufo_buffer_get_device_image(), the copies
+ * in other locations stay valid, so that alternating between locations
+ * transfers the data only once. The returned data must not be modified, and
+ * @buffer must not be accessed for writing until ufo_buffer_end_read() is
+ * called. Calls may be nested and several threads may read @buffer at the
+ * same time.
+ *
+ * Returns: (transfer none): The float array, cl_mem object or cl_mem image of
+ * @buffer or %NULL if @location is invalid.
+ */
+gpointer
+ufo_buffer_begin_read (UfoBuffer *buffer,
+                       UfoBufferLocation location,
+                       gpointer cmd_queue)
 {
-    gint n_pixels;
-    gfloat *dst;
+    UfoBufferPrivate *priv;
+    gpointer data;
 
-    n_pixels = (gint) (priv->size / 4);
-    dst = priv->host_array;
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    g_return_val_if_fail (location == UFO_BUFFER_LOCATION_HOST ||
+                          location == UFO_BUFFER_LOCATION_DEVICE ||
+                          location == UFO_BUFFER_LOCATION_DEVICE_IMAGE, NULL);
 
-    /* To save a memory allocation and several copies, we process data from back
-     * to front. This is possible if src bit depth is at most half as wide as
-     * the 32-bit target buffer. The processor cache should not be a
-     * problem. */
-    if (depth == UFO_BUFFER_DEPTH_8U) {
-        const guint8 *src = (const guint8 *) data;
+    priv = buffer->priv;
 
-        for (gint i = (n_pixels - 1); i >= 0; i--)
-            dst[i] = ((gfloat) src[i]);
+    /* Images describe a single frame */
+    g_return_val_if_fail (location != UFO_BUFFER_LOCATION_DEVICE_IMAGE || priv->n_frames == 1, NULL);
+
+    g_atomic_int_inc (&priv->n_readers);
+
+    /*
+     * Several readers may get the data of a shared buffer in different
+     * locations at the same time. Only the transfer is serialized, the data is
+     * read without holding the lock.
+     */
+    g_bit_lock (&priv->read_lock, 0);
+
+    switch (location) {
+        case UFO_BUFFER_LOCATION_HOST:
+            data = get_host_array (priv, cmd_queue, TRUE);
+            break;
+        case UFO_BUFFER_LOCATION_DEVICE:
+            data = get_device_array (priv, cmd_queue, TRUE);
+            break;
+        default:
+            data = get_device_image (priv, cmd_queue, TRUE);
+            break;
     }
-    else if (depth == UFO_BUFFER_DEPTH_16U) {
-        const guint16 *src = (const guint16 *) data;
 
-        for (gint i = (n_pixels - 1); i >= 0; i--)
-            dst[i] = ((gfloat) src[i]);
-    }
-    else if (depth == UFO_BUFFER_DEPTH_16S) {
-        const gint16 *src = (const gint16 *) data;
+    g_bit_unlock (&priv->read_lock, 0);
 
-        for (gint i = (n_pixels - 1); i >= 0; i--)
-            dst[i] = ((gfloat) src[i]);
-    }
-    else if (depth == UFO_BUFFER_DEPTH_32S) {
-        const gint32 *src = (const gint32 *) data;
+    return data;
+}
 
-        for (gint i = (n_pixels - 1); i >= 0; i--)
-            dst[i] = ((gfloat) src[i]);
-    }
-    else if (depth == UFO_BUFFER_DEPTH_32U) {
-        const guint32 *src = (const guint32 *) data;
+/**
+ * ufo_buffer_end_read:
+ * @buffer: A #UfoBuffer
+ *
+ * End a read-only access started with ufo_buffer_begin_read().
+ */
+void
+ufo_buffer_end_read (UfoBuffer *buffer)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    g_return_if_fail (g_atomic_int_get (&buffer->priv->n_readers) > 0);
+    g_atomic_int_add (&buffer->priv->n_readers, -1);
+}
 
-        for (gint i = (n_pixels - 1); i >= 0; i--)
-            dst[i] = ((gfloat) src[i]);
-    }
+static void
+convert_data (UfoBufferPrivate *priv,
+              gconstpointer data,
+              UfoBufferDepth depth)
+{
+    /* To save a memory allocation and several copies, data is processed from
+     * back to front if it already lives in the host array. */
+    ufo_convert_to_float (priv->host_array, data, depth, priv->size / sizeof (gfloat));
 }
 
 /**
@@ -1156,9 +2587,65 @@ ufo_buffer_convert (UfoBuffer *buffer,
 
     g_return_if_fail (UFO_IS_BUFFER (buffer));
     priv = buffer->priv;
+    wait_pending_event (priv);
 
-    if (priv->host_array != NULL)
+    if (priv->mapping != NULL)
+        convert_mapping (priv, depth);
+    else if (priv->host_array != NULL)
         convert_data (priv, priv->host_array, depth);
+
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+}
+
+/**
+ * ufo_buffer_set_depth:
+ * @buffer: A #UfoBuffer
+ * @depth: Bit depth of the data in the host array
+ *
+ * Declare that the host array of @buffer holds tightly packed data of @depth,
+ * e.g. as read from a camera or file. Unlike ufo_buffer_convert(), the data is
+ * not converted right away. When it is requested on the device, only the
+ * native bytes are transferred and widened to 32-bit floating point by an
+ * OpenCL kernel. Accessing the host array again converts the data on the host.
+ *
+ * The host array must be the current location of @buffer, i.e. it must have
+ * been filled after calling ufo_buffer_get_host_array().
+ */
+void
+ufo_buffer_set_depth (UfoBuffer *buffer,
+                      UfoBufferDepth depth)
+{
+    UfoBufferPrivate *priv;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    g_return_if_fail (depth > UFO_BUFFER_DEPTH_INVALID && depth <= UFO_BUFFER_DEPTH_32F);
+
+    priv = buffer->priv;
+
+    if (priv->location != UFO_BUFFER_LOCATION_HOST || priv->host_array == NULL) {
+        g_warning ("Native depth can only be set for host data");
+        return;
+    }
+
+    wait_pending_event (priv);
+    priv->depth = depth;
+}
+
+/**
+ * ufo_buffer_get_depth:
+ * @buffer: A #UfoBuffer
+ *
+ * Get the bit depth of the data in the host array as set with
+ * ufo_buffer_set_depth().
+ *
+ * Returns: The depth of data that has not been converted yet or
+ * #UFO_BUFFER_DEPTH_32F.
+ */
+UfoBufferDepth
+ufo_buffer_get_depth (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), UFO_BUFFER_DEPTH_INVALID);
+    return buffer->priv->depth;
 }
 
 /**
@@ -1181,11 +2668,213 @@ ufo_buffer_convert_from_data (UfoBuffer *buffer,
 
     g_return_if_fail (UFO_IS_BUFFER (buffer));
     priv = buffer->priv;
+    wait_pending_event (priv);
 
-    if (priv->host_array == NULL)
+    if (priv->host_array == NULL || priv->mapping != NULL)
         alloc_host_mem (priv);
 
     convert_data (priv, data, depth);
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+    priv->mirrors = 0;
+}
+
+/**
+ * ufo_buffer_convert_to:
+ * @buffer: A #UfoBuffer
+ * @data: Pointer to memory that receives the converted data
+ * @depth: Target bit depth
+ * @min: Value that is mapped to the lowest value of @depth
+ * @max: Value that is mapped to the highest value of @depth
+ *
+ * Convert the 32-bit floating point data of @buffer to @depth and store it in
+ * @data. If @min is less than @max, the range [@min, @max] is scaled to the
+ * full range of @depth, otherwise values are only rounded and clamped. Only
+ * unsigned integer depths and #UFO_BUFFER_DEPTH_32F are supported.
+ *
+ * Note: @data must provide as many elements as the buffer holds.
+ */
+void
+ufo_buffer_convert_to (UfoBuffer *buffer,
+                       gpointer data,
+                       UfoBufferDepth depth,
+                       gfloat min,
+                       gfloat max)
+{
+    UfoBufferPrivate *priv;
+    gfloat *host_array;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    g_return_if_fail (data != NULL);
+
+    priv = buffer->priv;
+    host_array = ufo_buffer_begin_read (buffer, UFO_BUFFER_LOCATION_HOST, NULL);
+    ufo_convert_from_float (data, host_array, depth, priv->size / sizeof (gfloat), min, max);
+    ufo_buffer_end_read (buffer);
+}
+
+static Metadata *
+metadata_new (guint n_allocated)
+{
+    Metadata *metadata;
+
+    metadata = g_malloc (sizeof (Metadata) + n_allocated * sizeof (MetadataEntry));
+    metadata->ref_count = 1;
+    metadata->n_entries = 0;
+    metadata->n_allocated = n_allocated;
+    return metadata;
+}
+
+static Metadata *
+metadata_ref (Metadata *metadata)
+{
+    if (metadata != NULL)
+        g_atomic_int_inc (&metadata->ref_count);
+
+    return metadata;
+}
+
+static void
+metadata_unref (Metadata *metadata)
+{
+    if (metadata == NULL || !g_atomic_int_dec_and_test (&metadata->ref_count))
+        return;
+
+    for (guint i = 0; i < metadata->n_entries; i++)
+        g_value_unset (&metadata->entries[i].value);
+
+    g_free (metadata);
+}
+
+static MetadataEntry *
+metadata_lookup (Metadata *metadata,
+                 GQuark key)
+{
+    if (metadata == NULL || key == 0)
+        return NULL;
+
+    for (guint i = 0; i < metadata->n_entries; i++) {
+        if (metadata->entries[i].key == key)
+            return &metadata->entries[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Make sure that *store is owned exclusively by the caller and has room for at
+ * least one more entry.
+ */
+static Metadata *
+metadata_make_writable (Metadata **store)
+{
+    Metadata *old = *store;
+    Metadata *new;
+    guint n_allocated;
+
+    if (old == NULL) {
+        *store = metadata_new (METADATA_MIN_ENTRIES);
+        return *store;
+    }
+
+    if (g_atomic_int_get (&old->ref_count) == 1) {
+        if (old->n_entries == old->n_allocated) {
+            old->n_allocated *= 2;
+            old = g_realloc (old, sizeof (Metadata) + old->n_allocated * sizeof (MetadataEntry));
+            *store = old;
+        }
+
+        return old;
+    }
+
+    n_allocated = old->n_allocated;
+
+    if (old->n_entries == n_allocated)
+        n_allocated *= 2;
+
+    new = metadata_new (n_allocated);
+
+    for (guint i = 0; i < old->n_entries; i++) {
+        MetadataEntry *entry = &new->entries[i];
+
+        entry->key = old->entries[i].key;
+        memset (&entry->value, 0, sizeof (GValue));
+        g_value_init (&entry->value, G_VALUE_TYPE (&old->entries[i].value));
+        g_value_copy (&old->entries[i].value, &entry->value);
+    }
+
+    new->n_entries = old->n_entries;
+    metadata_unref (old);
+    *store = new;
+    return new;
+}
+
+static void
+metadata_set (Metadata **store,
+              GQuark key,
+              const GValue *value)
+{
+    Metadata *metadata;
+    MetadataEntry *entry;
+    GValue copy = { 0, };
+
+    /* Copy first, @value may point into the store we are about to modify */
+    g_value_init (&copy, G_VALUE_TYPE (value));
+    g_value_copy (value, &copy);
+
+    metadata = metadata_make_writable (store);
+    entry = metadata_lookup (metadata, key);
+
+    if (entry != NULL) {
+        g_value_unset (&entry->value);
+    }
+    else {
+        entry = &metadata->entries[metadata->n_entries++];
+        entry->key = key;
+    }
+
+    entry->value = copy;
+}
+
+static void
+metadata_copy (Metadata *src,
+               Metadata **dst)
+{
+    gboolean replace = TRUE;
+
+    if (src == NULL || src == *dst)
+        return;
+
+    /* If every key of dst is overwritten anyway, which is the common case for
+     * output buffers that are re-used frame after frame, we can share the
+     * store of src instead of merging. */
+    if (*dst != NULL) {
+        for (guint i = 0; i < (*dst)->n_entries && replace; i++)
+            replace = metadata_lookup (src, (*dst)->entries[i].key) != NULL;
+    }
+
+    if (replace) {
+        Metadata *old = *dst;
+
+        *dst = metadata_ref (src);
+        metadata_unref (old);
+        return;
+    }
+
+    for (guint i = 0; i < src->n_entries; i++)
+        metadata_set (dst, src->entries[i].key, &src->entries[i].value);
+}
+
+static void
+free_frame_metadata (UfoBufferPrivate *priv)
+{
+    if (priv->frame_metadata == NULL)
+        return;
+
+    for (guint i = 0; i < priv->n_frames; i++)
+        metadata_unref (priv->frame_metadata[i]);
+
+    g_free (priv->frame_metadata);
+    priv->frame_metadata = NULL;
 }
 
 /**
@@ -1193,7 +2882,8 @@ ufo_buffer_convert_from_data (UfoBuffer *buffer,
  * @buffer: A #UfoBuffer
  * @name: Name of the associated meta data
  *
- * Retrieve meta data.
+ * Retrieve meta data. The returned value may be shared with other buffers and
+ * must not be modified, use ufo_buffer_set_metadata() instead.
  *
  * Returns: previously defined metadata #GValue for this buffer.
  */
@@ -1201,8 +2891,11 @@ GValue *
 ufo_buffer_get_metadata (UfoBuffer *buffer,
                          const gchar *name)
 {
+    MetadataEntry *entry;
+
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
-    return g_hash_table_lookup (buffer->priv->metadata, name);
+    entry = metadata_lookup (buffer->priv->metadata, g_quark_try_string (name));
+    return entry != NULL ? &entry->value : NULL;
 }
 
 /**
@@ -1218,24 +2911,9 @@ ufo_buffer_set_metadata (UfoBuffer *buffer,
                          const gchar *name,
                          GValue *value)
 {
-    UfoBufferPrivate *priv;
-    GValue *old;
-    GValue *new;
-
     g_return_if_fail (UFO_IS_BUFFER (buffer));
-    priv = buffer->priv;
-
-    old = g_hash_table_lookup (priv->metadata, name);
-
-    if (old != NULL) {
-        g_value_unset (old);
-    }
-
-    new = g_malloc0 (sizeof (GValue));
-    g_value_init (new, G_VALUE_TYPE ((GValue *) value));
-    g_value_copy (value, new);
-
-    g_hash_table_replace (priv->metadata, g_strdup (name), new);
+    g_return_if_fail (name != NULL && G_IS_VALUE (value));
+    metadata_set (&buffer->priv->metadata, g_quark_from_string (name), value);
 }
 
 /**
@@ -1243,29 +2921,50 @@ ufo_buffer_set_metadata (UfoBuffer *buffer,
  * @src: Source buffer
  * @dst: Destination buffer
  *
- * Copies meta data content from @src to @dst.
+ * Copies meta data content from @src to @dst. Existing entries of @dst with the
+ * same name are replaced. The values are shared between both buffers until
+ * either of them is modified. If both buffers hold the same number of frames,
+ * per-frame meta data is copied as well.
  */
 void
 ufo_buffer_copy_metadata (UfoBuffer *src,
                           UfoBuffer *dst)
 {
-    UfoBufferPrivate *priv;
-    GList *keys;
-    GList *it;
+    UfoBufferPrivate *spriv;
+    UfoBufferPrivate *dpriv;
 
     g_return_if_fail (UFO_IS_BUFFER (src) && UFO_IS_BUFFER (dst));
-    priv = src->priv;
-    keys = g_hash_table_get_keys (priv->metadata);
+    spriv = src->priv;
+    dpriv = dst->priv;
+
+    metadata_copy (spriv->metadata, &dpriv->metadata);
 
-    g_list_for (keys, it) {
-        GValue *value;
-        const gchar *name = (const gchar *) it->data;
+    if (spriv->frame_metadata != NULL && spriv->n_frames == dpriv->n_frames) {
+        if (dpriv->frame_metadata == NULL)
+            dpriv->frame_metadata = g_new0 (Metadata *, dpriv->n_frames);
 
-        value = ufo_buffer_get_metadata (src, name);
-        ufo_buffer_set_metadata (dst, name, value);
+        for (guint i = 0; i < spriv->n_frames; i++)
+            metadata_copy (spriv->frame_metadata[i], &dpriv->frame_metadata[i]);
     }
+}
+
+void
+ufo_buffer_clear_metadata (UfoBuffer *buffer)
+{
+    UfoBufferPrivate *priv;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    priv = buffer->priv;
+    metadata_unref (priv->metadata);
+    priv->metadata = NULL;
+    free_frame_metadata (priv);
+}
 
-    g_list_free (keys);
+gpointer
+ufo_buffer_get_context (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    return buffer->priv->context;
 }
 
 /**
@@ -1281,80 +2980,389 @@ ufo_buffer_copy_metadata (UfoBuffer *src,
 GList *
 ufo_buffer_get_metadata_keys (UfoBuffer *buffer)
 {
+    Metadata *metadata;
+    GList *keys = NULL;
+
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
-    return g_hash_table_get_keys (buffer->priv->metadata);
+    metadata = buffer->priv->metadata;
+
+    if (metadata == NULL)
+        return NULL;
+
+    for (guint i = metadata->n_entries; i > 0; i--)
+        keys = g_list_prepend (keys, (gpointer) g_quark_to_string (metadata->entries[i - 1].key));
+
+    return keys;
 }
 
 /**
- * ufo_buffer_max:
+ * ufo_buffer_set_n_frames:
  * @buffer: A #UfoBuffer
- * @cmd_queue: An OpenCL command queue or %NULL
- *
- * Return the maximum value of @buffer.
+ * @n_frames: Number of frames
  *
- * Returns: The maximum found.
+ * Turn @buffer into a batch of @n_frames consecutive frames, each of the size
+ * described by its requisition. Batches let tasks that declare
+ * %UFO_TASK_MODE_BATCH process several small frames with a single kernel
+ * launch. If @n_frames is smaller than before, the data of the remaining
+ * frames is kept, otherwise the contents of @buffer are undefined afterwards.
+ * Per-frame meta data of removed frames is dropped.
  */
-gfloat
-ufo_buffer_max (UfoBuffer *buffer,
-                gpointer cmd_queue)
+void
+ufo_buffer_set_n_frames (UfoBuffer *buffer,
+                         guint n_frames)
 {
     UfoBufferPrivate *priv;
-    gsize n;
-    gfloat max = -G_MAXFLOAT;
-
-    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0.0f);
+    gsize frame_size;
 
+    g_return_if_fail (UFO_IS_BUFFER (buffer) && n_frames > 0);
     priv = buffer->priv;
 
-    if (priv->location != UFO_BUFFER_LOCATION_HOST) {
-        g_warning ("max() not supported for non-host buffers");
-        return 0.0f;
+    if (n_frames == priv->n_frames)
+        return;
+
+    wait_pending_event (priv);
+    frame_size = priv->size / priv->n_frames;
+
+    if (priv->frame_metadata != NULL) {
+        for (guint i = n_frames; i < priv->n_frames; i++)
+            metadata_unref (priv->frame_metadata[i]);
+
+        priv->frame_metadata = g_renew (Metadata *, priv->frame_metadata, n_frames);
+
+        for (guint i = priv->n_frames; i < n_frames; i++)
+            priv->frame_metadata[i] = NULL;
     }
 
-    n = get_num_elements (priv);
+    /* Shrinking keeps the larger arrays, transfers only use priv->size */
+    release_device_image (priv);
+    set_size (priv, frame_size * n_frames);
+    priv->n_frames = n_frames;
+}
+
+/**
+ * ufo_buffer_get_n_frames:
+ * @buffer: A #UfoBuffer
+ *
+ * Get the number of frames in @buffer.
+ *
+ * Returns: Number of frames, 1 unless @buffer is a batch.
+ */
+guint
+ufo_buffer_get_n_frames (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 1);
+    return buffer->priv->n_frames;
+}
+
+/*
+ * Copy @size bytes between two buffers, on the device if the source data lives
+ * there. If @overwrite is %TRUE, the previous contents of @dst are not needed
+ * and do not have to be transferred first.
+ */
+static void
+copy_frame (UfoBuffer *src,
+            gsize src_offset,
+            UfoBuffer *dst,
+            gsize dst_offset,
+            gsize size,
+            gboolean overwrite)
+{
+    UfoBufferPrivate *spriv = src->priv;
+    UfoBufferPrivate *dpriv = dst->priv;
+    cl_command_queue queue;
+
+    queue = spriv->last_queue != NULL ? spriv->last_queue : dpriv->last_queue;
+
+    if (spriv->location == UFO_BUFFER_LOCATION_DEVICE && queue != NULL && dpriv->context != NULL) {
+        cl_mem src_mem;
+        cl_mem dst_mem;
+        cl_event event;
+
+        src_mem = ufo_buffer_begin_read (src, UFO_BUFFER_LOCATION_DEVICE, queue);
+
+        if (overwrite) {
+            wait_pending_event (dpriv);
+            dpriv->last_queue = queue;
+
+            if (dpriv->device_array == NULL)
+                alloc_device_array (dpriv);
+
+            update_location (dpriv, UFO_BUFFER_LOCATION_DEVICE, FALSE);
+            dst_mem = dpriv->device_array;
+        }
+        else {
+            dst_mem = ufo_buffer_get_device_array (dst, queue);
+        }
 
-    for (gsize i = 0; i < n; i++) {
-        if (priv->host_array[i] > max)
-            max = priv->host_array[i];
+        /* The source is usually handed back to its producer right away */
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueCopyBuffer (queue, src_mem, dst_mem,
+                                                        src_offset, dst_offset, size,
+                                                        0, NULL, &event));
+        UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+        ufo_buffer_end_read (src);
     }
+    else {
+        gchar *src_host;
+        gchar *dst_host;
+
+        src_host = (gchar *) ufo_buffer_begin_read (src, UFO_BUFFER_LOCATION_HOST, NULL);
+
+        if (overwrite) {
+            wait_pending_event (dpriv);
+
+            if (dpriv->host_array == NULL || dpriv->mapping != NULL)
+                alloc_host_mem (dpriv);
+
+            update_location (dpriv, UFO_BUFFER_LOCATION_HOST, FALSE);
+            dpriv->depth = UFO_BUFFER_DEPTH_32F;
+            dst_host = (gchar *) dpriv->host_array;
+        }
+        else {
+            dst_host = (gchar *) ufo_buffer_get_host_array (dst, NULL);
+        }
 
-    return max;
+        memcpy (dst_host + dst_offset, src_host + src_offset, size);
+        ufo_buffer_end_read (src);
+    }
 }
 
 /**
- * ufo_buffer_min:
+ * ufo_buffer_get_frame:
+ * @buffer: A #UfoBuffer holding a batch
+ * @index: Index of the frame
+ * @frame: A #UfoBuffer that receives the frame
+ *
+ * Copy frame @index of @buffer to @frame, which is resized to a single frame
+ * if necessary. Meta data of the frame is shared with @frame.
+ */
+void
+ufo_buffer_get_frame (UfoBuffer *buffer,
+                      guint index,
+                      UfoBuffer *frame)
+{
+    UfoBufferPrivate *priv;
+    gsize frame_size;
+    Metadata *metadata;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer) && UFO_IS_BUFFER (frame));
+    priv = buffer->priv;
+    g_return_if_fail (index < priv->n_frames);
+
+    ufo_buffer_set_n_frames (frame, 1);
+
+    if (!requisition_equal (&priv->requisition, &frame->priv->requisition))
+        ufo_buffer_resize (frame, &priv->requisition);
+
+    frame_size = priv->size / priv->n_frames;
+    copy_frame (buffer, index * frame_size, frame, 0, frame_size, TRUE);
+
+    metadata = priv->frame_metadata != NULL && priv->frame_metadata[index] != NULL ?
+        priv->frame_metadata[index] : priv->metadata;
+
+    if (metadata != frame->priv->metadata) {
+        metadata_unref (frame->priv->metadata);
+        frame->priv->metadata = metadata_ref (metadata);
+    }
+}
+
+/**
+ * ufo_buffer_set_frame:
+ * @buffer: A #UfoBuffer holding a batch
+ * @index: Index of the frame
+ * @frame: A #UfoBuffer with a single frame of the same requisition
+ *
+ * Copy @frame into frame @index of @buffer. The other frames of @buffer are
+ * kept. Meta data of @frame becomes the meta data of frame @index.
+ */
+void
+ufo_buffer_set_frame (UfoBuffer *buffer,
+                      guint index,
+                      UfoBuffer *frame)
+{
+    UfoBufferPrivate *priv;
+    gsize frame_size;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer) && UFO_IS_BUFFER (frame));
+    priv = buffer->priv;
+    g_return_if_fail (index < priv->n_frames && frame->priv->n_frames == 1);
+    g_return_if_fail (requisition_equal (&priv->requisition, &frame->priv->requisition));
+
+    frame_size = frame->priv->size;
+    copy_frame (frame, 0, buffer, index * frame_size, frame_size, priv->n_frames == 1);
+
+    if (priv->frame_metadata == NULL)
+        priv->frame_metadata = g_new0 (Metadata *, priv->n_frames);
+
+    metadata_unref (priv->frame_metadata[index]);
+    priv->frame_metadata[index] = metadata_ref (frame->priv->metadata);
+}
+
+/**
+ * ufo_buffer_get_frame_metadata:
  * @buffer: A #UfoBuffer
- * @cmd_queue: An OpenCL command queue or %NULL
+ * @index: Index of the frame
+ * @name: Name of the associated meta data
  *
- * Return the minimum value of @buffer.
+ * Retrieve meta data of frame @index. If the frame has no meta data of its own,
+ * the meta data of @buffer is used.
  *
- * Returns: The minimum found.
+ * Returns: previously defined metadata #GValue for this frame.
  */
-gfloat
-ufo_buffer_min (UfoBuffer *buffer,
-                gpointer cmd_queue)
+GValue *
+ufo_buffer_get_frame_metadata (UfoBuffer *buffer,
+                               guint index,
+                               const gchar *name)
 {
     UfoBufferPrivate *priv;
-    gsize n;
-    gfloat min = G_MAXFLOAT;
+    MetadataEntry *entry;
+    Metadata *metadata;
 
-    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0.0f);
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+    priv = buffer->priv;
+    g_return_val_if_fail (index < priv->n_frames, NULL);
+
+    metadata = priv->frame_metadata != NULL && priv->frame_metadata[index] != NULL ?
+        priv->frame_metadata[index] : priv->metadata;
+
+    entry = metadata_lookup (metadata, g_quark_try_string (name));
+    return entry != NULL ? &entry->value : NULL;
+}
+
+/**
+ * ufo_buffer_set_frame_metadata:
+ * @buffer: A #UfoBuffer
+ * @index: Index of the frame
+ * @name: Name of the associated meta data
+ * @value: #GValue of the meta data
+ *
+ * Associates a key-value pair with frame @index of @buffer.
+ */
+void
+ufo_buffer_set_frame_metadata (UfoBuffer *buffer,
+                               guint index,
+                               const gchar *name,
+                               GValue *value)
+{
+    UfoBufferPrivate *priv;
 
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    g_return_if_fail (name != NULL && G_IS_VALUE (value));
     priv = buffer->priv;
+    g_return_if_fail (index < priv->n_frames);
 
-    if (priv->location != UFO_BUFFER_LOCATION_HOST) {
-        g_warning ("min() not supported for non-host buffers");
-        return 0.0f;
-    }
+    if (priv->frame_metadata == NULL)
+        priv->frame_metadata = g_new0 (Metadata *, priv->n_frames);
+
+    metadata_set (&priv->frame_metadata[index], g_quark_from_string (name), value);
+}
+
+/**
+ * ufo_buffer_get_stats:
+ * @buffer: A #UfoBuffer
+ * @stats: (out caller-allocates): Location to store the statistics
+ * @histogram: (array length=n_bins) (allow-none): Location for @n_bins counts
+ *  or %NULL
+ * @n_bins: Number of histogram bins
+ * @cmd_queue: (allow-none): An OpenCL command queue or %NULL
+ *
+ * Compute minimum, maximum, sum, mean and variance of @buffer in one pass. If
+ * @histogram is not %NULL, it is filled with the number of values in @n_bins
+ * equally sized bins between the minimum and the maximum.
+ *
+ * If the data of @buffer resides on the device, the statistics are computed
+ * there and only the results are transferred. The location of @buffer is not
+ * changed to host memory in that case. The result is undefined if @buffer
+ * contains NaN values.
+ */
+void
+ufo_buffer_get_stats (UfoBuffer *buffer,
+                      UfoBufferStats *stats,
+                      guint *histogram,
+                      guint n_bins,
+                      gpointer cmd_queue)
+{
+    UfoBufferPrivate *priv;
+    gfloat *host_array;
+    gsize n;
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    g_return_if_fail (stats != NULL);
 
+    priv = buffer->priv;
     n = get_num_elements (priv);
 
-    for (gsize i = 0; i < n; i++) {
-        if (priv->host_array[i] < min)
-            min = priv->host_array[i];
+    if (histogram == NULL)
+        n_bins = 0;
+
+    if (priv->location == UFO_BUFFER_LOCATION_DEVICE ||
+        priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE) {
+        gpointer queue;
+        gpointer mem;
+        gboolean computed;
+
+        update_last_queue (priv, cmd_queue);
+        queue = priv->last_queue;
+
+        if (queue != NULL) {
+            mem = ufo_buffer_begin_read (buffer, UFO_BUFFER_LOCATION_DEVICE, queue);
+            computed = ufo_stats_compute_device (queue, mem, n, stats, histogram, n_bins);
+            ufo_buffer_end_read (buffer);
+
+            if (computed)
+                return;
+        }
     }
 
-    return min;
+    host_array = ufo_buffer_begin_read (buffer, UFO_BUFFER_LOCATION_HOST, cmd_queue);
+    ufo_stats_compute_host (host_array, n, stats);
+
+    if (n_bins > 0)
+        ufo_stats_histogram_host (host_array, n, stats->min, stats->max, histogram, n_bins);
+
+    ufo_buffer_end_read (buffer);
+}
+
+/**
+ * ufo_buffer_max:
+ * @buffer: A #UfoBuffer
+ * @cmd_queue: An OpenCL command queue or %NULL
+ *
+ * Return the maximum value of @buffer. Use ufo_buffer_get_stats() if you also
+ * need the minimum.
+ *
+ * Returns: The maximum found.
+ */
+gfloat
+ufo_buffer_max (UfoBuffer *buffer,
+                gpointer cmd_queue)
+{
+    UfoBufferStats stats;
+
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0.0f);
+    ufo_buffer_get_stats (buffer, &stats, NULL, 0, cmd_queue);
+    return stats.max;
+}
+
+/**
+ * ufo_buffer_min:
+ * @buffer: A #UfoBuffer
+ * @cmd_queue: An OpenCL command queue or %NULL
+ *
+ * Return the minimum value of @buffer. Use ufo_buffer_get_stats() if you also
+ * need the maximum.
+ *
+ * Returns: The minimum found.
+ */
+gfloat
+ufo_buffer_min (UfoBuffer *buffer,
+                gpointer cmd_queue)
+{
+    UfoBufferStats stats;
+
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0.0f);
+    ufo_buffer_get_stats (buffer, &stats, NULL, 0, cmd_queue);
+    return stats.min;
 }
 
 /**
@@ -1401,10 +3409,8 @@ ufo_buffer_finalize (GObject *gobject)
     UfoBuffer *buffer = UFO_BUFFER (gobject);
     UfoBufferPrivate *priv = UFO_BUFFER_GET_PRIVATE (buffer);
 
-    if (priv->free)
-        g_free (priv->host_array);
-
-    priv->host_array = NULL;
+    wait_pending_event (priv);
+    free_host_mem (priv);
 
     g_list_for (priv->sub_device_arrays, it) {
         free_cl_mem ((cl_mem *) &it->data);
@@ -1412,8 +3418,13 @@ ufo_buffer_finalize (GObject *gobject)
 
     free_cl_mem (&priv->device_array);
     free_cl_mem (&priv->device_image);
+    free_cl_mem (&priv->raw_array);
+
+    metadata_unref (priv->metadata);
+    free_frame_metadata (priv);
 
-    g_hash_table_destroy (priv->metadata);
+    if (priv->parent != NULL)
+        g_object_unref (priv->parent);
 
     G_OBJECT_CLASS(ufo_buffer_parent_class)->finalize(gobject);
 }
@@ -1437,11 +3448,27 @@ ufo_buffer_init (UfoBuffer *buffer)
     priv->device_image = NULL;
     priv->host_array = NULL;
     priv->free = TRUE;
+    priv->host_size = 0;
+    priv->host_memory = UFO_BUFFER_HOST_MEMORY_DEFAULT;
+    priv->pinned_array = NULL;
+    priv->pinned_queue = NULL;
+    priv->pending_event = NULL;
+    priv->depth = UFO_BUFFER_DEPTH_32F;
+    priv->raw_array = NULL;
+    priv->mapping = NULL;
+    priv->mapping_size = 0;
+    priv->mapping_writable = FALSE;
+    priv->n_frames = 1;
+    priv->frame_metadata = NULL;
+    priv->parent = NULL;
 
     priv->location = UFO_BUFFER_LOCATION_INVALID;
     priv->last_location = UFO_BUFFER_LOCATION_INVALID;
+    priv->mirrors = 0;
+    priv->n_readers = 0;
+    priv->read_lock = 0;
     priv->requisition.n_dims = 0;
-    priv->metadata = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->metadata = NULL;
     priv->sub_device_arrays = NULL;
 }
 
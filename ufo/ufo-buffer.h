@@ -45,6 +45,7 @@ typedef struct _UfoBufferPrivate    UfoBufferPrivate;
 typedef struct _UfoBufferParamSpec  UfoBufferParamSpec;
 typedef struct _UfoRequisition      UfoRequisition;
 typedef struct _UfoRegion           UfoRegion;
+typedef struct _UfoBufferStats      UfoBufferStats;
 
 /**
  * UfoBuffer:
@@ -93,6 +94,24 @@ struct _UfoRegion {
     gsize size[UFO_BUFFER_MAX_NDIMS];
 };
 
+/**
+ * UfoBufferStats:
+ * @min: Smallest value
+ * @max: Largest value
+ * @sum: Sum of all values
+ * @mean: Arithmetic mean
+ * @variance: Population variance
+ *
+ * Statistics of a #UfoBuffer as computed by ufo_buffer_get_stats().
+ */
+struct _UfoBufferStats {
+    gfloat  min;
+    gfloat  max;
+    gdouble sum;
+    gdouble mean;
+    gdouble variance;
+};
+
 typedef enum {
     UFO_BUFFER_DEPTH_INVALID,
     UFO_BUFFER_DEPTH_8U,
@@ -110,6 +129,17 @@ typedef enum {
     UFO_BUFFER_LOCATION_INVALID
 } UfoBufferLocation;
 
+typedef enum {
+    UFO_BUFFER_HOST_MEMORY_DEFAULT = 0,
+    UFO_BUFFER_HOST_MEMORY_PAGEABLE,
+    UFO_BUFFER_HOST_MEMORY_PINNED
+} UfoBufferHostMemory;
+
+typedef enum {
+    UFO_BUFFER_MAPPING_READ_ONLY = 0,
+    UFO_BUFFER_MAPPING_COPY_ON_WRITE
+} UfoBufferMapping;
+
 UfoBuffer*  ufo_buffer_new                  (UfoRequisition *requisition,
                                              gpointer        context);
 UfoBuffer*  ufo_buffer_new_with_size        (GList          *dims,
@@ -117,6 +147,16 @@ UfoBuffer*  ufo_buffer_new_with_size        (GList          *dims,
 UfoBuffer*  ufo_buffer_new_with_data        (UfoRequisition *requisition,
                                              gpointer        data,
                                              gpointer        context);
+UfoBuffer*  ufo_buffer_new_from_file_mapping
+                                            (const gchar    *filename,
+                                             gsize           offset,
+                                             UfoRequisition *requisition,
+                                             UfoBufferDepth  depth,
+                                             UfoBufferMapping mode,
+                                             gpointer        context,
+                                             GError        **error);
+UfoBuffer*  ufo_buffer_new_view             (UfoBuffer      *parent,
+                                             UfoRegion      *region);
 void        ufo_buffer_resize               (UfoBuffer      *buffer,
                                              UfoRequisition *requisition);
 gint        ufo_buffer_cmp_dimensions       (UfoBuffer      *buffer,
@@ -126,6 +166,10 @@ void        ufo_buffer_get_requisition      (UfoBuffer      *buffer,
 gsize       ufo_buffer_get_size             (UfoBuffer      *buffer);
 void        ufo_buffer_copy                 (UfoBuffer      *src,
                                              UfoBuffer      *dst);
+void        ufo_buffer_copy_region          (UfoBuffer      *src,
+                                             UfoRegion      *region,
+                                             UfoBuffer      *dst,
+                                             const gsize    *dst_origin);
 UfoBuffer  *ufo_buffer_dup                  (UfoBuffer      *buffer);
 void        ufo_buffer_set_host_array       (UfoBuffer      *buffer,
                                              gpointer        array,
@@ -134,11 +178,25 @@ void        ufo_buffer_copy_host_array      (UfoBuffer      *buffer,
 		                                     gpointer        array);
 gfloat*     ufo_buffer_get_host_array       (UfoBuffer      *buffer,
                                              gpointer        cmd_queue);
+void        ufo_buffer_set_host_memory      (UfoBuffer      *buffer,
+                                             UfoBufferHostMemory mode);
+UfoBufferHostMemory
+            ufo_buffer_get_host_memory      (UfoBuffer      *buffer);
+gboolean    ufo_buffer_is_pinned            (UfoBuffer      *buffer);
+gfloat*     ufo_buffer_get_host_array_async (UfoBuffer      *buffer,
+                                             gpointer        cmd_queue,
+                                             gpointer       *event);
 void        ufo_buffer_set_device_array     (UfoBuffer      *buffer,
                                              gpointer        array,
                                              gboolean        free_data);
 gpointer    ufo_buffer_get_device_array     (UfoBuffer      *buffer,
                                              gpointer        cmd_queue);
+gpointer    ufo_buffer_get_device_array_async
+                                            (UfoBuffer      *buffer,
+                                             gpointer        cmd_queue,
+                                             gpointer       *event);
+gpointer    ufo_buffer_get_pending_event    (UfoBuffer      *buffer);
+void        ufo_buffer_wait                 (UfoBuffer      *buffer);
 gpointer    ufo_buffer_get_device_array_view(UfoBuffer      *buffer,
                                              gpointer        cmd_queue,
                                              UfoRegion      *region);
@@ -151,11 +209,24 @@ gpointer    ufo_buffer_get_device_array_with_offset
 UfoBufferLocation
             ufo_buffer_get_location         (UfoBuffer      *buffer);
 void        ufo_buffer_discard_location     (UfoBuffer      *buffer);
+gpointer    ufo_buffer_begin_read           (UfoBuffer      *buffer,
+                                             UfoBufferLocation location,
+                                             gpointer        cmd_queue);
+void        ufo_buffer_end_read             (UfoBuffer      *buffer);
 void        ufo_buffer_convert              (UfoBuffer      *buffer,
                                              UfoBufferDepth  depth);
 void        ufo_buffer_convert_from_data    (UfoBuffer      *buffer,
                                              gconstpointer   data,
                                              UfoBufferDepth  depth);
+void        ufo_buffer_set_depth            (UfoBuffer      *buffer,
+                                             UfoBufferDepth  depth);
+UfoBufferDepth
+            ufo_buffer_get_depth            (UfoBuffer      *buffer);
+void        ufo_buffer_convert_to           (UfoBuffer      *buffer,
+                                             gpointer        data,
+                                             UfoBufferDepth  depth,
+                                             gfloat          min,
+                                             gfloat          max);
 GValue     *ufo_buffer_get_metadata         (UfoBuffer      *buffer,
                                              const gchar    *name);
 void        ufo_buffer_set_metadata         (UfoBuffer      *buffer,
@@ -164,7 +235,28 @@ void        ufo_buffer_set_metadata         (UfoBuffer      *buffer,
 void        ufo_buffer_copy_metadata        (UfoBuffer      *src,
                                              UfoBuffer      *dst);
 GList      *ufo_buffer_get_metadata_keys    (UfoBuffer      *buffer);
+void        ufo_buffer_set_n_frames         (UfoBuffer      *buffer,
+                                             guint           n_frames);
+guint       ufo_buffer_get_n_frames         (UfoBuffer      *buffer);
+void        ufo_buffer_get_frame            (UfoBuffer      *buffer,
+                                             guint           index,
+                                             UfoBuffer      *frame);
+void        ufo_buffer_set_frame            (UfoBuffer      *buffer,
+                                             guint           index,
+                                             UfoBuffer      *frame);
+GValue     *ufo_buffer_get_frame_metadata   (UfoBuffer      *buffer,
+                                             guint           index,
+                                             const gchar    *name);
+void        ufo_buffer_set_frame_metadata   (UfoBuffer      *buffer,
+                                             guint           index,
+                                             const gchar    *name,
+                                             GValue         *value);
 
+void        ufo_buffer_get_stats            (UfoBuffer      *buffer,
+                                             UfoBufferStats *stats,
+                                             guint          *histogram,
+                                             guint           n_bins,
+                                             gpointer        cmd_queue);
 gfloat      ufo_buffer_max                  (UfoBuffer      *buffer,
                                              gpointer        cmd_queue);
 gfloat      ufo_buffer_min                  (UfoBuffer      *buffer,
@@ -0,0 +1,731 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string.h>
+#include <ufo/ufo-resources.h>
+#include "ufo-convert.h"
+#include "ufo-priv.h"
+
+/*
+ * Depth conversion kernels used by ufo_buffer_convert() and
+ * ufo_buffer_convert_to(). On x86 we use SSE2, which is always available on
+ * x86-64, and dispatch to AVX2 at run-time if the compiler lets us build it.
+ *
+ * Widening may happen in-place, i.e. the narrow source data occupies the front
+ * of the float destination. This works as long as we go from back to front and
+ * every block is loaded completely before anything is stored.
+ *
+ * Native-depth device data is widened by the OpenCL kernels below. 8 and 16 bit
+ * data needs a separate source buffer, 32 bit data is converted in-place.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define HAVE_SSE2
+#include <emmintrin.h>
+
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define HAVE_AVX2
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+#endif
+
+/* Do not bother other threads for less than this amount of elements */
+#define MIN_ELEMENTS_PER_THREAD     (1 << 21)
+#define MAX_THREADS                 4
+
+/* Largest float that still fits into 32 bit unsigned integers */
+#define MAX_32U_AS_FLOAT            4294967040.0f
+
+static const gchar *kernel_source =
+    "kernel void widen_8u (global const uchar *src, global float *dst)\n"
+    "{\n"
+    "    dst[get_global_id (0)] = convert_float (src[get_global_id (0)]);\n"
+    "}\n"
+    "\n"
+    "kernel void widen_16u (global const ushort *src, global float *dst)\n"
+    "{\n"
+    "    dst[get_global_id (0)] = convert_float (src[get_global_id (0)]);\n"
+    "}\n"
+    "\n"
+    "kernel void widen_16s (global const short *src, global float *dst)\n"
+    "{\n"
+    "    dst[get_global_id (0)] = convert_float (src[get_global_id (0)]);\n"
+    "}\n"
+    "\n"
+    "kernel void widen_32s (global float *data)\n"
+    "{\n"
+    "    data[get_global_id (0)] = convert_float (as_int (data[get_global_id (0)]));\n"
+    "}\n"
+    "\n"
+    "kernel void widen_32u (global float *data)\n"
+    "{\n"
+    "    data[get_global_id (0)] = convert_float (as_uint (data[get_global_id (0)]));\n"
+    "}\n";
+
+typedef void (*WidenFunc) (gfloat *dst, gconstpointer src, gsize n);
+typedef void (*NarrowFunc) (gpointer dst, const gfloat *src, gsize n,
+                            gfloat offset, gfloat scale, gfloat upper);
+
+typedef struct {
+    WidenFunc widen[UFO_BUFFER_DEPTH_32F + 1];
+    NarrowFunc narrow[UFO_BUFFER_DEPTH_32F + 1];
+    guint n_threads;
+    GThreadPool *pool;
+} Dispatch;
+
+typedef struct {
+    GMutex *lock;
+    GCond *cond;
+    guint remaining;
+} Completion;
+
+typedef struct {
+    WidenFunc widen;
+    NarrowFunc narrow;
+    gpointer dst;
+    gconstpointer src;
+    gsize n;
+    gfloat offset;
+    gfloat scale;
+    gfloat upper;
+    Completion *completion;
+} Chunk;
+
+#define DEFINE_WIDEN_SCALAR(name, type) \
+static void \
+name (gfloat *dst, gconstpointer data, gsize n) \
+{ \
+    const type *src = (const type *) data; \
+    for (gsize i = n; i > 0; i--) \
+        dst[i - 1] = (gfloat) src[i - 1]; \
+}
+
+DEFINE_WIDEN_SCALAR (widen_8u_scalar, guint8)
+DEFINE_WIDEN_SCALAR (widen_16u_scalar, guint16)
+DEFINE_WIDEN_SCALAR (widen_16s_scalar, gint16)
+DEFINE_WIDEN_SCALAR (widen_32s_scalar, gint32)
+DEFINE_WIDEN_SCALAR (widen_32u_scalar, guint32)
+
+static inline gfloat
+transform (gfloat value,
+           gfloat offset,
+           gfloat scale,
+           gfloat upper)
+{
+    gfloat result = (value - offset) * scale;
+
+    /* Written this way to map NaN to 0 like the SIMD versions */
+    if (!(result > 0.0f))
+        result = 0.0f;
+
+    if (result > upper)
+        result = upper;
+
+    return result + 0.5f;
+}
+
+#define DEFINE_NARROW_SCALAR(name, type) \
+static void \
+name (gpointer data, const gfloat *src, gsize n, \
+      gfloat offset, gfloat scale, gfloat upper) \
+{ \
+    type *dst = (type *) data; \
+    for (gsize i = 0; i < n; i++) \
+        dst[i] = (type) transform (src[i], offset, scale, upper); \
+}
+
+DEFINE_NARROW_SCALAR (narrow_8u_scalar, guint8)
+DEFINE_NARROW_SCALAR (narrow_16u_scalar, guint16)
+DEFINE_NARROW_SCALAR (narrow_32u_scalar, guint32)
+
+#ifdef HAVE_SSE2
+static void
+widen_8u_sse2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const guint8 *src = (const guint8 *) data;
+    const __m128i zero = _mm_setzero_si128 ();
+    const gsize n_vec = n & ~((gsize) 15);
+
+    widen_8u_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 16) {
+        const __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i - 16));
+        const __m128i lo = _mm_unpacklo_epi8 (v, zero);
+        const __m128i hi = _mm_unpackhi_epi8 (v, zero);
+        gfloat *d = dst + i - 16;
+
+        _mm_storeu_ps (d + 12, _mm_cvtepi32_ps (_mm_unpackhi_epi16 (hi, zero)));
+        _mm_storeu_ps (d + 8, _mm_cvtepi32_ps (_mm_unpacklo_epi16 (hi, zero)));
+        _mm_storeu_ps (d + 4, _mm_cvtepi32_ps (_mm_unpackhi_epi16 (lo, zero)));
+        _mm_storeu_ps (d, _mm_cvtepi32_ps (_mm_unpacklo_epi16 (lo, zero)));
+    }
+}
+
+static void
+widen_16u_sse2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const guint16 *src = (const guint16 *) data;
+    const __m128i zero = _mm_setzero_si128 ();
+    const gsize n_vec = n & ~((gsize) 7);
+
+    widen_16u_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 8) {
+        const __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i - 8));
+        gfloat *d = dst + i - 8;
+
+        _mm_storeu_ps (d + 4, _mm_cvtepi32_ps (_mm_unpackhi_epi16 (v, zero)));
+        _mm_storeu_ps (d, _mm_cvtepi32_ps (_mm_unpacklo_epi16 (v, zero)));
+    }
+}
+
+static void
+widen_16s_sse2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const gint16 *src = (const gint16 *) data;
+    const gsize n_vec = n & ~((gsize) 7);
+
+    widen_16s_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 8) {
+        const __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i - 8));
+        gfloat *d = dst + i - 8;
+
+        /* Interleave with itself and shift back to sign-extend */
+        _mm_storeu_ps (d + 4, _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16)));
+        _mm_storeu_ps (d, _mm_cvtepi32_ps (_mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16)));
+    }
+}
+
+static void
+widen_32s_sse2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const gint32 *src = (const gint32 *) data;
+    const gsize n_vec = n & ~((gsize) 3);
+
+    widen_32s_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 4) {
+        const __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i - 4));
+        _mm_storeu_ps (dst + i - 4, _mm_cvtepi32_ps (v));
+    }
+}
+
+static void
+widen_32u_sse2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const guint32 *src = (const guint32 *) data;
+    const __m128i mask = _mm_set1_epi32 (0xffff);
+    const __m128 factor = _mm_set1_ps (65536.0f);
+    const gsize n_vec = n & ~((gsize) 3);
+
+    widen_32u_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    /* Both halves convert exactly, so the sum is rounded only once */
+    for (gsize i = n_vec; i > 0; i -= 4) {
+        const __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i - 4));
+        const __m128 hi = _mm_cvtepi32_ps (_mm_srli_epi32 (v, 16));
+        const __m128 lo = _mm_cvtepi32_ps (_mm_and_si128 (v, mask));
+
+        _mm_storeu_ps (dst + i - 4, _mm_add_ps (_mm_mul_ps (hi, factor), lo));
+    }
+}
+
+static inline __m128i
+transform_sse2 (const gfloat *src, __m128 offset, __m128 scale, __m128 upper)
+{
+    const __m128 zero = _mm_setzero_ps ();
+    const __m128 half = _mm_set1_ps (0.5f);
+    __m128 v;
+
+    v = _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (src), offset), scale);
+    v = _mm_min_ps (_mm_max_ps (v, zero), upper);
+    return _mm_cvttps_epi32 (_mm_add_ps (v, half));
+}
+
+static void
+narrow_8u_sse2 (gpointer data, const gfloat *src, gsize n,
+                gfloat offset, gfloat scale, gfloat upper)
+{
+    guint8 *dst = (guint8 *) data;
+    const __m128 voffset = _mm_set1_ps (offset);
+    const __m128 vscale = _mm_set1_ps (scale);
+    const __m128 vupper = _mm_set1_ps (upper);
+    const gsize n_vec = n & ~((gsize) 15);
+
+    for (gsize i = 0; i < n_vec; i += 16) {
+        const __m128i a = transform_sse2 (src + i, voffset, vscale, vupper);
+        const __m128i b = transform_sse2 (src + i + 4, voffset, vscale, vupper);
+        const __m128i c = transform_sse2 (src + i + 8, voffset, vscale, vupper);
+        const __m128i d = transform_sse2 (src + i + 12, voffset, vscale, vupper);
+
+        _mm_storeu_si128 ((__m128i *) (dst + i),
+                          _mm_packus_epi16 (_mm_packs_epi32 (a, b), _mm_packs_epi32 (c, d)));
+    }
+
+    narrow_8u_scalar (dst + n_vec, src + n_vec, n - n_vec, offset, scale, upper);
+}
+
+static void
+narrow_16u_sse2 (gpointer data, const gfloat *src, gsize n,
+                 gfloat offset, gfloat scale, gfloat upper)
+{
+    guint16 *dst = (guint16 *) data;
+    const __m128 voffset = _mm_set1_ps (offset);
+    const __m128 vscale = _mm_set1_ps (scale);
+    const __m128 vupper = _mm_set1_ps (upper);
+    const __m128i bias32 = _mm_set1_epi32 (32768);
+    const __m128i bias16 = _mm_set1_epi16 ((gint16) 0x8000);
+    const gsize n_vec = n & ~((gsize) 7);
+
+    /* SSE2 can only pack with signed saturation, so shift into signed range */
+    for (gsize i = 0; i < n_vec; i += 8) {
+        const __m128i a = _mm_sub_epi32 (transform_sse2 (src + i, voffset, vscale, vupper), bias32);
+        const __m128i b = _mm_sub_epi32 (transform_sse2 (src + i + 4, voffset, vscale, vupper), bias32);
+
+        _mm_storeu_si128 ((__m128i *) (dst + i), _mm_xor_si128 (_mm_packs_epi32 (a, b), bias16));
+    }
+
+    narrow_16u_scalar (dst + n_vec, src + n_vec, n - n_vec, offset, scale, upper);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 static void
+widen_8u_avx2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const guint8 *src = (const guint8 *) data;
+    const gsize n_vec = n & ~((gsize) 15);
+
+    widen_8u_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 16) {
+        const __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i - 16));
+        const __m256i lo = _mm256_cvtepu8_epi32 (v);
+        const __m256i hi = _mm256_cvtepu8_epi32 (_mm_srli_si128 (v, 8));
+        gfloat *d = dst + i - 16;
+
+        _mm256_storeu_ps (d + 8, _mm256_cvtepi32_ps (hi));
+        _mm256_storeu_ps (d, _mm256_cvtepi32_ps (lo));
+    }
+}
+
+TARGET_AVX2 static void
+widen_16u_avx2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const guint16 *src = (const guint16 *) data;
+    const gsize n_vec = n & ~((gsize) 15);
+
+    widen_16u_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 16) {
+        const __m128i lo = _mm_loadu_si128 ((const __m128i *) (src + i - 16));
+        const __m128i hi = _mm_loadu_si128 ((const __m128i *) (src + i - 8));
+        gfloat *d = dst + i - 16;
+
+        _mm256_storeu_ps (d + 8, _mm256_cvtepi32_ps (_mm256_cvtepu16_epi32 (hi)));
+        _mm256_storeu_ps (d, _mm256_cvtepi32_ps (_mm256_cvtepu16_epi32 (lo)));
+    }
+}
+
+TARGET_AVX2 static void
+widen_16s_avx2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const gint16 *src = (const gint16 *) data;
+    const gsize n_vec = n & ~((gsize) 15);
+
+    widen_16s_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 16) {
+        const __m128i lo = _mm_loadu_si128 ((const __m128i *) (src + i - 16));
+        const __m128i hi = _mm_loadu_si128 ((const __m128i *) (src + i - 8));
+        gfloat *d = dst + i - 16;
+
+        _mm256_storeu_ps (d + 8, _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (hi)));
+        _mm256_storeu_ps (d, _mm256_cvtepi32_ps (_mm256_cvtepi16_epi32 (lo)));
+    }
+}
+
+TARGET_AVX2 static void
+widen_32s_avx2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const gint32 *src = (const gint32 *) data;
+    const gsize n_vec = n & ~((gsize) 7);
+
+    widen_32s_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 8) {
+        const __m256i v = _mm256_loadu_si256 ((const __m256i *) (src + i - 8));
+        _mm256_storeu_ps (dst + i - 8, _mm256_cvtepi32_ps (v));
+    }
+}
+
+TARGET_AVX2 static void
+widen_32u_avx2 (gfloat *dst, gconstpointer data, gsize n)
+{
+    const guint32 *src = (const guint32 *) data;
+    const __m256i mask = _mm256_set1_epi32 (0xffff);
+    const __m256 factor = _mm256_set1_ps (65536.0f);
+    const gsize n_vec = n & ~((gsize) 7);
+
+    widen_32u_scalar (dst + n_vec, src + n_vec, n - n_vec);
+
+    for (gsize i = n_vec; i > 0; i -= 8) {
+        const __m256i v = _mm256_loadu_si256 ((const __m256i *) (src + i - 8));
+        const __m256 hi = _mm256_cvtepi32_ps (_mm256_srli_epi32 (v, 16));
+        const __m256 lo = _mm256_cvtepi32_ps (_mm256_and_si256 (v, mask));
+
+        _mm256_storeu_ps (dst + i - 8, _mm256_add_ps (_mm256_mul_ps (hi, factor), lo));
+    }
+}
+#endif
+
+static void
+run_chunk (Chunk *chunk)
+{
+    if (chunk->widen != NULL)
+        chunk->widen ((gfloat *) chunk->dst, chunk->src, chunk->n);
+    else
+        chunk->narrow (chunk->dst, (const gfloat *) chunk->src, chunk->n,
+                       chunk->offset, chunk->scale, chunk->upper);
+}
+
+static void
+run_chunk_in_pool (Chunk *chunk,
+                   gpointer unused)
+{
+    Completion *completion = chunk->completion;
+
+    run_chunk (chunk);
+
+    g_mutex_lock (completion->lock);
+
+    if (--completion->remaining == 0)
+        g_cond_signal (completion->cond);
+
+    g_mutex_unlock (completion->lock);
+}
+
+static guint
+get_num_threads (void)
+{
+    const gchar *var;
+    guint n_threads = 1;
+
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    n_threads = MIN (MAX_THREADS, g_get_num_processors ());
+#endif
+
+    var = g_getenv ("UFO_CONVERT_THREADS");
+
+    if (var != NULL)
+        n_threads = MAX (1, (guint) g_ascii_strtoull (var, NULL, 10));
+
+    return n_threads;
+}
+
+static Dispatch *
+get_dispatch (void)
+{
+    static gsize initialized = 0;
+    static Dispatch dispatch;
+
+    if (g_once_init_enter (&initialized)) {
+        memset (&dispatch, 0, sizeof (dispatch));
+
+        dispatch.widen[UFO_BUFFER_DEPTH_8U] = widen_8u_scalar;
+        dispatch.widen[UFO_BUFFER_DEPTH_16U] = widen_16u_scalar;
+        dispatch.widen[UFO_BUFFER_DEPTH_16S] = widen_16s_scalar;
+        dispatch.widen[UFO_BUFFER_DEPTH_32S] = widen_32s_scalar;
+        dispatch.widen[UFO_BUFFER_DEPTH_32U] = widen_32u_scalar;
+        dispatch.narrow[UFO_BUFFER_DEPTH_8U] = narrow_8u_scalar;
+        dispatch.narrow[UFO_BUFFER_DEPTH_16U] = narrow_16u_scalar;
+        dispatch.narrow[UFO_BUFFER_DEPTH_32U] = narrow_32u_scalar;
+
+#ifdef HAVE_SSE2
+        dispatch.widen[UFO_BUFFER_DEPTH_8U] = widen_8u_sse2;
+        dispatch.widen[UFO_BUFFER_DEPTH_16U] = widen_16u_sse2;
+        dispatch.widen[UFO_BUFFER_DEPTH_16S] = widen_16s_sse2;
+        dispatch.widen[UFO_BUFFER_DEPTH_32S] = widen_32s_sse2;
+        dispatch.widen[UFO_BUFFER_DEPTH_32U] = widen_32u_sse2;
+        dispatch.narrow[UFO_BUFFER_DEPTH_8U] = narrow_8u_sse2;
+        dispatch.narrow[UFO_BUFFER_DEPTH_16U] = narrow_16u_sse2;
+#endif
+
+#ifdef HAVE_AVX2
+        __builtin_cpu_init ();
+
+        if (__builtin_cpu_supports ("avx2")) {
+            g_debug ("Using AVX2 depth conversion");
+            dispatch.widen[UFO_BUFFER_DEPTH_8U] = widen_8u_avx2;
+            dispatch.widen[UFO_BUFFER_DEPTH_16U] = widen_16u_avx2;
+            dispatch.widen[UFO_BUFFER_DEPTH_16S] = widen_16s_avx2;
+            dispatch.widen[UFO_BUFFER_DEPTH_32S] = widen_32s_avx2;
+            dispatch.widen[UFO_BUFFER_DEPTH_32U] = widen_32u_avx2;
+        }
+#endif
+
+        dispatch.n_threads = get_num_threads ();
+
+        if (dispatch.n_threads > 1) {
+            /* The calling thread processes one chunk itself */
+            dispatch.pool = g_thread_pool_new ((GFunc) run_chunk_in_pool, NULL,
+                                               dispatch.n_threads - 1, FALSE, NULL);
+        }
+
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return &dispatch;
+}
+
+static void
+run_split (Dispatch *dispatch,
+           Chunk *whole,
+           gsize dst_size,
+           gsize src_size)
+{
+    Completion completion;
+    Chunk *chunks;
+    guint n_chunks;
+    gsize per_chunk;
+
+    n_chunks = MIN (dispatch->n_threads, whole->n / MIN_ELEMENTS_PER_THREAD);
+
+    if (dispatch->pool == NULL || n_chunks < 2) {
+        run_chunk (whole);
+        return;
+    }
+
+    chunks = g_new0 (Chunk, n_chunks);
+    per_chunk = whole->n / n_chunks;
+
+    completion.lock = g_mutex_new ();
+    completion.cond = g_cond_new ();
+    completion.remaining = n_chunks - 1;
+
+    for (guint i = 0; i < n_chunks; i++) {
+        gsize start = i * per_chunk;
+
+        chunks[i] = *whole;
+        chunks[i].dst = ((guint8 *) whole->dst) + start * dst_size;
+        chunks[i].src = ((const guint8 *) whole->src) + start * src_size;
+        chunks[i].n = i == n_chunks - 1 ? whole->n - start : per_chunk;
+        chunks[i].completion = &completion;
+    }
+
+    for (guint i = 1; i < n_chunks; i++)
+        g_thread_pool_push (dispatch->pool, &chunks[i], NULL);
+
+    run_chunk (&chunks[0]);
+
+    g_mutex_lock (completion.lock);
+
+    while (completion.remaining > 0)
+        g_cond_wait (completion.cond, completion.lock);
+
+    g_mutex_unlock (completion.lock);
+
+    g_cond_free (completion.cond);
+    g_mutex_free (completion.lock);
+    g_free (chunks);
+}
+
+gsize
+ufo_convert_get_depth_size (UfoBufferDepth depth)
+{
+    switch (depth) {
+        case UFO_BUFFER_DEPTH_8U:
+            return 1;
+        case UFO_BUFFER_DEPTH_16U:
+        case UFO_BUFFER_DEPTH_16S:
+            return 2;
+        case UFO_BUFFER_DEPTH_32S:
+        case UFO_BUFFER_DEPTH_32U:
+        case UFO_BUFFER_DEPTH_32F:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Convert @n_elements of @depth in @src to float. @src may start at the same
+ * address as @dst.
+ */
+void
+ufo_convert_to_float (gfloat *dst,
+                      gconstpointer src,
+                      UfoBufferDepth depth,
+                      gsize n_elements)
+{
+    Dispatch *dispatch;
+    Chunk whole;
+    gsize src_size;
+    gboolean overlaps;
+
+    if (depth == UFO_BUFFER_DEPTH_32F) {
+        if ((gconstpointer) dst != src)
+            memmove (dst, src, n_elements * sizeof (gfloat));
+
+        return;
+    }
+
+    dispatch = get_dispatch ();
+    src_size = ufo_convert_get_depth_size (depth);
+
+    if (src_size == 0 || dispatch->widen[depth] == NULL)
+        return;
+
+    memset (&whole, 0, sizeof (whole));
+    whole.widen = dispatch->widen[depth];
+    whole.dst = dst;
+    whole.src = src;
+    whole.n = n_elements;
+
+    overlaps = ((const guint8 *) src < (const guint8 *) (dst + n_elements)) &&
+               ((const guint8 *) dst < ((const guint8 *) src) + n_elements * src_size);
+
+    /*
+     * In-place widening must strictly proceed from back to front, only
+     * same-width conversions can be split safely.
+     */
+    if (overlaps && !(src_size == sizeof (gfloat) && (gconstpointer) dst == src))
+        run_chunk (&whole);
+    else
+        run_split (dispatch, &whole, sizeof (gfloat), src_size);
+}
+
+/*
+ * Convert @n_elements floats to @depth. If @min is less than @max, [@min, @max]
+ * is mapped to the full range of @depth, otherwise values are only clamped.
+ * @dst and @src must not overlap.
+ */
+void
+ufo_convert_from_float (gpointer dst,
+                        const gfloat *src,
+                        UfoBufferDepth depth,
+                        gsize n_elements,
+                        gfloat min,
+                        gfloat max)
+{
+    Dispatch *dispatch;
+    Chunk whole;
+    gfloat upper;
+
+    if (depth == UFO_BUFFER_DEPTH_32F) {
+        memmove (dst, src, n_elements * sizeof (gfloat));
+        return;
+    }
+
+    dispatch = get_dispatch ();
+
+    if (dispatch->narrow[depth] == NULL) {
+        g_warning ("Conversion to depth %i is not supported", depth);
+        return;
+    }
+
+    switch (depth) {
+        case UFO_BUFFER_DEPTH_8U:
+            upper = 255.0f;
+            break;
+        case UFO_BUFFER_DEPTH_16U:
+            upper = 65535.0f;
+            break;
+        default:
+            upper = MAX_32U_AS_FLOAT;
+    }
+
+    memset (&whole, 0, sizeof (whole));
+    whole.narrow = dispatch->narrow[depth];
+    whole.dst = dst;
+    whole.src = src;
+    whole.n = n_elements;
+    whole.upper = upper;
+    whole.offset = 0.0f;
+    whole.scale = 1.0f;
+
+    if (min < max) {
+        whole.offset = min;
+        whole.scale = upper / (max - min);
+    }
+
+    run_split (dispatch, &whole, ufo_convert_get_depth_size (depth), sizeof (gfloat));
+}
+
+/*
+ * Create the kernel that widens @depth to float on the device or %NULL if
+ * @depth needs no conversion or the kernels could not be built. Pass it to
+ * ufo_convert_enqueue_to_float(), which releases it.
+ */
+gpointer
+ufo_convert_create_device_kernel (gpointer context,
+                                  UfoBufferDepth depth)
+{
+    const gchar *names[] = {
+        NULL, "widen_8u", "widen_16u", "widen_16s", "widen_32s", "widen_32u", NULL
+    };
+
+    if (depth <= UFO_BUFFER_DEPTH_INVALID || depth >= UFO_BUFFER_DEPTH_32F)
+        return NULL;
+
+    return ufo_create_context_kernel (context, kernel_source, names[depth]);
+}
+
+/*
+ * Enqueue @kernel to widen @n_elements from @src to @dst after @wait_event. If
+ * the source depth is 32 bit wide, @src and @dst must be the same cl_mem.
+ * Returns the event of the conversion.
+ */
+gpointer
+ufo_convert_enqueue_to_float (gpointer kernel,
+                              gpointer cmd_queue,
+                              gpointer dst,
+                              gpointer src,
+                              gsize n_elements,
+                              gpointer wait_event)
+{
+    cl_event event;
+    cl_uint n_args;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelInfo (kernel, CL_KERNEL_NUM_ARGS, sizeof (cl_uint), &n_args, NULL));
+
+    if (n_args == 1) {
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &dst));
+    }
+    else {
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &src));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &dst));
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, 1, NULL, &n_elements, NULL,
+                                                       wait_event != NULL ? 1 : 0,
+                                                       wait_event != NULL ? (cl_event *) &wait_event : NULL,
+                                                       &event));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseKernel (kernel));
+
+    return event;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_CONVERT_H
+#define UFO_CONVERT_H
+
+#include <glib.h>
+#include <ufo/ufo-buffer.h>
+
+G_BEGIN_DECLS
+
+gsize   ufo_convert_get_depth_size  (UfoBufferDepth  depth);
+void    ufo_convert_to_float        (gfloat         *dst,
+                                     gconstpointer   src,
+                                     UfoBufferDepth  depth,
+                                     gsize           n_elements);
+void    ufo_convert_from_float      (gpointer        dst,
+                                     const gfloat   *src,
+                                     UfoBufferDepth  depth,
+                                     gsize           n_elements,
+                                     gfloat          min,
+                                     gfloat          max);
+gpointer ufo_convert_create_device_kernel
+                                    (gpointer        context,
+                                     UfoBufferDepth  depth);
+gpointer ufo_convert_enqueue_to_float
+                                    (gpointer        kernel,
+                                     gpointer        cmd_queue,
+                                     gpointer        dst,
+                                     gpointer        src,
+                                     gsize           n_elements,
+                                     gpointer        wait_event);
+
+G_END_DECLS
+
+#endif
@@ -32,6 +32,7 @@ struct _UfoCpuNodePrivate {
 #else
     cpu_set_t *mask;
 #endif
+    gint numa_node;
 };
 
 UfoNode *
@@ -49,6 +50,63 @@ ufo_cpu_node_new (gpointer mask)
     return UFO_NODE (node);
 }
 
+/**
+ * ufo_cpu_node_set_numa_node:
+ * @node: A #UfoCpuNode
+ * @numa_node: NUMA node the CPUs of @node belong to or -1 if unknown
+ *
+ * Set the NUMA node of @node.
+ */
+void
+ufo_cpu_node_set_numa_node (UfoCpuNode *node,
+                            gint numa_node)
+{
+    g_return_if_fail (UFO_IS_CPU_NODE (node));
+    node->priv->numa_node = numa_node;
+}
+
+/**
+ * ufo_cpu_node_get_numa_node:
+ * @node: A #UfoCpuNode
+ *
+ * Get the NUMA node of @node.
+ *
+ * Returns: The NUMA node the CPUs of @node belong to or -1 if unknown.
+ */
+gint
+ufo_cpu_node_get_numa_node (UfoCpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_CPU_NODE (node), -1);
+    return node->priv->numa_node;
+}
+
+/**
+ * ufo_cpu_node_pin_thread:
+ * @node: A #UfoCpuNode
+ *
+ * Restrict the calling thread to the CPUs of @node. Memory that the thread
+ * touches first is then allocated on the NUMA node of these CPUs.
+ *
+ * Returns: %TRUE if the thread was pinned.
+ */
+gboolean
+ufo_cpu_node_pin_thread (UfoCpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_CPU_NODE (node), FALSE);
+
+#ifdef __APPLE__
+    return FALSE;
+#else
+    /* A pid of 0 refers to the calling thread */
+    if (sched_setaffinity (0, sizeof (cpu_set_t), node->priv->mask) != 0) {
+        g_warning ("Could not pin thread to NUMA node %i", node->priv->numa_node);
+        return FALSE;
+    }
+
+    return TRUE;
+#endif
+}
+
 /**
  * ufo_cpu_node_get_affinity:
  * @node: A #UfoCpuNode
@@ -84,7 +142,12 @@ static UfoNode *
 ufo_cpu_node_copy_real (UfoNode *node,
                         GError **error)
 {
-    return UFO_NODE (ufo_cpu_node_new (UFO_CPU_NODE (node)->priv->mask));
+    UfoNode *copy;
+
+    copy = ufo_cpu_node_new (UFO_CPU_NODE (node)->priv->mask);
+    ufo_cpu_node_set_numa_node (UFO_CPU_NODE (copy), UFO_CPU_NODE (node)->priv->numa_node);
+
+    return copy;
 }
 
 static gboolean
@@ -133,4 +196,5 @@ ufo_cpu_node_init (UfoCpuNode *self)
     UfoCpuNodePrivate *priv;
     self->priv = priv = UFO_CPU_NODE_GET_PRIVATE (self);
     priv->mask = NULL;
+    priv->numa_node = -1;
 }
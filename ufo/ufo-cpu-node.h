@@ -64,6 +64,10 @@ struct _UfoCpuNodeClass {
 
 UfoNode     *ufo_cpu_node_new           (gpointer mask);
 gpointer     ufo_cpu_node_get_affinity  (UfoCpuNode *node);
+void         ufo_cpu_node_set_numa_node (UfoCpuNode *node,
+                                         gint        numa_node);
+gint         ufo_cpu_node_get_numa_node (UfoCpuNode *node);
+gboolean     ufo_cpu_node_pin_thread    (UfoCpuNode *node);
 GType        ufo_cpu_node_get_type      (void);
 
 G_END_DECLS
@@ -71,6 +71,7 @@ typedef struct {
     UfoTask *task;
     GList *connections;
     cl_context context;
+    UfoCpuNode *cpu_node;
 } TaskData;
 
 enum {
@@ -378,6 +379,9 @@ run_local (TaskData *data)
 {
     UfoTaskMode mode;
 
+    if (data->cpu_node != NULL)
+        ufo_cpu_node_pin_thread (data->cpu_node);
+
     mode = ufo_task_get_mode (data->task) & UFO_TASK_MODE_TYPE_MASK;
 
     switch (mode) {
@@ -518,6 +522,7 @@ ufo_fixed_scheduler_run (UfoBaseScheduler *scheduler,
     GList *threads;
     GList *it;
     GError *tmp_error = NULL;
+    gboolean fuse;
 
     g_return_if_fail (UFO_IS_FIXED_SCHEDULER (scheduler));
 
@@ -526,6 +531,11 @@ ufo_fixed_scheduler_run (UfoBaseScheduler *scheduler,
     if (resources == NULL)
         return;
 
+    g_object_get (scheduler, "fuse", &fuse, NULL);
+
+    if (fuse)
+        ufo_task_graph_fuse (task_graph);
+
     pdata = setup_tasks (UFO_GRAPH (task_graph), scheduler, resources, &tmp_error);
 
     if (tmp_error != NULL) {
@@ -544,6 +554,7 @@ ufo_fixed_scheduler_run (UfoBaseScheduler *scheduler,
         tdata->task = UFO_TASK (it->data);
         tdata->connections = pdata->connections;
         tdata->context = ufo_resources_get_context (resources);
+        tdata->cpu_node = ufo_find_cpu_node (resources, tdata->graph, UFO_TASK_NODE (it->data));
         thread = g_thread_create ((GThreadFunc) run_local, tdata, TRUE, error);
         threads = g_list_append (threads, thread);
     }
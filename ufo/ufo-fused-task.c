@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include <ufo/ufo-fused-task.h>
+#include <ufo/ufo-buffer-pool.h>
+#include <ufo/ufo-task-iface.h>
+
+#include "compat.h"
+
+/**
+ * SECTION:ufo-fused-task
+ * @Short_description: Run a chain of tasks as one
+ * @Title: UfoFusedTask
+ *
+ * A fused task runs a chain of processors, each with a single input, in one
+ * thread. The output of one task is handed to the next through two buffers
+ * that are used in turns, instead of a group and a queue per edge. If the
+ * tasks run on the same GPU, they enqueue their work into the same in-order
+ * command queue and the buffers in between never leave the device.
+ * Fused tasks are created by ufo_task_graph_fuse().
+ */
+
+struct _UfoFusedTaskPrivate {
+    GList *tasks;
+    UfoTask *last;
+    UfoTaskMode mode;
+    UfoBuffer *buffers[2];
+    UfoBuffer *current;
+    gpointer context;
+    gboolean go_on;
+};
+
+static void ufo_task_interface_init (UfoTaskIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UfoFusedTask, ufo_fused_task, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK,
+                                                ufo_task_interface_init))
+
+#define UFO_FUSED_TASK_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_FUSED_TASK, UfoFusedTaskPrivate))
+
+enum {
+    PROP_0,
+    N_PROPERTIES
+};
+
+static void
+set_tasks (UfoFusedTask *fused,
+           GList *tasks)
+{
+    UfoFusedTaskPrivate *priv;
+    GString *identifier;
+    GList *it;
+
+    priv = fused->priv;
+    priv->tasks = g_list_copy (tasks);
+    priv->last = UFO_TASK (g_list_last (tasks)->data);
+
+    /* Only the first task sees the input that siblings may share */
+    priv->mode = UFO_TASK_MODE_PROCESSOR;
+    priv->mode |= ufo_task_get_mode (UFO_TASK (tasks->data)) &
+                  (UFO_TASK_MODE_PROCESSOR_MASK | UFO_TASK_MODE_READ_ONLY_INPUT);
+
+    identifier = g_string_new (NULL);
+
+    g_list_for (tasks, it) {
+        g_object_ref (it->data);
+
+        if (identifier->len > 0)
+            g_string_append_c (identifier, '+');
+
+        g_string_append (identifier, ufo_task_node_get_identifier (UFO_TASK_NODE (it->data)));
+    }
+
+    ufo_task_node_set_identifier (UFO_TASK_NODE (fused), identifier->str);
+    g_string_free (identifier, TRUE);
+}
+
+/**
+ * ufo_fused_task_new:
+ * @tasks: (element-type UfoTaskNode): Chain of tasks in processing order
+ *
+ * Create a task that runs @tasks one after the other. All of them must be
+ * processors with a single input, running either on the CPU or on the same
+ * GPU.
+ *
+ * Returns: (transfer full): A new #UfoFusedTask
+ */
+UfoNode *
+ufo_fused_task_new (GList *tasks)
+{
+    UfoFusedTask *fused;
+
+    g_return_val_if_fail (tasks != NULL, NULL);
+
+    fused = UFO_FUSED_TASK (g_object_new (UFO_TYPE_FUSED_TASK, NULL));
+    set_tasks (fused, tasks);
+
+    return UFO_NODE (fused);
+}
+
+/**
+ * ufo_fused_task_get_tasks:
+ * @task: A #UfoFusedTask
+ *
+ * Get the tasks that @task runs.
+ *
+ * Returns: (transfer none) (element-type UfoTaskNode): List of tasks in
+ * processing order
+ */
+GList *
+ufo_fused_task_get_tasks (UfoFusedTask *task)
+{
+    g_return_val_if_fail (UFO_IS_FUSED_TASK (task), NULL);
+    return task->priv->tasks;
+}
+
+static UfoBuffer *
+get_buffer (UfoFusedTaskPrivate *priv,
+            guint index,
+            UfoRequisition *requisition)
+{
+    if (priv->buffers[index] == NULL) {
+        priv->buffers[index] = ufo_buffer_pool_acquire (ufo_buffer_pool_get_default (),
+                                                        requisition, priv->context);
+    }
+    else if (ufo_buffer_cmp_dimensions (priv->buffers[index], requisition)) {
+        ufo_buffer_resize (priv->buffers[index], requisition);
+    }
+
+    return priv->buffers[index];
+}
+
+static void
+ufo_fused_task_setup (UfoTask *task,
+                      UfoResources *resources,
+                      GError **error)
+{
+    UfoFusedTaskPrivate *priv;
+    GList *it;
+    guint index;
+    guint total;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    priv->context = ufo_resources_get_context (resources);
+    ufo_task_node_get_partition (UFO_TASK_NODE (task), &index, &total);
+
+    g_list_for (priv->tasks, it) {
+        ufo_task_node_set_partition (UFO_TASK_NODE (it->data), index, total);
+        ufo_task_setup (UFO_TASK (it->data), resources, error);
+
+        if (error && *error != NULL)
+            return;
+    }
+}
+
+static guint
+ufo_fused_task_get_num_inputs (UfoTask *task)
+{
+    return 1;
+}
+
+static guint
+ufo_fused_task_get_num_dimensions (UfoTask *task,
+                                   guint input)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    return ufo_task_get_num_dimensions (UFO_TASK (priv->tasks->data), input);
+}
+
+static UfoTaskMode
+ufo_fused_task_get_mode (UfoTask *task)
+{
+    return UFO_FUSED_TASK_GET_PRIVATE (task)->mode;
+}
+
+/*
+ * The output requisition depends on what the tasks before the last one
+ * produce, so these run here. ufo_fused_task_process() only runs the last one.
+ */
+static void
+ufo_fused_task_get_requisition (UfoTask *task,
+                                UfoBuffer **inputs,
+                                UfoRequisition *requisition)
+{
+    UfoFusedTaskPrivate *priv;
+    GList *it;
+    guint index = 0;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    priv->current = inputs[0];
+    priv->go_on = TRUE;
+
+    for (it = priv->tasks; it->data != priv->last && priv->go_on; it = g_list_next (it)) {
+        UfoBuffer *output;
+        UfoRequisition req;
+
+        ufo_task_get_requisition (UFO_TASK (it->data), &priv->current, &req);
+        output = get_buffer (priv, index, &req);
+        ufo_buffer_discard_location (output);
+        ufo_buffer_copy_metadata (priv->current, output);
+
+        priv->go_on = ufo_task_process (UFO_TASK (it->data), &priv->current, output, &req);
+        priv->current = output;
+        index = 1 - index;
+    }
+
+    if (priv->go_on)
+        ufo_task_get_requisition (priv->last, &priv->current, requisition);
+    else
+        ufo_buffer_get_requisition (priv->current, requisition);
+}
+
+static gboolean
+ufo_fused_task_process (UfoTask *task,
+                        UfoBuffer **inputs,
+                        UfoBuffer *output,
+                        UfoRequisition *requisition)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+
+    if (!priv->go_on)
+        return FALSE;
+
+    ufo_buffer_copy_metadata (priv->current, output);
+    return ufo_task_process (priv->last, &priv->current, output, requisition);
+}
+
+static UfoNode *
+ufo_fused_task_copy (UfoNode *node,
+                     GError **error)
+{
+    UfoFusedTask *copy;
+    GList *tasks = NULL;
+    GList *it;
+
+    copy = UFO_FUSED_TASK (UFO_NODE_CLASS (ufo_fused_task_parent_class)->copy (node, error));
+
+    g_list_for (UFO_FUSED_TASK_GET_PRIVATE (node)->tasks, it) {
+        UfoNode *task;
+
+        task = ufo_node_copy (UFO_NODE (it->data), error);
+
+        if (error && *error != NULL) {
+            g_list_foreach (tasks, (GFunc) g_object_unref, NULL);
+            g_list_free (tasks);
+            g_object_unref (copy);
+            return NULL;
+        }
+
+        tasks = g_list_append (tasks, task);
+    }
+
+    set_tasks (copy, tasks);
+    g_list_foreach (tasks, (GFunc) g_object_unref, NULL);
+    g_list_free (tasks);
+
+    return UFO_NODE (copy);
+}
+
+static void
+ufo_fused_task_dispose (GObject *object)
+{
+    UfoFusedTaskPrivate *priv;
+
+    priv = UFO_FUSED_TASK_GET_PRIVATE (object);
+
+    for (guint i = 0; i < 2; i++) {
+        if (priv->buffers[i] != NULL) {
+            ufo_buffer_pool_release (ufo_buffer_pool_get_default (), priv->buffers[i]);
+            priv->buffers[i] = NULL;
+        }
+    }
+
+    g_list_foreach (priv->tasks, (GFunc) g_object_unref, NULL);
+    g_list_free (priv->tasks);
+    priv->tasks = NULL;
+    priv->last = NULL;
+
+    G_OBJECT_CLASS (ufo_fused_task_parent_class)->dispose (object);
+}
+
+static void
+ufo_task_interface_init (UfoTaskIface *iface)
+{
+    iface->setup = ufo_fused_task_setup;
+    iface->get_num_inputs = ufo_fused_task_get_num_inputs;
+    iface->get_num_dimensions = ufo_fused_task_get_num_dimensions;
+    iface->get_mode = ufo_fused_task_get_mode;
+    iface->get_requisition = ufo_fused_task_get_requisition;
+    iface->process = ufo_fused_task_process;
+}
+
+static void
+ufo_fused_task_class_init (UfoFusedTaskClass *klass)
+{
+    GObjectClass *oclass;
+    UfoNodeClass *nclass;
+
+    oclass = G_OBJECT_CLASS (klass);
+    oclass->dispose = ufo_fused_task_dispose;
+
+    nclass = UFO_NODE_CLASS (klass);
+    nclass->copy = ufo_fused_task_copy;
+
+    g_type_class_add_private (klass, sizeof(UfoFusedTaskPrivate));
+}
+
+static void
+ufo_fused_task_init (UfoFusedTask *task)
+{
+    task->priv = UFO_FUSED_TASK_GET_PRIVATE (task);
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (task), "fused-task");
+
+    task->priv->tasks = NULL;
+    task->priv->last = NULL;
+    task->priv->mode = UFO_TASK_MODE_PROCESSOR | UFO_TASK_MODE_CPU;
+    task->priv->buffers[0] = NULL;
+    task->priv->buffers[1] = NULL;
+    task->priv->current = NULL;
+    task->priv->context = NULL;
+    task->priv->go_on = TRUE;
+}
@@ -31,6 +31,43 @@ G_DEFINE_TYPE (UfoGpuNode, ufo_gpu_node, UFO_TYPE_NODE)
 
 #define UFO_GPU_NODE_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_GPU_NODE, UfoGpuNodePrivate))
 
+/* PCI location queries of cl_khr_pci_bus_info and the vendor extensions */
+#ifndef CL_DEVICE_PCI_BUS_INFO_KHR
+#define CL_DEVICE_PCI_BUS_INFO_KHR  0x410F
+#endif
+
+#ifndef CL_DEVICE_PCI_BUS_ID_NV
+#define CL_DEVICE_PCI_BUS_ID_NV     0x4008
+#endif
+
+#ifndef CL_DEVICE_PCI_SLOT_ID_NV
+#define CL_DEVICE_PCI_SLOT_ID_NV    0x4009
+#endif
+
+#ifndef CL_DEVICE_PCI_DOMAIN_ID_NV
+#define CL_DEVICE_PCI_DOMAIN_ID_NV  0x400A
+#endif
+
+#ifndef CL_DEVICE_TOPOLOGY_AMD
+#define CL_DEVICE_TOPOLOGY_AMD      0x4037
+#endif
+
+typedef struct {
+    cl_uint domain;
+    cl_uint bus;
+    cl_uint device;
+    cl_uint function;
+} PciAddress;
+
+/* Layout of cl_device_topology_amd for PCIe devices */
+typedef struct {
+    cl_uint type;
+    cl_char unused[17];
+    cl_char bus;
+    cl_char device;
+    cl_char function;
+} TopologyAmd;
+
 
 struct _UfoGpuNodePrivate {
     cl_context context;
@@ -75,6 +112,62 @@ ufo_gpu_node_get_cmd_queue (UfoGpuNode *node)
     return node->priv->cmd_queue;
 }
 
+static gboolean
+get_pci_address (cl_device_id device,
+                 PciAddress *address)
+{
+    TopologyAmd topology;
+    cl_uint slot;
+
+    if (clGetDeviceInfo (device, CL_DEVICE_PCI_BUS_INFO_KHR, sizeof (PciAddress), address, NULL) == CL_SUCCESS)
+        return TRUE;
+
+    if (clGetDeviceInfo (device, CL_DEVICE_PCI_BUS_ID_NV, sizeof (cl_uint), &address->bus, NULL) == CL_SUCCESS &&
+        clGetDeviceInfo (device, CL_DEVICE_PCI_SLOT_ID_NV, sizeof (cl_uint), &slot, NULL) == CL_SUCCESS) {
+        if (clGetDeviceInfo (device, CL_DEVICE_PCI_DOMAIN_ID_NV, sizeof (cl_uint), &address->domain, NULL) != CL_SUCCESS)
+            address->domain = 0;
+
+        address->device = slot >> 3;
+        address->function = slot & 7;
+        return TRUE;
+    }
+
+    /* Type 1 is CL_DEVICE_TOPOLOGY_TYPE_PCIE_AMD */
+    if (clGetDeviceInfo (device, CL_DEVICE_TOPOLOGY_AMD, sizeof (TopologyAmd), &topology, NULL) == CL_SUCCESS &&
+        topology.type == 1) {
+        address->domain = 0;
+        address->bus = (cl_uchar) topology.bus;
+        address->device = (cl_uchar) topology.device;
+        address->function = (cl_uchar) topology.function;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static gint
+get_numa_node (cl_device_id device)
+{
+    PciAddress address;
+    gchar *path;
+    gchar *contents;
+    gint numa_node = -1;
+
+    if (!get_pci_address (device, &address))
+        return -1;
+
+    path = g_strdup_printf ("/sys/bus/pci/devices/%04x:%02x:%02x.%x/numa_node",
+                            address.domain, address.bus, address.device, address.function);
+
+    if (g_file_get_contents (path, &contents, NULL, NULL)) {
+        numa_node = (gint) g_ascii_strtoll (contents, NULL, 10);
+        g_free (contents);
+    }
+
+    g_free (path);
+    return numa_node;
+}
+
 /**
  * ufo_gpu_node_get_info:
  * @node: A #UfoGpuNodeInfo
@@ -139,6 +232,12 @@ ufo_gpu_node_get_info (UfoGpuNode *node,
                 g_value_init (value, G_TYPE_STRING);
                 g_value_take_string (value, name);
             }
+            break;
+
+        case UFO_GPU_NODE_INFO_NUMA_NODE:
+            g_value_init (value, G_TYPE_INT);
+            g_value_set_int (value, get_numa_node (priv->device));
+            break;
     }
 
     return value;
@@ -68,6 +68,9 @@ struct _UfoGpuNodeClass {
  * @UFO_GPU_NODE_INFO_MAX_MEM_ALLOC_SIZE: Maximum allocatable global memory size
  * @UFO_GPU_NODE_INFO_LOCAL_MEM_SIZE: Local memory size
  * @UFO_GPU_NODE_INFO_MAX_WORK_GROUP_SIZE: Maximum work group size
+ * @UFO_GPU_NODE_INFO_NAME: Device name
+ * @UFO_GPU_NODE_INFO_NUMA_NODE: NUMA node of the PCI slot of the device or -1
+ *  if unknown
  *
  * OpenCL device info types. Refer to the OpenCL standard for complete details
  * about each information.
@@ -77,7 +80,8 @@ typedef enum {
     UFO_GPU_NODE_INFO_MAX_MEM_ALLOC_SIZE,
     UFO_GPU_NODE_INFO_LOCAL_MEM_SIZE,
     UFO_GPU_NODE_INFO_MAX_WORK_GROUP_SIZE,
-    UFO_GPU_NODE_INFO_NAME
+    UFO_GPU_NODE_INFO_NAME,
+    UFO_GPU_NODE_INFO_NUMA_NODE
 } UfoGpuNodeInfo;
 
 UfoNode  *ufo_gpu_node_new              (gpointer        context,
@@ -47,6 +47,8 @@ static gint cmp_edge (gconstpointer a, gconstpointer b);
 static gint cmp_edge_source (gconstpointer a, gconstpointer b);
 static gint cmp_edge_target (gconstpointer a, gconstpointer b);
 static UfoEdge *find_edge (GList *edges, UfoNode *source, UfoNode *target);
+static GList *get_target_edges (GList *edges, UfoNode *target);
+static GList *get_source_edges (GList *edges, UfoNode *source);
 static GList *g_list_find_all_data (GList *list, gconstpointer data, GCompareFunc func);
 
 /**
@@ -258,6 +260,40 @@ ufo_graph_remove_edge (UfoGraph *graph,
     }
 }
 
+/**
+ * ufo_graph_remove_node:
+ * @graph: A #UfoGraph
+ * @node: A #UfoNode of @graph
+ *
+ * Remove @node and all edges from and to it.
+ */
+void
+ufo_graph_remove_node (UfoGraph *graph,
+                       UfoNode *node)
+{
+    UfoGraphPrivate *priv;
+    GList *edges;
+    GList *it;
+
+    g_return_if_fail (UFO_IS_GRAPH (graph));
+    priv = graph->priv;
+
+    if (!g_list_find (priv->nodes, node))
+        return;
+
+    edges = g_list_concat (get_source_edges (priv->edges, node),
+                           get_target_edges (priv->edges, node));
+
+    g_list_for (edges, it) {
+        priv->edges = g_list_remove (priv->edges, it->data);
+        g_free (it->data);
+    }
+
+    g_list_free (edges);
+    priv->nodes = g_list_remove (priv->nodes, node);
+    g_object_unref (node);
+}
+
 /**
  * ufo_graph_get_edge_label:
  * @graph: A #UfoGraph
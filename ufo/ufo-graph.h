@@ -90,6 +90,8 @@ gboolean    ufo_graph_is_connected          (UfoGraph       *graph,
 void        ufo_graph_remove_edge           (UfoGraph       *graph,
                                              UfoNode        *source,
                                              UfoNode        *target);
+void        ufo_graph_remove_node           (UfoGraph       *graph,
+                                             UfoNode        *node);
 gpointer    ufo_graph_get_edge_label        (UfoGraph       *graph,
                                              UfoNode        *source,
                                              UfoNode        *target);
@@ -61,6 +61,7 @@ typedef struct {
     gboolean is_leaf;
     gpointer context;
     UfoTwoWayQueue *queue;
+    UfoCpuNode *cpu_node;
     enum {
         TASK_GROUP_ROUND_ROBIN,
         TASK_GROUP_SHARED,
@@ -229,6 +230,20 @@ build_group_graph (UfoBaseScheduler *scheduler, UfoTaskGraph *graph, UfoResource
         return NULL;
     }
 
+    nodes = ufo_graph_get_nodes (result);
+
+    /* A thread serving copies on all GPUs is not close to any of them */
+    g_list_for (nodes, it) {
+        TaskGroup *group;
+
+        group = ufo_node_get_label (UFO_NODE (it->data));
+
+        if (g_list_length (group->tasks) == 1)
+            group->cpu_node = ufo_find_cpu_node (resources, NULL, UFO_TASK_NODE (group->tasks->data));
+    }
+
+    g_list_free (nodes);
+
     return result;
 }
 
@@ -333,6 +348,9 @@ run_group (TaskGroup *group)
     gboolean active = TRUE;
     GList *current = NULL;  /* current task */
 
+    if (group->cpu_node != NULL)
+        ufo_cpu_node_pin_thread (group->cpu_node);
+
     /* We should use get_structure to assert constraints ... */
     n_inputs = g_list_length (group->parents);
     inputs = g_new0 (UfoBuffer *, n_inputs);
@@ -440,6 +458,7 @@ ufo_group_scheduler_run (UfoBaseScheduler *scheduler,
     GList *groups;
     GList *tasks;
     GList *it;
+    gboolean fuse;
 
     g_return_if_fail (UFO_IS_GROUP_SCHEDULER (scheduler));
 
@@ -448,6 +467,11 @@ ufo_group_scheduler_run (UfoBaseScheduler *scheduler,
     if (resources == NULL)
         return;
 
+    g_object_get (scheduler, "fuse", &fuse, NULL);
+
+    if (fuse)
+        ufo_task_graph_fuse (task_graph);
+
     group_graph = build_group_graph (scheduler, task_graph, resources, error);
 
     if (group_graph == NULL)
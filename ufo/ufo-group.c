@@ -22,9 +22,11 @@
 #else
 #include <CL/cl.h>
 #endif
+#include <ufo/ufo-buffer-pool.h>
 #include <ufo/ufo-group.h>
 #include <ufo/ufo-task-node.h>
 #include <ufo/ufo-two-way-queue.h>
+#include "compat.h"
 
 G_DEFINE_TYPE (UfoGroup, ufo_group, G_TYPE_OBJECT)
 
@@ -35,12 +37,19 @@ struct _UfoGroupPrivate {
     guint            n_targets;
     UfoTwoWayQueue  **queues;
     gint            *n_expected;
+    guint           *depths;        /* buffers in flight per target */
+    gint            *in_flight;     /* items not yet released per target */
     gint             n_received;
     gboolean        *ready;
     UfoSendPattern   pattern;
     guint            current;
     cl_context       context;
     GList           *buffers;
+    gboolean        *shared;        /* targets that only read broadcasts */
+    guint            n_shared;
+    guint            owner;         /* slot whose queue holds broadcast originals */
+    GHashTable      *readers;       /* shared buffer -> remaining readers */
+    GMutex          *readers_lock;
 };
 
 enum {
@@ -74,13 +83,44 @@ ufo_group_new (GList *targets,
     priv->n_targets = g_list_length (targets);
     priv->queues = g_new0 (UfoTwoWayQueue *, priv->n_targets);
     priv->n_expected = g_new0 (gint, priv->n_targets);
+    priv->depths = g_new0 (guint, priv->n_targets);
+    priv->in_flight = g_new0 (gint, priv->n_targets);
     priv->pattern = pattern;
     priv->current = 0;
     priv->context = context;
     priv->n_received = 0;
 
-    for (guint i = 0; i < priv->n_targets; i++)
+    for (guint i = 0; i < priv->n_targets; i++) {
         priv->queues[i] = ufo_two_way_queue_new (NULL);
+        ufo_two_way_queue_reserve (priv->queues[i], priv->n_targets + 1);
+    }
+
+    priv->shared = g_new0 (gboolean, priv->n_targets);
+    priv->n_shared = 0;
+    priv->owner = 0;
+
+    /*
+     * Broadcast targets that declare UFO_TASK_MODE_READ_ONLY_INPUT only read
+     * their input, so they can all use the same buffer instead of a copy.
+     */
+    if (pattern == UFO_SEND_BROADCAST && priv->n_targets > 1) {
+        GList *it;
+        guint pos = 0;
+
+        g_list_for (priv->targets, it) {
+            if (UFO_IS_TASK (it->data) && (ufo_task_get_mode (UFO_TASK (it->data)) & UFO_TASK_MODE_READ_ONLY_INPUT)) {
+                /* The original comes from and returns to a reader's queue, so
+                 * that the copies of writing targets use their own */
+                if (priv->n_shared == 0)
+                    priv->owner = pos;
+
+                priv->shared[pos] = TRUE;
+                priv->n_shared++;
+            }
+
+            pos++;
+        }
+    }
 
     return group;
 }
@@ -92,6 +132,13 @@ ufo_group_get_num_targets (UfoGroup *group)
     return group->priv->n_targets;
 }
 
+static guint
+get_depth (UfoGroupPrivate *priv,
+           guint pos)
+{
+    return priv->depths[pos] > 0 ? priv->depths[pos] : priv->n_targets + 1;
+}
+
 static UfoBuffer *
 pop_or_alloc_buffer (UfoGroupPrivate *priv,
                      guint pos,
@@ -99,8 +146,10 @@ pop_or_alloc_buffer (UfoGroupPrivate *priv,
 {
     UfoBuffer *buffer;
 
-    if (ufo_two_way_queue_get_capacity (priv->queues[pos]) < (priv->n_targets + 1)) {
-        buffer = ufo_buffer_new (requisition, priv->context);
+    /* Once the queue is filled, this blocks until a target releases a buffer */
+    if (ufo_two_way_queue_get_capacity (priv->queues[pos]) < get_depth (priv, pos)) {
+        buffer = ufo_buffer_pool_acquire (ufo_buffer_pool_get_default (),
+                                          requisition, priv->context);
         priv->buffers = g_list_append (priv->buffers, buffer);
         ufo_two_way_queue_insert (priv->queues[pos], buffer);
     }
@@ -113,6 +162,37 @@ pop_or_alloc_buffer (UfoGroupPrivate *priv,
     return buffer;
 }
 
+static gboolean
+has_room (UfoGroupPrivate *priv,
+          guint pos)
+{
+    return ufo_two_way_queue_get_capacity (priv->queues[pos]) < get_depth (priv, pos) ||
+           ufo_two_way_queue_producer_can_pop (priv->queues[pos]);
+}
+
+static guint
+find_least_loaded (UfoGroupPrivate *priv)
+{
+    guint least_loaded = priv->current;
+    gint least = G_MAXINT;
+
+    /* Start after the last target so that ties are broken round-robin */
+    for (guint i = 1; i <= priv->n_targets; i++) {
+        guint pos;
+        gint n;
+
+        pos = (priv->current + i) % priv->n_targets;
+        n = g_atomic_int_get (&priv->in_flight[pos]);
+
+        if (n < least) {
+            least = n;
+            least_loaded = pos;
+        }
+    }
+
+    return least_loaded;
+}
+
 /**
  * ufo_group_pop_output_buffer:
  * @group: A #UfoGroup
@@ -130,12 +210,54 @@ ufo_group_pop_output_buffer (UfoGroup *group,
 
     priv = group->priv;
 
-    if ((priv->pattern == UFO_SEND_SCATTER) || (priv->pattern == UFO_SEND_SEQUENTIAL))
+    /* The target is chosen here because the buffer comes from its queue */
+    if (priv->pattern == UFO_SEND_DYNAMIC)
+        priv->current = find_least_loaded (priv);
+
+    if ((priv->pattern == UFO_SEND_SCATTER) || (priv->pattern == UFO_SEND_SEQUENTIAL) ||
+        (priv->pattern == UFO_SEND_DYNAMIC))
         pos = priv->current;
+    else if (priv->pattern == UFO_SEND_BROADCAST)
+        pos = priv->owner;
 
     return pop_or_alloc_buffer (priv, pos, requisition);
 }
 
+/**
+ * ufo_group_can_pop_output:
+ * @group: A #UfoGroup
+ *
+ * Check if the next buffer can be produced without waiting for a target to
+ * release one. As long as nobody else produces into @group,
+ * ufo_group_pop_output_buffer() and ufo_group_push_output_buffer() do not
+ * block afterwards.
+ *
+ * Return value: %TRUE if there is room for another buffer.
+ */
+gboolean
+ufo_group_can_pop_output (UfoGroup *group)
+{
+    UfoGroupPrivate *priv;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), FALSE);
+    priv = group->priv;
+
+    if (priv->pattern == UFO_SEND_DYNAMIC)
+        return has_room (priv, find_least_loaded (priv));
+
+    if (priv->pattern == UFO_SEND_BROADCAST) {
+        /* Copies for the other targets are taken when pushing */
+        for (guint pos = 0; pos < priv->n_targets; pos++) {
+            if (!has_room (priv, pos))
+                return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    return has_room (priv, priv->current);
+}
+
 void
 ufo_group_push_output_buffer (UfoGroup *group,
                               UfoBuffer *buffer)
@@ -155,15 +277,37 @@ ufo_group_push_output_buffer (UfoGroup *group,
 
         ufo_buffer_get_requisition (buffer, &requisition);
 
-        for (guint pos = 1; pos < priv->n_targets; pos++) {
+        /* Targets that write get a private copy, except the one whose queue
+         * the original came from if nobody shares it */
+        for (guint pos = 0; pos < priv->n_targets; pos++) {
             UfoBuffer *copy;
 
+            if (priv->shared[pos] || pos == priv->owner)
+                continue;
+
             copy = pop_or_alloc_buffer (priv, pos, &requisition);
             ufo_buffer_copy (buffer, copy);
             ufo_two_way_queue_producer_push (priv->queues[pos], copy);
         }
 
-        ufo_two_way_queue_producer_push (priv->queues[0], buffer);
+        if (priv->n_shared == 0) {
+            ufo_two_way_queue_producer_push (priv->queues[priv->owner], buffer);
+        }
+        else {
+            /* Register before pushing, a reader might be done immediately */
+            g_mutex_lock (priv->readers_lock);
+            g_hash_table_insert (priv->readers, buffer, GUINT_TO_POINTER (priv->n_shared));
+            g_mutex_unlock (priv->readers_lock);
+
+            for (guint pos = 0; pos < priv->n_targets; pos++) {
+                if (priv->shared[pos])
+                    ufo_two_way_queue_producer_push (priv->queues[pos], buffer);
+            }
+        }
+    }
+    else if (priv->pattern == UFO_SEND_DYNAMIC) {
+        g_atomic_int_inc (&priv->in_flight[priv->current]);
+        ufo_two_way_queue_producer_push (priv->queues[priv->current], buffer);
     }
     else if (priv->pattern == UFO_SEND_SEQUENTIAL) {
         ufo_two_way_queue_producer_push (priv->queues[priv->current], buffer);
@@ -192,6 +336,54 @@ ufo_group_set_num_expected (UfoGroup *group,
     priv->n_expected[pos] = n_expected;
 }
 
+/**
+ * ufo_group_set_queue_depth:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @depth: Number of buffers in flight to @target or 0 for the default
+ *
+ * Limit the number of buffers that can be produced for @target before
+ * ufo_group_pop_output_buffer() blocks. By default, each target can have one
+ * more buffer in flight than there are targets.
+ */
+void
+ufo_group_set_queue_depth (UfoGroup *group,
+                           UfoTask *target,
+                           guint depth)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+    pos = g_list_index (priv->targets, target);
+
+    if (pos >= 0) {
+        priv->depths[pos] = depth;
+        ufo_two_way_queue_reserve (priv->queues[pos], get_depth (priv, (guint) pos));
+    }
+}
+
+/**
+ * ufo_group_get_slot:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Look up the position of @target among the targets of @group. Resolving it
+ * once and using ufo_group_pop_input_buffers_at() and
+ * ufo_group_push_input_buffers_at() avoids searching the targets for each
+ * buffer.
+ *
+ * Return value: The slot of @target or -1 if it is not a target of @group.
+ */
+gint
+ufo_group_get_slot (UfoGroup *group,
+                    UfoTask *target)
+{
+    g_return_val_if_fail (UFO_IS_GROUP (group), -1);
+    return g_list_index (group->priv->targets, target);
+}
+
 /**
  * ufo_group_pop_input_buffer:
  * @group: A #UfoGroup
@@ -215,19 +407,188 @@ ufo_group_pop_input_buffer (UfoGroup *group,
     return input;
 }
 
+/**
+ * ufo_group_pop_input_buffers:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @inputs: (array length=max) (out caller-allocates): Array for the buffers
+ * @max: Maximum number of buffers to fetch
+ *
+ * Wait for at least one buffer and fetch up to @max buffers that are ready
+ * for @target in one go. If the stream ends, %UFO_END_OF_STREAM is the last
+ * element and buffers fetched after it are released right away.
+ *
+ * Return value: Number of elements stored in @inputs. Buffers must be released
+ * with ufo_group_push_input_buffers() or ufo_group_push_input_buffer().
+ */
+guint
+ufo_group_pop_input_buffers (UfoGroup *group,
+                             UfoTask *target,
+                             UfoBuffer **inputs,
+                             guint max)
+{
+    gint pos;
+
+    pos = g_list_index (group->priv->targets, target);
+
+    if (pos < 0)
+        return 0;
+
+    return ufo_group_pop_input_buffers_at (group, (guint) pos, inputs, max);
+}
+
+/**
+ * ufo_group_pop_input_buffers_at:
+ * @group: A #UfoGroup
+ * @slot: Slot of the target as returned by ufo_group_get_slot()
+ * @inputs: (array length=max) (out caller-allocates): Array for the buffers
+ * @max: Maximum number of buffers to fetch
+ *
+ * Same as ufo_group_pop_input_buffers() but for the target at @slot.
+ *
+ * Return value: Number of elements stored in @inputs.
+ */
+guint
+ufo_group_pop_input_buffers_at (UfoGroup *group,
+                                guint slot,
+                                UfoBuffer **inputs,
+                                guint max)
+{
+    UfoGroupPrivate *priv;
+    guint n_inputs;
+
+    priv = group->priv;
+    g_assert (slot < priv->n_targets);
+    n_inputs = ufo_two_way_queue_consumer_pop_many (priv->queues[slot], (gpointer *) inputs, max);
+
+    for (guint i = 0; i < n_inputs; i++) {
+        guint n_trailing = 0;
+
+        if (inputs[i] != UFO_END_OF_STREAM)
+            continue;
+
+        /*
+         * A sequential group may send more buffers and end the stream again,
+         * but the target stops at the first end. Give these buffers back so
+         * that the producer does not run out of them.
+         */
+        for (guint j = i + 1; j < n_inputs; j++) {
+            if (inputs[j] != UFO_END_OF_STREAM)
+                inputs[i + 1 + n_trailing++] = inputs[j];
+        }
+
+        ufo_group_push_input_buffers_at (group, slot, inputs + i + 1, n_trailing);
+        return i + 1;
+    }
+
+    return n_inputs;
+}
+
+/**
+ * ufo_group_can_pop_input_at:
+ * @group: A #UfoGroup
+ * @slot: Slot of the target as returned by ufo_group_get_slot()
+ *
+ * Check if a buffer or the end of stream is ready for the target at @slot, so
+ * that ufo_group_pop_input_buffers_at() does not block.
+ *
+ * Return value: %TRUE if an input is ready.
+ */
+gboolean
+ufo_group_can_pop_input_at (UfoGroup *group,
+                            guint slot)
+{
+    g_return_val_if_fail (UFO_IS_GROUP (group), FALSE);
+    g_assert (slot < group->priv->n_targets);
+    return ufo_two_way_queue_consumer_can_pop (group->priv->queues[slot]);
+}
+
+static void
+release_shared (UfoGroupPrivate *priv,
+                UfoBuffer *input)
+{
+    guint remaining;
+
+    g_mutex_lock (priv->readers_lock);
+    remaining = GPOINTER_TO_UINT (g_hash_table_lookup (priv->readers, input)) - 1;
+
+    if (remaining > 0)
+        g_hash_table_insert (priv->readers, input, GUINT_TO_POINTER (remaining));
+    else
+        g_hash_table_remove (priv->readers, input);
+
+    g_mutex_unlock (priv->readers_lock);
+
+    /* The last reader gives the buffer back to the producer */
+    if (remaining == 0)
+        ufo_two_way_queue_consumer_push (priv->queues[priv->owner], input);
+}
+
 void
 ufo_group_push_input_buffer (UfoGroup *group,
                              UfoTask *target,
                              UfoBuffer *input)
 {
-    UfoGroupPrivate *priv;
+    ufo_group_push_input_buffers (group, target, &input, 1);
+}
+
+/**
+ * ufo_group_push_input_buffers:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @inputs: (array length=n_inputs): Buffers to release
+ * @n_inputs: Number of buffers
+ *
+ * Release several buffers obtained with ufo_group_pop_input_buffers() or
+ * ufo_group_pop_input_buffer() in one go.
+ */
+void
+ufo_group_push_input_buffers (UfoGroup *group,
+                              UfoTask *target,
+                              UfoBuffer **inputs,
+                              guint n_inputs)
+{
     gint pos;
 
+    pos = g_list_index (group->priv->targets, target);
+
+    if (pos < 0)
+        return;
+
+    ufo_group_push_input_buffers_at (group, (guint) pos, inputs, n_inputs);
+}
+
+/**
+ * ufo_group_push_input_buffers_at:
+ * @group: A #UfoGroup
+ * @slot: Slot of the target as returned by ufo_group_get_slot()
+ * @inputs: (array length=n_inputs): Buffers to release
+ * @n_inputs: Number of buffers
+ *
+ * Same as ufo_group_push_input_buffers() but for the target at @slot.
+ */
+void
+ufo_group_push_input_buffers_at (UfoGroup *group,
+                                 guint slot,
+                                 UfoBuffer **inputs,
+                                 guint n_inputs)
+{
+    UfoGroupPrivate *priv;
+
     priv = group->priv;
-    pos = g_list_index (priv->targets, target);
+    g_assert (slot < priv->n_targets);
+
+    if (priv->shared[slot]) {
+        for (guint i = 0; i < n_inputs; i++)
+            release_shared (priv, inputs[i]);
+
+        return;
+    }
+
+    if (priv->pattern == UFO_SEND_DYNAMIC)
+        g_atomic_int_add (&priv->in_flight[slot], -((gint) n_inputs));
 
-    if (pos >= 0)
-        ufo_two_way_queue_consumer_push (priv->queues[pos], input);
+    ufo_two_way_queue_consumer_push_many (priv->queues[slot], (gpointer *) inputs, n_inputs);
 }
 
 void
@@ -245,9 +606,20 @@ static void
 ufo_group_dispose(GObject *object)
 {
     UfoGroupPrivate *priv;
+    UfoBufferPool *pool;
+    GList *it;
 
     priv = UFO_GROUP_GET_PRIVATE (object);
-    g_list_foreach (priv->buffers, (GFunc) g_object_unref, NULL);
+    pool = ufo_buffer_pool_get_default ();
+
+    /* Hand buffers back so that the next run does not have to allocate */
+    g_list_for (priv->buffers, it) {
+        ufo_buffer_pool_release (pool, UFO_BUFFER (it->data));
+    }
+
+    g_list_free (priv->buffers);
+    priv->buffers = NULL;
+
     G_OBJECT_CLASS (ufo_group_parent_class)->dispose (object);
 }
 
@@ -259,6 +631,12 @@ ufo_group_finalize (GObject *object)
     priv = UFO_GROUP_GET_PRIVATE (object);
 
     g_free (priv->n_expected);
+    g_free (priv->depths);
+    g_free (priv->in_flight);
+    g_free (priv->shared);
+
+    g_hash_table_destroy (priv->readers);
+    g_mutex_free (priv->readers_lock);
 
     g_list_free (priv->targets);
     priv->targets = NULL;
@@ -292,4 +670,6 @@ ufo_group_init (UfoGroup *self)
     UfoGroupPrivate *priv;
     self->priv = priv = UFO_GROUP_GET_PRIVATE (self);
     priv->buffers = NULL;
+    priv->readers = g_hash_table_new (g_direct_hash, g_direct_equal);
+    priv->readers_lock = g_mutex_new ();
 }
@@ -48,13 +48,16 @@ typedef struct _UfoGroupPrivate    UfoGroupPrivate;
  * @UFO_SEND_SCATTER: Scatter data among connected nodes.
  * @UFO_SEND_SEQUENTIAL: Break up a linear input stream and transfer sub streams
  * one by one to connected nodes.
+ * @UFO_SEND_DYNAMIC: Send data to the connected node with the fewest items in
+ * flight, so that faster nodes receive more data.
  *
  * The send pattern describes how results are passed to connected nodes.
  */
 typedef enum {
     UFO_SEND_BROADCAST,
     UFO_SEND_SCATTER,
-    UFO_SEND_SEQUENTIAL
+    UFO_SEND_SEQUENTIAL,
+    UFO_SEND_DYNAMIC
 } UfoSendPattern;
 
 /**
@@ -87,15 +90,39 @@ guint       ufo_group_get_num_targets       (UfoGroup       *group);
 void        ufo_group_set_num_expected      (UfoGroup       *group,
                                              UfoTask        *target,
                                              gint            n_expected);
+void        ufo_group_set_queue_depth       (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             guint           depth);
 UfoBuffer * ufo_group_pop_output_buffer     (UfoGroup       *group,
                                              UfoRequisition *requisition);
 void        ufo_group_push_output_buffer    (UfoGroup       *group,
                                              UfoBuffer      *buffer);
+gboolean    ufo_group_can_pop_output        (UfoGroup       *group);
+gint        ufo_group_get_slot              (UfoGroup       *group,
+                                             UfoTask        *target);
 UfoBuffer * ufo_group_pop_input_buffer      (UfoGroup       *group,
                                              UfoTask        *target);
 void        ufo_group_push_input_buffer     (UfoGroup       *group,
                                              UfoTask        *target,
                                              UfoBuffer      *input);
+guint       ufo_group_pop_input_buffers     (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             UfoBuffer     **inputs,
+                                             guint           max);
+void        ufo_group_push_input_buffers    (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             UfoBuffer     **inputs,
+                                             guint           n_inputs);
+guint       ufo_group_pop_input_buffers_at  (UfoGroup       *group,
+                                             guint           slot,
+                                             UfoBuffer     **inputs,
+                                             guint           max);
+void        ufo_group_push_input_buffers_at (UfoGroup       *group,
+                                             guint           slot,
+                                             UfoBuffer     **inputs,
+                                             guint           n_inputs);
+gboolean    ufo_group_can_pop_input_at      (UfoGroup       *group,
+                                             guint           slot);
 void        ufo_group_finish                (UfoGroup       *group);
 GType       ufo_group_get_type              (void);
 
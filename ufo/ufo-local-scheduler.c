@@ -66,8 +66,10 @@ typedef struct {
     UfoTask *task;
     UfoTwoWayQueue **inputs;
     UfoTwoWayQueue *output;
+    guint depth;
     guint n_inputs;
     gboolean is_leaf;
+    UfoCpuNode *cpu_node;
 } TaskLocal;
 
 enum {
@@ -168,6 +170,9 @@ run_local (TaskLocal *local)
 /*     gboolean shared; */
     gboolean active = TRUE;
 
+    if (local->cpu_node != NULL)
+        ufo_cpu_node_pin_thread (local->cpu_node);
+
     task = local->task;
     inputs = g_new0 (UfoBuffer *, local->n_inputs);
     mode = ufo_task_get_mode (task) & UFO_TASK_MODE_TYPE_MASK;
@@ -192,7 +197,7 @@ run_local (TaskLocal *local)
 
         /* Insert output buffers as longs as capacity is not filled */
         if (!local->is_leaf) {
-            if (ufo_two_way_queue_get_capacity (local->output) < 2) {
+            if (ufo_two_way_queue_get_capacity (local->output) < local->depth) {
                 UfoBuffer *buffer;
 
                 buffer = ufo_buffer_new (&requisition, local->context);
@@ -289,6 +294,9 @@ setup_tasks (UfoGraph *graph,
         data->n_inputs = ufo_task_get_num_inputs (task);
         data->context = ufo_resources_get_context (resources);
 
+        /* GPUs change per item, so only explicit NUMA nodes apply here */
+        data->cpu_node = ufo_find_cpu_node (resources, graph, UFO_TASK_NODE (node));
+
         g_hash_table_insert (local, node, data);
         successors = ufo_graph_get_successors (graph, UFO_NODE (task));
         predecessors = ufo_graph_get_predecessors (graph, UFO_NODE (task));
@@ -303,6 +311,12 @@ setup_tasks (UfoGraph *graph,
             succ_data = g_hash_table_lookup (local, succ);
 
             port = GPOINTER_TO_INT (ufo_graph_get_edge_label (graph, node, succ));
+            data->depth = ufo_task_graph_get_edge_queue_depth (UFO_TASK_GRAPH (graph),
+                                                               UFO_TASK_NODE (node),
+                                                               UFO_TASK_NODE (succ));
+
+            if (data->depth == 0)
+                data->depth = 2;
 
             if (succ_data != NULL) {
                 data->output = succ_data->inputs[port];
@@ -310,6 +324,8 @@ setup_tasks (UfoGraph *graph,
             else {
                 data->output = ufo_two_way_queue_new (NULL);
             }
+
+            ufo_two_way_queue_reserve (data->output, data->depth);
         }
 
         if (g_list_length (predecessors) > 0) {
@@ -357,6 +373,7 @@ ufo_local_scheduler_run (UfoBaseScheduler *scheduler,
     GList *threads;
     GList *it;
     GList *gpu_nodes;
+    gboolean fuse;
 
     g_return_if_fail (UFO_IS_LOCAL_SCHEDULER (scheduler));
 
@@ -365,6 +382,11 @@ ufo_local_scheduler_run (UfoBaseScheduler *scheduler,
     if (resources == NULL)
         return;
 
+    g_object_get (scheduler, "fuse", &fuse, NULL);
+
+    if (fuse)
+        ufo_task_graph_fuse (task_graph);
+
     gpu_nodes = ufo_resources_get_gpu_nodes (resources);
     pp = ufo_pp_new (gpu_nodes);
     g_list_free (gpu_nodes);
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <ufo/ufo-resources.h>
+#include "ufo-memory.h"
+
+/*
+ * Book-keeping of the memory held by buffers. Accounts are kept per cl_context
+ * because that is the granularity at which OpenCL allocates buffers; the NULL
+ * context stands for host memory. Device memory objects are accounted from
+ * their creation until the OpenCL runtime actually destroys them, which we
+ * learn about through a destructor callback. That way sub-buffers, images and
+ * buffers released from anywhere are covered without touching every
+ * clReleaseMemObject() call.
+ */
+
+typedef struct {
+    guint64 used;
+    guint64 peak;
+    guint64 budget;
+    gboolean warned;
+} Account;
+
+typedef struct {
+    gpointer context;
+    gsize size;
+} TrackedMem;
+
+static GHashTable *accounts = NULL;
+G_LOCK_DEFINE_STATIC (accounts);
+
+static Account *
+get_account (gpointer context, gboolean create)
+{
+    Account *account;
+
+    if (accounts == NULL) {
+        if (!create)
+            return NULL;
+
+        accounts = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    }
+
+    account = g_hash_table_lookup (accounts, context);
+
+    if (account == NULL && create) {
+        account = g_new0 (Account, 1);
+        g_hash_table_insert (accounts, context, account);
+    }
+
+    return account;
+}
+
+void
+ufo_memory_set_budget (gpointer context, guint64 budget)
+{
+    Account *account;
+
+    G_LOCK (accounts);
+    account = get_account (context, TRUE);
+    account->budget = budget;
+    account->warned = FALSE;
+    G_UNLOCK (accounts);
+}
+
+guint64
+ufo_memory_get_budget (gpointer context)
+{
+    Account *account;
+    guint64 budget = 0;
+
+    G_LOCK (accounts);
+    account = get_account (context, FALSE);
+
+    if (account != NULL)
+        budget = account->budget;
+
+    G_UNLOCK (accounts);
+    return budget;
+}
+
+void
+ufo_memory_get_usage (gpointer context, guint64 *used, guint64 *peak)
+{
+    Account *account;
+
+    G_LOCK (accounts);
+    account = get_account (context, FALSE);
+
+    if (used != NULL)
+        *used = account != NULL ? account->used : 0;
+
+    if (peak != NULL)
+        *peak = account != NULL ? account->peak : 0;
+
+    G_UNLOCK (accounts);
+}
+
+/*
+ * Returns TRUE if allocating another @size bytes in @context would exceed its
+ * budget. Without a budget this is never the case.
+ */
+gboolean
+ufo_memory_exceeds_budget (gpointer context, gsize size)
+{
+    Account *account;
+    gboolean exceeds = FALSE;
+
+    G_LOCK (accounts);
+    account = get_account (context, FALSE);
+
+    if (account != NULL && account->budget > 0)
+        exceeds = account->used + size > account->budget;
+
+    G_UNLOCK (accounts);
+    return exceeds;
+}
+
+/*
+ * Returns TRUE exactly once per budget setting, so that exceeding the budget
+ * does not flood the log with warnings.
+ */
+gboolean
+ufo_memory_warn_once (gpointer context)
+{
+    Account *account;
+    gboolean warn = FALSE;
+
+    G_LOCK (accounts);
+    account = get_account (context, FALSE);
+
+    if (account != NULL && !account->warned) {
+        account->warned = TRUE;
+        warn = TRUE;
+    }
+
+    G_UNLOCK (accounts);
+    return warn;
+}
+
+void
+ufo_memory_alloc (gpointer context, gsize size)
+{
+    Account *account;
+
+    G_LOCK (accounts);
+    account = get_account (context, TRUE);
+    account->used += size;
+    account->peak = MAX (account->peak, account->used);
+    G_UNLOCK (accounts);
+}
+
+void
+ufo_memory_free (gpointer context, gsize size)
+{
+    Account *account;
+
+    G_LOCK (accounts);
+    account = get_account (context, FALSE);
+
+    /* The account may be gone if the context was forgotten in between */
+    if (account != NULL)
+        account->used -= MIN (account->used, size);
+
+    G_UNLOCK (accounts);
+}
+
+static void CL_CALLBACK
+release_tracked_mem (cl_mem mem, gpointer user_data)
+{
+    TrackedMem *tracked = user_data;
+
+    ufo_memory_free (tracked->context, tracked->size);
+    g_free (tracked);
+}
+
+/*
+ * Account the size of @mem to @context until the memory object is destroyed.
+ */
+void
+ufo_memory_track_mem (gpointer context, gpointer mem)
+{
+    TrackedMem *tracked;
+    size_t size;
+    cl_int errcode;
+
+    errcode = clGetMemObjectInfo (mem, CL_MEM_SIZE, sizeof (size_t), &size, NULL);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    if (errcode != CL_SUCCESS)
+        return;
+
+    tracked = g_new0 (TrackedMem, 1);
+    tracked->context = context;
+    tracked->size = size;
+    ufo_memory_alloc (context, size);
+
+    errcode = clSetMemObjectDestructorCallback (mem, release_tracked_mem, tracked);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    if (errcode != CL_SUCCESS) {
+        ufo_memory_free (context, size);
+        g_free (tracked);
+    }
+}
+
+/*
+ * Drop the account of @context. Must be called before @context is released.
+ */
+void
+ufo_memory_forget (gpointer context)
+{
+    G_LOCK (accounts);
+
+    if (accounts != NULL)
+        g_hash_table_remove (accounts, context);
+
+    G_UNLOCK (accounts);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_MEMORY_H
+#define UFO_MEMORY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void        ufo_memory_set_budget       (gpointer    context,
+                                         guint64     budget);
+guint64     ufo_memory_get_budget       (gpointer    context);
+void        ufo_memory_get_usage        (gpointer    context,
+                                         guint64    *used,
+                                         guint64    *peak);
+gboolean    ufo_memory_exceeds_budget   (gpointer    context,
+                                         gsize       size);
+gboolean    ufo_memory_warn_once        (gpointer    context);
+void        ufo_memory_alloc            (gpointer    context,
+                                         gsize       size);
+void        ufo_memory_free             (gpointer    context,
+                                         gsize       size);
+void        ufo_memory_track_mem        (gpointer    context,
+                                         gpointer    mem);
+void        ufo_memory_forget           (gpointer    context);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ufo-merge.h"
+
+/*
+ * A merge is the state of an input that is fed by several groups, i.e. where
+ * expanded branches join again. With a window of zero, items are taken from
+ * the groups in turn. Otherwise the items are reassembled in the order of
+ * their "sequence" metadata, holding back at most window items.
+ */
+struct _UfoMerge {
+    guint            n_groups;
+    UfoLink         *links;
+    UfoBuffer      **heads;         /* items held back for reordering */
+    gboolean        *done;          /* group has ended its stream */
+    guint            n_held;
+    guint            current;       /* next group to pop from when unordered */
+    guint64          next;          /* sequence number expected next */
+};
+
+UfoMerge *
+ufo_merge_new (const UfoLink *links,
+               guint n_links)
+{
+    UfoMerge *merge;
+
+    merge = g_new0 (UfoMerge, 1);
+    merge->n_groups = n_links;
+    merge->links = g_memdup (links, n_links * sizeof (UfoLink));
+    merge->heads = g_new0 (UfoBuffer *, n_links);
+    merge->done = g_new0 (gboolean, n_links);
+
+    return merge;
+}
+
+void
+ufo_merge_free (UfoMerge *merge)
+{
+    g_free (merge->links);
+    g_free (merge->heads);
+    g_free (merge->done);
+    g_free (merge);
+}
+
+static UfoBuffer *
+pop_link (UfoLink *link)
+{
+    UfoBuffer *buffer;
+
+    ufo_group_pop_input_buffers_at (link->group, link->slot, &buffer, 1);
+    return buffer;
+}
+
+static gboolean
+get_sequence (UfoBuffer *buffer,
+              guint64 *sequence)
+{
+    GValue *value;
+
+    value = ufo_buffer_get_metadata (buffer, "sequence");
+
+    if (value == NULL || !G_VALUE_HOLDS_UINT64 (value))
+        return FALSE;
+
+    *sequence = g_value_get_uint64 (value);
+    return TRUE;
+}
+
+/*
+ * Find the held item with the lowest sequence number. Returns -1 if nothing is
+ * held.
+ */
+static gint
+find_lowest_head (UfoMerge *merge,
+                  guint64 *sequence)
+{
+    gint lowest = -1;
+
+    for (guint i = 0; i < merge->n_groups; i++) {
+        guint64 current;
+
+        if (merge->heads[i] == NULL)
+            continue;
+
+        /* Items without sequence number cannot be ordered, pass them on first */
+        if (!get_sequence (merge->heads[i], &current)) {
+            *sequence = merge->next - 1;
+            return (gint) i;
+        }
+
+        if (lowest < 0 || current < *sequence) {
+            lowest = (gint) i;
+            *sequence = current;
+        }
+    }
+
+    return lowest;
+}
+
+/*
+ * Pop from the groups of @merge in turn. The input ends only after all groups
+ * ended their stream, because branches may deliver different numbers of items.
+ * Items already fetched by ufo_merge_poll() are handed out first.
+ */
+static UfoBuffer *
+pop_merged (UfoMerge *merge,
+            UfoLink **source)
+{
+    for (guint i = 0; merge->n_held > 0 && i < merge->n_groups; i++) {
+        UfoBuffer *buffer;
+        guint pos = (merge->current + i) % merge->n_groups;
+
+        if (merge->heads[pos] == NULL)
+            continue;
+
+        buffer = merge->heads[pos];
+        merge->heads[pos] = NULL;
+        merge->n_held--;
+        merge->current = (pos + 1) % merge->n_groups;
+        *source = &merge->links[pos];
+        return buffer;
+    }
+
+    for (guint i = 0; i < merge->n_groups; i++) {
+        UfoBuffer *buffer;
+        guint pos = merge->current;
+
+        merge->current = (merge->current + 1) % merge->n_groups;
+
+        if (merge->done[pos])
+            continue;
+
+        buffer = pop_link (&merge->links[pos]);
+
+        if (buffer == UFO_END_OF_STREAM) {
+            merge->done[pos] = TRUE;
+            continue;
+        }
+
+        *source = &merge->links[pos];
+        return buffer;
+    }
+
+    return UFO_END_OF_STREAM;
+}
+
+/*
+ * Reassemble the items of all groups of @merge in sequence order. Each group
+ * delivers its items in order, so holding the oldest item of every group is
+ * enough to emit the lowest sequence number. At most @window items are held
+ * back; if that is less than the number of groups, the order is only restored
+ * within the window.
+ */
+static UfoBuffer *
+pop_ordered (UfoMerge *merge,
+             guint window,
+             UfoLink **source)
+{
+    UfoBuffer *buffer;
+    guint64 sequence;
+    gint lowest;
+
+    lowest = find_lowest_head (merge, &sequence);
+
+    if (lowest < 0 || sequence != merge->next) {
+        for (guint i = 0; i < merge->n_groups && merge->n_held < window; i++) {
+            if (merge->heads[i] != NULL || merge->done[i])
+                continue;
+
+            buffer = pop_link (&merge->links[i]);
+
+            if (buffer == UFO_END_OF_STREAM) {
+                merge->done[i] = TRUE;
+                continue;
+            }
+
+            merge->heads[i] = buffer;
+            merge->n_held++;
+
+            if (!get_sequence (buffer, &sequence) || sequence == merge->next)
+                break;
+        }
+
+        lowest = find_lowest_head (merge, &sequence);
+    }
+
+    if (lowest < 0)
+        return UFO_END_OF_STREAM;
+
+    buffer = merge->heads[lowest];
+    merge->heads[lowest] = NULL;
+    merge->n_held--;
+    merge->next = sequence + 1;
+    *source = &merge->links[lowest];
+    return buffer;
+}
+
+/*
+ * Pop the next item of @merge, in sequence order if @window is not zero.
+ * @source is set to the link the item came from, which must get the item back.
+ * Returns %UFO_END_OF_STREAM once all groups ended their stream.
+ */
+UfoBuffer *
+ufo_merge_pop (UfoMerge *merge,
+               guint window,
+               UfoLink **source)
+{
+    if (window > 0)
+        return pop_ordered (merge, window, source);
+
+    return pop_merged (merge, source);
+}
+
+/*
+ * Fetch the heads of all branches of @merge that have data, without blocking.
+ * Returns TRUE if ufo_merge_pop() with the same @window does not block
+ * afterwards.
+ */
+gboolean
+ufo_merge_poll (UfoMerge *merge,
+                guint window)
+{
+    guint limit;
+    guint64 sequence;
+    gboolean waiting = FALSE;
+
+    limit = window > 0 ? window : merge->n_groups;
+
+    for (guint i = 0; i < merge->n_groups && merge->n_held < limit; i++) {
+        UfoLink *link = &merge->links[i];
+        UfoBuffer *buffer;
+
+        if (merge->heads[i] != NULL || merge->done[i])
+            continue;
+
+        if (!ufo_group_can_pop_input_at (link->group, link->slot)) {
+            waiting = TRUE;
+            continue;
+        }
+
+        buffer = pop_link (link);
+
+        if (buffer == UFO_END_OF_STREAM) {
+            merge->done[i] = TRUE;
+            continue;
+        }
+
+        merge->heads[i] = buffer;
+        merge->n_held++;
+    }
+
+    if (window == 0)
+        return merge->n_held > 0 || !waiting;
+
+    if (find_lowest_head (merge, &sequence) >= 0 && sequence == merge->next)
+        return TRUE;
+
+    return !waiting || merge->n_held >= limit;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_MERGE_H
+#define UFO_MERGE_H
+
+#include <glib.h>
+#include <ufo/ufo-buffer.h>
+#include <ufo/ufo-group.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A group feeding an input and the slot of the task among the targets of that
+ * group, resolved once so that the group does not need to look it up for each
+ * buffer.
+ */
+typedef struct {
+    UfoGroup        *group;
+    guint            slot;
+} UfoLink;
+
+typedef struct _UfoMerge UfoMerge;
+
+UfoMerge   *ufo_merge_new           (const UfoLink  *links,
+                                     guint           n_links);
+UfoBuffer  *ufo_merge_pop           (UfoMerge       *merge,
+                                     guint           window,
+                                     UfoLink       **source);
+gboolean    ufo_merge_poll          (UfoMerge       *merge,
+                                     guint           window);
+void        ufo_merge_free          (UfoMerge       *merge);
+
+G_END_DECLS
+
+#endif
@@ -29,8 +29,10 @@
 #include <CL/cl.h>
 #endif
 
+#include <ufo/ufo-buffer-pool.h>
 #include <ufo/ufo-output-task.h>
 #include <ufo/ufo-task-iface.h>
+#include "compat.h"
 
 /**
  * SECTION:ufo-output-task
@@ -229,9 +231,18 @@ static void
 ufo_output_task_dispose (GObject *object)
 {
     UfoOutputTaskPrivate *priv;
+    UfoBufferPool *pool;
+    GList *it;
 
     priv = UFO_OUTPUT_TASK_GET_PRIVATE (object);
-    g_list_foreach (priv->copies, (GFunc) g_object_unref, NULL);
+    pool = ufo_buffer_pool_get_default ();
+
+    g_list_for (priv->copies, it) {
+        ufo_buffer_pool_release (pool, UFO_BUFFER (it->data));
+    }
+
+    g_list_free (priv->copies);
+    priv->copies = NULL;
 
     G_OBJECT_CLASS (ufo_output_task_parent_class)->dispose (object);
 }
@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+#include <ufo/ufo-fused-task.h>
+#include <ufo/ufo-task-iface.h>
+#include <ufo/ufo-task-node.h>
+#include "ufo-plan.h"
+#include "ufo-priv.h"
+#include "compat.h"
+
+/*
+ * A plan records how many copies of the GPU path the scheduler expands and the
+ * queue depth of each edge. It is refined from the profiles of a run and keyed
+ * by a hash over the plugins and edges of the graph as it was passed to the
+ * scheduler. Graphs that only differ in task properties therefore share a plan.
+ *
+ * A graph read from a JSON file keeps its plan next to it in a sidecar file
+ * with the same name and a .plan suffix, which is only used as long as the
+ * hash stored in it matches. Graphs built in code, by ufo-launch or read from
+ * data have no such file, their plans are kept in the user's cache directory
+ * under the hash. The same goes for graphs in directories we cannot write to.
+ *
+ * Refining only looks at the waiting times of the tasks. Tasks of the GPU path
+ * that are busy nearly all the time ask for another copy, while copies whose
+ * tasks mostly wait are given up. An edge whose producer waits for room while
+ * its consumer waits for data at other times has too few buffers to absorb
+ * the jitter between both, so its depth is doubled.
+ */
+
+#define PLAN_VERSION        1
+
+/* Load the GPU path should see per copy */
+#define TARGET_LOAD         0.8
+
+/* Above this load, more copies might still speed up the whole graph */
+#define SATURATED_LOAD      0.95
+
+/* Fraction of the run time both ends of an edge must have waited */
+#define WAIT_THRESHOLD      0.1
+
+#define MAX_DEPTH           64
+
+typedef struct {
+    guint       from;
+    guint       to;
+    guint       port;
+    guint       depth;
+} PlanEdge;
+
+struct _UfoPlan {
+    gchar      *hash;
+    gchar      *path;
+    guint       n_copies;       /* 0 until known */
+    guint       n_nodes;
+    UfoNode   **nodes;
+    guint       n_edges;
+    PlanEdge   *edges;
+};
+
+static guint
+find_node (UfoPlan *plan,
+           UfoNode *node)
+{
+    for (guint i = 0; i < plan->n_nodes; i++) {
+        if (plan->nodes[i] == node)
+            return i;
+    }
+
+    g_assert_not_reached ();
+    return 0;
+}
+
+static const gchar *
+get_node_name (UfoNode *node)
+{
+    const gchar *name;
+
+    name = ufo_task_node_get_plugin_name (UFO_TASK_NODE (node));
+    return name != NULL ? name : G_OBJECT_TYPE_NAME (node);
+}
+
+static gchar *
+compute_hash (UfoPlan *plan)
+{
+    GString *str;
+    gchar *hash;
+
+    str = g_string_new (NULL);
+
+    for (guint i = 0; i < plan->n_nodes; i++)
+        g_string_append_printf (str, "%s;", get_node_name (plan->nodes[i]));
+
+    for (guint i = 0; i < plan->n_edges; i++) {
+        PlanEdge *edge = &plan->edges[i];
+
+        g_string_append_printf (str, "%u>%u:%u;", edge->from, edge->to, edge->port);
+    }
+
+    hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, str->str, (gssize) str->len);
+    g_string_free (str, TRUE);
+
+    return hash;
+}
+
+static gchar *
+get_plan_path (UfoPlan *plan,
+               UfoTaskGraph *graph)
+{
+    const gchar *graph_filename;
+    gchar *filename;
+    gchar *path;
+
+    graph_filename = ufo_task_graph_get_filename (graph);
+
+    if (graph_filename != NULL) {
+        gchar *dir;
+        gboolean writable;
+
+        dir = g_path_get_dirname (graph_filename);
+        writable = g_access (dir, W_OK) == 0;
+        g_free (dir);
+
+        if (writable)
+            return g_strdup_printf ("%s.plan", graph_filename);
+    }
+
+    filename = g_strdup_printf ("%s.json", plan->hash);
+    path = g_build_filename (g_get_user_cache_dir (), "ufo", "plans", filename, NULL);
+    g_free (filename);
+
+    return path;
+}
+
+/*
+ * Create a plan for @graph before it is expanded, keeping the queue depths set
+ * on its edges. The nodes are referenced until the plan is freed.
+ */
+UfoPlan *
+ufo_plan_new (UfoTaskGraph *graph)
+{
+    UfoPlan *plan;
+    GList *nodes;
+    GList *edges;
+    GList *it;
+    guint i;
+
+    plan = g_new0 (UfoPlan, 1);
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+    plan->n_nodes = g_list_length (nodes);
+    plan->nodes = g_new0 (UfoNode *, plan->n_nodes);
+    i = 0;
+
+    g_list_for (nodes, it)
+        plan->nodes[i++] = g_object_ref (it->data);
+
+    edges = ufo_graph_get_edges (UFO_GRAPH (graph));
+    plan->n_edges = g_list_length (edges);
+    plan->edges = g_new0 (PlanEdge, plan->n_edges);
+    i = 0;
+
+    g_list_for (edges, it) {
+        UfoEdge *edge = (UfoEdge *) it->data;
+        PlanEdge *plan_edge = &plan->edges[i++];
+
+        plan_edge->from = find_node (plan, edge->source);
+        plan_edge->to = find_node (plan, edge->target);
+        plan_edge->port = (guint) GPOINTER_TO_INT (edge->label);
+        plan_edge->depth = ufo_task_node_get_queue_depth (UFO_TASK_NODE (edge->target), plan_edge->port);
+    }
+
+    plan->hash = compute_hash (plan);
+    plan->path = get_plan_path (plan, graph);
+
+    g_list_free (edges);
+    g_list_free (nodes);
+
+    return plan;
+}
+
+static PlanEdge *
+find_edge (UfoPlan *plan,
+           guint from,
+           guint to,
+           guint port)
+{
+    for (guint i = 0; i < plan->n_edges; i++) {
+        PlanEdge *edge = &plan->edges[i];
+
+        if (edge->from == from && edge->to == to && edge->port == port)
+            return edge;
+    }
+
+    return NULL;
+}
+
+/*
+ * Replace copies and queue depths with the ones stored by a previous run of the
+ * same graph. Returns FALSE if there are none.
+ */
+gboolean
+ufo_plan_load (UfoPlan *plan)
+{
+    JsonParser *parser;
+    JsonObject *object;
+    JsonArray *edges;
+    GError *error = NULL;
+    const gchar *path;
+
+    path = plan->path;
+
+    if (!g_file_test (path, G_FILE_TEST_EXISTS))
+        return FALSE;
+
+    parser = json_parser_new ();
+
+    if (!json_parser_load_from_file (parser, path, &error)) {
+        g_warning ("Could not load plan %s: %s", path, error->message);
+        g_error_free (error);
+        g_object_unref (parser);
+        return FALSE;
+    }
+
+    object = json_node_get_object (json_parser_get_root (parser));
+
+    if (json_object_get_int_member (object, "version") != PLAN_VERSION) {
+        g_debug ("TUNE Ignoring plan %s of another version", path);
+        g_object_unref (parser);
+        return FALSE;
+    }
+
+    /* The graph next to a sidecar plan might have been changed since */
+    if (!json_object_has_member (object, "hash") ||
+        g_strcmp0 (json_object_get_string_member (object, "hash"), plan->hash) != 0) {
+        g_debug ("TUNE Ignoring plan %s of another graph", path);
+        g_object_unref (parser);
+        return FALSE;
+    }
+
+    plan->n_copies = (guint) json_object_get_int_member (object, "copies");
+    edges = json_object_get_array_member (object, "edges");
+
+    for (guint i = 0; i < json_array_get_length (edges); i++) {
+        JsonObject *edge_object;
+        PlanEdge *edge;
+
+        edge_object = json_array_get_object_element (edges, i);
+        edge = find_edge (plan,
+                          (guint) json_object_get_int_member (edge_object, "from"),
+                          (guint) json_object_get_int_member (edge_object, "to"),
+                          (guint) json_object_get_int_member (edge_object, "port"));
+
+        if (edge != NULL)
+            edge->depth = (guint) json_object_get_int_member (edge_object, "depth");
+    }
+
+    g_debug ("TUNE Loaded plan %s", path);
+    g_object_unref (parser);
+
+    return TRUE;
+}
+
+gboolean
+ufo_plan_save (UfoPlan *plan,
+               GError **error)
+{
+    JsonGenerator *generator;
+    JsonNode *root_node;
+    JsonObject *root_object;
+    JsonArray *edges;
+    gchar *dir;
+    gboolean result;
+
+    root_object = json_object_new ();
+    edges = json_array_new ();
+
+    for (guint i = 0; i < plan->n_edges; i++) {
+        PlanEdge *edge = &plan->edges[i];
+        JsonObject *edge_object;
+
+        edge_object = json_object_new ();
+        json_object_set_int_member (edge_object, "from", edge->from);
+        json_object_set_int_member (edge_object, "to", edge->to);
+        json_object_set_int_member (edge_object, "port", edge->port);
+        json_object_set_int_member (edge_object, "depth", edge->depth);
+        json_array_add_object_element (edges, edge_object);
+    }
+
+    json_object_set_int_member (root_object, "version", PLAN_VERSION);
+    json_object_set_string_member (root_object, "hash", plan->hash);
+    json_object_set_int_member (root_object, "copies", plan->n_copies);
+    json_object_set_array_member (root_object, "edges", edges);
+
+    root_node = json_node_new (JSON_NODE_OBJECT);
+    json_node_set_object (root_node, root_object);
+
+    generator = json_generator_new ();
+    json_generator_set_root (generator, root_node);
+    json_node_free (root_node);
+
+    dir = g_path_get_dirname (plan->path);
+    g_mkdir_with_parents (dir, 0755);
+
+    result = json_generator_to_file (generator, plan->path, error);
+
+    if (result)
+        g_debug ("TUNE Saved plan %s", plan->path);
+
+    g_object_unref (generator);
+    g_free (dir);
+
+    return result;
+}
+
+/* Must happen before expansion, so that copies inherit the depths */
+void
+ufo_plan_apply (UfoPlan *plan)
+{
+    for (guint i = 0; i < plan->n_edges; i++) {
+        PlanEdge *edge = &plan->edges[i];
+
+        if (edge->depth > 0)
+            ufo_task_node_set_queue_depth (UFO_TASK_NODE (plan->nodes[edge->to]), edge->port, edge->depth);
+    }
+}
+
+guint
+ufo_plan_get_copies (UfoPlan *plan,
+                     guint n_gpus)
+{
+    if (plan->n_copies == 0)
+        return n_gpus;
+
+    return MIN (plan->n_copies, n_gpus);
+}
+
+static gboolean
+is_plan_node (UfoPlan *plan,
+              UfoNode *node)
+{
+    for (guint i = 0; i < plan->n_nodes; i++) {
+        if (plan->nodes[i] == node)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Find the node of @nodes that actually ran @node, i.e. @node itself or the
+ * fused task that took it over.
+ */
+static UfoNode *
+find_running_node (GList *nodes,
+                   UfoNode *node)
+{
+    GList *it;
+
+    g_list_for (nodes, it) {
+        if (it->data == node)
+            return node;
+
+        if (UFO_IS_FUSED_TASK (it->data) &&
+            g_list_find (ufo_fused_task_get_tasks (UFO_FUSED_TASK (it->data)), node) != NULL)
+            return UFO_NODE (it->data);
+    }
+
+    return NULL;
+}
+
+static gdouble
+get_fraction (UfoNode *node,
+              UfoProfilerTimer timer,
+              gdouble time)
+{
+    UfoProfiler *profiler;
+
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (node));
+    return MAX (0.0, ufo_profiler_elapsed (profiler, timer)) / time;
+}
+
+static gdouble
+get_load (UfoNode *node,
+          gdouble time)
+{
+    gdouble waiting;
+
+    waiting = get_fraction (node, UFO_PROFILER_TIMER_FETCH, time) +
+              get_fraction (node, UFO_PROFILER_TIMER_BLOCKED, time);
+
+    return CLAMP (1.0 - waiting, 0.0, 1.0);
+}
+
+/*
+ * Refine the plan from the waiting times of a run of @graph that was expanded
+ * to @n_copies, or 0 if it was not expanded.
+ */
+void
+ufo_plan_refine (UfoPlan *plan,
+                 UfoTaskGraph *graph,
+                 guint n_copies,
+                 guint n_gpus,
+                 gdouble time)
+{
+    GList *nodes;
+    GList *it;
+    UfoNode *bottleneck = NULL;
+    gdouble max_load = 0.0;
+    gdouble gpu_load = 0.0;
+
+    if (time <= 0.0)
+        return;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoNode *node = UFO_NODE (it->data);
+        gdouble load;
+
+        load = get_load (node, time);
+
+        if (load > max_load) {
+            max_load = load;
+            bottleneck = node;
+        }
+
+        /* Once expanded, only copies tell the load of the GPU path */
+        if (ufo_task_uses_gpu (UFO_TASK (node)) && (n_copies < 2 || !is_plan_node (plan, node)))
+            gpu_load = MAX (gpu_load, load);
+    }
+
+    if (bottleneck != NULL) {
+        g_debug ("TUNE Bottleneck %s busy for %3.1f%% of the time",
+                 ufo_task_node_get_identifier (UFO_TASK_NODE (bottleneck)), max_load * 100.0);
+    }
+
+    if (n_copies > 0 && gpu_load > 0.0) {
+        guint needed;
+
+        needed = (guint) ceil (gpu_load * n_copies / TARGET_LOAD);
+
+        if (gpu_load > SATURATED_LOAD)
+            needed = MAX (needed, n_copies + 1);
+
+        plan->n_copies = CLAMP (needed, 1, MAX (n_gpus, 1));
+        g_debug ("TUNE Expand for %i GPU nodes next time", plan->n_copies);
+    }
+
+    for (guint i = 0; i < plan->n_edges; i++) {
+        PlanEdge *edge = &plan->edges[i];
+        UfoNode *producer;
+        UfoNode *consumer;
+
+        producer = find_running_node (nodes, plan->nodes[edge->from]);
+        consumer = find_running_node (nodes, plan->nodes[edge->to]);
+
+        /* Edges inside a fused task have no queue */
+        if (producer == NULL || consumer == NULL || producer == consumer)
+            continue;
+
+        if (get_fraction (producer, UFO_PROFILER_TIMER_BLOCKED, time) > WAIT_THRESHOLD &&
+            get_fraction (consumer, UFO_PROFILER_TIMER_FETCH, time) > WAIT_THRESHOLD) {
+            guint depth;
+
+            depth = edge->depth;
+
+            if (depth == 0)
+                depth = ufo_task_graph_get_queue_depth (graph);
+
+            /* Groups with a single target hold two buffers by default */
+            if (depth == 0)
+                depth = 2;
+
+            edge->depth = MIN (2 * depth, MAX_DEPTH);
+            g_debug ("TUNE Queue depth %i from %s to %s", edge->depth,
+                     ufo_task_node_get_identifier (UFO_TASK_NODE (plan->nodes[edge->from])),
+                     ufo_task_node_get_identifier (UFO_TASK_NODE (plan->nodes[edge->to])));
+        }
+    }
+
+    g_list_free (nodes);
+}
+
+void
+ufo_plan_free (UfoPlan *plan)
+{
+    for (guint i = 0; i < plan->n_nodes; i++)
+        g_object_unref (plan->nodes[i]);
+
+    g_free (plan->nodes);
+    g_free (plan->edges);
+    g_free (plan->hash);
+    g_free (plan->path);
+    g_free (plan);
+}
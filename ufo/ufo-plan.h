@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_PLAN_H
+#define UFO_PLAN_H
+
+#include <glib.h>
+#include <ufo/ufo-task-graph.h>
+
+G_BEGIN_DECLS
+
+typedef struct _UfoPlan UfoPlan;
+
+UfoPlan    *ufo_plan_new            (UfoTaskGraph   *graph);
+gboolean    ufo_plan_load           (UfoPlan        *plan);
+gboolean    ufo_plan_save           (UfoPlan        *plan,
+                                     GError        **error);
+void        ufo_plan_apply          (UfoPlan        *plan);
+guint       ufo_plan_get_copies     (UfoPlan        *plan,
+                                     guint           n_gpus);
+void        ufo_plan_refine         (UfoPlan        *plan,
+                                     UfoTaskGraph   *graph,
+                                     guint           n_copies,
+                                     guint           n_gpus,
+                                     gdouble         time);
+void        ufo_plan_free           (UfoPlan        *plan);
+
+G_END_DECLS
+
+#endif
@@ -1,7 +1,16 @@
 #include <stdio.h>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
 #include "ufo-priv.h"
 #include "ufo/compat.h"
 #include "ufo/ufo-profiler.h"
+#include "ufo/ufo-cpu-node.h"
+#include "ufo/ufo-resources.h"
 #include "ufo/ufo-task-node.h"
 
 
@@ -184,3 +193,163 @@ ufo_escape_device_name (gchar *name)
 
     return name;
 }
+
+/* cl_context -> (kernel source -> cl_program) for built-in kernels */
+static GHashTable *context_programs = NULL;
+G_LOCK_DEFINE_STATIC (context_programs);
+
+static void
+release_program (cl_program program)
+{
+    UFO_RESOURCES_CHECK_CLERR (clReleaseProgram (program));
+}
+
+/*
+ * Create a kernel @name from the internal kernel @source for @context. The
+ * program is built once per context and kept until
+ * ufo_release_context_programs() is called. The returned kernel must be
+ * released by the caller, so that different threads do not race when setting
+ * arguments.
+ */
+gpointer
+ufo_create_context_kernel (gpointer context,
+                           const gchar *source,
+                           const gchar *name)
+{
+    GHashTable *programs;
+    cl_program program;
+    cl_kernel kernel;
+    cl_int errcode;
+
+    G_LOCK (context_programs);
+
+    if (context_programs == NULL)
+        context_programs = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                  NULL, (GDestroyNotify) g_hash_table_destroy);
+
+    programs = g_hash_table_lookup (context_programs, context);
+
+    if (programs == NULL) {
+        programs = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                          NULL, (GDestroyNotify) release_program);
+        g_hash_table_insert (context_programs, context, programs);
+    }
+
+    program = g_hash_table_lookup (programs, source);
+
+    if (program == NULL) {
+        program = clCreateProgramWithSource (context, 1, &source, NULL, &errcode);
+        UFO_RESOURCES_CHECK_CLERR (errcode);
+
+        if (errcode != CL_SUCCESS) {
+            G_UNLOCK (context_programs);
+            return NULL;
+        }
+
+        errcode = clBuildProgram (program, 0, NULL, NULL, NULL, NULL);
+
+        if (errcode != CL_SUCCESS) {
+            g_warning ("Could not build internal kernels: %s", ufo_resources_clerr (errcode));
+            UFO_RESOURCES_CHECK_CLERR (clReleaseProgram (program));
+            G_UNLOCK (context_programs);
+            return NULL;
+        }
+
+        g_hash_table_insert (programs, (gpointer) source, program);
+    }
+
+    G_UNLOCK (context_programs);
+
+    kernel = clCreateKernel (program, name, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    return errcode == CL_SUCCESS ? kernel : NULL;
+}
+
+/*
+ * Release all programs built by ufo_create_context_kernel() for @context. Must
+ * be called before the context itself is released.
+ */
+void
+ufo_release_context_programs (gpointer context)
+{
+    G_LOCK (context_programs);
+
+    if (context_programs != NULL)
+        g_hash_table_remove (context_programs, context);
+
+    G_UNLOCK (context_programs);
+}
+
+static UfoNode *
+find_closest_neighbour (UfoResources *resources,
+                        GList *neighbours)
+{
+    GList *it;
+
+    g_list_for (neighbours, it) {
+        UfoNode *proc_node;
+
+        proc_node = ufo_task_node_get_proc_node (UFO_TASK_NODE (it->data));
+
+        if (proc_node != NULL)
+            return ufo_resources_get_closest_cpu_node (resources, proc_node);
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the CPU node a thread running @node should be pinned to. An explicit
+ * NUMA node of the task wins, otherwise the CPUs closest to its own device or,
+ * if @graph is given, to the device of a task it exchanges data with. Returns
+ * NULL on machines with a single NUMA node.
+ */
+UfoCpuNode *
+ufo_find_cpu_node (UfoResources *resources,
+                   UfoGraph *graph,
+                   UfoTaskNode *node)
+{
+    GList *cpu_nodes;
+    UfoNode *cpu_node = NULL;
+    UfoNode *proc_node;
+    guint n_cpu_nodes;
+    gint numa_node;
+
+    cpu_nodes = ufo_resources_get_cpu_nodes (resources);
+    n_cpu_nodes = g_list_length (cpu_nodes);
+    g_list_free (cpu_nodes);
+
+    if (n_cpu_nodes < 2)
+        return NULL;
+
+    numa_node = ufo_task_node_get_numa_node (node);
+    proc_node = ufo_task_node_get_proc_node (node);
+
+    if (numa_node >= 0)
+        cpu_node = ufo_resources_get_cpu_node (resources, numa_node);
+
+    if (cpu_node == NULL && proc_node != NULL)
+        cpu_node = ufo_resources_get_closest_cpu_node (resources, proc_node);
+
+    if (cpu_node == NULL && graph != NULL) {
+        GList *neighbours;
+
+        neighbours = ufo_graph_get_predecessors (graph, UFO_NODE (node));
+        cpu_node = find_closest_neighbour (resources, neighbours);
+        g_list_free (neighbours);
+
+        if (cpu_node == NULL) {
+            neighbours = ufo_graph_get_successors (graph, UFO_NODE (node));
+            cpu_node = find_closest_neighbour (resources, neighbours);
+            g_list_free (neighbours);
+        }
+    }
+
+    if (cpu_node != NULL) {
+        g_debug ("PIN  %s on NUMA node %i", ufo_task_node_get_identifier (node),
+                 ufo_cpu_node_get_numa_node (UFO_CPU_NODE (cpu_node)));
+    }
+
+    return cpu_node != NULL ? UFO_CPU_NODE (cpu_node) : NULL;
+}
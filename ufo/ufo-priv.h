@@ -2,9 +2,48 @@
 #define UFO_PRIV_H
 
 #include <glib.h>
+#include <ufo/ufo-buffer.h>
+#include <ufo/ufo-buffer-pool.h>
+#include <ufo/ufo-cpu-node.h>
+#include <ufo/ufo-resources.h>
+#include <ufo/ufo-task-graph.h>
+#include <ufo/ufo-task-node.h>
 
-void    ufo_write_profile_events    (GList *nodes);
-void    ufo_write_opencl_events     (GList *nodes);
-gchar * ufo_escape_device_name      (gchar *name);
+void     ufo_write_profile_events    (GList *nodes);
+void     ufo_write_opencl_events     (GList *nodes);
+gchar *  ufo_escape_device_name      (gchar *name);
+gpointer ufo_create_context_kernel   (gpointer context,
+                                      const gchar *source,
+                                      const gchar *name);
+void     ufo_release_context_programs
+                                     (gpointer context);
+gpointer ufo_buffer_get_context      (UfoBuffer *buffer);
+void     ufo_buffer_clear_metadata   (UfoBuffer *buffer);
+void     ufo_buffer_set_context_host_memory
+                                     (gpointer context,
+                                      UfoBufferHostMemory mode,
+                                      gpointer cmd_queue);
+gsize    ufo_buffer_discard_host_array
+                                     (UfoBuffer *buffer);
+void     ufo_buffer_reset_location   (UfoBuffer *buffer);
+gsize    ufo_buffer_get_capacity     (UfoBuffer *buffer);
+void     ufo_buffer_pool_discard_host_arrays
+                                     (UfoBufferPool *pool,
+                                      gsize n_bytes);
+UfoCpuNode *
+         ufo_find_cpu_node           (UfoResources *resources,
+                                      UfoGraph *graph,
+                                      UfoTaskNode *node);
+const gchar *
+         ufo_task_graph_get_filename (UfoTaskGraph *graph);
+gint     ufo_find_closest_numa_index (const guint *distances,
+                                      guint n_nodes,
+                                      guint from,
+                                      const guint *candidates,
+                                      guint n_candidates);
+#ifndef __APPLE__
+void     ufo_parse_cpu_list          (const gchar *list,
+                                      gpointer mask);
+#endif
 
 #endif
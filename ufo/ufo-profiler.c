@@ -76,6 +76,8 @@ static GTimer *global_clock = NULL;
  *  time to fetch data from the queues.
  * @UFO_PROFILER_TIMER_RELEASE: Select timer that measures the synchronization
  *  time to push data to the queues.
+ * @UFO_PROFILER_TIMER_BLOCKED: Select timer that measures the time a producer
+ *  waited for a free output buffer because its successors were busy.
  * @UFO_PROFILER_TIMER_LAST: Auxiliary value, do not use.
  *
  * Use these values to select a specific timer when calling
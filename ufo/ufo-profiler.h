@@ -117,6 +117,7 @@ typedef enum {
     UFO_PROFILER_TIMER_GPU,
     UFO_PROFILER_TIMER_FETCH,
     UFO_PROFILER_TIMER_RELEASE,
+    UFO_PROFILER_TIMER_BLOCKED,
     UFO_PROFILER_TIMER_LAST
 } UfoProfilerTimer;
 
@@ -17,6 +17,8 @@
  * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+#include <sched.h>
 #include "config.h"
 
 #include <glib.h>
@@ -30,9 +32,12 @@
 #endif
 
 #include <ufo/ufo-resources.h>
+#include <ufo/ufo-buffer-pool.h>
+#include <ufo/ufo-cpu-node.h>
 #include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-remote-node.h>
 #include <ufo/ufo-enums.h>
+#include "ufo-memory.h"
 #include "ufo-priv.h"
 #include "compat.h"
 
@@ -86,6 +91,10 @@ struct _UfoResourcesPrivate {
     gchar           **device_names;     /* Array of names for each device */
 
     GList       *gpu_nodes;
+    GList       *cpu_nodes;             /* one per NUMA node with usable CPUs */
+    guint        n_numa_nodes;
+    gint        *numa_ids;
+    guint       *numa_distances;        /* n_numa_nodes x n_numa_nodes */
 
     GList       *paths;         /* List of paths containing kernels and header files */
     GHashTable  *kernel_cache;
@@ -95,6 +104,10 @@ struct _UfoResourcesPrivate {
 
     GList       *remotes;
     GList       *remote_nodes;
+
+    gboolean     pinned_host_memory;
+    guint64      host_memory_budget;
+    guint64      device_memory_budget;
 };
 
 enum {
@@ -102,6 +115,13 @@ enum {
     PROP_PLATFORM_INDEX,
     PROP_DEVICE_TYPE,
     PROP_REMOTES,
+    PROP_PINNED_HOST_MEMORY,
+    PROP_HOST_MEMORY_BUDGET,
+    PROP_DEVICE_MEMORY_BUDGET,
+    PROP_HOST_MEMORY_USAGE,
+    PROP_HOST_MEMORY_PEAK,
+    PROP_DEVICE_MEMORY_USAGE,
+    PROP_DEVICE_MEMORY_PEAK,
     N_PROPERTIES
 };
 
@@ -472,6 +492,8 @@ initialize_opencl (UfoResourcesPrivate *priv)
     if (errcode != CL_SUCCESS)
         return FALSE;
 
+    ufo_memory_set_budget (priv->context, priv->device_memory_budget);
+
     priv->gpu_nodes = NULL;
     priv->device_names = g_malloc0 (priv->n_devices * sizeof (gchar *));
 
@@ -493,6 +515,188 @@ initialize_opencl (UfoResourcesPrivate *priv)
     return TRUE;
 }
 
+#ifndef __APPLE__
+/*
+ * Fill the cpu_set_t @mask with the CPUs of a list such as "0-3,8,10-11" as
+ * found in the cpulist files of sysfs.
+ */
+void
+ufo_parse_cpu_list (const gchar *list,
+                    gpointer mask)
+{
+    gchar **ranges;
+
+    CPU_ZERO ((cpu_set_t *) mask);
+    ranges = g_strsplit (list, ",", -1);
+
+    for (gchar **range = ranges; *range != NULL; range++) {
+        gchar *end;
+        guint64 first;
+        guint64 last;
+
+        if (**range == '\0')
+            continue;
+
+        first = g_ascii_strtoull (*range, &end, 10);
+        last = *end == '-' ? g_ascii_strtoull (end + 1, NULL, 10) : first;
+
+        for (guint64 cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET (cpu, (cpu_set_t *) mask);
+    }
+
+    g_strfreev (ranges);
+}
+
+static gchar *
+read_numa_file (gint id,
+                const gchar *name)
+{
+    gchar *path;
+    gchar *contents = NULL;
+
+    path = g_strdup_printf ("/sys/devices/system/node/node%i/%s", id, name);
+
+    if (g_file_get_contents (path, &contents, NULL, NULL))
+        g_strstrip (contents);
+
+    g_free (path);
+    return contents;
+}
+
+static gint
+compare_ids (gconstpointer a,
+             gconstpointer b)
+{
+    return GPOINTER_TO_INT (a) - GPOINTER_TO_INT (b);
+}
+
+/*
+ * Create a UfoCpuNode for each NUMA node that Linux exports in sysfs, limited
+ * to the CPUs the process may run on. The distance file of each node lists
+ * the distances to all nodes in ascending order of their numbers.
+ */
+static void
+discover_cpu_nodes (UfoResourcesPrivate *priv)
+{
+    GDir *dir;
+    GList *ids = NULL;
+    GList *it;
+    const gchar *name;
+    cpu_set_t allowed;
+    guint n;
+    guint i = 0;
+
+    dir = g_dir_open ("/sys/devices/system/node", 0, NULL);
+
+    if (dir == NULL)
+        return;
+
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        if (g_str_has_prefix (name, "node") && g_ascii_isdigit (name[4]))
+            ids = g_list_insert_sorted (ids, GINT_TO_POINTER ((gint) g_ascii_strtoull (name + 4, NULL, 10)), compare_ids);
+    }
+
+    g_dir_close (dir);
+
+    /* Respect affinities set from the outside, e.g. with taskset */
+    if (sched_getaffinity (0, sizeof (cpu_set_t), &allowed) != 0)
+        memset (&allowed, 0xff, sizeof (cpu_set_t));
+
+    n = g_list_length (ids);
+    priv->n_numa_nodes = n;
+    priv->numa_ids = g_new0 (gint, n);
+    priv->numa_distances = g_new0 (guint, n * n);
+
+    g_list_for (ids, it) {
+        gint id = GPOINTER_TO_INT (it->data);
+        gchar *contents;
+
+        priv->numa_ids[i] = id;
+        contents = read_numa_file (id, "distance");
+
+        if (contents != NULL) {
+            gchar **distances = g_strsplit_set (contents, " \t", -1);
+            guint j = 0;
+
+            for (gchar **d = distances; *d != NULL && j < n; d++) {
+                if (**d != '\0')
+                    priv->numa_distances[i * n + j++] = (guint) g_ascii_strtoull (*d, NULL, 10);
+            }
+
+            g_strfreev (distances);
+            g_free (contents);
+        }
+
+        contents = read_numa_file (id, "cpulist");
+
+        if (contents != NULL) {
+            cpu_set_t mask;
+
+            ufo_parse_cpu_list (contents, &mask);
+            CPU_AND (&mask, &mask, &allowed);
+
+            /* Nodes with memory only or without CPUs we may use */
+            if (CPU_COUNT (&mask) > 0) {
+                UfoNode *node;
+
+                node = ufo_cpu_node_new (&mask);
+                ufo_cpu_node_set_numa_node (UFO_CPU_NODE (node), id);
+                priv->cpu_nodes = g_list_append (priv->cpu_nodes, node);
+                g_debug ("NEW  UfoCpuNode-%p [numa=%i cpus=%s]", (gpointer) node, id, contents);
+            }
+
+            g_free (contents);
+        }
+
+        i++;
+    }
+
+    g_list_free (ids);
+}
+#endif
+
+/*
+ * Return the position of the node among @candidates that is closest to node
+ * @from according to the @n_nodes x @n_nodes matrix @distances. Candidates
+ * are indices into the matrix, the first one wins ties. Returns -1 if there
+ * are no candidates.
+ */
+gint
+ufo_find_closest_numa_index (const guint *distances,
+                             guint n_nodes,
+                             guint from,
+                             const guint *candidates,
+                             guint n_candidates)
+{
+    guint min_distance = G_MAXUINT;
+    gint closest = -1;
+
+    for (guint i = 0; i < n_candidates; i++) {
+        guint distance;
+
+        distance = distances[from * n_nodes + candidates[i]];
+
+        if (distance < min_distance) {
+            min_distance = distance;
+            closest = (gint) i;
+        }
+    }
+
+    return closest;
+}
+
+static gint
+get_numa_index (UfoResourcesPrivate *priv,
+                gint numa_node)
+{
+    for (guint i = 0; i < priv->n_numa_nodes; i++) {
+        if (priv->numa_ids[i] == numa_node)
+            return (gint) i;
+    }
+
+    return -1;
+}
+
 /**
  * ufo_resources_new:
  * @error: Location of a #GError or %NULL
@@ -1023,6 +1227,103 @@ ufo_resources_get_gpu_nodes (UfoResources *resources)
     return g_list_copy (resources->priv->gpu_nodes);
 }
 
+/**
+ * ufo_resources_get_cpu_nodes:
+ * @resources: A #UfoResources
+ *
+ * Get a #UfoCpuNode for each NUMA node that has CPUs the process may run on.
+ * The list is empty if the system does not export its NUMA topology.
+ *
+ * Returns: (transfer container) (element-type Ufo.CpuNode): List with
+ * #UfoCpuNode objects. Free with g_list_free() but not its elements.
+ */
+GList *
+ufo_resources_get_cpu_nodes (UfoResources *resources)
+{
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
+    return g_list_copy (resources->priv->cpu_nodes);
+}
+
+/**
+ * ufo_resources_get_cpu_node:
+ * @resources: A #UfoResources
+ * @numa_node: Number of a NUMA node
+ *
+ * Get the #UfoCpuNode closest to @numa_node. This is the node itself unless it
+ * has no CPUs the process may run on.
+ *
+ * Returns: (transfer none): A #UfoCpuNode or %NULL if @numa_node is unknown.
+ */
+UfoNode *
+ufo_resources_get_cpu_node (UfoResources *resources,
+                            gint numa_node)
+{
+    UfoResourcesPrivate *priv;
+    guint *candidates;
+    guint n_candidates;
+    gint from;
+    gint closest;
+    GList *it;
+    guint i = 0;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
+
+    priv = resources->priv;
+    from = get_numa_index (priv, numa_node);
+
+    if (from < 0)
+        return NULL;
+
+    n_candidates = g_list_length (priv->cpu_nodes);
+    candidates = g_new0 (guint, n_candidates);
+
+    g_list_for (priv->cpu_nodes, it)
+        candidates[i++] = (guint) get_numa_index (priv, ufo_cpu_node_get_numa_node (UFO_CPU_NODE (it->data)));
+
+    closest = ufo_find_closest_numa_index (priv->numa_distances, priv->n_numa_nodes,
+                                           (guint) from, candidates, n_candidates);
+    g_free (candidates);
+
+    if (closest < 0)
+        return NULL;
+
+    return UFO_NODE (g_list_nth_data (priv->cpu_nodes, (guint) closest));
+}
+
+/**
+ * ufo_resources_get_closest_cpu_node:
+ * @resources: A #UfoResources
+ * @proc_node: A #UfoGpuNode or #UfoCpuNode
+ *
+ * Get the #UfoCpuNode whose CPUs are closest to @proc_node, i.e. to the PCI
+ * slot of a GPU.
+ *
+ * Returns: (transfer none): A #UfoCpuNode or %NULL if the location of
+ * @proc_node is unknown.
+ */
+UfoNode *
+ufo_resources_get_closest_cpu_node (UfoResources *resources,
+                                    UfoNode *proc_node)
+{
+    GValue *value;
+    gint numa_node;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
+
+    if (UFO_IS_CPU_NODE (proc_node))
+        return proc_node;
+
+    if (!UFO_IS_GPU_NODE (proc_node))
+        return NULL;
+
+    value = ufo_gpu_node_get_info (UFO_GPU_NODE (proc_node), UFO_GPU_NODE_INFO_NUMA_NODE);
+    numa_node = g_value_get_int (value);
+    g_value_unset (value);
+    g_free (value);
+
+    return ufo_resources_get_cpu_node (resources, numa_node);
+}
+
 /**
  * ufo_resources_get_remote_nodes:
  * @resources: A #UfoResources
@@ -1079,6 +1380,33 @@ ufo_resources_set_property (GObject *object,
             }
             break;
 
+        case PROP_PINNED_HOST_MEMORY:
+            priv->pinned_host_memory = g_value_get_boolean (value);
+
+            if (priv->context != NULL) {
+                /* Readers allocate host arrays before any queue is known */
+                ufo_buffer_set_context_host_memory (priv->context,
+                                                    priv->pinned_host_memory ?
+                                                    UFO_BUFFER_HOST_MEMORY_PINNED :
+                                                    UFO_BUFFER_HOST_MEMORY_DEFAULT,
+                                                    priv->gpu_nodes != NULL ?
+                                                    ufo_gpu_node_get_cmd_queue (UFO_GPU_NODE (priv->gpu_nodes->data)) :
+                                                    NULL);
+            }
+            break;
+
+        case PROP_HOST_MEMORY_BUDGET:
+            priv->host_memory_budget = g_value_get_uint64 (value);
+            ufo_memory_set_budget (NULL, priv->host_memory_budget);
+            break;
+
+        case PROP_DEVICE_MEMORY_BUDGET:
+            priv->device_memory_budget = g_value_get_uint64 (value);
+
+            if (priv->context != NULL)
+                ufo_memory_set_budget (priv->context, priv->device_memory_budget);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
             break;
@@ -1106,6 +1434,39 @@ ufo_resources_get_property (GObject *object,
             g_value_set_boxed (value, priv->remotes);
             break;
 
+        case PROP_PINNED_HOST_MEMORY:
+            g_value_set_boolean (value, priv->pinned_host_memory);
+            break;
+
+        case PROP_HOST_MEMORY_BUDGET:
+            g_value_set_uint64 (value, priv->host_memory_budget);
+            break;
+
+        case PROP_DEVICE_MEMORY_BUDGET:
+            g_value_set_uint64 (value, priv->device_memory_budget);
+            break;
+
+        case PROP_HOST_MEMORY_USAGE:
+        case PROP_HOST_MEMORY_PEAK:
+        case PROP_DEVICE_MEMORY_USAGE:
+        case PROP_DEVICE_MEMORY_PEAK:
+            {
+                gboolean host;
+                guint64 used = 0;
+                guint64 peak = 0;
+
+                host = property_id == PROP_HOST_MEMORY_USAGE || property_id == PROP_HOST_MEMORY_PEAK;
+
+                if (host || priv->context != NULL)
+                    ufo_memory_get_usage (host ? NULL : priv->context, &used, &peak);
+
+                if (property_id == PROP_HOST_MEMORY_USAGE || property_id == PROP_DEVICE_MEMORY_USAGE)
+                    g_value_set_uint64 (value, used);
+                else
+                    g_value_set_uint64 (value, peak);
+            }
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
             break;
@@ -1128,11 +1489,17 @@ ufo_resources_dispose (GObject *object)
         g_object_unref (G_OBJECT (it->data));
     }
 
+    g_list_for (priv->cpu_nodes, it) {
+        g_object_unref (G_OBJECT (it->data));
+    }
+
     g_list_free (priv->gpu_nodes);
     g_list_free (priv->remote_nodes);
+    g_list_free (priv->cpu_nodes);
 
     priv->gpu_nodes = NULL;
     priv->remote_nodes = NULL;
+    priv->cpu_nodes = NULL;
 }
 
 static void
@@ -1157,6 +1524,10 @@ ufo_resources_finalize (GObject *object)
     }
 
     if (priv->context) {
+        ufo_buffer_pool_drain (ufo_buffer_pool_get_default (), priv->context);
+        ufo_release_context_programs (priv->context);
+        ufo_buffer_set_context_host_memory (priv->context, UFO_BUFFER_HOST_MEMORY_DEFAULT, NULL);
+        ufo_memory_forget (priv->context);
         g_debug ("FREE context=%p", (gpointer) priv->context);
         UFO_RESOURCES_CHECK_CLERR (clReleaseContext (priv->context));
     }
@@ -1165,6 +1536,8 @@ ufo_resources_finalize (GObject *object)
 
     g_free (priv->device_names);
     g_free (priv->devices);
+    g_free (priv->numa_ids);
+    g_free (priv->numa_distances);
 
     priv->kernels = NULL;
     priv->devices = NULL;
@@ -1259,6 +1632,98 @@ ufo_resources_class_init (UfoResourcesClass *klass)
                                                        G_PARAM_READABLE),
                                   G_PARAM_READWRITE);
 
+    /**
+     * UfoResources:pinned-host-memory:
+     *
+     * Back the host arrays of all buffers created in this context with pinned
+     * memory, so that host to device transfers can use DMA. Buffers can
+     * override this with ufo_buffer_set_host_memory().
+     */
+    properties[PROP_PINNED_HOST_MEMORY] =
+        g_param_spec_boolean ("pinned-host-memory",
+                              "Use pinned host memory for buffers",
+                              "Use pinned host memory for buffers",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
+    /**
+     * UfoResources:host-memory-budget:
+     *
+     * Number of bytes that host arrays of buffers may occupy or 0 for no
+     * limit. The budget is shared by the whole process. If it is exceeded, host
+     * copies of pooled buffers that reside on a device are released.
+     */
+    properties[PROP_HOST_MEMORY_BUDGET] =
+        g_param_spec_uint64 ("host-memory-budget",
+                             "Host memory budget in bytes",
+                             "Host memory budget in bytes",
+                             0, G_MAXUINT64, 0,
+                             G_PARAM_READWRITE);
+
+    /**
+     * UfoResources:device-memory-budget:
+     *
+     * Number of bytes that device arrays and images of buffers may occupy in
+     * the context of these resources or 0 for no limit. If it is exceeded or
+     * an allocation fails, pooled buffers of the context are released.
+     */
+    properties[PROP_DEVICE_MEMORY_BUDGET] =
+        g_param_spec_uint64 ("device-memory-budget",
+                             "Device memory budget in bytes",
+                             "Device memory budget in bytes",
+                             0, G_MAXUINT64, 0,
+                             G_PARAM_READWRITE);
+
+    /**
+     * UfoResources:host-memory-usage:
+     *
+     * Number of bytes currently held by host arrays of buffers.
+     */
+    properties[PROP_HOST_MEMORY_USAGE] =
+        g_param_spec_uint64 ("host-memory-usage",
+                             "Host memory in use in bytes",
+                             "Host memory in use in bytes",
+                             0, G_MAXUINT64, 0,
+                             G_PARAM_READABLE);
+
+    /**
+     * UfoResources:host-memory-peak:
+     *
+     * Maximum number of bytes that host arrays of buffers held at once.
+     */
+    properties[PROP_HOST_MEMORY_PEAK] =
+        g_param_spec_uint64 ("host-memory-peak",
+                             "Peak host memory usage in bytes",
+                             "Peak host memory usage in bytes",
+                             0, G_MAXUINT64, 0,
+                             G_PARAM_READABLE);
+
+    /**
+     * UfoResources:device-memory-usage:
+     *
+     * Number of bytes currently held by device arrays and images of buffers in
+     * the context of these resources.
+     */
+    properties[PROP_DEVICE_MEMORY_USAGE] =
+        g_param_spec_uint64 ("device-memory-usage",
+                             "Device memory in use in bytes",
+                             "Device memory in use in bytes",
+                             0, G_MAXUINT64, 0,
+                             G_PARAM_READABLE);
+
+    /**
+     * UfoResources:device-memory-peak:
+     *
+     * Maximum number of bytes that device arrays and images of buffers held at
+     * once in the context of these resources.
+     */
+    properties[PROP_DEVICE_MEMORY_PEAK] =
+        g_param_spec_uint64 ("device-memory-peak",
+                             "Peak device memory usage in bytes",
+                             "Peak device memory usage in bytes",
+                             0, G_MAXUINT64, 0,
+                             G_PARAM_READABLE);
+
     for (guint i = PROP_0 + 1; i < N_PROPERTIES; i++)
         g_object_class_install_property (oclass, i, properties[i]);
 
@@ -1284,8 +1749,15 @@ ufo_resources_init (UfoResources *self)
     priv->paths = g_list_append (NULL, g_strdup ("."));
     priv->paths = g_list_append (priv->paths, g_strdup (UFO_KERNEL_DIR));
     priv->gpu_nodes = NULL;
+    priv->cpu_nodes = NULL;
+    priv->n_numa_nodes = 0;
+    priv->numa_ids = NULL;
+    priv->numa_distances = NULL;
     priv->remotes = NULL;
     priv->remote_nodes = NULL;
+    priv->pinned_host_memory = FALSE;
+    priv->host_memory_budget = 0;
+    priv->device_memory_budget = 0;
 
     kernel_path = g_getenv ("UFO_KERNEL_PATH");
 
@@ -1304,5 +1776,8 @@ ufo_resources_init (UfoResources *self)
     priv->device_type = UFO_DEVICE_GPU;
     priv->platform_index = -1;
 
+#ifndef __APPLE__
+    discover_cpu_nodes (priv);
+#endif
     initialize_opencl (priv);
 }
@@ -25,6 +25,7 @@
 #endif
 
 #include <ufo/ufo-buffer.h>
+#include <ufo/ufo-node.h>
 
 G_BEGIN_DECLS
 
@@ -146,6 +147,11 @@ gpointer         ufo_resources_get_context              (UfoResources   *resourc
 GList          * ufo_resources_get_cmd_queues           (UfoResources   *resources);
 GList          * ufo_resources_get_devices              (UfoResources   *resources);
 GList          * ufo_resources_get_gpu_nodes            (UfoResources   *resources);
+GList          * ufo_resources_get_cpu_nodes            (UfoResources   *resources);
+UfoNode        * ufo_resources_get_cpu_node             (UfoResources   *resources,
+                                                         gint            numa_node);
+UfoNode        * ufo_resources_get_closest_cpu_node     (UfoResources   *resources,
+                                                         UfoNode        *proc_node);
 GList          * ufo_resources_get_remote_nodes         (UfoResources   *resources);
 const gchar    * ufo_resources_clerr                    (int             error);
 GType            ufo_resources_get_type                 (void);
@@ -30,14 +30,18 @@
 #include <gio/gio.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ufo/ufo-buffer.h>
+#include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-remote-node.h>
 #include <ufo/ufo-remote-task.h>
 #include <ufo/ufo-resources.h>
 #include <ufo/ufo-scheduler.h>
 #include <ufo/ufo-task-node.h>
 #include <ufo/ufo-task-iface.h>
+#include "ufo-merge.h"
+#include "ufo-plan.h"
 #include "ufo-priv.h"
 #include "compat.h"
 
@@ -55,6 +59,33 @@ G_DEFINE_TYPE (UfoScheduler, ufo_scheduler, UFO_TYPE_BASE_SCHEDULER)
 
 #define UFO_SCHEDULER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_SCHEDULER, UfoSchedulerPrivate))
 
+/* Maximum number of inputs fetched at once if a task lags behind */
+#define MAX_BURST   8
+
+/*
+ * Inputs that were ready when the queue was last drained. Taking them in one
+ * burst saves a queue operation for each of them.
+ */
+typedef struct {
+    UfoBuffer       *items[MAX_BURST];
+    guint            n_items;
+    guint            next;
+} Burst;
+
+/*
+ * Where a task run by the worker pool continues. Tasks that are not reductors
+ * only use PHASE_START and PHASE_DONE.
+ */
+typedef enum {
+    PHASE_START,
+    PHASE_PROCESS,
+    PHASE_FETCH,
+    PHASE_GENERATE,
+    PHASE_DONE,
+} Phase;
+
+typedef struct _Pool Pool;
+
 typedef struct {
     UfoTask         *task;
     UfoTaskMode      mode;
@@ -63,8 +94,53 @@ typedef struct {
     gboolean        *finished;
     gboolean         strict;
     gboolean         timestamps;
+    gpointer         cmd_queue;
+    UfoCpuNode      *cpu_node;      /* CPUs the thread is pinned to */
+    guint            batch_size;    /* frames to combine for batch tasks */
+    UfoBuffer      **batches;       /* combined inputs of batch tasks */
+    UfoBuffer      **splits;        /* batched inputs handed out frame-wise */
+    UfoBuffer      **frames;        /* current frame of splits */
+    guint           *split_index;
+    gboolean        *device_inputs; /* inputs last read as device arrays */
+    UfoLink         *links;         /* inputs fed by a single group */
+    UfoMerge       **merges;        /* inputs fed by more than one group */
+    Burst           *bursts;
+    UfoLink        **sources;       /* links the current inputs came from */
+    guint            reorder_window;
+    guint64          sequence;      /* next sequence number of generators */
+    Phase            phase;         /* state kept between steps of the pool */
+    UfoBuffer      **inputs;
+    UfoBuffer       *output;
+    UfoRequisition   requisition;
+    gboolean         go_on;
+    gboolean         active;
+    Pool            *pool;          /* notified when a remote task ends */
 } TaskLocalData;
 
+/* Steps a worker runs a task before turning to the next one */
+#define MAX_STEPS       16
+
+/* Time after which idle workers look for ready tasks while remote tasks run */
+#define POOL_WAIT_USEC  1000
+
+typedef struct {
+    Pool            *pool;
+    guint            index;
+    GQueue          *tasks;         /* own tasks, others steal from the tail */
+    GMutex          *lock;
+} Worker;
+
+struct _Pool {
+    Worker          *workers;
+    guint            n_workers;
+    gint             n_active;      /* tasks that are not done yet */
+    gint             n_remote;      /* remote tasks running in own threads */
+    gint             progress;      /* incremented whenever a task made a step */
+    gint             n_sleeping;
+    GMutex          *lock;
+    GCond           *cond;
+};
+
 
 struct _UfoSchedulerPrivate {
     UfoRemoteMode    mode;
@@ -95,22 +171,140 @@ ufo_scheduler_new (void)
     return UFO_BASE_SCHEDULER (g_object_new (UFO_TYPE_SCHEDULER, NULL));
 }
 
+static void
+push_link (UfoLink *link,
+           UfoBuffer *buffer)
+{
+    ufo_group_push_input_buffers_at (link->group, link->slot, &buffer, 1);
+}
+
+static UfoBuffer *
+pop_input (TaskLocalData *tld,
+           guint input)
+{
+    UfoMerge *merge = tld->merges[input];
+    UfoLink *link = &tld->links[input];
+    Burst *burst = &tld->bursts[input];
+
+    if (merge != NULL)
+        return ufo_merge_pop (merge, tld->reorder_window, &tld->sources[input]);
+
+    tld->sources[input] = link;
+
+    if (burst->next == burst->n_items) {
+        burst->n_items = ufo_group_pop_input_buffers_at (link->group, link->slot, burst->items, MAX_BURST);
+        burst->next = 0;
+    }
+
+    return burst->items[burst->next++];
+}
+
+/*
+ * Combine @first and up to batch_size - 1 following inputs of @input into one
+ * batch. Every frame is given back to its producer right after copying it,
+ * because producers may not have more buffers than that in flight.
+ */
+static UfoBuffer *
+combine_input (TaskLocalData *tld,
+               guint input,
+               UfoBuffer *first)
+{
+    UfoBuffer *batch = tld->batches[input];
+    UfoBuffer *frame = first;
+    UfoRequisition req;
+    guint n_frames = 0;
+
+    ufo_buffer_get_requisition (first, &req);
+
+    if (batch == NULL) {
+        batch = ufo_buffer_new (&req, ufo_buffer_get_context (first));
+        tld->batches[input] = batch;
+    }
+
+    ufo_buffer_set_n_frames (batch, tld->batch_size);
+
+    if (ufo_buffer_cmp_dimensions (batch, &req) != 0)
+        ufo_buffer_resize (batch, &req);
+
+    ufo_buffer_clear_metadata (batch);
+    ufo_buffer_copy_metadata (first, batch);
+
+    while (frame != UFO_END_OF_STREAM) {
+        ufo_buffer_set_frame (batch, n_frames++, frame);
+        push_link (tld->sources[input], frame);
+
+        if (n_frames == tld->batch_size)
+            break;
+
+        frame = pop_input (tld, input);
+    }
+
+    /* The stream ended early, hand out what we have and stop afterwards */
+    if (frame == UFO_END_OF_STREAM) {
+        tld->finished[input] = TRUE;
+        ufo_buffer_set_n_frames (batch, n_frames);
+    }
+
+    return batch;
+}
+
+/*
+ * Hand out the next frame of a batch to a task that cannot process batches.
+ */
+static UfoBuffer *
+split_input (TaskLocalData *tld,
+             guint input)
+{
+    UfoBuffer *batch = tld->splits[input];
+
+    if (tld->frames[input] == NULL) {
+        UfoRequisition req;
+
+        ufo_buffer_get_requisition (batch, &req);
+        tld->frames[input] = ufo_buffer_new (&req, ufo_buffer_get_context (batch));
+    }
+
+    ufo_buffer_get_frame (batch, tld->split_index[input], tld->frames[input]);
+    return tld->frames[input];
+}
+
 static gboolean
 get_inputs (TaskLocalData *tld,
             UfoBuffer **inputs)
 {
+    UfoProfiler *profiler;
     UfoRequisition req;
-    UfoTaskNode *node = UFO_TASK_NODE (tld->task);
     guint n_finished = 0;
 
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (tld->task));
+
     for (guint i = 0; i < tld->n_inputs; i++) {
-        UfoGroup *group;
+        if (tld->splits[i] != NULL) {
+            inputs[i] = split_input (tld, i);
+            continue;
+        }
 
         if (!tld->finished[i]) {
             UfoBuffer *input;
 
-            group = ufo_task_node_get_current_in_group (node, i);
-            input = ufo_group_pop_input_buffer (group, tld->task);
+            /* Blocks until the predecessors have produced data */
+            ufo_profiler_start (profiler, UFO_PROFILER_TIMER_FETCH);
+            input = pop_input (tld, i);
+            ufo_profiler_stop (profiler, UFO_PROFILER_TIMER_FETCH);
+
+            if (input != UFO_END_OF_STREAM) {
+                guint n_frames = ufo_buffer_get_n_frames (input);
+
+                if (tld->mode & UFO_TASK_MODE_BATCH) {
+                    if (n_frames == 1 && tld->batch_size > 1)
+                        input = combine_input (tld, i, input);
+                }
+                else if (n_frames > 1) {
+                    tld->splits[i] = input;
+                    tld->split_index[i] = 0;
+                    input = split_input (tld, i);
+                }
+            }
 
             if (tld->strict && input != UFO_END_OF_STREAM) {
                 ufo_buffer_get_requisition (input, &req);
@@ -136,21 +330,114 @@ get_inputs (TaskLocalData *tld,
     return (tld->n_inputs == 0) || (n_finished < tld->n_inputs);
 }
 
+static void
+prefetch_inputs (TaskLocalData *tld,
+                 UfoBuffer **inputs)
+{
+    /*
+     * Start uploading host data without blocking, so that the transfer can
+     * overlap with kernels that are still running for the previous item. Only
+     * inputs that the task read as device arrays before are uploaded, others
+     * would just move to the device and back. Read-only tasks may share
+     * their inputs with other readers and must not move them for writing.
+     */
+    if (tld->mode & UFO_TASK_MODE_READ_ONLY_INPUT)
+        return;
+
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        if (!tld->finished[i] && tld->device_inputs[i] &&
+            ufo_buffer_get_location (inputs[i]) == UFO_BUFFER_LOCATION_HOST)
+            ufo_buffer_get_device_array_async (inputs[i], tld->cmd_queue, NULL);
+    }
+}
+
+static gboolean
+process_inputs (TaskLocalData *tld,
+                UfoBuffer **inputs,
+                UfoBuffer *output,
+                UfoRequisition *requisition)
+{
+    UfoBufferLocation before[tld->n_inputs];
+    gboolean result;
+
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        if (tld->finished[i])
+            continue;
+
+        before[i] = ufo_buffer_get_location (inputs[i]);
+    }
+
+    result = ufo_task_process (tld->task, inputs, output, requisition);
+
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        UfoBufferLocation after;
+
+        if (tld->finished[i])
+            continue;
+
+        /* Where the data went tells how the task accesses this input */
+        after = ufo_buffer_get_location (inputs[i]);
+
+        if (before[i] == UFO_BUFFER_LOCATION_HOST || after != before[i])
+            tld->device_inputs[i] = after == UFO_BUFFER_LOCATION_DEVICE;
+    }
+
+    return result;
+}
+
 static void
 release_inputs (TaskLocalData *tld,
                 UfoBuffer **inputs)
 {
-    UfoTaskNode *node = UFO_TASK_NODE (tld->task);
-
     for (guint i = 0; i < tld->n_inputs; i++) {
-        UfoGroup *group;
+        /* Frames of combined batches have been given back already */
+        if (inputs[i] == tld->batches[i])
+            continue;
 
-        group = ufo_task_node_get_current_in_group (node, i);
-        ufo_group_push_input_buffer (group, tld->task, inputs[i]);
-        ufo_task_node_switch_in_group (node, i);
+        if (tld->splits[i] != NULL) {
+            if (++tld->split_index[i] < ufo_buffer_get_n_frames (tld->splits[i]))
+                continue;
+
+            inputs[i] = tld->splits[i];
+            tld->splits[i] = NULL;
+        }
+
+        push_link (tld->sources[i], inputs[i]);
     }
 }
 
+static UfoBuffer *
+pop_output (TaskLocalData *tld,
+            UfoGroup *group,
+            UfoRequisition *requisition)
+{
+    UfoProfiler *profiler;
+    UfoBuffer *output;
+
+    /* Blocks while the successors still hold all buffers of the queue */
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (tld->task));
+    ufo_profiler_start (profiler, UFO_PROFILER_TIMER_BLOCKED);
+    output = ufo_group_pop_output_buffer (group, requisition);
+    ufo_profiler_stop (profiler, UFO_PROFILER_TIMER_BLOCKED);
+
+    return output;
+}
+
+static guint
+get_output_frames (TaskLocalData *tld,
+                   UfoBuffer **inputs)
+{
+    if (!(tld->mode & UFO_TASK_MODE_BATCH))
+        return 1;
+
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        if (!tld->finished[i] || inputs[i] == tld->batches[i])
+            return ufo_buffer_get_n_frames (inputs[i]);
+    }
+
+    return tld->batch_size;
+}
+
 static gboolean
 any (gboolean *values,
      guint n_values)
@@ -204,7 +491,7 @@ run_remote_task (TaskLocalData *tld)
 
             ufo_remote_node_get_requisition (remote, &requisition);
             group = ufo_task_node_get_out_group (UFO_TASK_NODE (tld->task));
-            output = ufo_group_pop_output_buffer (group, &requisition);
+            output = pop_output (tld, group, &requisition);
             ufo_remote_node_get_result (remote, output);
             ufo_group_push_output_buffer (group, output);
         }
@@ -217,6 +504,96 @@ run_remote_task (TaskLocalData *tld)
     ufo_remote_node_terminate (remote);
 }
 
+static gboolean
+produces_output (TaskLocalData *tld)
+{
+    return (tld->mode & UFO_TASK_MODE_TYPE_MASK) != UFO_TASK_MODE_SINK;
+}
+
+/*
+ * Fetch the next inputs and an output buffer for them. Returns FALSE and ends
+ * the output stream if all inputs are finished.
+ */
+static gboolean
+prepare_step (TaskLocalData *tld,
+              UfoBuffer **inputs,
+              UfoBuffer **output,
+              UfoRequisition *requisition)
+{
+    UfoGroup *group;
+
+    group = ufo_task_node_get_out_group (UFO_TASK_NODE (tld->task));
+
+    if (!get_inputs (tld, inputs)) {
+        ufo_group_finish (group);
+        return FALSE;
+    }
+
+    if (tld->cmd_queue != NULL)
+        prefetch_inputs (tld, inputs);
+
+    /* Get output buffers, fused tasks already process their inputs here */
+    ufo_task_get_requisition (tld->task, inputs, requisition);
+
+    if (produces_output (tld)) {
+        *output = pop_output (tld, group, requisition);
+        g_assert (*output != NULL);
+        ufo_buffer_set_n_frames (*output, get_output_frames (tld, inputs));
+        ufo_buffer_discard_location (*output);
+
+        for (guint i = 0; i < tld->n_inputs; i++)
+            ufo_buffer_copy_metadata (inputs[i], *output);
+    }
+
+    return TRUE;
+}
+
+static gboolean
+generate_output (TaskLocalData *tld,
+                 UfoBuffer *output,
+                 UfoRequisition *requisition)
+{
+    GValue sequence = { 0, };
+
+    g_value_init (&sequence, G_TYPE_UINT64);
+    g_value_set_uint64 (&sequence, tld->sequence++);
+    ufo_buffer_set_metadata (output, "sequence", &sequence);
+
+    if (tld->timestamps) {
+        GValue v = { 0, };
+
+        g_value_init (&v, G_TYPE_INT64);
+        g_value_set_int64 (&v, g_get_real_time ());
+        ufo_buffer_set_metadata (output, "ts", &v);
+    }
+
+    return ufo_task_generate (tld->task, output, requisition);
+}
+
+/*
+ * Count progress and wake workers that wait for it, so that they look for
+ * tasks that became ready.
+ */
+static void
+wake_workers (Pool *pool)
+{
+    g_atomic_int_inc (&pool->progress);
+
+    if (g_atomic_int_get (&pool->n_sleeping) > 0) {
+        g_mutex_lock (pool->lock);
+        g_cond_broadcast (pool->cond);
+        g_mutex_unlock (pool->lock);
+    }
+}
+
+static void
+finish_remote_task (Pool *pool)
+{
+    /* Without remote tasks, workers need not poll anymore */
+    g_atomic_int_add (&pool->n_remote, -1);
+    wake_workers (pool);
+}
+
 static gpointer
 run_task (TaskLocalData *tld)
 {
@@ -234,45 +611,36 @@ run_task (TaskLocalData *tld)
 
     if (UFO_IS_REMOTE_TASK (tld->task)) {
         run_remote_task (tld);
+
+        if (tld->pool != NULL)
+            finish_remote_task (tld->pool);
+
         return NULL;
     }
 
+    /* Output buffers allocated from now on are touched first on this node */
+    if (tld->cpu_node != NULL)
+        ufo_cpu_node_pin_thread (tld->cpu_node);
+
     /* mode without CPU/GPU flag */
     mode = tld->mode & UFO_TASK_MODE_TYPE_MASK;
-    produces = mode != UFO_TASK_MODE_SINK;
+    produces = produces_output (tld);
 
     while (active) {
         UfoGroup *group;
 
         group = ufo_task_node_get_out_group (node);
 
-        /* Get input buffers */
-        active = get_inputs (tld, inputs);
+        /* Get input and output buffers */
+        active = prepare_step (tld, inputs, &output, &requisition);
 
-        if (!active) {
-            ufo_group_finish (group);
+        if (!active)
             break;
-        }
-
-        /* Get output buffers */
-        ufo_task_get_requisition (tld->task, inputs, &requisition);
-
-        if (produces) {
-            output = ufo_group_pop_output_buffer (group, &requisition);
-            g_assert (output != NULL);
-        }
-
-        if (output != NULL) {
-            ufo_buffer_discard_location (output);
-
-            for (guint i = 0; i < tld->n_inputs; i++)
-                ufo_buffer_copy_metadata (inputs[i], output);
-        }
 
         switch (mode) {
             case UFO_TASK_MODE_PROCESSOR:
             case UFO_TASK_MODE_SINK:
-                active = ufo_task_process (tld->task, inputs, output, &requisition);
+                active = process_inputs (tld, inputs, output, &requisition);
                 break;
 
             case UFO_TASK_MODE_REDUCTOR:
@@ -280,7 +648,7 @@ run_task (TaskLocalData *tld)
                     gboolean go_on = TRUE;
 
                     do {
-                        go_on = ufo_task_process (tld->task, inputs, output, &requisition);
+                        go_on = process_inputs (tld, inputs, output, &requisition);
 
                         release_inputs (tld, inputs);
                         active = get_inputs (tld, inputs);
@@ -292,7 +660,7 @@ run_task (TaskLocalData *tld)
 
                         if (go_on) {
                             ufo_group_push_output_buffer (group, output);
-                            output = ufo_group_pop_output_buffer (group, &requisition);
+                            output = pop_output (tld, group, &requisition);
                         }
                     } while (go_on);
                 } while (active);
@@ -300,18 +668,7 @@ run_task (TaskLocalData *tld)
                 break;
 
             case UFO_TASK_MODE_GENERATOR:
-                {
-                    if (tld->timestamps) {
-                        GValue v = { 0, };
-
-                        g_value_init (&v, G_TYPE_INT64);
-                        g_value_set_int64 (&v, g_get_real_time ());
-                        ufo_buffer_set_metadata (output, "ts", &v);
-                    }
-
-                    active = ufo_task_generate (tld->task, output, &requisition);
-
-                }
+                active = generate_output (tld, output, &requisition);
                 break;
 
             default:
@@ -332,17 +689,375 @@ run_task (TaskLocalData *tld)
     return NULL;
 }
 
+static gboolean
+inputs_ready (TaskLocalData *tld)
+{
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        UfoLink *link = &tld->links[i];
+        Burst *burst = &tld->bursts[i];
+
+        if (tld->finished[i] || tld->splits[i] != NULL)
+            continue;
+
+        if (tld->merges[i] != NULL) {
+            if (!ufo_merge_poll (tld->merges[i], tld->reorder_window))
+                return FALSE;
+
+            continue;
+        }
+
+        if (burst->next == burst->n_items && !ufo_group_can_pop_input_at (link->group, link->slot))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+output_ready (TaskLocalData *tld)
+{
+    if (!produces_output (tld))
+        return TRUE;
+
+    return ufo_group_can_pop_output (ufo_task_node_get_out_group (UFO_TASK_NODE (tld->task)));
+}
+
+/*
+ * Run one iteration of the loop in run_task() if it can run without blocking.
+ * Reductors are split into phases so that consuming inputs and generating
+ * outputs can be interleaved with other tasks as well. Returns TRUE if the task
+ * made progress.
+ */
+static gboolean
+step_task (TaskLocalData *tld)
+{
+    UfoGroup *group;
+    UfoTaskMode mode;
+    gboolean go_on;
+
+    group = ufo_task_node_get_out_group (UFO_TASK_NODE (tld->task));
+    mode = tld->mode & UFO_TASK_MODE_TYPE_MASK;
+
+    switch (tld->phase) {
+        case PHASE_START:
+            if (!inputs_ready (tld) || !output_ready (tld))
+                return FALSE;
+
+            if (!prepare_step (tld, tld->inputs, &tld->output, &tld->requisition)) {
+                tld->phase = PHASE_DONE;
+                return TRUE;
+            }
+
+            if (mode == UFO_TASK_MODE_REDUCTOR) {
+                tld->phase = PHASE_PROCESS;
+                return TRUE;
+            }
+
+            if (mode == UFO_TASK_MODE_GENERATOR)
+                go_on = generate_output (tld, tld->output, &tld->requisition);
+            else
+                go_on = process_inputs (tld, tld->inputs, tld->output, &tld->requisition);
+
+            if (!go_on) {
+                ufo_group_finish (group);
+                tld->phase = PHASE_DONE;
+                return TRUE;
+            }
+
+            if (tld->output != NULL)
+                ufo_group_push_output_buffer (group, tld->output);
+
+            release_inputs (tld, tld->inputs);
+            tld->output = NULL;
+            return TRUE;
+
+        case PHASE_PROCESS:
+            tld->go_on = process_inputs (tld, tld->inputs, tld->output, &tld->requisition);
+            release_inputs (tld, tld->inputs);
+            tld->phase = PHASE_FETCH;
+            return TRUE;
+
+        case PHASE_FETCH:
+            if (!inputs_ready (tld))
+                return FALSE;
+
+            tld->active = get_inputs (tld, tld->inputs);
+            tld->phase = tld->go_on && tld->active ? PHASE_PROCESS : PHASE_GENERATE;
+            return TRUE;
+
+        case PHASE_GENERATE:
+            /* Pushing changes the target, so room is checked right before popping */
+            if (tld->output == NULL) {
+                if (!output_ready (tld))
+                    return FALSE;
+
+                tld->output = pop_output (tld, group, &tld->requisition);
+            }
+
+            if (ufo_task_generate (tld->task, tld->output, &tld->requisition)) {
+                ufo_group_push_output_buffer (group, tld->output);
+                tld->output = NULL;
+            }
+            else if (tld->active) {
+                tld->phase = PHASE_PROCESS;
+            }
+            else {
+                ufo_group_finish (group);
+                tld->phase = PHASE_DONE;
+            }
+
+            return TRUE;
+
+        case PHASE_DONE:
+            break;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Step @tld as long as it can run, but not forever so that other tasks of the
+ * worker get their turn. Returns TRUE if the task made progress.
+ */
+static gboolean
+run_steps (Pool *pool,
+           TaskLocalData *tld)
+{
+    guint n_steps = 0;
+
+    while (n_steps < MAX_STEPS && tld->phase != PHASE_DONE && step_task (tld))
+        n_steps++;
+
+    if (n_steps == 0)
+        return FALSE;
+
+    if (tld->phase == PHASE_DONE)
+        g_atomic_int_add (&pool->n_active, -1);
+
+    /* Progress may have made tasks of sleeping workers ready */
+    wake_workers (pool);
+
+    return TRUE;
+}
+
+static void
+give_task (Worker *worker,
+           TaskLocalData *tld)
+{
+    if (tld->phase == PHASE_DONE)
+        return;
+
+    g_mutex_lock (worker->lock);
+    g_queue_push_tail (worker->tasks, tld);
+    g_mutex_unlock (worker->lock);
+}
+
+static TaskLocalData *
+take_task (Worker *worker,
+           gboolean steal)
+{
+    TaskLocalData *tld;
+
+    g_mutex_lock (worker->lock);
+    tld = steal ? g_queue_pop_tail (worker->tasks) : g_queue_pop_head (worker->tasks);
+    g_mutex_unlock (worker->lock);
+
+    return tld;
+}
+
+/*
+ * Look for a task of another worker that can run. A task that was run stays
+ * with the thief.
+ */
+static gboolean
+steal_task (Pool *pool,
+            Worker *thief)
+{
+    for (guint i = 1; i < pool->n_workers; i++) {
+        Worker *victim;
+        TaskLocalData *tld;
+
+        victim = &pool->workers[(thief->index + i) % pool->n_workers];
+        tld = take_task (victim, TRUE);
+
+        if (tld == NULL)
+            continue;
+
+        if (run_steps (pool, tld)) {
+            give_task (thief, tld);
+            return TRUE;
+        }
+
+        give_task (victim, tld);
+    }
+
+    return FALSE;
+}
+
+static void
+wait_for_progress (Pool *pool,
+                   gint progress)
+{
+    GTimeVal end;
+
+    g_mutex_lock (pool->lock);
+    g_atomic_int_inc (&pool->n_sleeping);
+
+    if (g_atomic_int_get (&pool->progress) == progress && g_atomic_int_get (&pool->n_active) > 0) {
+        /*
+         * Remote tasks run in their own threads and do not signal progress,
+         * so do not rely on being woken up while they run.
+         */
+        if (g_atomic_int_get (&pool->n_remote) > 0) {
+            g_get_current_time (&end);
+            g_time_val_add (&end, POOL_WAIT_USEC);
+            g_cond_timed_wait (pool->cond, pool->lock, &end);
+        }
+        else {
+            g_cond_wait (pool->cond, pool->lock);
+        }
+    }
+
+    g_atomic_int_add (&pool->n_sleeping, -1);
+    g_mutex_unlock (pool->lock);
+}
+
+static gpointer
+run_worker (Worker *worker)
+{
+    Pool *pool = worker->pool;
+    guint n_misses = 0;
+    gint progress = 0;
+
+    while (g_atomic_int_get (&pool->n_active) > 0) {
+        TaskLocalData *tld;
+        guint n_tasks;
+
+        if (n_misses == 0)
+            progress = g_atomic_int_get (&pool->progress);
+
+        tld = take_task (worker, FALSE);
+
+        if (tld != NULL) {
+            gboolean progressed;
+
+            progressed = run_steps (pool, tld);
+            give_task (worker, tld);
+
+            if (progressed) {
+                n_misses = 0;
+                continue;
+            }
+        }
+
+        g_mutex_lock (worker->lock);
+        n_tasks = g_queue_get_length (worker->tasks);
+        g_mutex_unlock (worker->lock);
+
+        /* Only look elsewhere after none of our own tasks could run */
+        if (++n_misses < n_tasks)
+            continue;
+
+        if (!steal_task (pool, worker))
+            wait_for_progress (pool, progress);
+
+        n_misses = 0;
+    }
+
+    return NULL;
+}
+
+static Pool *
+pool_new (TaskLocalData **tlds,
+          guint n_tlds,
+          guint n_workers)
+{
+    Pool *pool;
+    guint pos = 0;
+
+    pool = g_new0 (Pool, 1);
+    pool->n_workers = n_workers;
+    pool->workers = g_new0 (Worker, n_workers);
+    pool->lock = g_mutex_new ();
+    pool->cond = g_cond_new ();
+
+    for (guint i = 0; i < n_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].tasks = g_queue_new ();
+        pool->workers[i].lock = g_mutex_new ();
+    }
+
+    /* Remote tasks cannot be stepped and keep running in their own thread */
+    for (guint i = 0; i < n_tlds; i++) {
+        if (UFO_IS_REMOTE_TASK (tlds[i]->task)) {
+            tlds[i]->pool = pool;
+            pool->n_remote++;
+        }
+        else {
+            give_task (&pool->workers[pos++ % n_workers], tlds[i]);
+            pool->n_active++;
+        }
+    }
+
+    return pool;
+}
+
+static void
+pool_free (Pool *pool)
+{
+    for (guint i = 0; i < pool->n_workers; i++) {
+        g_queue_free (pool->workers[i].tasks);
+        g_mutex_free (pool->workers[i].lock);
+    }
+
+    g_mutex_free (pool->lock);
+    g_cond_free (pool->cond);
+    g_free (pool->workers);
+    g_free (pool);
+}
+
 static void
 cleanup_task_local_data (TaskLocalData **tlds,
                          guint n)
 {
     for (guint i = 0; i < n; i++) {
         TaskLocalData *tld = tlds[i];
+        UfoProfiler *profiler;
+
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (tld->task));
+        g_debug ("BLCK %s blocked on output for %3.5fs",
+                 ufo_task_node_get_identifier (UFO_TASK_NODE (tld->task)),
+                 ufo_profiler_elapsed (profiler, UFO_PROFILER_TIMER_BLOCKED));
+        g_debug ("FTCH %s waited for input for %3.5fs",
+                 ufo_task_node_get_identifier (UFO_TASK_NODE (tld->task)),
+                 ufo_profiler_elapsed (profiler, UFO_PROFILER_TIMER_FETCH));
 
         ufo_task_node_reset (UFO_TASK_NODE (tld->task));
 
+        for (guint j = 0; j < tld->n_inputs; j++) {
+            if (tld->batches[j] != NULL)
+                g_object_unref (tld->batches[j]);
+
+            if (tld->frames[j] != NULL)
+                g_object_unref (tld->frames[j]);
+
+            if (tld->merges[j] != NULL)
+                ufo_merge_free (tld->merges[j]);
+        }
+
         g_free (tld->dims);
         g_free (tld->finished);
+        g_free (tld->batches);
+        g_free (tld->splits);
+        g_free (tld->frames);
+        g_free (tld->split_index);
+        g_free (tld->device_inputs);
+        g_free (tld->links);
+        g_free (tld->merges);
+        g_free (tld->bursts);
+        g_free (tld->sources);
+        g_free (tld->inputs);
         g_free (tld);
     }
 
@@ -394,6 +1109,25 @@ check_target_connections (UfoTaskGraph *graph,
     return result;
 }
 
+/* Number of workers to run the tasks on or 0 for one thread per task */
+static guint
+get_num_workers (UfoBaseScheduler *scheduler)
+{
+    guint n_workers;
+
+    g_object_get (scheduler, "workers", &n_workers, NULL);
+
+    if (n_workers == UFO_BASE_SCHEDULER_AUTO_WORKERS) {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+        n_workers = g_get_num_processors ();
+#else
+        n_workers = (guint) MAX (sysconf (_SC_NPROCESSORS_ONLN), 1);
+#endif
+    }
+
+    return n_workers;
+}
+
 static TaskLocalData **
 setup_tasks (UfoBaseScheduler *scheduler,
              UfoTaskGraph *task_graph,
@@ -405,6 +1139,9 @@ setup_tasks (UfoBaseScheduler *scheduler,
     guint n_nodes;
     gboolean timestamps;
     gboolean tracing_enabled;
+    guint batch_size;
+    guint reorder_window;
+    guint n_workers;
 
     resources = ufo_base_scheduler_get_resources (scheduler, error);
 
@@ -414,8 +1151,12 @@ setup_tasks (UfoBaseScheduler *scheduler,
     g_object_get (scheduler,
                   "enable-tracing", &tracing_enabled,
                   "timestamps", &timestamps,
+                  "batch-size", &batch_size,
+                  "reorder-window", &reorder_window,
                   NULL);
 
+    n_workers = get_num_workers (scheduler);
+
     nodes = ufo_graph_get_nodes (UFO_GRAPH (task_graph));
     n_nodes = g_list_length (nodes);
 
@@ -435,6 +1176,42 @@ setup_tasks (UfoBaseScheduler *scheduler,
         tld->n_inputs = ufo_task_get_num_inputs (tld->task);
         tld->dims = g_new0 (guint, tld->n_inputs);
         tld->timestamps = timestamps;
+        tld->batch_size = tld->mode & UFO_TASK_MODE_BATCH ? batch_size : 1;
+
+        /* Combining frames waits for all of them, which workers must not do */
+        if (n_workers > 0 && tld->batch_size > 1) {
+            g_warning ("%s does not combine frames when running on workers",
+                       ufo_task_node_get_plugin_name (UFO_TASK_NODE (node)));
+            tld->batch_size = 1;
+        }
+        tld->batches = g_new0 (UfoBuffer *, tld->n_inputs);
+        tld->splits = g_new0 (UfoBuffer *, tld->n_inputs);
+        tld->frames = g_new0 (UfoBuffer *, tld->n_inputs);
+        tld->split_index = g_new0 (guint, tld->n_inputs);
+        tld->device_inputs = g_new0 (gboolean, tld->n_inputs);
+        tld->merges = g_new0 (UfoMerge *, tld->n_inputs);
+        tld->bursts = g_new0 (Burst, tld->n_inputs);
+        tld->links = g_new0 (UfoLink, tld->n_inputs);
+        tld->sources = g_new0 (UfoLink *, tld->n_inputs);
+        tld->inputs = g_new0 (UfoBuffer *, tld->n_inputs);
+        tld->reorder_window = reorder_window;
+
+        if (tld->mode & UFO_TASK_MODE_GPU) {
+            UfoNode *proc_node;
+
+            proc_node = ufo_task_node_get_proc_node (UFO_TASK_NODE (node));
+
+            if (proc_node != NULL && UFO_IS_GPU_NODE (proc_node))
+                tld->cmd_queue = ufo_gpu_node_get_cmd_queue (UFO_GPU_NODE (proc_node));
+        }
+
+        /* Workers run any task, so they cannot be pinned for one */
+        if (n_workers == 0)
+            tld->cpu_node = ufo_find_cpu_node (resources, UFO_GRAPH (task_graph), UFO_TASK_NODE (node));
+        else if (ufo_task_node_get_numa_node (UFO_TASK_NODE (node)) >= 0)
+            g_warning ("%s is not pinned to NUMA node %i when running on workers",
+                       ufo_task_node_get_plugin_name (UFO_TASK_NODE (node)),
+                       ufo_task_node_get_numa_node (UFO_TASK_NODE (node)));
 
         /* TODO: make this configurable from outside */
         tld->strict = FALSE;
@@ -505,6 +1282,10 @@ setup_groups (UfoBaseScheduler *scheduler,
             ufo_group_set_num_expected (group, UFO_TASK (target),
                                         ufo_task_node_get_num_expected (UFO_TASK_NODE (target),
                                                                         input));
+            ufo_group_set_queue_depth (group, UFO_TASK (target),
+                                       ufo_task_graph_get_edge_queue_depth (task_graph,
+                                                                            UFO_TASK_NODE (node),
+                                                                            UFO_TASK_NODE (target)));
         }
 
         g_list_free (successors);
@@ -514,6 +1295,50 @@ setup_groups (UfoBaseScheduler *scheduler,
     return groups;
 }
 
+static void
+set_link (UfoLink *link,
+          UfoGroup *group,
+          UfoTask *task)
+{
+    gint slot;
+
+    slot = ufo_group_get_slot (group, task);
+    g_assert (slot >= 0);
+    link->group = group;
+    link->slot = (guint) slot;
+}
+
+static void
+setup_links (TaskLocalData **tlds,
+             guint n_tlds)
+{
+    for (guint i = 0; i < n_tlds; i++) {
+        TaskLocalData *tld = tlds[i];
+
+        for (guint j = 0; j < tld->n_inputs; j++) {
+            GList *groups;
+            GList *it;
+            UfoLink *links;
+            guint pos = 0;
+
+            groups = ufo_task_node_get_in_groups (UFO_TASK_NODE (tld->task), j);
+
+            if (g_list_length (groups) < 2) {
+                set_link (&tld->links[j], UFO_GROUP (groups->data), tld->task);
+                continue;
+            }
+
+            links = g_new0 (UfoLink, g_list_length (groups));
+
+            g_list_for (groups, it)
+                set_link (&links[pos++], UFO_GROUP (it->data), tld->task);
+
+            tld->merges[j] = ufo_merge_new (links, pos);
+            g_free (links);
+        }
+    }
+}
+
 static gboolean
 correct_connections (UfoTaskGraph *graph,
                      GError **error)
@@ -613,12 +1438,26 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
     GList *groups;
     guint n_nodes;
     GThread **threads;
+    GTimer *timer;
     TaskLocalData **tlds;
+    Pool *pool = NULL;
+    UfoPlan *plan = NULL;
+    guint n_threads = 0;
+    guint n_workers;
+    guint n_copies;
     gboolean expand;
+    gboolean fuse;
+    gboolean tune;
 
     priv = UFO_SCHEDULER_GET_PRIVATE (scheduler);
 
-    g_object_get (scheduler, "expand", &expand, NULL);
+    g_object_get (scheduler,
+                  "expand", &expand,
+                  "fuse", &fuse,
+                  "tune", &tune,
+                  NULL);
+
+    n_workers = get_num_workers (scheduler);
 
     graph = task_graph;
     resources = ufo_base_scheduler_get_resources (scheduler, error);
@@ -627,15 +1466,26 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
         return;
 
     gpu_nodes = ufo_resources_get_gpu_nodes (resources);
+    n_copies = g_list_length (gpu_nodes);
 
     if (priv->mode == UFO_REMOTE_MODE_REPLICATE)
         replicate_task_graph (graph, resources);
 
+    /* Plans describe the graph as given, so they only fit before expansion */
+    if (tune && !priv->ran) {
+        plan = ufo_plan_new (graph);
+
+        if (ufo_plan_load (plan)) {
+            ufo_plan_apply (plan);
+            n_copies = ufo_plan_get_copies (plan, n_copies);
+        }
+    }
+
     if (expand) {
         gboolean expand_remote = priv->mode == UFO_REMOTE_MODE_STREAM;
 
         if (!priv->ran)
-            ufo_task_graph_expand (graph, resources, g_list_length (gpu_nodes), expand_remote);
+            ufo_task_graph_expand (graph, resources, n_copies, expand_remote);
         else
             g_debug ("Task graph already expanded, skipping.");
     }
@@ -643,6 +1493,10 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
     propagate_partition (graph);
     ufo_task_graph_map (graph, gpu_nodes);
 
+    /* GPU tasks can only be fused once they are mapped */
+    if (fuse)
+        ufo_task_graph_fuse (graph);
+
     /* Prepare task structures */
     tlds = setup_tasks (scheduler, graph, error);
 
@@ -654,15 +1508,32 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
     if (groups == NULL)
         return;
 
+    n_nodes = ufo_graph_get_num_nodes (UFO_GRAPH (graph));
+    setup_links (tlds, n_nodes);
+
     if (!correct_connections (graph, error))
         return;
 
-    n_nodes = ufo_graph_get_num_nodes (UFO_GRAPH (graph));
-    threads = g_new0 (GThread *, n_nodes);
+    threads = g_new0 (GThread *, n_nodes + n_workers);
+
+    if (n_workers > 0)
+        pool = pool_new (tlds, n_nodes, n_workers);
+
+    timer = g_timer_new ();
 
     /* Spawn threads */
     for (guint i = 0; i < n_nodes; i++) {
-        threads[i] = g_thread_create ((GThreadFunc) run_task, tlds[i], TRUE, error);
+        if (pool != NULL && !UFO_IS_REMOTE_TASK (tlds[i]->task))
+            continue;
+
+        threads[n_threads++] = g_thread_create ((GThreadFunc) run_task, tlds[i], TRUE, error);
+
+        if (error && (*error != NULL))
+            return;
+    }
+
+    for (guint i = 0; i < n_workers; i++) {
+        threads[n_threads++] = g_thread_create ((GThreadFunc) run_worker, &pool->workers[i], TRUE, error);
 
         if (error && (*error != NULL))
             return;
@@ -673,23 +1544,46 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
         PyGILState_STATE state = PyGILState_Ensure ();
         Py_BEGIN_ALLOW_THREADS
 
-        join_threads (threads, n_nodes);
+        join_threads (threads, n_threads);
 
         Py_END_ALLOW_THREADS
         PyGILState_Release (state);
     }
     else {
-        join_threads (threads, n_nodes);
+        join_threads (threads, n_threads);
     }
 #else
-    join_threads (threads, n_nodes);
+    join_threads (threads, n_threads);
 #endif
 
+    g_timer_stop (timer);
+
+    if (plan != NULL) {
+        /* Tasks of the pool never wait, so their profiles tell nothing */
+        if (n_workers == 0) {
+            GError *tmp_error = NULL;
+
+            ufo_plan_refine (plan, graph, expand ? n_copies : 0,
+                             g_list_length (gpu_nodes), g_timer_elapsed (timer, NULL));
+
+            if (!ufo_plan_save (plan, &tmp_error)) {
+                g_warning ("Could not save plan: %s", tmp_error->message);
+                g_error_free (tmp_error);
+            }
+        }
+
+        ufo_plan_free (plan);
+    }
+
     /* Cleanup */
+    if (pool != NULL)
+        pool_free (pool);
+
     cleanup_task_local_data (tlds, n_nodes);
     g_list_foreach (groups, (GFunc) g_object_unref, NULL);
     g_list_free (groups);
     g_list_free (gpu_nodes);
+    g_timer_destroy (timer);
     g_free (threads);
 
     priv->ran = TRUE;
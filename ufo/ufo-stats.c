@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <ufo/ufo-resources.h>
+#include "ufo-stats.h"
+#include "ufo-priv.h"
+
+/*
+ * Statistics of float data. On the host, min, max, sum and sum of squares are
+ * accumulated in a single pass. The sums are computed in double precision
+ * relative to the first element to avoid cancellation when computing the
+ * variance. On the device, each work group reduces a strided part of the data
+ * with Welford's method and partial results are combined on the host, so only
+ * a few bytes per work group are transferred.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define MAX_LOCAL_SIZE  256
+#define MAX_GROUPS      64
+
+static const gchar *kernel_source =
+    "kernel void\n"
+    "reduce_stats (global const float *input,\n"
+    "              global float4 *partial,\n"
+    "              global uint *counts,\n"
+    "              local float4 *scratch,\n"
+    "              local uint *scratch_counts,\n"
+    "              const uint n)\n"
+    "{\n"
+    "    const uint lid = get_local_id (0);\n"
+    "    float4 s = (float4) (INFINITY, -INFINITY, 0.0f, 0.0f);\n"
+    "    uint count = 0;\n"
+    "\n"
+    "    for (uint i = get_global_id (0); i < n; i += get_global_size (0)) {\n"
+    "        const float x = input[i];\n"
+    "        const float delta = x - s.z;\n"
+    "\n"
+    "        count++;\n"
+    "        s.x = fmin (s.x, x);\n"
+    "        s.y = fmax (s.y, x);\n"
+    "        s.z += delta / count;\n"
+    "        s.w += delta * (x - s.z);\n"
+    "    }\n"
+    "\n"
+    "    scratch[lid] = s;\n"
+    "    scratch_counts[lid] = count;\n"
+    "    barrier (CLK_LOCAL_MEM_FENCE);\n"
+    "\n"
+    "    for (uint offset = get_local_size (0) / 2; offset > 0; offset >>= 1) {\n"
+    "        if (lid < offset && scratch_counts[lid + offset] > 0) {\n"
+    "            const float4 a = scratch[lid];\n"
+    "            const float4 b = scratch[lid + offset];\n"
+    "            const uint na = scratch_counts[lid];\n"
+    "            const uint nab = na + scratch_counts[lid + offset];\n"
+    "            const float delta = b.z - a.z;\n"
+    "            const float fb = (float) (nab - na) / nab;\n"
+    "\n"
+    "            scratch[lid] = (float4) (fmin (a.x, b.x), fmax (a.y, b.y),\n"
+    "                                     a.z + delta * fb,\n"
+    "                                     a.w + b.w + delta * delta * na * fb);\n"
+    "            scratch_counts[lid] = nab;\n"
+    "        }\n"
+    "\n"
+    "        barrier (CLK_LOCAL_MEM_FENCE);\n"
+    "    }\n"
+    "\n"
+    "    if (lid == 0) {\n"
+    "        partial[get_group_id (0)] = scratch[0];\n"
+    "        counts[get_group_id (0)] = scratch_counts[0];\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "kernel void\n"
+    "histogram (global const float *input,\n"
+    "           global uint *bins,\n"
+    "           const uint n,\n"
+    "           const uint n_bins,\n"
+    "           const float min,\n"
+    "           const float scale)\n"
+    "{\n"
+    "    for (uint i = get_global_id (0); i < n; i += get_global_size (0)) {\n"
+    "        const float x = input[i];\n"
+    "\n"
+    "        if (!isnan (x))\n"
+    "            atomic_inc (&bins[clamp ((int) ((x - min) * scale), 0, (int) n_bins - 1)]);\n"
+    "    }\n"
+    "}\n";
+
+static void
+finish_stats (UfoBufferStats *stats,
+              gsize n,
+              gdouble shift,
+              gdouble sum,
+              gdouble sum_squares)
+{
+    gdouble mean;
+
+    mean = sum / n;
+    stats->sum = shift * n + sum;
+    stats->mean = shift + mean;
+    stats->variance = MAX (0.0, sum_squares / n - mean * mean);
+}
+
+void
+ufo_stats_compute_host (const gfloat *data,
+                        gsize n,
+                        UfoBufferStats *stats)
+{
+    gfloat min;
+    gfloat max;
+    gdouble shift;
+    gdouble sum = 0.0;
+    gdouble sum_squares = 0.0;
+    gsize i = 0;
+
+    memset (stats, 0, sizeof (UfoBufferStats));
+
+    if (n == 0)
+        return;
+
+    min = max = data[0];
+    shift = data[0];
+
+#ifdef HAVE_SSE2
+    if (n >= 4) {
+        const gsize n_vec = n & ~((gsize) 3);
+        const __m128d vshift = _mm_set1_pd (shift);
+        __m128 vmin = _mm_set1_ps (min);
+        __m128 vmax = _mm_set1_ps (max);
+        __m128d vsum_lo = _mm_setzero_pd ();
+        __m128d vsum_hi = _mm_setzero_pd ();
+        __m128d vsq_lo = _mm_setzero_pd ();
+        __m128d vsq_hi = _mm_setzero_pd ();
+        gfloat f[4];
+        gdouble d[2];
+
+        for (; i < n_vec; i += 4) {
+            const __m128 v = _mm_loadu_ps (data + i);
+            const __m128d lo = _mm_sub_pd (_mm_cvtps_pd (v), vshift);
+            const __m128d hi = _mm_sub_pd (_mm_cvtps_pd (_mm_movehl_ps (v, v)), vshift);
+
+            vmin = _mm_min_ps (vmin, v);
+            vmax = _mm_max_ps (vmax, v);
+            vsum_lo = _mm_add_pd (vsum_lo, lo);
+            vsum_hi = _mm_add_pd (vsum_hi, hi);
+            vsq_lo = _mm_add_pd (vsq_lo, _mm_mul_pd (lo, lo));
+            vsq_hi = _mm_add_pd (vsq_hi, _mm_mul_pd (hi, hi));
+        }
+
+        _mm_storeu_ps (f, vmin);
+        min = MIN (MIN (f[0], f[1]), MIN (f[2], f[3]));
+        _mm_storeu_ps (f, vmax);
+        max = MAX (MAX (f[0], f[1]), MAX (f[2], f[3]));
+        _mm_storeu_pd (d, _mm_add_pd (vsum_lo, vsum_hi));
+        sum = d[0] + d[1];
+        _mm_storeu_pd (d, _mm_add_pd (vsq_lo, vsq_hi));
+        sum_squares = d[0] + d[1];
+    }
+#endif
+
+    for (; i < n; i++) {
+        const gdouble x = data[i] - shift;
+
+        min = MIN (min, data[i]);
+        max = MAX (max, data[i]);
+        sum += x;
+        sum_squares += x * x;
+    }
+
+    stats->min = min;
+    stats->max = max;
+    finish_stats (stats, n, shift, sum, sum_squares);
+}
+
+void
+ufo_stats_histogram_host (const gfloat *data,
+                          gsize n,
+                          gfloat min,
+                          gfloat max,
+                          guint *histogram,
+                          guint n_bins)
+{
+    gfloat scale;
+
+    memset (histogram, 0, n_bins * sizeof (guint));
+    scale = max > min ? n_bins / (max - min) : 0.0f;
+
+    for (gsize i = 0; i < n; i++) {
+        gfloat bin;
+
+        if (isnan (data[i]))
+            continue;
+
+        bin = (data[i] - min) * scale;
+        histogram[bin > 0.0f ? MIN ((guint) bin, n_bins - 1) : 0]++;
+    }
+}
+
+static gsize
+get_local_size (cl_kernel kernel,
+                cl_device_id device)
+{
+    gsize max_size = 1;
+    gsize size = 1;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                         sizeof (gsize), &max_size, NULL));
+
+    /* The tree reduction requires a power of two */
+    while (size * 2 <= MIN (max_size, MAX_LOCAL_SIZE))
+        size *= 2;
+
+    return size;
+}
+
+/*
+ * Compute @stats and optionally @histogram of @n_elements floats in the
+ * cl_mem @mem using @cmd_queue. Returns %FALSE if the kernels could not be
+ * built, in which case nothing has been enqueued.
+ */
+gboolean
+ufo_stats_compute_device (gpointer cmd_queue,
+                          gpointer mem,
+                          gsize n,
+                          UfoBufferStats *stats,
+                          guint *histogram,
+                          guint n_bins)
+{
+    cl_kernel kernel;
+    cl_context context;
+    cl_device_id device;
+    cl_mem partial_mem;
+    cl_mem counts_mem;
+    cl_float4 *partial;
+    cl_uint *counts;
+    cl_uint n_elements;
+    gsize local_size;
+    gsize global_size;
+    gsize n_groups;
+    gdouble mean = 0.0;
+    gdouble m2 = 0.0;
+    gsize count = 0;
+    cl_int errcode;
+
+    memset (stats, 0, sizeof (UfoBufferStats));
+
+    if (n == 0)
+        return TRUE;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (cmd_queue, CL_QUEUE_CONTEXT, sizeof (cl_context), &context, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (cmd_queue, CL_QUEUE_DEVICE, sizeof (cl_device_id), &device, NULL));
+
+    kernel = ufo_create_context_kernel (context, kernel_source, "reduce_stats");
+
+    if (kernel == NULL)
+        return FALSE;
+
+    local_size = get_local_size (kernel, device);
+    n_groups = MIN (MAX_GROUPS, (n + local_size - 1) / local_size);
+    global_size = n_groups * local_size;
+    n_elements = (cl_uint) n;
+
+    partial_mem = clCreateBuffer (context, CL_MEM_WRITE_ONLY, n_groups * sizeof (cl_float4), NULL, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+    counts_mem = clCreateBuffer (context, CL_MEM_WRITE_ONLY, n_groups * sizeof (cl_uint), NULL, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &mem));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &partial_mem));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof (cl_mem), &counts_mem));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, local_size * sizeof (cl_float4), NULL));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, local_size * sizeof (cl_uint), NULL));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, sizeof (cl_uint), &n_elements));
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, 1, NULL,
+                                                       &global_size, &local_size, 0, NULL, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseKernel (kernel));
+
+    partial = g_new0 (cl_float4, n_groups);
+    counts = g_new0 (cl_uint, n_groups);
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (cmd_queue, counts_mem, CL_FALSE, 0, n_groups * sizeof (cl_uint),
+                                                    counts, 0, NULL, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (cmd_queue, partial_mem, CL_TRUE, 0, n_groups * sizeof (cl_float4),
+                                                    partial, 0, NULL, NULL));
+
+    stats->min = partial[0].s[0];
+    stats->max = partial[0].s[1];
+
+    /* Combine the per-group results with Chan's formula */
+    for (gsize i = 0; i < n_groups; i++) {
+        gdouble delta;
+        gsize total;
+
+        if (counts[i] == 0)
+            continue;
+
+        total = count + counts[i];
+        delta = partial[i].s[2] - mean;
+        stats->min = MIN (stats->min, partial[i].s[0]);
+        stats->max = MAX (stats->max, partial[i].s[1]);
+        mean += delta * counts[i] / total;
+        m2 += partial[i].s[3] + delta * delta * ((gdouble) count) * counts[i] / total;
+        count = total;
+    }
+
+    stats->mean = mean;
+    stats->sum = mean * n;
+    stats->variance = m2 / n;
+
+    g_free (partial);
+    g_free (counts);
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (partial_mem));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (counts_mem));
+
+    if (histogram != NULL && n_bins > 0) {
+        cl_mem bins_mem;
+        cl_float min;
+        cl_float scale;
+
+        memset (histogram, 0, n_bins * sizeof (guint));
+        bins_mem = clCreateBuffer (context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                                   n_bins * sizeof (cl_uint), histogram, &errcode);
+        UFO_RESOURCES_CHECK_CLERR (errcode);
+
+        min = stats->min;
+        scale = stats->max > stats->min ? n_bins / (stats->max - stats->min) : 0.0f;
+
+        kernel = ufo_create_context_kernel (context, kernel_source, "histogram");
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &mem));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &bins_mem));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof (cl_uint), &n_elements));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof (cl_uint), &n_bins));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, sizeof (cl_float), &min));
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, sizeof (cl_float), &scale));
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, 1, NULL,
+                                                           &global_size, NULL, 0, NULL, NULL));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseKernel (kernel));
+
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (cmd_queue, bins_mem, CL_TRUE, 0, n_bins * sizeof (cl_uint),
+                                                        histogram, 0, NULL, NULL));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (bins_mem));
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2011-2017 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef UFO_STATS_H
+#define UFO_STATS_H
+
+#include <glib.h>
+#include <ufo/ufo-buffer.h>
+
+G_BEGIN_DECLS
+
+void        ufo_stats_compute_host      (const gfloat   *data,
+                                         gsize           n_elements,
+                                         UfoBufferStats *stats);
+void        ufo_stats_histogram_host    (const gfloat   *data,
+                                         gsize           n_elements,
+                                         gfloat          min,
+                                         gfloat          max,
+                                         guint          *histogram,
+                                         guint           n_bins);
+gboolean    ufo_stats_compute_device    (gpointer        cmd_queue,
+                                         gpointer        mem,
+                                         gsize           n_elements,
+                                         UfoBufferStats *stats,
+                                         guint          *histogram,
+                                         guint           n_bins);
+
+G_END_DECLS
+
+#endif
@@ -25,7 +25,9 @@
 #include <ufo/ufo-remote-node.h>
 #include <ufo/ufo-input-task.h>
 #include <ufo/ufo-dummy-task.h>
+#include <ufo/ufo-fused-task.h>
 #include <ufo/ufo-remote-task.h>
+#include "ufo-priv.h"
 #include "compat.h"
 
 /**
@@ -48,6 +50,8 @@ struct _UfoTaskGraphPrivate {
     GList *remote_tasks;
     guint index;
     guint total;
+    guint queue_depth;
+    gchar *filename;
 };
 
 typedef enum {
@@ -72,8 +76,9 @@ static UfoTaskNode *create_node_from_json (JsonNode *json_node,UfoPluginManager
  * ChangeLog:
  * - 1.1: Add "index" and "total" keys to the root object
  * - 2.0: Add "index" and "total" keys to the root object
+ * - 2.1: Add "queue-depth" key to the root object and "depth" key to edges
  */
-static const gchar *JSON_API_VERSION = "2.0";
+static const gchar *JSON_API_VERSION = "2.1";
 
 /**
  * UfoTaskGraphError:
@@ -104,6 +109,30 @@ ufo_task_graph_new (void)
     return UFO_GRAPH (graph);
 }
 
+/*
+ * Read the queue depth stored under @key of @object into @depth. Depths that
+ * are not positive or do not fit into a guint are rejected.
+ */
+static gboolean
+get_json_depth (JsonObject *object,
+                const gchar *key,
+                guint *depth,
+                GError **error)
+{
+    gint64 value;
+
+    value = json_object_get_int_member (object, key);
+
+    if (value < 1 || value > G_MAXUINT) {
+        g_set_error (error, UFO_TASK_GRAPH_ERROR, UFO_TASK_GRAPH_ERROR_JSON_KEY,
+                     "`%s' must be a positive number, got %" G_GINT64_FORMAT, key, value);
+        return FALSE;
+    }
+
+    *depth = (guint) value;
+    return TRUE;
+}
+
 static void
 read_json (UfoTaskGraph *graph,
            UfoPluginManager *manager,
@@ -137,6 +166,11 @@ read_json (UfoTaskGraph *graph,
     graph->priv->manager = manager;
     g_object_ref (manager);
 
+    if (location == JSON_FILE) {
+        g_free (graph->priv->filename);
+        graph->priv->filename = g_strdup (data);
+    }
+
     json_root = json_parser_get_root (json_parser);
     object = json_node_get_object (json_root);
 
@@ -147,6 +181,17 @@ read_json (UfoTaskGraph *graph,
         ufo_task_graph_set_partition (graph, index, total);
     }
 
+    if (json_object_has_member (object, "queue-depth")) {
+        guint depth;
+
+        if (!get_json_depth (object, "queue-depth", &depth, error)) {
+            g_object_unref (json_parser);
+            return;
+        }
+
+        ufo_task_graph_set_queue_depth (graph, depth);
+    }
+
     add_nodes_from_json (graph, json_root, error);
     g_object_unref (json_parser);
 }
@@ -189,6 +234,17 @@ ufo_task_graph_read_from_data (UfoTaskGraph *graph,
     read_json (graph, manager, JSON_DATA, json, error);
 }
 
+/*
+ * Return the JSON file @graph was read from or %NULL if it was built in code or
+ * read from data.
+ */
+const gchar *
+ufo_task_graph_get_filename (UfoTaskGraph *graph)
+{
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (graph), NULL);
+    return graph->priv->filename;
+}
+
 static JsonNode *
 get_json_representation (UfoTaskGraph *graph,
                          GError **error)
@@ -217,9 +273,11 @@ get_json_representation (UfoTaskGraph *graph,
             JsonObject *to_object;
             JsonObject *from_object;
             JsonObject *edge_object;
+            guint depth;
 
             to = UFO_NODE (jt->data);
             port = GPOINTER_TO_INT (ufo_graph_get_edge_label (UFO_GRAPH (graph), from, to));
+            depth = ufo_task_node_get_queue_depth (UFO_TASK_NODE (to), (guint) port);
             to_object  = json_object_from_ufo_node (to);
             from_object = json_object_from_ufo_node (from);
             edge_object = json_object_new ();
@@ -227,6 +285,10 @@ get_json_representation (UfoTaskGraph *graph,
             json_object_set_int_member (to_object, "input", port);
             json_object_set_object_member (edge_object, "to", to_object);
             json_object_set_object_member (edge_object, "from", from_object);
+
+            if (depth > 0)
+                json_object_set_int_member (edge_object, "depth", depth);
+
             json_array_add_object_element (edges, edge_object);
         }
 
@@ -239,6 +301,9 @@ get_json_representation (UfoTaskGraph *graph,
     json_object_set_int_member (root_object, "index", graph->priv->index);
     json_object_set_int_member (root_object, "total", graph->priv->total);
 
+    if (graph->priv->queue_depth > 0)
+        json_object_set_int_member (root_object, "queue-depth", graph->priv->queue_depth);
+
     json_node_set_object (root_node, root_object);
     g_list_free (task_nodes);
 
@@ -511,17 +576,196 @@ ufo_task_graph_expand (UfoTaskGraph *graph,
     g_list_free (path);
 }
 
+static gboolean
+is_fusable (UfoNode *node)
+{
+    UfoTaskMode mode;
+    UfoTaskMode proc_mode;
+
+    if (UFO_IS_FUSED_TASK (node) || UFO_IS_REMOTE_TASK (node) || UFO_IS_INPUT_TASK (node))
+        return FALSE;
+
+    /* Batch tasks keep their node so that the scheduler can combine frames */
+    mode = ufo_task_get_mode (UFO_TASK (node));
+    proc_mode = mode & UFO_TASK_MODE_PROCESSOR_MASK;
+
+    /* GPU tasks can only be fused once they are mapped to a device */
+    if (proc_mode == UFO_TASK_MODE_GPU && ufo_task_node_get_proc_node (UFO_TASK_NODE (node)) == NULL)
+        return FALSE;
+
+    return (mode & UFO_TASK_MODE_TYPE_MASK) == UFO_TASK_MODE_PROCESSOR &&
+           (proc_mode == UFO_TASK_MODE_CPU || proc_mode == UFO_TASK_MODE_GPU) &&
+           !(mode & UFO_TASK_MODE_BATCH) &&
+           ufo_task_get_num_inputs (UFO_TASK (node)) == 1;
+}
+
+static gboolean
+on_same_device (UfoNode *n1,
+                UfoNode *n2)
+{
+    if (ufo_task_uses_gpu (UFO_TASK (n1)) != ufo_task_uses_gpu (UFO_TASK (n2)))
+        return FALSE;
+
+    if (!ufo_task_uses_gpu (UFO_TASK (n1)))
+        return TRUE;
+
+    /* Tasks on the same GPU share its in-order command queue */
+    return ufo_task_node_get_proc_node (UFO_TASK_NODE (n1)) ==
+           ufo_task_node_get_proc_node (UFO_TASK_NODE (n2));
+}
+
+static UfoNode *
+next_in_chain (UfoGraph *graph,
+               UfoNode *node)
+{
+    GList *successors;
+    UfoNode *next;
+
+    if (!is_fusable (node) || ufo_graph_get_num_successors (graph, node) != 1)
+        return NULL;
+
+    successors = ufo_graph_get_successors (graph, node);
+    next = UFO_NODE (successors->data);
+    g_list_free (successors);
+
+    if (!is_fusable (next) || !on_same_device (node, next) ||
+        ufo_graph_get_num_predecessors (graph, next) != 1)
+        return NULL;
+
+    return next;
+}
+
+static gboolean
+is_chain_head (UfoGraph *graph,
+               UfoNode *node)
+{
+    GList *predecessors;
+    gboolean head;
+
+    if (!is_fusable (node))
+        return FALSE;
+
+    /* A chain needs input, anything else is not a valid graph anyway */
+    if (ufo_graph_get_num_predecessors (graph, node) == 0)
+        return FALSE;
+
+    if (ufo_graph_get_num_predecessors (graph, node) > 1)
+        return TRUE;
+
+    predecessors = ufo_graph_get_predecessors (graph, node);
+    head = next_in_chain (graph, UFO_NODE (predecessors->data)) != node;
+    g_list_free (predecessors);
+
+    return head;
+}
+
+static void
+fuse_chain (UfoTaskGraph *graph,
+            GList *chain)
+{
+    UfoTaskNode *first;
+    UfoTaskNode *last;
+    UfoTaskNode *fused;
+    UfoNode *proc_node;
+    GList *predecessors;
+    GList *successors;
+    GList *it;
+    guint index;
+    guint total;
+
+    first = UFO_TASK_NODE (g_list_first (chain)->data);
+    last = UFO_TASK_NODE (g_list_last (chain)->data);
+    fused = UFO_TASK_NODE (ufo_fused_task_new (chain));
+
+    g_debug ("FUSE %s", ufo_task_node_get_identifier (fused));
+
+    proc_node = ufo_task_node_get_proc_node (first);
+
+    if (proc_node != NULL)
+        ufo_task_node_set_proc_node (fused, proc_node);
+
+    ufo_task_node_get_partition (first, &index, &total);
+    ufo_task_node_set_partition (fused, index, total);
+    ufo_task_node_set_send_pattern (fused, ufo_task_node_get_send_pattern (last));
+    ufo_task_node_set_num_expected (fused, 0, ufo_task_node_get_num_expected (first, 0));
+    ufo_task_node_set_queue_depth (fused, 0, ufo_task_node_get_queue_depth (first, 0));
+
+    predecessors = ufo_graph_get_predecessors (UFO_GRAPH (graph), UFO_NODE (first));
+    successors = ufo_graph_get_successors (UFO_GRAPH (graph), UFO_NODE (last));
+
+    g_list_for (predecessors, it) {
+        gpointer label;
+
+        label = ufo_graph_get_edge_label (UFO_GRAPH (graph), UFO_NODE (it->data), UFO_NODE (first));
+        ufo_graph_connect_nodes (UFO_GRAPH (graph), UFO_NODE (it->data), UFO_NODE (fused), label);
+    }
+
+    g_list_for (successors, it) {
+        gpointer label;
+
+        label = ufo_graph_get_edge_label (UFO_GRAPH (graph), UFO_NODE (last), UFO_NODE (it->data));
+        ufo_graph_connect_nodes (UFO_GRAPH (graph), UFO_NODE (fused), UFO_NODE (it->data), label);
+    }
+
+    g_list_for (chain, it) {
+        ufo_graph_remove_node (UFO_GRAPH (graph), UFO_NODE (it->data));
+    }
+
+    g_list_free (predecessors);
+    g_list_free (successors);
+    g_object_unref (fused);
+}
+
 /**
  * ufo_task_graph_fuse:
  * @graph: A #UfoTaskGraph
  *
- * Fuses task nodes to increase data locality.
- *
- * Note: This is not implemented and a no-op right now.
+ * Fuses task nodes to increase data locality. Each maximal chain of
+ * processors with a single input is replaced by a #UfoFusedTask that runs the
+ * chain in one thread without handing buffers through queues. Tasks that
+ * branch or merge end a chain, and so does a change from CPU to GPU or from
+ * one GPU to another. GPU tasks are only fused after ufo_task_graph_map().
  */
 void
 ufo_task_graph_fuse (UfoTaskGraph *graph)
 {
+    GList *nodes;
+    GList *chains = NULL;
+    GList *it;
+
+    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    /* Find all chains first, fusing removes nodes from the graph */
+    g_list_for (nodes, it) {
+        GList *chain;
+        UfoNode *next;
+
+        if (!is_chain_head (UFO_GRAPH (graph), UFO_NODE (it->data)))
+            continue;
+
+        chain = g_list_append (NULL, it->data);
+        next = next_in_chain (UFO_GRAPH (graph), UFO_NODE (it->data));
+
+        while (next != NULL) {
+            chain = g_list_append (chain, next);
+            next = next_in_chain (UFO_GRAPH (graph), next);
+        }
+
+        if (g_list_length (chain) > 1)
+            chains = g_list_append (chains, chain);
+        else
+            g_list_free (chain);
+    }
+
+    g_list_for (chains, it) {
+        fuse_chain (graph, (GList *) it->data);
+        g_list_free ((GList *) it->data);
+    }
+
+    g_list_free (chains);
+    g_list_free (nodes);
 }
 
 static void
@@ -716,6 +960,91 @@ ufo_task_graph_get_partition (UfoTaskGraph *graph,
     *total = graph->priv->total;
 }
 
+/**
+ * ufo_task_graph_set_queue_depth:
+ * @graph: A #UfoTaskGraph
+ * @depth: Number of buffers in flight per edge or 0 to let the scheduler decide
+ *
+ * Set the default number of buffers a task may produce ahead of its successors
+ * before it blocks. Deeper queues keep long GPU pipelines busy, shallower ones
+ * bound the memory used by large data sets. Individual edges can override the
+ * default with ufo_task_graph_set_edge_queue_depth().
+ */
+void
+ufo_task_graph_set_queue_depth (UfoTaskGraph *graph,
+                                guint depth)
+{
+    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
+    graph->priv->queue_depth = depth;
+}
+
+/**
+ * ufo_task_graph_get_queue_depth:
+ * @graph: A #UfoTaskGraph
+ *
+ * Get the default queue depth of @graph.
+ *
+ * Returns: The default number of buffers in flight per edge or 0 if the
+ * scheduler decides.
+ */
+guint
+ufo_task_graph_get_queue_depth (UfoTaskGraph *graph)
+{
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (graph), 0);
+    return graph->priv->queue_depth;
+}
+
+/**
+ * ufo_task_graph_set_edge_queue_depth:
+ * @graph: A #UfoTaskGraph
+ * @n1: A source node
+ * @n2: A destination node connected to @n1
+ * @depth: Number of buffers in flight or 0 to use the default of @graph
+ *
+ * Set the queue depth of the edge from @n1 to @n2.
+ */
+void
+ufo_task_graph_set_edge_queue_depth (UfoTaskGraph *graph,
+                                     UfoTaskNode *n1,
+                                     UfoTaskNode *n2,
+                                     guint depth)
+{
+    gpointer label;
+
+    g_return_if_fail (UFO_IS_TASK_GRAPH (graph));
+    g_return_if_fail (ufo_graph_is_connected (UFO_GRAPH (graph), UFO_NODE (n1), UFO_NODE (n2)));
+
+    label = ufo_graph_get_edge_label (UFO_GRAPH (graph), UFO_NODE (n1), UFO_NODE (n2));
+    ufo_task_node_set_queue_depth (n2, (guint) GPOINTER_TO_INT (label), depth);
+}
+
+/**
+ * ufo_task_graph_get_edge_queue_depth:
+ * @graph: A #UfoTaskGraph
+ * @n1: A source node
+ * @n2: A destination node connected to @n1
+ *
+ * Get the queue depth of the edge from @n1 to @n2, falling back to the default
+ * of @graph if the edge does not specify one.
+ *
+ * Returns: The number of buffers in flight or 0 if the scheduler decides.
+ */
+guint
+ufo_task_graph_get_edge_queue_depth (UfoTaskGraph *graph,
+                                     UfoTaskNode *n1,
+                                     UfoTaskNode *n2)
+{
+    gpointer label;
+    guint depth;
+
+    g_return_val_if_fail (UFO_IS_TASK_GRAPH (graph), 0);
+
+    label = ufo_graph_get_edge_label (UFO_GRAPH (graph), UFO_NODE (n1), UFO_NODE (n2));
+    depth = ufo_task_node_get_queue_depth (n2, (guint) GPOINTER_TO_INT (label));
+
+    return depth > 0 ? depth : graph->priv->queue_depth;
+}
+
 static void
 add_nodes_from_json (UfoTaskGraph *self,
                      JsonNode *root,
@@ -757,6 +1086,17 @@ add_nodes_from_json (UfoTaskGraph *self,
          */
         if (json_object_has_member (root_object, "edges")) {
             JsonArray *edges = json_object_get_array_member (root_object, "edges");
+
+            /* Check depths up front, connecting edges cannot report errors */
+            for (guint i = 0; i < json_array_get_length (edges); i++) {
+                JsonObject *edge = json_array_get_object_element (edges, i);
+                guint depth;
+
+                if (json_object_has_member (edge, "depth") &&
+                    !get_json_depth (edge, "depth", &depth, error))
+                    return;
+            }
+
             json_array_foreach_element (edges, handle_json_task_edge, self);
         }
     }
@@ -888,6 +1228,9 @@ create_node_from_json (JsonNode *json_node,
     task_name = json_object_get_string_member (json_object, "name");
     ufo_task_node_set_identifier (ret_node, task_name);
 
+    if (json_object_has_member (json_object, "numa-node"))
+        ufo_task_node_set_numa_node (ret_node, (gint) json_object_get_int_member (json_object, "numa-node"));
+
     if (json_object_has_member (json_object, "properties")) {
         JsonObject *prop_object;
         JsonSetPropertyInfo info = { .task = ret_node, .manager = manager, .error = error };
@@ -959,6 +1302,9 @@ handle_json_task_edge (JsonArray *array,
 
     ufo_task_graph_connect_nodes_full (graph, from_node, to_node, to_port);
 
+    if (json_object_has_member (edge, "depth"))
+        ufo_task_node_set_queue_depth (to_node, to_port, (guint) json_object_get_int_member (edge, "depth"));
+
     if (error != NULL)
         g_warning ("%s", error->message);
 }
@@ -993,6 +1339,9 @@ create_full_json_from_task_node (UfoTaskNode *task_node)
     g_assert (name != NULL);
     json_object_set_string_member (node_object, "name", name);
 
+    if (ufo_task_node_get_numa_node (task_node) >= 0)
+        json_object_set_int_member (node_object, "numa-node", ufo_task_node_get_numa_node (task_node));
+
     prop_node = json_gobject_serialize (G_OBJECT (task_node));
 
     /* Remove num-processed which is a read-only property */
@@ -1080,6 +1429,7 @@ ufo_task_graph_finalize (GObject *object)
     priv = UFO_TASK_GRAPH_GET_PRIVATE (object);
 
     g_hash_table_destroy (priv->json_nodes);
+    g_free (priv->filename);
 
     G_OBJECT_CLASS (ufo_task_graph_parent_class)->finalize (object);
 }
@@ -1107,4 +1457,6 @@ ufo_task_graph_init (UfoTaskGraph *self)
     priv->json_nodes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     priv->index = 0;
     priv->total = 1;
+    priv->queue_depth = 0;
+    priv->filename = NULL;
 }
@@ -108,6 +108,18 @@ void         ufo_task_graph_set_partition       (UfoTaskGraph       *graph,
 void         ufo_task_graph_get_partition       (UfoTaskGraph       *graph,
                                                  guint              *index,
                                                  guint              *total);
+void         ufo_task_graph_set_queue_depth     (UfoTaskGraph       *graph,
+                                                 guint               depth);
+guint        ufo_task_graph_get_queue_depth     (UfoTaskGraph       *graph);
+void         ufo_task_graph_set_edge_queue_depth
+                                                (UfoTaskGraph       *graph,
+                                                 UfoTaskNode        *n1,
+                                                 UfoTaskNode        *n2,
+                                                 guint               depth);
+guint        ufo_task_graph_get_edge_queue_depth
+                                                (UfoTaskGraph       *graph,
+                                                 UfoTaskNode        *n1,
+                                                 UfoTaskNode        *n2);
 GType        ufo_task_graph_get_type            (void);
 GQuark       ufo_task_graph_error_quark         (void);
 
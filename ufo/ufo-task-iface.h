@@ -56,6 +56,13 @@ typedef enum {
  * @UFO_TASK_MODE_GPU: runs on GPU
  * @UFO_TASK_MODE_CPU: runs on CPU
  * @UFO_TASK_MODE_SHARE_DATA: sibling tasks share the same input data
+ * @UFO_TASK_MODE_BATCH: the task processes all frames of a batched buffer (see
+ *  ufo_buffer_get_n_frames()) in one call. The scheduler may combine several
+ *  inputs into one batch for such tasks
+ * @UFO_TASK_MODE_READ_ONLY_INPUT: the task never modifies its inputs.
+ *  Broadcasting groups hand the same buffer to all such targets instead of a
+ *  copy, which they process concurrently. Such tasks must get their inputs
+ *  with ufo_buffer_begin_read()
  * @UFO_TASK_MODE_TYPE_MASK: mask to get type from UfoTaskMode
  * @UFO_TASK_MODE_PROCESSOR_MASK: mask to get processor from UfoTaskMode
  *
@@ -70,6 +77,8 @@ typedef enum {
     UFO_TASK_MODE_CPU           = 1 << 4,
     UFO_TASK_MODE_GPU           = 1 << 5,
     UFO_TASK_MODE_SHARE_DATA    = 1 << 6,
+    UFO_TASK_MODE_BATCH         = 1 << 7,
+    UFO_TASK_MODE_READ_ONLY_INPUT = 1 << 8,
 
     UFO_TASK_MODE_TYPE_MASK     = UFO_TASK_MODE_PROCESSOR | UFO_TASK_MODE_GENERATOR | UFO_TASK_MODE_REDUCTOR  | UFO_TASK_MODE_SINK,
 
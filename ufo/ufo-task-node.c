@@ -49,6 +49,8 @@ struct _UfoTaskNodePrivate {
     GList           *in_groups[16];
     GList           *current[16];
     gint             n_expected[16];
+    guint            queue_depth[16];
+    gint             numa_node;
     guint            index;
     guint            total;
     guint            num_processed;
@@ -143,6 +145,67 @@ ufo_task_node_get_num_expected (UfoTaskNode *node,
     return node->priv->n_expected[pos];
 }
 
+/**
+ * ufo_task_node_set_queue_depth:
+ * @node: A #UfoTaskNode
+ * @pos: Input port of @node
+ * @depth: Number of buffers in flight on the edge to @pos or 0 to use the
+ *  default of the task graph
+ *
+ * Set how many buffers the predecessor connected to @pos may produce ahead of
+ * @node before it blocks.
+ */
+void
+ufo_task_node_set_queue_depth (UfoTaskNode *node,
+                               guint pos,
+                               guint depth)
+{
+    g_return_if_fail (UFO_IS_TASK_NODE (node));
+    g_return_if_fail (pos < 16);
+    node->priv->queue_depth[pos] = depth;
+}
+
+guint
+ufo_task_node_get_queue_depth (UfoTaskNode *node,
+                               guint pos)
+{
+    g_return_val_if_fail (UFO_IS_TASK_NODE (node), 0);
+    g_return_val_if_fail (pos < 16, 0);
+    return node->priv->queue_depth[pos];
+}
+
+/**
+ * ufo_task_node_set_numa_node:
+ * @node: A #UfoTaskNode
+ * @numa_node: NUMA node whose CPUs should run @node or -1 to let the scheduler
+ *  decide
+ *
+ * Override the NUMA node the scheduler pins the thread of @node to. By default,
+ * it is the node closest to the processing node of the task.
+ */
+void
+ufo_task_node_set_numa_node (UfoTaskNode *node,
+                             gint numa_node)
+{
+    g_return_if_fail (UFO_IS_TASK_NODE (node));
+    node->priv->numa_node = numa_node;
+}
+
+/**
+ * ufo_task_node_get_numa_node:
+ * @node: A #UfoTaskNode
+ *
+ * Get the NUMA node set with ufo_task_node_set_numa_node().
+ *
+ * Returns: The NUMA node or -1 if the scheduler decides.
+ */
+gint
+ufo_task_node_get_numa_node (UfoTaskNode *node)
+{
+    g_return_val_if_fail (UFO_IS_TASK_NODE (node), -1);
+    return node->priv->numa_node;
+}
+
 void
 ufo_task_node_set_out_group (UfoTaskNode *node,
                              UfoGroup *group)
@@ -231,8 +294,28 @@ ufo_task_node_switch_in_group (UfoTaskNode *node,
     priv = node->priv;
     priv->current[pos] = g_list_next (priv->current[pos]);
 
+    /* in_groups always points to the head, no need to walk back */
     if (priv->current[pos] == NULL)
-        priv->current[pos] = g_list_first (priv->in_groups[pos]);
+        priv->current[pos] = priv->in_groups[pos];
+}
+
+/**
+ * ufo_task_node_get_in_groups:
+ * @node: A #UfoTaskNode
+ * @pos: Input port
+ *
+ * Get all groups feeding input @pos. There is more than one group if several
+ * branches of the graph are merged at this input.
+ *
+ * Return value: (transfer none) (element-type UfoGroup): List of #UfoGroup.
+ */
+GList *
+ufo_task_node_get_in_groups (UfoTaskNode *node,
+                             guint pos)
+{
+    g_return_val_if_fail (UFO_IS_TASK_NODE (node), NULL);
+    g_assert (pos < 16);
+    return node->priv->in_groups[pos];
 }
 
 void
@@ -325,9 +408,12 @@ ufo_task_node_copy (UfoNode *node,
     orig = UFO_TASK_NODE (node);
 
     copy->priv->pattern = orig->priv->pattern;
+    copy->priv->numa_node = orig->priv->numa_node;
 
-    for (guint i = 0; i < 16; i++)
+    for (guint i = 0; i < 16; i++) {
         copy->priv->n_expected[i] = orig->priv->n_expected[i];
+        copy->priv->queue_depth[i] = orig->priv->queue_depth[i];
+    }
 
     ufo_task_node_set_plugin_name (copy, orig->priv->plugin);
 
@@ -425,6 +511,7 @@ ufo_task_node_init (UfoTaskNode *self)
     self->priv->pattern = UFO_SEND_SCATTER;
     self->priv->proc_node = NULL;
     self->priv->out_group = NULL;
+    self->priv->numa_node = -1;
     self->priv->index = 0;
     self->priv->total = 1;
     self->priv->num_processed = 0;
@@ -434,5 +521,6 @@ ufo_task_node_init (UfoTaskNode *self)
         self->priv->in_groups[i] = NULL;
         self->priv->current[i] = NULL;
         self->priv->n_expected[i] = -1;
+        self->priv->queue_depth[i] = 0;
     }
 }
@@ -85,6 +85,14 @@ void            ufo_task_node_set_num_expected      (UfoTaskNode    *node,
                                                      gint            n_expected);
 gint            ufo_task_node_get_num_expected      (UfoTaskNode    *node,
                                                      guint           pos);
+void            ufo_task_node_set_queue_depth       (UfoTaskNode    *node,
+                                                     guint           pos,
+                                                     guint           depth);
+guint           ufo_task_node_get_queue_depth       (UfoTaskNode    *node,
+                                                     guint           pos);
+void            ufo_task_node_set_numa_node         (UfoTaskNode    *node,
+                                                     gint            numa_node);
+gint            ufo_task_node_get_numa_node         (UfoTaskNode    *node);
 void            ufo_task_node_set_out_group         (UfoTaskNode    *node,
                                                      UfoGroup       *group);
 UfoGroup       *ufo_task_node_get_out_group         (UfoTaskNode    *node);
@@ -95,6 +103,8 @@ UfoGroup       *ufo_task_node_get_current_in_group  (UfoTaskNode    *node,
                                                      guint           pos);
 void            ufo_task_node_switch_in_group       (UfoTaskNode    *node,
                                                      guint           pos);
+GList          *ufo_task_node_get_in_groups         (UfoTaskNode    *node,
+                                                     guint           pos);
 void            ufo_task_node_set_proc_node         (UfoTaskNode    *task_node,
                                                      UfoNode        *proc_node);
 UfoNode        *ufo_task_node_get_proc_node         (UfoTaskNode    *node);
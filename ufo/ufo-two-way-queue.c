@@ -17,17 +17,392 @@
  * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
+
 #include <ufo/ufo-two-way-queue.h>
 #include "compat.h"
 
+/*
+ * Besides the GAsyncQueue backend, a two-way queue can be backed by two bounded
+ * lock-free rings. Each slot carries a sequence number that tells producers and
+ * consumers of a ring whether the slot is free or filled, so pushing and
+ * popping only needs a compare-and-swap on the respective position. Because
+ * the number of items circulating in a two-way queue never exceeds its
+ * capacity, a ring can never overflow as long as it has at least as many slots
+ * as items were inserted. Rings are therefore grown to the capacity that is
+ * reserved before the queue is used. Queues that would need more than
+ * RING_MAX_SIZE slots fall back to GAsyncQueue.
+ *
+ * Waiting for an empty ring first spins, then yields and only then parks the
+ * thread on a condition variable. The number of spins adapts to how often
+ * spinning was successful before. Pushers only touch the mutex if somebody is
+ * actually parked.
+ */
+
+#define RING_DEFAULT_SIZE   256
+#define RING_MAX_SIZE       (1 << 16)
+#define RING_MIN_SPINS      16
+#define RING_MAX_SPINS      4096
+#define RING_YIELDS         8
+#define CACHE_LINE_SIZE     64
+
+typedef struct {
+    gint sequence;
+    gpointer data;
+} Slot;
+
+typedef struct {
+    gint enqueue_pos;
+    gchar pad0[CACHE_LINE_SIZE - sizeof (gint)];
+    gint dequeue_pos;
+    gchar pad1[CACHE_LINE_SIZE - sizeof (gint)];
+    gint n_waiters;
+    gint n_spins;
+    gint max_spins;
+    guint mask;
+    Slot *slots;
+    GMutex *lock;
+    GCond *cond;
+} Ring;
 
 struct _UfoTwoWayQueue {
     GAsyncQueue *producer_queue;
     GAsyncQueue *consumer_queue;
+    Ring *producer_ring;
+    Ring *consumer_ring;
     GList *inserted;
     guint capacity;
 };
 
+static Ring *
+ring_new (guint n_slots)
+{
+    Ring *ring;
+
+    ring = g_new0 (Ring, 1);
+    ring->mask = n_slots - 1;
+    ring->max_spins = RING_MAX_SPINS;
+
+#if GLIB_CHECK_VERSION (2, 36, 0)
+    /* Spinning cannot succeed if the other side cannot run at the same time */
+    if (g_get_num_processors () == 1)
+        ring->max_spins = 0;
+#endif
+
+    ring->n_spins = MIN (RING_MIN_SPINS, ring->max_spins);
+    ring->slots = g_new0 (Slot, n_slots);
+    ring->lock = g_mutex_new ();
+    ring->cond = g_cond_new ();
+
+    for (guint i = 0; i < n_slots; i++)
+        ring->slots[i].sequence = (gint) i;
+
+    return ring;
+}
+
+static void
+ring_free (Ring *ring)
+{
+    g_mutex_free (ring->lock);
+    g_cond_free (ring->cond);
+    g_free (ring->slots);
+    g_free (ring);
+}
+
+/*
+ * Claim up to @n consecutive free slots with a single compare-and-swap and
+ * fill them with @items. Returns the number of items pushed.
+ */
+static guint
+ring_try_push_many (Ring *ring, gpointer *items, guint n)
+{
+    guint pos;
+    guint n_free;
+
+    pos = (guint) g_atomic_int_get (&ring->enqueue_pos);
+
+    for (;;) {
+        gint diff;
+
+        diff = (gint) ((guint) g_atomic_int_get (&ring->slots[pos & ring->mask].sequence) - pos);
+
+        if (diff == 0) {
+            n_free = 1;
+
+            while (n_free < n &&
+                   (guint) g_atomic_int_get (&ring->slots[(pos + n_free) & ring->mask].sequence) == pos + n_free)
+                n_free++;
+
+            if (g_atomic_int_compare_and_exchange (&ring->enqueue_pos, (gint) pos, (gint) (pos + n_free)))
+                break;
+        }
+        else if (diff < 0) {
+            return 0;
+        }
+
+        pos = (guint) g_atomic_int_get (&ring->enqueue_pos);
+    }
+
+    for (guint i = 0; i < n_free; i++) {
+        Slot *slot = &ring->slots[(pos + i) & ring->mask];
+
+        slot->data = items[i];
+        g_atomic_int_set (&slot->sequence, (gint) (pos + i + 1));
+    }
+
+    return n_free;
+}
+
+/*
+ * Claim up to @max consecutive filled slots with a single compare-and-swap and
+ * move their data to @items. Returns the number of items popped.
+ */
+static guint
+ring_try_pop_many (Ring *ring, gpointer *items, guint max)
+{
+    guint pos;
+    guint n_filled;
+
+    pos = (guint) g_atomic_int_get (&ring->dequeue_pos);
+
+    for (;;) {
+        gint diff;
+
+        diff = (gint) ((guint) g_atomic_int_get (&ring->slots[pos & ring->mask].sequence) - (pos + 1));
+
+        if (diff == 0) {
+            n_filled = 1;
+
+            while (n_filled < max &&
+                   (guint) g_atomic_int_get (&ring->slots[(pos + n_filled) & ring->mask].sequence) == pos + n_filled + 1)
+                n_filled++;
+
+            if (g_atomic_int_compare_and_exchange (&ring->dequeue_pos, (gint) pos, (gint) (pos + n_filled)))
+                break;
+        }
+        else if (diff < 0) {
+            return 0;
+        }
+
+        pos = (guint) g_atomic_int_get (&ring->dequeue_pos);
+    }
+
+    for (guint i = 0; i < n_filled; i++) {
+        Slot *slot = &ring->slots[(pos + i) & ring->mask];
+
+        items[i] = slot->data;
+        g_atomic_int_set (&slot->sequence, (gint) (pos + i + ring->mask + 1));
+    }
+
+    return n_filled;
+}
+
+/*
+ * Move all items of @ring to a new ring with @n_slots slots and free @ring.
+ * Nobody else may use @ring meanwhile.
+ */
+static Ring *
+ring_grow (Ring *ring, guint n_slots)
+{
+    Ring *grown;
+    gpointer data;
+
+    grown = ring_new (n_slots);
+
+    while (ring_try_pop_many (ring, &data, 1) == 1)
+        ring_try_push_many (grown, &data, 1);
+
+    ring_free (ring);
+    return grown;
+}
+
+static void
+ring_push_many (Ring *ring, gpointer *items, guint n)
+{
+    guint n_pushed = 0;
+
+    /*
+     * The ring is sized for the capacity of the queue, so it is only full for
+     * the short moment in which a popper has claimed but not yet released a
+     * slot.
+     */
+    while (n_pushed < n) {
+        guint pushed;
+
+        pushed = ring_try_push_many (ring, items + n_pushed, n - n_pushed);
+
+        if (pushed == 0)
+            g_thread_yield ();
+
+        n_pushed += pushed;
+    }
+
+    if (g_atomic_int_get (&ring->n_waiters) > 0) {
+        g_mutex_lock (ring->lock);
+
+        if (n > 1)
+            g_cond_broadcast (ring->cond);
+        else
+            g_cond_signal (ring->cond);
+
+        g_mutex_unlock (ring->lock);
+    }
+}
+
+static void
+ring_push (Ring *ring, gpointer data)
+{
+    ring_push_many (ring, &data, 1);
+}
+
+/*
+ * Wait until at least one item is available and pop up to @max items.
+ */
+static guint
+ring_pop_many (Ring *ring, gpointer *items, guint max)
+{
+    guint n_popped;
+    gint n_spins;
+
+    n_spins = g_atomic_int_get (&ring->n_spins);
+
+    for (gint i = 0; i < n_spins; i++) {
+        n_popped = ring_try_pop_many (ring, items, max);
+
+        if (n_popped > 0) {
+            if (i > 0 && n_spins < ring->max_spins)
+                g_atomic_int_set (&ring->n_spins, MIN (ring->max_spins, n_spins * 2));
+
+            return n_popped;
+        }
+    }
+
+    /* Spinning was not worth it, so try less next time */
+    if (n_spins > RING_MIN_SPINS)
+        g_atomic_int_set (&ring->n_spins, MAX (RING_MIN_SPINS, n_spins / 2));
+
+    for (guint i = 0; i < RING_YIELDS; i++) {
+        g_thread_yield ();
+        n_popped = ring_try_pop_many (ring, items, max);
+
+        if (n_popped > 0)
+            return n_popped;
+    }
+
+    g_mutex_lock (ring->lock);
+    g_atomic_int_inc (&ring->n_waiters);
+
+    while ((n_popped = ring_try_pop_many (ring, items, max)) == 0)
+        g_cond_wait (ring->cond, ring->lock);
+
+    g_atomic_int_add (&ring->n_waiters, -1);
+    g_mutex_unlock (ring->lock);
+
+    return n_popped;
+}
+
+static gboolean
+ring_is_empty (Ring *ring)
+{
+    guint pos;
+
+    pos = (guint) g_atomic_int_get (&ring->dequeue_pos);
+    return (guint) g_atomic_int_get (&ring->slots[pos & ring->mask].sequence) != pos + 1;
+}
+
+static gpointer
+ring_pop (Ring *ring)
+{
+    gpointer data;
+
+    ring_pop_many (ring, &data, 1);
+    return data;
+}
+
+/*
+ * Wait for the first item and take everything else that is available up to
+ * @max, all under the lock of @queue.
+ */
+static guint
+async_queue_pop_many (GAsyncQueue *queue, gpointer *items, guint max)
+{
+    guint n_popped = 1;
+
+    g_async_queue_lock (queue);
+    items[0] = g_async_queue_pop_unlocked (queue);
+
+    while (n_popped < max) {
+        gpointer data = g_async_queue_try_pop_unlocked (queue);
+
+        if (data == NULL)
+            break;
+
+        items[n_popped++] = data;
+    }
+
+    g_async_queue_unlock (queue);
+    return n_popped;
+}
+
+static void
+async_queue_push_many (GAsyncQueue *queue, gpointer *items, guint n)
+{
+    g_async_queue_lock (queue);
+
+    for (guint i = 0; i < n; i++)
+        g_async_queue_push_unlocked (queue, items[i]);
+
+    g_async_queue_unlock (queue);
+}
+
+static guint
+get_ring_size (void)
+{
+    const gchar *var;
+    guint n_slots = 0;
+
+#ifdef WITH_LOCKFREE_QUEUE
+    n_slots = RING_DEFAULT_SIZE;
+#endif
+
+    var = g_getenv ("UFO_TWO_WAY_QUEUE");
+
+    if (var != NULL) {
+        if (!g_strcmp0 (var, "async"))
+            n_slots = 0;
+        else if (!g_strcmp0 (var, "ring"))
+            n_slots = RING_DEFAULT_SIZE;
+        else
+            g_warning ("Unknown two-way queue backend `%s'", var);
+    }
+
+    if (n_slots == 0)
+        return 0;
+
+    var = g_getenv ("UFO_TWO_WAY_QUEUE_SIZE");
+
+    if (var != NULL)
+        n_slots = MAX (2, (guint) g_ascii_strtoull (var, NULL, 10));
+
+    /* Round up to a power of two so that positions wrap consistently */
+    return 1 << g_bit_storage (n_slots - 1);
+}
+
+static GAsyncQueue *
+ring_to_async_queue (Ring *ring)
+{
+    GAsyncQueue *queue;
+    gpointer data;
+
+    queue = g_async_queue_new ();
+
+    while (ring_try_pop_many (ring, &data, 1) == 1)
+        g_async_queue_push (queue, data);
+
+    ring_free (ring);
+    return queue;
+}
+
 /**
  * ufo_two_way_queue_new: (skip)
  * @init: (element-type gpointer): List with elements inserted into
@@ -36,16 +411,32 @@ struct _UfoTwoWayQueue {
  * Create a new two-way queue and optionally initialize the consumer queue with
  * elements from @init.
  *
+ * The queue is backed by lock-free rings if the library was built with
+ * lock-free queues or if the environment variable UFO_TWO_WAY_QUEUE is set to
+ * "ring". Setting it to "async" selects #GAsyncQueue. The initial number of
+ * ring slots can be set with UFO_TWO_WAY_QUEUE_SIZE. The rings grow with the
+ * capacity of the queue, see ufo_two_way_queue_reserve().
+ *
  * Returns: A new #UfoTwoWayQueue.
  */
 UfoTwoWayQueue *
 ufo_two_way_queue_new (GList *init)
 {
     GList *it;
+    guint n_slots;
     UfoTwoWayQueue *queue = g_new0 (UfoTwoWayQueue, 1);
 
-    queue->producer_queue = g_async_queue_new ();
-    queue->consumer_queue = g_async_queue_new ();
+    n_slots = get_ring_size ();
+
+    if (n_slots > 0) {
+        queue->producer_ring = ring_new (n_slots);
+        queue->consumer_ring = ring_new (n_slots);
+    }
+    else {
+        queue->producer_queue = g_async_queue_new ();
+        queue->consumer_queue = g_async_queue_new ();
+    }
+
     queue->inserted = NULL;
     queue->capacity = 0;
 
@@ -59,8 +450,15 @@ ufo_two_way_queue_new (GList *init)
 void
 ufo_two_way_queue_free (UfoTwoWayQueue *queue)
 {
-    g_async_queue_unref (queue->producer_queue);
-    g_async_queue_unref (queue->consumer_queue);
+    if (queue->producer_ring != NULL) {
+        ring_free (queue->producer_ring);
+        ring_free (queue->consumer_ring);
+    }
+    else {
+        g_async_queue_unref (queue->producer_queue);
+        g_async_queue_unref (queue->consumer_queue);
+    }
+
     g_list_free (queue->inserted);
     g_free (queue);
 }
@@ -76,13 +474,19 @@ ufo_two_way_queue_free (UfoTwoWayQueue *queue)
 gpointer
 ufo_two_way_queue_consumer_pop (UfoTwoWayQueue *queue)
 {
+    if (queue->consumer_ring != NULL)
+        return ring_pop (queue->consumer_ring);
+
     return g_async_queue_pop (queue->consumer_queue);
 }
 
 void
 ufo_two_way_queue_consumer_push (UfoTwoWayQueue *queue, gpointer data)
 {
-    g_async_queue_push (queue->producer_queue, data);
+    if (queue->producer_ring != NULL)
+        ring_push (queue->producer_ring, data);
+    else
+        g_async_queue_push (queue->producer_queue, data);
 }
 
 /**
@@ -96,13 +500,141 @@ ufo_two_way_queue_consumer_push (UfoTwoWayQueue *queue, gpointer data)
 gpointer
 ufo_two_way_queue_producer_pop (UfoTwoWayQueue *queue)
 {
+    if (queue->producer_ring != NULL)
+        return ring_pop (queue->producer_ring);
+
     return g_async_queue_pop (queue->producer_queue);
 }
 
 void
 ufo_two_way_queue_producer_push (UfoTwoWayQueue *queue, gpointer data)
 {
-    g_async_queue_push (queue->consumer_queue, data);
+    if (queue->consumer_ring != NULL)
+        ring_push (queue->consumer_ring, data);
+    else
+        g_async_queue_push (queue->consumer_queue, data);
+}
+
+/**
+ * ufo_two_way_queue_consumer_pop_many: (skip)
+ * @queue: A #UfoTwoWayQueue
+ * @items: Array with room for @max items
+ * @max: Maximum number of items to fetch
+ *
+ * Wait for at least one item for consumption and fetch up to @max items that
+ * are available at once. Compared to calling
+ * ufo_two_way_queue_consumer_pop() repeatedly, this takes the lock or claims
+ * the ring slots only once.
+ *
+ * Returns: Number of items stored in @items.
+ */
+guint
+ufo_two_way_queue_consumer_pop_many (UfoTwoWayQueue *queue, gpointer *items, guint max)
+{
+    g_return_val_if_fail (max > 0, 0);
+
+    if (queue->consumer_ring != NULL)
+        return ring_pop_many (queue->consumer_ring, items, max);
+
+    return async_queue_pop_many (queue->consumer_queue, items, max);
+}
+
+/**
+ * ufo_two_way_queue_consumer_push_many: (skip)
+ * @queue: A #UfoTwoWayQueue
+ * @items: Array of consumed items
+ * @n: Number of items
+ *
+ * Give back @n consumed items at once.
+ */
+void
+ufo_two_way_queue_consumer_push_many (UfoTwoWayQueue *queue, gpointer *items, guint n)
+{
+    if (n == 0)
+        return;
+
+    if (queue->producer_ring != NULL)
+        ring_push_many (queue->producer_ring, items, n);
+    else
+        async_queue_push_many (queue->producer_queue, items, n);
+}
+
+/**
+ * ufo_two_way_queue_producer_pop_many: (skip)
+ * @queue: A #UfoTwoWayQueue
+ * @items: Array with room for @max items
+ * @max: Maximum number of items to fetch
+ *
+ * Wait for at least one item for production and fetch up to @max items that
+ * are available at once.
+ *
+ * Returns: Number of items stored in @items.
+ */
+guint
+ufo_two_way_queue_producer_pop_many (UfoTwoWayQueue *queue, gpointer *items, guint max)
+{
+    g_return_val_if_fail (max > 0, 0);
+
+    if (queue->producer_ring != NULL)
+        return ring_pop_many (queue->producer_ring, items, max);
+
+    return async_queue_pop_many (queue->producer_queue, items, max);
+}
+
+/**
+ * ufo_two_way_queue_producer_push_many: (skip)
+ * @queue: A #UfoTwoWayQueue
+ * @items: Array of produced items
+ * @n: Number of items
+ *
+ * Hand @n produced items to the consumer at once.
+ */
+void
+ufo_two_way_queue_producer_push_many (UfoTwoWayQueue *queue, gpointer *items, guint n)
+{
+    if (n == 0)
+        return;
+
+    if (queue->consumer_ring != NULL)
+        ring_push_many (queue->consumer_ring, items, n);
+    else
+        async_queue_push_many (queue->consumer_queue, items, n);
+}
+
+/**
+ * ufo_two_way_queue_consumer_can_pop: (skip)
+ * @queue: A #UfoTwoWayQueue
+ *
+ * Check if an item for consumption is available. If there is only one
+ * consumer, ufo_two_way_queue_consumer_pop() does not block afterwards.
+ *
+ * Returns: %TRUE if an item can be consumed.
+ */
+gboolean
+ufo_two_way_queue_consumer_can_pop (UfoTwoWayQueue *queue)
+{
+    if (queue->consumer_ring != NULL)
+        return !ring_is_empty (queue->consumer_ring);
+
+    return g_async_queue_length (queue->consumer_queue) > 0;
+}
+
+/**
+ * ufo_two_way_queue_producer_can_pop: (skip)
+ * @queue: A #UfoTwoWayQueue
+ *
+ * Check if an item for production is available. If there is only one
+ * producer, ufo_two_way_queue_producer_pop() does not block afterwards.
+ *
+ * Returns: %TRUE if an item can be produced.
+ */
+gboolean
+ufo_two_way_queue_producer_can_pop (UfoTwoWayQueue *queue)
+{
+    if (queue->producer_ring != NULL)
+        return !ring_is_empty (queue->producer_ring);
+
+    return g_async_queue_length (queue->producer_queue) > 0;
 }
 
 /**
@@ -119,10 +651,57 @@ ufo_two_way_queue_get_inserted (UfoTwoWayQueue *queue)
     return queue->inserted;
 }
 
+/**
+ * ufo_two_way_queue_reserve: (skip)
+ * @queue: A #UfoTwoWayQueue
+ * @capacity: Number of items that will be inserted
+ *
+ * Make sure that @queue can pass @capacity items without blocking on its own
+ * storage. Rings are grown to the next power of two and queues that would need
+ * more than 65536 slots switch to #GAsyncQueue. This must be called before
+ * other threads use @queue, i.e. while setting up the pipeline.
+ */
+void
+ufo_two_way_queue_reserve (UfoTwoWayQueue *queue, guint capacity)
+{
+    guint n_slots;
+
+    if (queue->producer_ring == NULL || capacity <= queue->producer_ring->mask + 1)
+        return;
+
+    if (capacity > RING_MAX_SIZE) {
+        queue->producer_queue = ring_to_async_queue (queue->producer_ring);
+        queue->consumer_queue = ring_to_async_queue (queue->consumer_ring);
+        queue->producer_ring = NULL;
+        queue->consumer_ring = NULL;
+        return;
+    }
+
+    n_slots = 1 << g_bit_storage (capacity - 1);
+    queue->producer_ring = ring_grow (queue->producer_ring, n_slots);
+    queue->consumer_ring = ring_grow (queue->consumer_ring, n_slots);
+}
+
+/**
+ * ufo_two_way_queue_insert: (skip)
+ * @queue: A #UfoTwoWayQueue
+ * @data: Item to add
+ *
+ * Add @data to the items circulating in @queue. The first
+ * ufo_two_way_queue_producer_pop() calls return inserted items. If the capacity
+ * was not reserved with ufo_two_way_queue_reserve() beforehand, no other
+ * thread may use @queue meanwhile.
+ */
 void
 ufo_two_way_queue_insert (UfoTwoWayQueue *queue, gpointer data)
 {
-    g_async_queue_push (queue->producer_queue, data);
+    ufo_two_way_queue_reserve (queue, queue->capacity + 1);
+
+    if (queue->producer_ring != NULL)
+        ring_push (queue->producer_ring, data);
+    else
+        g_async_queue_push (queue->producer_queue, data);
+
     queue->inserted = g_list_append (queue->inserted, data);
     queue->capacity++;
 }
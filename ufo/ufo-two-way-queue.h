@@ -30,18 +30,34 @@ G_BEGIN_DECLS
 
 typedef struct _UfoTwoWayQueue          UfoTwoWayQueue;
 
-UfoTwoWayQueue  * ufo_two_way_queue_new             (GList *init);
-void              ufo_two_way_queue_free            (UfoTwoWayQueue *queue);
-gpointer          ufo_two_way_queue_consumer_pop    (UfoTwoWayQueue *queue);
-void              ufo_two_way_queue_consumer_push   (UfoTwoWayQueue *queue,
-                                                     gpointer data);
-gpointer          ufo_two_way_queue_producer_pop    (UfoTwoWayQueue *queue);
-void              ufo_two_way_queue_producer_push   (UfoTwoWayQueue *queue,
-                                                     gpointer data);
-void              ufo_two_way_queue_insert          (UfoTwoWayQueue *queue,
-                                                     gpointer data);
-guint             ufo_two_way_queue_get_capacity    (UfoTwoWayQueue *queue);
-GList           * ufo_two_way_queue_get_inserted    (UfoTwoWayQueue *queue);
+UfoTwoWayQueue  * ufo_two_way_queue_new                   (GList *init);
+void              ufo_two_way_queue_free                  (UfoTwoWayQueue *queue);
+gpointer          ufo_two_way_queue_consumer_pop          (UfoTwoWayQueue *queue);
+void              ufo_two_way_queue_consumer_push         (UfoTwoWayQueue *queue,
+                                                           gpointer data);
+gpointer          ufo_two_way_queue_producer_pop          (UfoTwoWayQueue *queue);
+void              ufo_two_way_queue_producer_push         (UfoTwoWayQueue *queue,
+                                                           gpointer data);
+guint             ufo_two_way_queue_consumer_pop_many     (UfoTwoWayQueue *queue,
+                                                           gpointer *items,
+                                                           guint max);
+void              ufo_two_way_queue_consumer_push_many    (UfoTwoWayQueue *queue,
+                                                           gpointer *items,
+                                                           guint n);
+guint             ufo_two_way_queue_producer_pop_many     (UfoTwoWayQueue *queue,
+                                                           gpointer *items,
+                                                           guint max);
+void              ufo_two_way_queue_producer_push_many    (UfoTwoWayQueue *queue,
+                                                           gpointer *items,
+                                                           guint n);
+gboolean          ufo_two_way_queue_consumer_can_pop      (UfoTwoWayQueue *queue);
+gboolean          ufo_two_way_queue_producer_can_pop      (UfoTwoWayQueue *queue);
+void              ufo_two_way_queue_reserve               (UfoTwoWayQueue *queue,
+                                                           guint capacity);
+void              ufo_two_way_queue_insert                (UfoTwoWayQueue *queue,
+                                                           gpointer data);
+guint             ufo_two_way_queue_get_capacity          (UfoTwoWayQueue *queue);
+GList           * ufo_two_way_queue_get_inserted          (UfoTwoWayQueue *queue);
 
 G_END_DECLS
 
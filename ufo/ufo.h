@@ -24,6 +24,7 @@
 
 #include <ufo/ufo-basic-ops.h>
 #include <ufo/ufo-buffer.h>
+#include <ufo/ufo-buffer-pool.h>
 #include <ufo/ufo-copyable-iface.h>
 #include <ufo/ufo-copy-task.h>
 #include <ufo/ufo-cpu-node.h>
@@ -31,6 +32,7 @@
 #include <ufo/ufo-daemon.h>
 #include <ufo/ufo-enums.h>
 #include <ufo/ufo-fixed-scheduler.h>
+#include <ufo/ufo-fused-task.h>
 #include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-graph.h>
 #include <ufo/ufo-group.h>